@@ -0,0 +1,201 @@
+// Coroutine app benchmark
+//
+// coro_resume_yield times one resume of a bare coroutine that yields at
+// once: two stack switches per operation. coro_tick/N then starts N
+// coroutine apps with --stack-size stacks that do nothing but yield, so a
+// scheduler tick costs the pick, the requeue and a round trip onto the
+// app's stack; compare with sched_tick/N from sched_bench for the switch
+// overhead. The partition memory each app's arena took (header, coroutine
+// and stack) is printed on stderr.
+//
+// Usage: coro_bench [--apps 1000,100000] [--stack-size B]
+//                   [--runs N] [--min-time-ms T] [--cpu C]
+//                   [--format text|json|csv] [--output file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddr_memory.h"
+#include "userspace_app.h"
+#include "userspace_coro.h"
+#include "bench.h"
+#include "config.h"
+#include "log.h"
+
+#define MAX_SWEEP_VALUES 16
+
+typedef struct {
+    size_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+static int parse_sweep(const char* arg, sweep_t* sweep) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long long value = strtoll(tok, NULL, 10);
+        if (value <= 0) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (size_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+static void yield_forever(void* arg) {
+    (void)arg;
+    for (;;) {
+        userspace_coro_yield();
+    }
+}
+
+static void app_yield_forever(user_app_t* app, void* context) {
+    (void)app;
+    (void)context;
+    for (;;) {
+        userspace_yield();
+    }
+}
+
+static void bench_resume(void* context, uint64_t iterations) {
+    userspace_coro_t* coro = context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        userspace_coro_resume(coro);
+    }
+}
+
+static void bench_tick(void* context, uint64_t iterations) {
+    (void)context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        userspace_run_scheduler();
+    }
+}
+
+// A fresh set of `count` coroutine apps; returns the partition bytes used
+static size_t start_apps(memory_partition_t* partition, size_t count, size_t stack_size) {
+    partition_clear(partition);
+    userspace_init(partition);
+    size_t used = partition->used;
+    for (size_t i = 0; i < count; i++) {
+        user_app_t* app = userspace_start_app("coro", APP_TYPE_BACKGROUND, 0);
+        if (!app || userspace_set_app_coroutine(app, app_yield_forever, NULL,
+                                                stack_size) != MEM_SUCCESS) {
+            return 0;
+        }
+    }
+    return partition->used - used;
+}
+
+int main(int argc, char* argv[]) {
+    sweep_t counts = { {1000, 100000}, 2 };
+    size_t stack_size = 4096;
+    bench_config_t config;
+    bench_default_config(&config);
+    bench_format_t format = BENCH_FORMAT_TEXT;
+    int cpu = -1;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--apps") && value) {
+            rc = parse_sweep(value, &counts);
+        } else if (!strcmp(argv[i], "--stack-size") && value) {
+            stack_size = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--runs") && value) {
+            config.runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--min-time-ms") && value) {
+            config.min_run_ns = strtoull(value, NULL, 10) * 1000000ull;
+        } else if (!strcmp(argv[i], "--cpu") && value) {
+            cpu = (int)strtol(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--format") && value) {
+            rc = bench_parse_format(value, &format);
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        if (rc != MEM_SUCCESS || config.runs == 0 || stack_size < 1024) {
+            fprintf(stderr, "usage: %s [--apps N,...] [--stack-size B] [--runs N] "
+                            "[--min-time-ms T] [--cpu C] [--format text|json|csv] "
+                            "[--output file]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    int pinned = bench_pin_cpu(cpu);
+    if (pinned < 0) {
+        fprintf(stderr, "Could not pin to CPU %d, running unpinned\n", cpu);
+    }
+
+    size_t most = 0;
+    for (int c = 0; c < counts.count; c++) {
+        if (counts.values[c] > most) most = counts.values[c];
+    }
+
+    // Room for the default apps userspace_init() starts, then per app an
+    // arena chunk for its header and one for the coroutine and its stack,
+    // rounded up by at most a quarter
+    log_set_level(LOG_LEVEL_WARN);
+    size_t per_app = 1024 + (stack_size + 512) * 5 / 4;
+    size_t memory_size = 16 * 1024 * 1024 + most * per_app;
+    ddr_memory_t* memory = ddr_init(memory_size);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, memory_size, MEM_READ_WRITE, "User Space") : NULL;
+    char* stack = malloc(stack_size);
+    if (!partition || !stack) {
+        fprintf(stderr, "Failed to set up user space partition\n");
+        return 1;
+    }
+
+    bench_report_t report;
+    bench_report_begin(&report, out, format, "userspace_coro");
+
+    bench_result_t result;
+    userspace_coro_t* coro = userspace_coro_init(stack, stack_size, yield_forever, NULL);
+    if (bench_run(&config, "coro_resume_yield", 0, bench_resume, coro, &result) ==
+        MEM_SUCCESS) {
+        bench_report_add(&report, &result);
+    }
+
+    for (int c = 0; c < counts.count; c++) {
+        size_t count = counts.values[c];
+        char name[64];
+        snprintf(name, sizeof(name), "coro_tick/%zu", count);
+
+        size_t used = start_apps(partition, count, stack_size);
+        if (used == 0) {
+            fprintf(stderr, "No room for %zu apps\n", count);
+            continue;
+        }
+        if (bench_run(&config, name, 0, bench_tick, NULL, &result) == MEM_SUCCESS) {
+            bench_report_add(&report, &result);
+        }
+        fprintf(stderr, "%zu apps: %zu bytes of partition per app (%zu-byte stack)\n",
+                count, used / count, stack_size);
+    }
+
+    bench_report_end(&report);
+
+    if (out != stdout) fclose(out);
+    free(stack);
+    ddr_deinit(memory);
+
+    return 0;
+}
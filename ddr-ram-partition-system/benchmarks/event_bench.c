@@ -0,0 +1,302 @@
+// User space event bus benchmark
+//
+// P producer threads post E events each to one app mailbox while C
+// consumer threads drain it, B events per post and per receive, with a
+// payload of S bytes copied through the User Space partition (0 for
+// none). Producers retry when the mailbox is full. Emits one JSON
+// document with events/sec and end-to-end latency percentiles (post to
+// receive) for every combination.
+//
+// Usage: event_bench [--producers 1,2,4] [--consumers 1,2,4] [--batch 1,16]
+//                    [--payload 0,64] [--events N] [--output file.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ddr_memory.h"
+#include "userspace_app.h"
+#include "config.h"
+#include "log.h"
+
+#define BENCH_PARTITION_SIZE (32u * 1024 * 1024)
+#define MAX_SWEEP_VALUES     16
+#define MAX_BATCH            64
+
+typedef struct {
+    uint32_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+typedef struct {
+    userspace_mailbox_t mailbox;
+    uint32_t events;
+    uint32_t batch;
+    uint32_t payload_size;
+    uint64_t full;                  // Posts that found the mailbox full
+} producer_t;
+
+typedef struct {
+    userspace_mailbox_t mailbox;
+    uint32_t batch;
+    uint64_t* latencies_ns;         // Room for every event of the run
+    size_t received;
+} consumer_t;
+
+static pthread_barrier_t start_barrier;
+static atomic_size_t remaining;     // Events not yet received
+
+static int parse_sweep(const char* arg, sweep_t* sweep, uint32_t min) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long value = strtol(tok, NULL, 10);
+        if (value < (long)min) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (uint32_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, size_t n, double pct) {
+    if (n == 0) return 0.0;
+    size_t idx = (size_t)(pct / 100.0 * (n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+static void* producer_thread(void* arg) {
+    producer_t* producer = arg;
+    char payload[USERSPACE_EVENT_PAYLOAD_MAX];
+    memset(payload, 0xA5, sizeof(payload));
+    userspace_event_t events[MAX_BATCH];
+    for (uint32_t i = 0; i < producer->batch; i++) {
+        events[i] = (userspace_event_t){
+            .type = USERSPACE_EVENT_USER,
+            .size = producer->payload_size,
+            .payload = producer->payload_size ? payload : NULL,
+        };
+    }
+
+    pthread_barrier_wait(&start_barrier);
+
+    uint32_t sent = 0;
+    while (sent < producer->events) {
+        uint32_t n = producer->events - sent;
+        if (n > producer->batch) n = producer->batch;
+        for (uint32_t i = 0; i < n; i++) {
+            events[i].data = sent + i;
+        }
+
+        uint32_t posted = userspace_post_events(producer->mailbox, events, n);
+        sent += posted;
+        if (posted < n) {
+            producer->full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void* consumer_thread(void* arg) {
+    consumer_t* consumer = arg;
+    userspace_event_t events[MAX_BATCH];
+
+    pthread_barrier_wait(&start_barrier);
+
+    while (atomic_load_explicit(&remaining, memory_order_relaxed) > 0) {
+        uint32_t n = userspace_receive_events(consumer->mailbox, events, consumer->batch);
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+
+        uint64_t now = now_ns();
+        for (uint32_t i = 0; i < n; i++) {
+            consumer->latencies_ns[consumer->received++] = now - events[i].posted_ns;
+        }
+        userspace_release_events(events, n);
+        atomic_fetch_sub_explicit(&remaining, n, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    sweep_t producers = { {1, 2, 4}, 3 };
+    sweep_t consumers = { {1, 2, 4}, 3 };
+    sweep_t batches = { {1, 16}, 2 };
+    sweep_t payloads = { {0, 64}, 2 };
+    uint32_t events = 200000;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--producers") && value) {
+            rc = parse_sweep(value, &producers, 1);
+        } else if (!strcmp(argv[i], "--consumers") && value) {
+            rc = parse_sweep(value, &consumers, 1);
+        } else if (!strcmp(argv[i], "--batch") && value) {
+            rc = parse_sweep(value, &batches, 1);
+        } else if (!strcmp(argv[i], "--payload") && value) {
+            rc = parse_sweep(value, &payloads, 0);
+        } else if (!strcmp(argv[i], "--events") && value) {
+            events = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        for (int b = 0; rc == MEM_SUCCESS && b < batches.count; b++) {
+            if (batches.values[b] > MAX_BATCH) rc = MEM_INVALID;
+        }
+        for (int p = 0; rc == MEM_SUCCESS && p < payloads.count; p++) {
+            if (payloads.values[p] > USERSPACE_EVENT_PAYLOAD_MAX) rc = MEM_INVALID;
+        }
+        if (rc != MEM_SUCCESS || events == 0) {
+            fprintf(stderr, "usage: %s [--producers P,...] [--consumers C,...] "
+                            "[--batch B,...] (at most %d) [--payload S,...] (at most %d) "
+                            "[--events N] [--output file.json]\n",
+                    argv[0], MAX_BATCH, USERSPACE_EVENT_PAYLOAD_MAX);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    // Modules log their set-up at INFO; keep stdout for the results
+    log_set_level(LOG_LEVEL_WARN);
+    ddr_memory_t* memory = ddr_init(BENCH_PARTITION_SIZE);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, BENCH_PARTITION_SIZE, MEM_READ_WRITE, "User Space") : NULL;
+    if (!partition) {
+        fprintf(stderr, "Failed to set up user space partition\n");
+        return 1;
+    }
+
+    bool first = true;
+    fprintf(out, "{\n  \"benchmark\": \"userspace_events\",\n");
+    fprintf(out, "  \"events_per_producer\": %u,\n  \"mailbox_capacity\": %u,\n"
+                 "  \"results\": [\n", events, USERSPACE_MAILBOX_CAPACITY);
+
+    for (int s = 0; s < payloads.count; s++) {
+        for (int b = 0; b < batches.count; b++) {
+            for (int p = 0; p < producers.count; p++) {
+                for (int c = 0; c < consumers.count; c++) {
+                    uint32_t nproducers = producers.values[p];
+                    uint32_t nconsumers = consumers.values[c];
+                    size_t samples = (size_t)nproducers * events;
+
+                    // Fresh partition and mailbox for every run
+                    partition_clear(partition);
+                    userspace_init(partition);
+                    user_app_t* app = userspace_start_app("Receiver", APP_TYPE_SERVICE, 0);
+                    userspace_mailbox_t mailbox = userspace_open_mailbox(app);
+
+                    producer_t* producer_args = calloc(nproducers, sizeof(producer_t));
+                    consumer_t* consumer_args = calloc(nconsumers, sizeof(consumer_t));
+                    uint64_t* latencies = malloc(samples * nconsumers * sizeof(uint64_t));
+                    pthread_t* tids = calloc(nproducers + nconsumers, sizeof(pthread_t));
+                    if (!mailbox || !producer_args || !consumer_args || !latencies || !tids) {
+                        fprintf(stderr, "Failed to set up run\n");
+                        return 1;
+                    }
+
+                    for (uint32_t i = 0; i < nproducers; i++) {
+                        producer_args[i] = (producer_t){ mailbox, events, batches.values[b],
+                                                         payloads.values[s], 0 };
+                    }
+                    for (uint32_t i = 0; i < nconsumers; i++) {
+                        consumer_args[i] = (consumer_t){ mailbox, batches.values[b],
+                                                         latencies + i * samples, 0 };
+                    }
+
+                    atomic_store(&remaining, samples);
+                    pthread_barrier_init(&start_barrier, NULL, nproducers + nconsumers + 1);
+                    for (uint32_t i = 0; i < nconsumers; i++) {
+                        pthread_create(&tids[i], NULL, consumer_thread, &consumer_args[i]);
+                    }
+                    for (uint32_t i = 0; i < nproducers; i++) {
+                        pthread_create(&tids[nconsumers + i], NULL, producer_thread,
+                                       &producer_args[i]);
+                    }
+
+                    pthread_barrier_wait(&start_barrier);
+                    uint64_t start = now_ns();
+                    for (uint32_t i = 0; i < nproducers + nconsumers; i++) {
+                        pthread_join(tids[i], NULL);
+                    }
+                    double elapsed = (now_ns() - start) / 1e9;
+                    pthread_barrier_destroy(&start_barrier);
+
+                    // Gather the consumers' samples at the front
+                    size_t gathered = 0;
+                    uint64_t full = 0;
+                    for (uint32_t i = 0; i < nconsumers; i++) {
+                        memmove(latencies + gathered, consumer_args[i].latencies_ns,
+                                consumer_args[i].received * sizeof(uint64_t));
+                        gathered += consumer_args[i].received;
+                    }
+                    for (uint32_t i = 0; i < nproducers; i++) {
+                        full += producer_args[i].full;
+                    }
+                    qsort(latencies, gathered, sizeof(uint64_t), compare_u64);
+
+                    fprintf(out, "%s    {\"producers\": %u, \"consumers\": %u, \"batch\": %u, "
+                                 "\"payload_bytes\": %u, \"events_per_sec\": %.0f, "
+                                 "\"latency_us\": {\"p50\": %.2f, \"p99\": %.2f, "
+                                 "\"p999\": %.2f, \"max\": %.2f}, \"full_retries\": %llu}",
+                            first ? "" : ",\n", nproducers, nconsumers, batches.values[b],
+                            payloads.values[s], gathered / elapsed,
+                            percentile_us(latencies, gathered, 50.0),
+                            percentile_us(latencies, gathered, 99.0),
+                            percentile_us(latencies, gathered, 99.9),
+                            gathered ? latencies[gathered - 1] / 1000.0 : 0.0,
+                            (unsigned long long)full);
+                    first = false;
+
+                    free(producer_args);
+                    free(consumer_args);
+                    free(latencies);
+                    free(tids);
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) fclose(out);
+    ddr_deinit(memory);
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Headless gaming partition scaling benchmark
+//
+// Runs the gaming frame loop with N objects for M frames, sweeping object
+// counts, simulation thread counts and sequential/pipelined execution, and
+// emits one JSON document with frame time percentiles, objects/sec and
+// bytes allocated per frame (partition and heap, as counted by the run).
+// Exits non-zero if any configuration could not be run.
+//
+// Usage: gaming_bench [--objects 1000,10000,...] [--threads 1,2,4,...]
+//                     [--frames M] [--output file.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddr_memory.h"
+#include "gaming_partition.h"
+#include "config.h"
+#include "log.h"
+
+#define BENCH_DDR_SIZE   (512u * 1024 * 1024)
+#define MAX_SWEEP_VALUES 16
+
+typedef struct {
+    uint32_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+static int parse_sweep(const char* arg, sweep_t* sweep) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long value = strtol(tok, NULL, 10);
+        if (value <= 0) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (uint32_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, uint32_t n, double pct) {
+    if (n == 0) return 0.0;
+    uint32_t idx = (uint32_t)(pct / 100.0 * (n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    sweep_t objects = { {1000, 10000, 100000}, 3 };
+    sweep_t threads = { {1, 2, 4}, 3 };
+    uint32_t frames = 300;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--objects") && value) {
+            rc = parse_sweep(value, &objects);
+        } else if (!strcmp(argv[i], "--threads") && value) {
+            rc = parse_sweep(value, &threads);
+        } else if (!strcmp(argv[i], "--frames") && value) {
+            frames = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        if (rc != MEM_SUCCESS || frames == 0) {
+            fprintf(stderr, "usage: %s [--objects N,...] [--threads T,...] "
+                            "[--frames M] [--output file.json]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    // Object counts are reached incrementally, so sweep them in order
+    qsort(objects.values, objects.count, sizeof(uint32_t), compare_u32);
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    // Modules log their set-up at INFO; keep stdout for the results
+    log_set_level(LOG_LEVEL_WARN);
+    ddr_memory_t* memory = ddr_init(BENCH_DDR_SIZE);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, BENCH_DDR_SIZE, MEM_READ_WRITE, "Gaming") : NULL;
+    if (partition) gaming_init(partition);
+
+    if (!partition || !get_game_state()) {
+        fprintf(stderr, "Failed to set up gaming partition\n");
+        return 1;
+    }
+
+    uint64_t* frame_times = malloc(frames * sizeof(uint64_t));
+    if (!frame_times) return 1;
+
+    srand(42);
+    uint32_t live_objects = 0;
+    bool first = true;
+    int failures = 0;
+
+    fprintf(out, "{\n  \"benchmark\": \"gaming_partition\",\n");
+    fprintf(out, "  \"frames\": %u,\n  \"results\": [\n", frames);
+
+    for (int o = 0; o < objects.count && failures == 0; o++) {
+        while (live_objects < objects.values[o]) {
+            if (!create_game_object(partition)) break;
+            live_objects++;
+        }
+        if (live_objects < objects.values[o]) {
+            fprintf(stderr, "Out of gaming partition memory at %u of %u objects\n",
+                    live_objects, objects.values[o]);
+            failures++;
+            break;
+        }
+
+        for (int mode = 0; mode < 2; mode++) {
+            for (int t = 0; t < threads.count; t++) {
+                gaming_pipeline_config_t config = {
+                    .frames = frames,
+                    .pipelined = mode == 1,
+                    .sim_workers = threads.values[t],
+                    .frame_times_ns = frame_times,
+                };
+                gaming_pipeline_stats_t stats;
+
+                // Warm-up run sizes the snapshot buffers for this object count
+                config.frames = frames < 10 ? frames : 10;
+                int rc = gaming_run_pipeline(&config, &stats);
+                config.frames = frames;
+                if (rc == MEM_SUCCESS) rc = gaming_run_pipeline(&config, &stats);
+                if (rc != MEM_SUCCESS) {
+                    fprintf(stderr, "Run failed (%d): %u objects, %s, %u sim threads\n",
+                            rc, live_objects, config.pipelined ? "pipelined" : "sequential",
+                            config.sim_workers);
+                    failures++;
+                    continue;
+                }
+
+                qsort(frame_times, frames, sizeof(uint64_t), compare_u64);
+
+                fprintf(out, "%s    {\"objects\": %u, \"mode\": \"%s\", \"sim_threads\": %u, "
+                             "\"wall_ms\": %.3f, \"fps\": %.1f, "
+                             "\"frame_us\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+                             "\"stage_avg_us\": {\"input\": %.2f, \"simulate\": %.2f, \"render\": %.2f}, "
+                             "\"objects_per_sec\": %.0f, \"bytes_allocated_per_frame\": %.1f}",
+                        first ? "" : ",\n",
+                        live_objects, config.pipelined ? "pipelined" : "sequential",
+                        config.sim_workers, stats.wall_time_ms, stats.frames_per_second,
+                        percentile_us(frame_times, frames, 50.0),
+                        percentile_us(frame_times, frames, 90.0),
+                        percentile_us(frame_times, frames, 99.0),
+                        frame_times[frames - 1] / 1000.0,
+                        stats.input.avg_us, stats.simulate.avg_us, stats.render.avg_us,
+                        stats.wall_time_ms > 0.0 ?
+                            (double)live_objects * frames / (stats.wall_time_ms / 1000.0) : 0.0,
+                        (double)stats.bytes_allocated / frames);
+                first = false;
+            }
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    free(frame_times);
+    if (out != stdout) fclose(out);
+    gaming_shutdown();
+    ddr_deinit(memory);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+// RW partition journal throughput benchmark
+//
+// T writer threads each overwrite their own block with W-byte writes while
+// the journal runs in sync, group commit or async mode, on files in the
+// given directory. Emits one JSON document with operations/sec, commit
+// latency percentiles and records per log sync for every combination.
+//
+// Usage: journal_bench [--dir /path] [--threads 1,4,16] [--size 64,4096]
+//                      [--ops N] [--output file.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ddr_memory.h"
+#include "rw_partition.h"
+#include "rw_journal.h"
+#include "config.h"
+#include "log.h"
+
+#define BENCH_DDR_SIZE   (256u * 1024 * 1024)
+#define MAX_SWEEP_VALUES 16
+
+typedef struct {
+    uint32_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+typedef struct {
+    data_block_t* block;
+    uint32_t write_size;
+    uint32_t ops;
+    uint64_t* latencies_ns;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} writer_t;
+
+static pthread_barrier_t start_barrier;
+
+static int parse_sweep(const char* arg, sweep_t* sweep) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long value = strtol(tok, NULL, 10);
+        if (value <= 0) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (uint32_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, size_t n, double pct) {
+    if (n == 0) return 0.0;
+    size_t idx = (size_t)(pct / 100.0 * (n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+static void* writer_thread(void* arg) {
+    writer_t* writer = arg;
+    uint8_t* payload = malloc(writer->write_size);
+    if (payload) memset(payload, 0xA5, writer->write_size);
+
+    pthread_barrier_wait(&start_barrier);
+    writer->start_ns = now_ns();
+
+    for (uint32_t i = 0; payload && i < writer->ops; i++) {
+        payload[0] = (uint8_t)i;
+        rw_op_t op = { RW_OP_WRITE, writer->block, 0, payload, writer->write_size, 0 };
+
+        // rw_submit_batch() returns once the write is committed
+        uint64_t start = now_ns();
+        rw_submit_batch(&op, 1);
+        writer->latencies_ns[i] = now_ns() - start;
+    }
+    writer->end_ns = now_ns();
+
+    free(payload);
+    return NULL;
+}
+
+static void remove_files(const char* log, const char* data) {
+    char path[512];
+    unlink(log);
+    unlink(data);
+    snprintf(path, sizeof(path), "%s.old", log);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.manifest", data);
+    unlink(path);
+}
+
+int main(int argc, char* argv[]) {
+    static const char* mode_names[] = { "sync", "group", "async" };
+    sweep_t threads = { {1, 4, 16}, 3 };
+    sweep_t sizes = { {64, 4096}, 2 };
+    uint32_t ops = 2000;
+    const char* dir = "/tmp";
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--threads") && value) {
+            rc = parse_sweep(value, &threads);
+        } else if (!strcmp(argv[i], "--size") && value) {
+            rc = parse_sweep(value, &sizes);
+        } else if (!strcmp(argv[i], "--ops") && value) {
+            ops = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--dir") && value) {
+            dir = value;
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        if (rc != MEM_SUCCESS || ops == 0) {
+            fprintf(stderr, "usage: %s [--dir path] [--threads T,...] [--size B,...] "
+                            "[--ops N] [--output file.json]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    char log_path[512], data_path[512];
+    snprintf(log_path, sizeof(log_path), "%s/journal_bench.log", dir);
+    snprintf(data_path, sizeof(data_path), "%s/journal_bench.data", dir);
+
+    // Modules log their set-up at INFO; keep stdout for the results
+    log_set_level(LOG_LEVEL_WARN);
+    ddr_memory_t* memory = ddr_init(BENCH_DDR_SIZE);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, BENCH_DDR_SIZE, MEM_READ_WRITE, "RW") : NULL;
+    if (!partition) {
+        fprintf(stderr, "Failed to set up RW partition\n");
+        return 1;
+    }
+
+    bool first = true;
+    fprintf(out, "{\n  \"benchmark\": \"rw_journal\",\n");
+    fprintf(out, "  \"ops_per_thread\": %u,\n  \"results\": [\n", ops);
+
+    for (int s = 0; s < sizes.count; s++) {
+        for (int t = 0; t < threads.count; t++) {
+            for (int mode = RW_JOURNAL_SYNC; mode <= RW_JOURNAL_ASYNC; mode++) {
+                uint32_t nthreads = threads.values[t];
+                size_t samples = (size_t)nthreads * ops;
+
+                // Fresh partition and journal files for every run
+                remove_files(log_path, data_path);
+                partition_clear(partition);
+                rw_init(partition);
+
+                rw_journal_config_t config = { log_path, data_path, (rw_journal_mode_t)mode, 5, 0 };
+                bool opened = rw_journal_open(&config) == MEM_SUCCESS;
+
+                writer_t* writers = calloc(nthreads, sizeof(writer_t));
+                uint64_t* latencies = malloc(samples * sizeof(uint64_t));
+                pthread_t* tids = calloc(nthreads, sizeof(pthread_t));
+                for (uint32_t i = 0; opened && writers && latencies && i < nthreads; i++) {
+                    writers[i].block = rw_create_data_block(sizes.values[s]);
+                    writers[i].write_size = sizes.values[s];
+                    writers[i].ops = ops;
+                    writers[i].latencies_ns = latencies + (size_t)i * ops;
+                }
+
+                if (!opened || !writers || !latencies || !tids) {
+                    fprintf(stderr, "Failed to set up %s run\n", mode_names[mode]);
+                    return 1;
+                }
+
+                rw_journal_stats_t before = *get_rw_journal_stats();
+                pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+                for (uint32_t i = 0; i < nthreads; i++) {
+                    pthread_create(&tids[i], NULL, writer_thread, &writers[i]);
+                }
+
+                pthread_barrier_wait(&start_barrier);
+                uint64_t first_start = UINT64_MAX, last_end = 0;
+                for (uint32_t i = 0; i < nthreads; i++) {
+                    pthread_join(tids[i], NULL);
+                    if (writers[i].start_ns < first_start) first_start = writers[i].start_ns;
+                    if (writers[i].end_ns > last_end) last_end = writers[i].end_ns;
+                }
+                double elapsed = (last_end - first_start) / 1e9;
+                pthread_barrier_destroy(&start_barrier);
+
+                rw_journal_stats_t after = *get_rw_journal_stats();
+                uint64_t syncs = after.syncs - before.syncs;
+                uint64_t records = after.records - before.records;
+
+                qsort(latencies, samples, sizeof(uint64_t), compare_u64);
+
+                fprintf(out, "%s    {\"mode\": \"%s\", \"threads\": %u, \"write_bytes\": %u, "
+                             "\"ops_per_sec\": %.0f, \"mb_per_sec\": %.2f, "
+                             "\"commit_us\": {\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+                             "\"log_syncs\": %llu, \"records_per_sync\": %.2f}",
+                        first ? "" : ",\n", mode_names[mode], nthreads, sizes.values[s],
+                        samples / elapsed, samples * (double)sizes.values[s] / elapsed / 1e6,
+                        percentile_us(latencies, samples, 50.0),
+                        percentile_us(latencies, samples, 99.0),
+                        latencies[samples - 1] / 1000.0,
+                        (unsigned long long)syncs,
+                        syncs ? (double)records / syncs : 0.0);
+                first = false;
+
+                rw_journal_close();
+
+                free(writers);
+                free(latencies);
+                free(tids);
+            }
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    remove_files(log_path, data_path);
+    if (out != stdout) fclose(out);
+    ddr_deinit(memory);
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+// RW key-value store benchmark
+//
+// For each key count: loads that many keys into a fresh store (one timed
+// pass, reported as kv_load), then times lookups of present keys, lookups
+// of absent keys and overwrites on the benchmark harness. Keys are visited
+// in a scattered order so the index is not walked sequentially.
+//
+// Usage: kv_bench [--keys 1000000,4000000] [--key-size B] [--value-size B]
+//                 [--memory-mb M] [--runs N] [--min-time-ms T] [--cpu C]
+//                 [--format text|json|csv] [--output file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddr_memory.h"
+#include "rw_partition.h"
+#include "rw_kv.h"
+#include "bench.h"
+#include "config.h"
+#include "log.h"
+
+#define MAX_SWEEP_VALUES 16
+
+typedef struct {
+    size_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+typedef struct {
+    rw_kv_t* kv;
+    size_t count;
+    size_t key_size;
+    size_t value_size;
+    uint8_t* value;
+    uint64_t cursor;
+} kv_bench_case_t;
+
+static int parse_sweep(const char* arg, sweep_t* sweep) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long long value = strtoll(tok, NULL, 10);
+        if (value <= 0) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (size_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+// Key `index` of the set; another first byte gives keys never stored
+static inline void make_key(uint8_t* key, size_t size, uint64_t index, uint8_t prefix) {
+    memset(key, 0, size);
+    key[0] = prefix;
+    memcpy(key + 1, &index, size - 1 < 8 ? size - 1 : 8);
+}
+
+// Next key in a scattered order covering the whole set
+static inline uint64_t next_index(kv_bench_case_t* c) {
+    return (c->cursor++ * 0x9E3779B97F4A7C15ull >> 16) % c->count;
+}
+
+static void bench_get_hit(void* context, uint64_t iterations) {
+    kv_bench_case_t* c = context;
+    uint8_t key[256];
+    size_t length = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        make_key(key, c->key_size, next_index(c), 'k');
+        rw_kv_get(c->kv, key, c->key_size, c->value, c->value_size, &length);
+        bench_do_not_optimize(c->value);
+    }
+}
+
+static void bench_get_miss(void* context, uint64_t iterations) {
+    kv_bench_case_t* c = context;
+    uint8_t key[256];
+    size_t length = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        make_key(key, c->key_size, next_index(c), 'm');
+        int rc = rw_kv_get(c->kv, key, c->key_size, c->value, c->value_size, &length);
+        bench_do_not_optimize(&rc);
+    }
+}
+
+static void bench_put_update(void* context, uint64_t iterations) {
+    kv_bench_case_t* c = context;
+    uint8_t key[256];
+    for (uint64_t i = 0; i < iterations; i++) {
+        make_key(key, c->key_size, next_index(c), 'k');
+        c->value[0] = (uint8_t)i;
+        rw_kv_put(c->kv, key, c->key_size, c->value, c->value_size);
+    }
+}
+
+// One timed pass over all keys; too slow to repeat at millions of keys
+static int load_keys(kv_bench_case_t* c, bench_result_t* result) {
+    uint8_t key[256];
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < c->count; i++) {
+        make_key(key, c->key_size, i, 'k');
+        if (rw_kv_put(c->kv, key, c->key_size, c->value, c->value_size) != MEM_SUCCESS) {
+            return MEM_FULL;
+        }
+    }
+    double per_op = (double)(bench_now_ns() - start) / (double)c->count;
+
+    memset(result, 0, sizeof(*result));
+    result->name = "kv_load";
+    result->bytes = c->key_size + c->value_size;
+    result->iterations = c->count;
+    result->runs = 1;
+    result->median_ns = result->mean_ns = result->run_p90_ns = per_op;
+    result->min_ns = result->max_ns = per_op;
+    result->mb_per_sec = (double)result->bytes / per_op * 1e9 / (1024.0 * 1024.0);
+    return MEM_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    sweep_t keys = { {1000000, 4000000}, 2 };
+    size_t key_size = 16, value_size = 16, memory_mb = 1024;
+    bench_config_t config;
+    bench_default_config(&config);
+    bench_format_t format = BENCH_FORMAT_TEXT;
+    int cpu = -1;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--keys") && value) {
+            rc = parse_sweep(value, &keys);
+        } else if (!strcmp(argv[i], "--key-size") && value) {
+            key_size = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--value-size") && value) {
+            value_size = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--memory-mb") && value) {
+            memory_mb = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--runs") && value) {
+            config.runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--min-time-ms") && value) {
+            config.min_run_ns = strtoull(value, NULL, 10) * 1000000ull;
+        } else if (!strcmp(argv[i], "--cpu") && value) {
+            cpu = (int)strtol(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--format") && value) {
+            rc = bench_parse_format(value, &format);
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        // Keys carry an 8-byte index after a prefix byte
+        if (rc != MEM_SUCCESS || config.runs == 0 || key_size < 9 || key_size > 256 ||
+            memory_mb == 0) {
+            fprintf(stderr, "usage: %s [--keys N,...] [--key-size 9-256] [--value-size B] "
+                            "[--memory-mb M] [--runs N] [--min-time-ms T] [--cpu C] "
+                            "[--format text|json|csv] [--output file]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    int pinned = bench_pin_cpu(cpu);
+    if (pinned < 0) {
+        fprintf(stderr, "Could not pin to CPU %d, running unpinned\n", cpu);
+    }
+
+    log_set_level(LOG_LEVEL_WARN);
+    size_t memory_size = memory_mb * 1024 * 1024;
+    ddr_memory_t* memory = ddr_init(memory_size);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, memory_size, MEM_READ_WRITE, "RW") : NULL;
+    uint8_t* value = malloc(value_size ? value_size : 1);
+    if (!partition || !value) {
+        fprintf(stderr, "Failed to set up RW partition\n");
+        return 1;
+    }
+    memset(value, 0xA5, value_size);
+
+    bench_report_t report;
+    bench_report_begin(&report, out, format, "rw_kv");
+
+    for (int k = 0; k < keys.count; k++) {
+        // A fresh partition for every key count
+        rw_init(partition);
+        rw_kv_config_t kv_config = { .store_id = 1, .expected_keys = 0 };
+        kv_bench_case_t c = { rw_kv_open(&kv_config), keys.values[k], key_size,
+                              value_size, value, 0 };
+        bench_result_t result;
+        if (!c.kv || load_keys(&c, &result) != MEM_SUCCESS) {
+            fprintf(stderr, "No room for %zu keys in %zu MB\n", c.count, memory_mb);
+            rw_kv_close(c.kv);
+            continue;
+        }
+        bench_report_add(&report, &result);
+
+        static const struct {
+            const char* name;
+            bench_fn_t fn;
+        } cases[] = {
+            { "kv_get_hit", bench_get_hit },
+            { "kv_get_miss", bench_get_miss },
+            { "kv_put_update", bench_put_update },
+        };
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            if (bench_run(&config, cases[i].name, key_size + value_size, cases[i].fn,
+                          &c, &result) == MEM_SUCCESS) {
+                bench_report_add(&report, &result);
+            }
+        }
+
+        rw_kv_stats_t stats;
+        rw_kv_get_stats(c.kv, &stats);
+        fprintf(stderr, "%zu keys: %llu segments, %llu index slots (%llu MB), "
+                        "%llu resizes, %llu compactions\n",
+                c.count, (unsigned long long)stats.segments,
+                (unsigned long long)stats.index_slots,
+                (unsigned long long)(stats.index_bytes >> 20),
+                (unsigned long long)stats.index_resizes,
+                (unsigned long long)stats.compactions);
+        rw_kv_close(c.kv);
+    }
+
+    bench_report_end(&report);
+
+    if (out != stdout) fclose(out);
+    free(value);
+    ddr_deinit(memory);
+
+    return 0;
+}
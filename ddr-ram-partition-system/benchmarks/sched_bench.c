@@ -0,0 +1,287 @@
+// User app scheduler benchmark
+//
+// For each app count, starts that many runnable apps whose run function
+// returns at once, so a scheduler tick costs the pick, the time slice
+// bookkeeping and the requeue and little else. sched_tick runs apps of
+// equal priority, sched_tick_mixed spreads them over every priority; the
+// share of turns each priority got in the mixed case is printed after it
+// against the share its weight entitles it to.
+//
+// Then, for each worker count, runs --smp-apps apps doing --work-iters
+// rounds of arithmetic per turn on SMP workers for --smp-ms and reports
+// the wall time per app turn across all workers (smp_turns/W), followed by
+// each worker's utilization and migrations on stderr.
+//
+// Usage: sched_bench [--apps 1000,10000,100000] [--workers 1,2,4] [--pin]
+//                    [--smp-apps N] [--smp-ms T] [--work-iters N]
+//                    [--runs N] [--min-time-ms T] [--cpu C]
+//                    [--format text|json|csv] [--output file]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "ddr_memory.h"
+#include "userspace_app.h"
+#include "bench.h"
+#include "config.h"
+#include "log.h"
+
+#define MAX_SWEEP_VALUES 16
+#define PRIORITIES       (USERSPACE_PRIORITY_MAX + 1)
+
+typedef struct {
+    size_t values[MAX_SWEEP_VALUES];
+    int count;
+} sweep_t;
+
+static int parse_sweep(const char* arg, sweep_t* sweep) {
+    sweep->count = 0;
+    char* copy = strdup(arg);
+    if (!copy) return MEM_ERROR;
+
+    for (char* tok = strtok(copy, ","); tok && sweep->count < MAX_SWEEP_VALUES;
+         tok = strtok(NULL, ",")) {
+        long long value = strtoll(tok, NULL, 10);
+        if (value <= 0) {
+            free(copy);
+            return MEM_INVALID;
+        }
+        sweep->values[sweep->count++] = (size_t)value;
+    }
+
+    free(copy);
+    return sweep->count > 0 ? MEM_SUCCESS : MEM_INVALID;
+}
+
+static app_run_result_t run_yield(user_app_t* app, void* context) {
+    (void)app;
+    (void)context;
+    return APP_RUN_YIELD;
+}
+
+static uint32_t work_iters = 2000;
+
+static app_run_result_t run_work(user_app_t* app, void* context) {
+    (void)context;
+    uint64_t x = app->app_id | 1;
+    for (uint32_t i = 0; i < work_iters; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    bench_do_not_optimize(&x);
+    return APP_RUN_YIELD;
+}
+
+static void bench_tick(void* context, uint64_t iterations) {
+    (void)context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        userspace_run_scheduler();
+    }
+}
+
+// A fresh set of `count` apps; with `mixed`, app i gets priority i % 10
+static int start_apps(memory_partition_t* partition, size_t count, bool mixed,
+                      user_app_run_fn run, user_app_t** apps) {
+    partition_clear(partition);
+    userspace_init(partition);
+    for (size_t i = 0; i < count; i++) {
+        apps[i] = userspace_start_app("bench", APP_TYPE_BACKGROUND, 0);
+        if (!apps[i]) return MEM_FULL;
+        userspace_set_app_entry(apps[i], run, NULL);
+        if (mixed) userspace_set_app_priority(apps[i], (uint32_t)(i % PRIORITIES));
+    }
+    return MEM_SUCCESS;
+}
+
+static void print_shares(user_app_t** apps, size_t count) {
+    uint64_t slices[PRIORITIES] = {0}, total = 0;
+    uint64_t weights[PRIORITIES] = {0}, total_weight = 0;
+    for (size_t i = 0; i < count; i++) {
+        slices[apps[i]->priority] += apps[i]->slices;
+        weights[apps[i]->priority] += apps[i]->weight;
+        total += apps[i]->slices;
+        total_weight += apps[i]->weight;
+    }
+
+    fprintf(stderr, "%zu apps, share of turns by priority (turns / weight):", count);
+    for (int p = 0; p < PRIORITIES; p++) {
+        fprintf(stderr, " %d: %.1f%%/%.1f%%", p, 100.0 * slices[p] / (total ? total : 1),
+                100.0 * weights[p] / total_weight);
+    }
+    fprintf(stderr, "\n");
+}
+
+static uint64_t total_slices(void) {
+    userspace_stats_t* stats = get_userspace_stats();
+    uint64_t slices = 0;
+    for (uint32_t i = 0; i < USERSPACE_MAX_CPUS; i++) {
+        slices += stats->cpu[i].slices;
+    }
+    return slices;
+}
+
+// Apps run for `ms` on `workers` workers; one result for all of them
+static int run_smp(uint32_t workers, bool pin, uint64_t ms, bench_result_t* result) {
+    userspace_smp_config_t config = { .workers = workers, .pin = pin };
+    if (userspace_smp_start(&config) != MEM_SUCCESS) return MEM_ERROR;
+
+    // Let the balancer spread the apps first
+    usleep(50 * 1000);
+    uint64_t slices = total_slices();
+    uint64_t start = bench_now_ns();
+    usleep(ms * 1000);
+    uint64_t elapsed = bench_now_ns() - start;
+    slices = total_slices() - slices;
+    userspace_smp_stop();
+
+    userspace_stats_t* stats = get_userspace_stats();
+    fprintf(stderr, "%u workers:", workers);
+    for (uint32_t i = 0; i < workers; i++) {
+        fprintf(stderr, " [%u] %.0f%% busy, %llu migrations", i,
+                stats->cpu[i].utilization * 100.0,
+                (unsigned long long)stats->cpu[i].migrations);
+    }
+    fprintf(stderr, "\n");
+    if (slices == 0) return MEM_ERROR;
+
+    double per_op = (double)elapsed / (double)slices;
+    memset(result, 0, sizeof(*result));
+    result->iterations = slices;
+    result->runs = 1;
+    result->median_ns = result->mean_ns = result->run_p90_ns = per_op;
+    result->min_ns = result->max_ns = per_op;
+    return MEM_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    sweep_t counts = { {1000, 10000, 100000}, 3 };
+    sweep_t workers = { {1, 2, 4}, 3 };
+    size_t smp_apps = 1000;
+    uint64_t smp_ms = 500;
+    bool pin = false;
+    bench_config_t config;
+    bench_default_config(&config);
+    bench_format_t format = BENCH_FORMAT_TEXT;
+    int cpu = -1;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int rc = MEM_SUCCESS;
+
+        if (!strcmp(argv[i], "--apps") && value) {
+            rc = parse_sweep(value, &counts);
+        } else if (!strcmp(argv[i], "--workers") && value) {
+            rc = parse_sweep(value, &workers);
+        } else if (!strcmp(argv[i], "--pin")) {
+            pin = true;
+            i--;
+        } else if (!strcmp(argv[i], "--smp-apps") && value) {
+            smp_apps = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--smp-ms") && value) {
+            smp_ms = strtoull(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--work-iters") && value) {
+            work_iters = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--runs") && value) {
+            config.runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--min-time-ms") && value) {
+            config.min_run_ns = strtoull(value, NULL, 10) * 1000000ull;
+        } else if (!strcmp(argv[i], "--cpu") && value) {
+            cpu = (int)strtol(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--format") && value) {
+            rc = bench_parse_format(value, &format);
+        } else if (!strcmp(argv[i], "--output") && value) {
+            output = value;
+        } else {
+            rc = MEM_INVALID;
+        }
+
+        if (rc != MEM_SUCCESS || config.runs == 0 || smp_apps == 0 || smp_ms == 0) {
+            fprintf(stderr, "usage: %s [--apps N,...] [--workers W,...] [--pin] [--smp-apps N] "
+                            "[--smp-ms T] [--work-iters N] [--runs N] [--min-time-ms T] "
+                            "[--cpu C] [--format text|json|csv] [--output file]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    // Workers inherit the affinity of the thread starting them
+    cpu_set_t all_cpus;
+    sched_getaffinity(0, sizeof(all_cpus), &all_cpus);
+    int pinned = bench_pin_cpu(cpu);
+    if (pinned < 0) {
+        fprintf(stderr, "Could not pin to CPU %d, running unpinned\n", cpu);
+    }
+
+    size_t most = smp_apps;
+    for (int c = 0; c < counts.count; c++) {
+        if (counts.values[c] > most) most = counts.values[c];
+    }
+
+    // Room for the default apps userspace_init() starts and an arena per
+    // app, whose first chunk holds the app header
+    log_set_level(LOG_LEVEL_WARN);
+    size_t memory_size = 16 * 1024 * 1024 + most * 1024;
+    ddr_memory_t* memory = ddr_init(memory_size);
+    memory_partition_t* partition = memory ?
+        create_partition(memory, memory_size, MEM_READ_WRITE, "User Space") : NULL;
+    user_app_t** apps = malloc(most * sizeof(user_app_t*));
+    if (!partition || !apps) {
+        fprintf(stderr, "Failed to set up user space partition\n");
+        return 1;
+    }
+
+    bench_report_t report;
+    bench_report_begin(&report, out, format, "userspace_sched");
+
+    for (int c = 0; c < counts.count; c++) {
+        size_t count = counts.values[c];
+        bench_result_t result;
+        char name[2][64];
+        snprintf(name[0], sizeof(name[0]), "sched_tick/%zu", count);
+        snprintf(name[1], sizeof(name[1]), "sched_tick_mixed/%zu", count);
+
+        for (int mixed = 0; mixed < 2; mixed++) {
+            if (start_apps(partition, count, mixed, run_yield, apps) != MEM_SUCCESS) {
+                fprintf(stderr, "No room for %zu apps\n", count);
+                break;
+            }
+            if (bench_run(&config, name[mixed], 0, bench_tick, NULL, &result) == MEM_SUCCESS) {
+                bench_report_add(&report, &result);
+            }
+            if (mixed) print_shares(apps, count);
+        }
+    }
+
+    sched_setaffinity(0, sizeof(all_cpus), &all_cpus);
+    if (start_apps(partition, smp_apps, false, run_work, apps) == MEM_SUCCESS) {
+        for (int w = 0; w < workers.count; w++) {
+            bench_result_t result;
+            char name[64];
+            snprintf(name, sizeof(name), "smp_turns/%zu", workers.values[w]);
+            if (run_smp((uint32_t)workers.values[w], pin, smp_ms, &result) == MEM_SUCCESS) {
+                result.name = name;
+                bench_report_add(&report, &result);
+            }
+        }
+    }
+
+    bench_report_end(&report);
+
+    if (out != stdout) fclose(out);
+    free(apps);
+    ddr_deinit(memory);
+
+    return 0;
+}
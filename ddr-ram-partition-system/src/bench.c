@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include "bench.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+void bench_default_config(bench_config_t* config) {
+    if (!config) return;
+
+    config->warmup_ns = 100000000ull;
+    config->min_run_ns = 20000000ull;
+    config->runs = 20;
+    config->max_iterations = 1ull << 32;
+}
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void bench_do_not_optimize(const void* value) {
+    __asm__ volatile("" : : "r"(value) : "memory");
+}
+
+int bench_pin_cpu(int cpu) {
+    if (cpu < 0) cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return MEM_ERROR;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return MEM_ERROR;
+    return cpu;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, uint32_t n, double pct) {
+    uint32_t idx = (uint32_t)(pct / 100.0 * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static uint64_t timed(bench_fn_t fn, void* context, uint64_t iterations) {
+    uint64_t start = bench_now_ns();
+    fn(context, iterations);
+    return bench_now_ns() - start;
+}
+
+int bench_run(const bench_config_t* config, const char* name, size_t bytes,
+              bench_fn_t fn, void* context, bench_result_t* result) {
+    if (!config || !fn || !result || config->runs == 0) return MEM_INVALID;
+
+    double* samples = malloc(config->runs * sizeof(double));
+    if (!samples) return MEM_ERROR;
+
+    // Warm caches, page tables and branch predictors; the last pass also
+    // gives a first estimate of the cost of one operation
+    uint64_t iterations = 1, elapsed = 0;
+    uint64_t warmup_end = bench_now_ns() + config->warmup_ns;
+    do {
+        elapsed = timed(fn, context, iterations);
+    } while (bench_now_ns() < warmup_end);
+
+    while (elapsed < config->min_run_ns && iterations < config->max_iterations) {
+        iterations *= 2;
+        elapsed = timed(fn, context, iterations);
+    }
+
+    double sum = 0.0;
+    for (uint32_t r = 0; r < config->runs; r++) {
+        samples[r] = (double)timed(fn, context, iterations) / (double)iterations;
+        sum += samples[r];
+    }
+
+    double mean = sum / config->runs;
+    double variance = 0.0;
+    for (uint32_t r = 0; r < config->runs; r++) {
+        variance += (samples[r] - mean) * (samples[r] - mean);
+    }
+    if (config->runs > 1) variance /= config->runs - 1;
+
+    qsort(samples, config->runs, sizeof(double), compare_double);
+
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->bytes = bytes;
+    result->iterations = iterations;
+    result->runs = config->runs;
+    result->median_ns = percentile(samples, config->runs, 50.0);
+    result->mean_ns = mean;
+    result->stddev_ns = sqrt(variance);
+    result->run_p90_ns = percentile(samples, config->runs, 90.0);
+    result->min_ns = samples[0];
+    result->max_ns = samples[config->runs - 1];
+    if (bytes && result->median_ns > 0.0) {
+        result->mb_per_sec = bytes / result->median_ns * 1e9 / (1024.0 * 1024.0);
+    }
+
+    free(samples);
+    return MEM_SUCCESS;
+}
+
+void bench_report_begin(bench_report_t* report, FILE* out, bench_format_t format,
+                        const char* benchmark) {
+    report->out = out;
+    report->format = format;
+    report->count = 0;
+
+    switch (format) {
+        case BENCH_FORMAT_TEXT:
+            fprintf(out, "%-24s %10s %12s %12s %10s %12s %10s\n", "benchmark", "bytes",
+                    "median ns", "p90 run ns", "stddev %", "MB/s", "iters");
+            break;
+        case BENCH_FORMAT_JSON:
+            fprintf(out, "{\n  \"benchmark\": \"%s\",\n  \"results\": [\n", benchmark);
+            break;
+        case BENCH_FORMAT_CSV:
+            fprintf(out, "name,bytes,iterations,runs,median_ns,mean_ns,stddev_ns,"
+                         "run_p90_ns,min_ns,max_ns,mb_per_sec\n");
+            break;
+    }
+}
+
+void bench_report_add(bench_report_t* report, const bench_result_t* r) {
+    double cv = r->mean_ns > 0.0 ? 100.0 * r->stddev_ns / r->mean_ns : 0.0;
+
+    switch (report->format) {
+        case BENCH_FORMAT_TEXT:
+            fprintf(report->out, "%-24s %10zu %12.1f %12.1f %10.2f %12.1f %10llu\n",
+                    r->name, r->bytes, r->median_ns, r->run_p90_ns, cv, r->mb_per_sec,
+                    (unsigned long long)r->iterations);
+            break;
+        case BENCH_FORMAT_JSON:
+            fprintf(report->out, "%s    {\"name\": \"%s\", \"bytes\": %zu, "
+                                 "\"iterations\": %llu, \"runs\": %u, "
+                                 "\"ns_per_op\": {\"median\": %.2f, \"mean\": %.2f, "
+                                 "\"stddev\": %.2f, \"run_p90\": %.2f, \"min\": %.2f, \"max\": %.2f}, "
+                                 "\"mb_per_sec\": %.2f}",
+                    report->count ? ",\n" : "", r->name, r->bytes,
+                    (unsigned long long)r->iterations, r->runs,
+                    r->median_ns, r->mean_ns, r->stddev_ns, r->run_p90_ns, r->min_ns, r->max_ns,
+                    r->mb_per_sec);
+            break;
+        case BENCH_FORMAT_CSV:
+            fprintf(report->out, "%s,%zu,%llu,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+                    r->name, r->bytes, (unsigned long long)r->iterations, r->runs,
+                    r->median_ns, r->mean_ns, r->stddev_ns, r->run_p90_ns, r->min_ns, r->max_ns,
+                    r->mb_per_sec);
+            break;
+    }
+    report->count++;
+}
+
+void bench_report_end(bench_report_t* report) {
+    if (report->format == BENCH_FORMAT_JSON) {
+        fprintf(report->out, "\n  ]\n}\n");
+    }
+    fflush(report->out);
+}
+
+int bench_parse_format(const char* name, bench_format_t* format) {
+    if (!name || !format) return MEM_INVALID;
+
+    if (!strcmp(name, "text")) {
+        *format = BENCH_FORMAT_TEXT;
+    } else if (!strcmp(name, "json")) {
+        *format = BENCH_FORMAT_JSON;
+    } else if (!strcmp(name, "csv")) {
+        *format = BENCH_FORMAT_CSV;
+    } else {
+        return MEM_INVALID;
+    }
+    return MEM_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Micro-benchmark harness
+//
+// A benchmark is a function running its operation `iterations` times.
+// bench_run() runs it untimed for a warm-up period, doubles the iteration
+// count until one run lasts at least min_run_ns (so timer resolution and
+// call overhead stay well below 1%), then times `runs` repetitions on the
+// monotonic clock. Statistics are over the per-operation time of each
+// repetition, a mean over its iterations: single-operation outliers are
+// not visible. Set-up belongs outside the function; nothing it does is
+// excluded from the timing.
+typedef void (*bench_fn_t)(void* context, uint64_t iterations);
+
+typedef struct {
+    uint64_t warmup_ns;
+    uint64_t min_run_ns;
+    uint32_t runs;
+    uint64_t max_iterations;        // Calibration stops here
+} bench_config_t;
+
+typedef struct {
+    const char* name;
+    size_t bytes;                   // Per operation; 0 if not a data mover
+    uint64_t iterations;            // Per run
+    uint32_t runs;
+    double median_ns;               // Per operation
+    double mean_ns;
+    double stddev_ns;
+    double run_p90_ns;              // 90th percentile over the repetitions
+    double min_ns;
+    double max_ns;
+    double mb_per_sec;              // At the median
+} bench_result_t;
+
+typedef enum {
+    BENCH_FORMAT_TEXT,
+    BENCH_FORMAT_JSON,
+    BENCH_FORMAT_CSV
+} bench_format_t;
+
+typedef struct {
+    FILE* out;
+    bench_format_t format;
+    size_t count;
+} bench_report_t;
+
+// 100 ms warm-up, 20 ms runs, 20 runs
+void bench_default_config(bench_config_t* config);
+uint64_t bench_now_ns(void);
+// Keep `value` alive so the compiler cannot drop the work producing it
+void bench_do_not_optimize(const void* value);
+// Pin the calling thread to `cpu`, or to the CPU it runs on if -1.
+// Returns the CPU, or MEM_ERROR.
+int bench_pin_cpu(int cpu);
+
+int bench_run(const bench_config_t* config, const char* name, size_t bytes,
+              bench_fn_t fn, void* context, bench_result_t* result);
+
+// Results as a text table, one JSON document, or CSV with a header row
+void bench_report_begin(bench_report_t* report, FILE* out, bench_format_t format,
+                        const char* benchmark);
+void bench_report_add(bench_report_t* report, const bench_result_t* result);
+void bench_report_end(bench_report_t* report);
+int bench_parse_format(const char* name, bench_format_t* format);
+
+#endif // BENCH_H
@@ -0,0 +1,264 @@
+#include "checksum.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY     0x82F63B78u
+#define LANE_LONG       8192    // Bytes per stream for big buffers
+#define LANE_SHORT      256     // Bytes per stream for medium buffers
+
+// Multiplication of a CRC state by a fixed power of x, one table per byte
+typedef struct {
+    uint32_t t[4][256];
+} crc_shift_t;
+
+static uint32_t crc_table[8][256];
+static uint32_t x2n_table[32];
+static crc_shift_t shift_long[2];   // x^(8 * LANE_LONG), x^(16 * LANE_LONG)
+static crc_shift_t shift_short[2];  // x^(8 * LANE_SHORT), x^(16 * LANE_SHORT)
+static bool use_hw = false;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+// a * b mod P in the reflected bit order
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(n * 2^k) mod P
+static uint32_t x2nmodp(size_t n, unsigned k) {
+    uint32_t p = 1u << 31;  // x^0
+
+    while (n) {
+        if (n & 1) {
+            p = multmodp(x2n_table[k & 31], p);
+        }
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+static void shift_init(crc_shift_t* shift, uint32_t power) {
+    for (int k = 0; k < 4; k++) {
+        for (uint32_t b = 0; b < 256; b++) {
+            shift->t[k][b] = multmodp(power, b << (8 * k));
+        }
+    }
+}
+
+static inline uint32_t shift_apply(const crc_shift_t* shift, uint32_t crc) {
+    return shift->t[0][crc & 0xff] ^ shift->t[1][(crc >> 8) & 0xff] ^
+           shift->t[2][(crc >> 16) & 0xff] ^ shift->t[3][crc >> 24];
+}
+
+static void crc32c_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = crc_table[0][n];
+        for (int k = 1; k < 8; k++) {
+            c = crc_table[0][c & 0xff] ^ (c >> 8);
+            crc_table[k][n] = c;
+        }
+    }
+
+    uint32_t p = 1u << 30;  // x^1
+    x2n_table[0] = p;
+    for (int n = 1; n < 32; n++) {
+        x2n_table[n] = p = multmodp(p, p);
+    }
+
+    shift_init(&shift_long[0], x2nmodp(LANE_LONG, 3));
+    shift_init(&shift_long[1], x2nmodp(2 * LANE_LONG, 3));
+    shift_init(&shift_short[0], x2nmodp(LANE_SHORT, 3));
+    shift_init(&shift_short[1], x2nmodp(2 * LANE_SHORT, 3));
+
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    use_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+// Raw (no pre/post inversion) slice-by-8 update
+static uint32_t crc_raw_sw(uint32_t crc, const uint8_t* p, size_t n) {
+    while (n && ((uintptr_t)p & 7)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = crc_table[7][w & 0xff] ^
+              crc_table[6][(w >> 8) & 0xff] ^
+              crc_table[5][(w >> 16) & 0xff] ^
+              crc_table[4][(w >> 24) & 0xff] ^
+              crc_table[3][(w >> 32) & 0xff] ^
+              crc_table[2][(w >> 40) & 0xff] ^
+              crc_table[1][(w >> 48) & 0xff] ^
+              crc_table[0][w >> 56];
+        p += 8;
+        n -= 8;
+    }
+#endif
+
+    while (n--) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+// The crc32 instruction has a 3-cycle latency but 1-cycle throughput, so
+// three independent streams are run side by side and stitched together
+// with a multiplication by x^(8 * lane).
+__attribute__((target("sse4.2")))
+static uint32_t crc_lanes_hw(uint32_t crc, const uint8_t** pp, size_t* np,
+                             size_t lane, const crc_shift_t shift[2]) {
+    const uint8_t* p = *pp;
+    size_t n = *np;
+
+    while (n >= 3 * lane) {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        const uint8_t* end = p + lane;
+
+        while (p < end) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p, 8);
+            memcpy(&w1, p + lane, 8);
+            memcpy(&w2, p + 2 * lane, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+            p += 8;
+        }
+
+        crc = shift_apply(&shift[1], (uint32_t)c0) ^
+              shift_apply(&shift[0], (uint32_t)c1) ^ (uint32_t)c2;
+        p += 2 * lane;
+        n -= 3 * lane;
+    }
+
+    *pp = p;
+    *np = n;
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc_raw_hw(uint32_t crc, const uint8_t* p, size_t n) {
+    while (n && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+
+    crc = crc_lanes_hw(crc, &p, &n, LANE_LONG, shift_long);
+    crc = crc_lanes_hw(crc, &p, &n, LANE_SHORT, shift_short);
+
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        n -= 8;
+    }
+    crc = (uint32_t)c;
+
+    while (n--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static inline uint32_t crc_raw(uint32_t crc, const uint8_t* p, size_t n) {
+#ifdef CRC32C_HAVE_SSE42
+    if (use_hw) return crc_raw_hw(crc, p, n);
+#endif
+    return crc_raw_sw(crc, p, n);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t size) {
+    pthread_once(&init_once, crc32c_init);
+    if (!data || size == 0) return crc;
+
+    return ~crc_raw(~crc, (const uint8_t*)data, size);
+}
+
+uint32_t crc32c(const void* data, size_t size) {
+    return crc32c_update(0, data, size);
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void* data, size_t size) {
+    pthread_once(&init_once, crc32c_init);
+    if (!data || size == 0) return crc;
+
+    return ~crc_raw_sw(~crc, (const uint8_t*)data, size);
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+    pthread_once(&init_once, crc32c_init);
+
+    return multmodp(x2nmodp(len_b, 3), crc_a) ^ crc_b;
+}
+
+uint32_t crc32c_zeros(size_t size) {
+    pthread_once(&init_once, crc32c_init);
+
+    return ~multmodp(x2nmodp(size, 3), 0xFFFFFFFFu);
+}
+
+// The CRC is affine in the message, so the new checksum is the old one
+// xor the raw CRC of (old ^ new) over the changed range, moved past the
+// unchanged tail by a multiplication with x^(8 * tail).
+uint32_t crc32c_patch(uint32_t crc, size_t total, size_t offset,
+                      const void* old_data, const void* new_data, size_t len) {
+    pthread_once(&init_once, crc32c_init);
+    if (!old_data || !new_data || len == 0 || offset > total || len > total - offset) {
+        return crc;
+    }
+
+    const uint8_t* old_bytes = (const uint8_t*)old_data;
+    const uint8_t* new_bytes = (const uint8_t*)new_data;
+    uint8_t delta[256];
+    uint32_t raw = 0;
+
+    for (size_t done = 0; done < len; ) {
+        size_t chunk = len - done < sizeof(delta) ? len - done : sizeof(delta);
+        for (size_t i = 0; i < chunk; i++) {
+            delta[i] = old_bytes[done + i] ^ new_bytes[done + i];
+        }
+        raw = crc_raw(raw, delta, chunk);
+        done += chunk;
+    }
+
+    size_t tail = total - offset - len;
+    return crc ^ multmodp(x2nmodp(tail, 3), raw);
+}
+
+bool crc32c_hw_available(void) {
+    pthread_once(&init_once, crc32c_init);
+    return use_hw;
+}
@@ -0,0 +1,37 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// CRC32C (Castagnoli): reflected polynomial 0x82F63B78, init and final
+// xor 0xFFFFFFFF. Uses the SSE4.2 crc32 instruction with three interleaved
+// streams when the CPU has it, otherwise a slice-by-8 table walk.
+
+// One-shot checksum of a buffer
+uint32_t crc32c(const void* data, size_t size);
+
+// Continue a checksum: crc32c_update(crc32c(A), B) == crc32c(A || B).
+// Start from 0 for a fresh checksum.
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t size);
+
+// Checksum of A || B from crc32c(A), crc32c(B) and the length of B, in
+// O(log len_b) without touching the data.
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
+
+// Checksum of `size` zero bytes in O(log size)
+uint32_t crc32c_zeros(size_t size);
+
+// Checksum of a `total`-byte buffer after bytes [offset, offset + len)
+// changed from `old_data` to `new_data`. Costs O(len + log total), so a
+// small write into a large block does not rehash the whole block.
+uint32_t crc32c_patch(uint32_t crc, size_t total, size_t offset,
+                      const void* old_data, const void* new_data, size_t len);
+
+// Table-driven implementation, always available (used for testing)
+uint32_t crc32c_sw(uint32_t crc, const void* data, size_t size);
+
+bool crc32c_hw_available(void);
+
+#endif // CHECKSUM_H
@@ -1,5 +1,6 @@
 #include "ddr_memory.h"
 #include "config.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,7 +34,7 @@ ddr_memory_t* ddr_init(size_t total_size) {
     // Initialize memory to zero
     memset(memory->base_address, 0, total_size);
     
-    printf("DDR Memory initialized: %zu MB\n", total_size / (1024 * 1024));
+    LOG_INFO("DDR Memory initialized: %zu MB", total_size / (1024 * 1024));
     return memory;
 }
 
@@ -65,7 +66,7 @@ memory_partition_t* create_partition(ddr_memory_t* memory,
     
     memory->used_size += size;
     
-    printf("Partition '%s' created: %zu MB, Protection: 0x%08X\n",
+    LOG_INFO("Partition '%s' created: %zu MB, Protection: 0x%08X",
            name, size / (1024 * 1024), protection);
     
     return partition;
@@ -97,7 +98,7 @@ void partition_free(memory_partition_t* partition, void* ptr) {
     // For simulation, we just decrement used counter
     if (partition && ptr) {
         // Note: Real implementation would need proper allocation tracking
-        printf("Free operation simulated for partition '%s'\n", partition->name);
+        LOG_DEBUG("Free operation simulated for partition '%s'", partition->name);
     }
 }
 
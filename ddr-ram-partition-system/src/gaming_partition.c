@@ -1,8 +1,17 @@
 #include "gaming_partition.h"
+#include "config.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define FRAME_DT    0.016f   // ~60 FPS
+#define WORLD_SIZE  100.0f
+#define STAGE_SPIN_LIMIT 20000   // Polls before a stage blocks on the condvar
 
 static game_state_t* game_state = NULL;
 static memory_partition_t* gaming_partition = NULL;
@@ -11,15 +20,67 @@ static float fps = 60.0f;
 static int frame_count = 0;
 static clock_t fps_start_time = 0;
 
+// Live objects created through create_game_object()
+static game_object_t** objects = NULL;
+static uint32_t object_count = 0;
+static uint32_t object_capacity = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Move an object by one frame, bouncing off the world edges
+static inline void integrate_object(game_object_t* obj) {
+    obj->position_x += obj->velocity_x;
+    obj->position_y += obj->velocity_y;
+    
+    if (obj->position_x < 0.0f || obj->position_x > WORLD_SIZE) {
+        obj->velocity_x = -obj->velocity_x;
+        obj->position_x += 2.0f * obj->velocity_x;
+    }
+    if (obj->position_y < 0.0f || obj->position_y > WORLD_SIZE) {
+        obj->velocity_y = -obj->velocity_y;
+        obj->position_y += 2.0f * obj->velocity_y;
+    }
+}
+
+static void track_object(game_object_t* obj) {
+    if (object_count == object_capacity) {
+        uint32_t capacity = object_capacity ? object_capacity * 2 : 64;
+        game_object_t** grown = realloc(objects, capacity * sizeof(game_object_t*));
+        if (!grown) return;
+        objects = grown;
+        object_capacity = capacity;
+    }
+    objects[object_count++] = obj;
+}
+
+static void untrack_object(game_object_t* obj) {
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (objects[i] == obj) {
+            objects[i] = objects[--object_count];
+            return;
+        }
+    }
+}
+
+// Pipeline snapshot buffers, see gaming_run_pipeline()
+static game_object_t* pipeline_buffers = NULL;
+static uint32_t pipeline_buffer_capacity = 0;
+
 void gaming_init(memory_partition_t* partition) {
     if (!partition) return;
     
+    // Objects and buffers of a previous partition are gone with it
+    gaming_shutdown();
     gaming_partition = partition;
     
     // Allocate game state
     game_state = (game_state_t*)partition_alloc(partition, sizeof(game_state_t));
     if (!game_state) {
-        printf("Failed to allocate game state!\n");
+        LOG_ERROR("Failed to allocate game state!");
         return;
     }
     
@@ -30,12 +91,24 @@ void gaming_init(memory_partition_t* partition) {
     game_state->game_time = 0.0f;
     game_state->score = 0;
     
-    printf("Gaming partition initialized\n");
+    LOG_INFO("Gaming partition initialized");
     
     // Start FPS counter
     fps_start_time = clock();
 }
 
+void gaming_shutdown(void) {
+    free(objects);
+    objects = NULL;
+    object_count = 0;
+    object_capacity = 0;
+    
+    pipeline_buffers = NULL;
+    pipeline_buffer_capacity = 0;
+    game_state = NULL;
+    gaming_partition = NULL;
+}
+
 void gaming_load_textures(void) {
     if (!gaming_partition) return;
     
@@ -44,7 +117,7 @@ void gaming_load_textures(void) {
     void* texture_memory = partition_alloc(gaming_partition, texture_size);
     
     if (texture_memory) {
-        printf("Textures loaded: %zu MB\n", texture_size / (1024 * 1024));
+        LOG_INFO("Textures loaded: %zu MB", texture_size / (1024 * 1024));
         
         // Initialize texture memory with some pattern
         for (size_t i = 0; i < texture_size / sizeof(uint32_t); i++) {
@@ -57,18 +130,21 @@ void gaming_update_physics(void) {
     if (!game_state || game_state->paused) return;
     
     game_state->frame_count++;
-    game_state->game_time += 0.016f;  // ~60 FPS
+    game_state->game_time += FRAME_DT;
     
-    // Simulate physics update
-    printf("Physics update: Frame %u, Time: %.2f\n", 
-           game_state->frame_count, game_state->game_time);
+    for (uint32_t i = 0; i < object_count; i++) {
+        integrate_object(objects[i]);
+    }
+    
+    LOG_DEBUG("Physics update: Frame %u, Time: %.2f",
+              game_state->frame_count, game_state->game_time);
 }
 
 void gaming_render_frame(void) {
     if (!game_state) return;
     
     // Simulate rendering
-    printf("Rendering frame %u\n", game_state->frame_count);
+    LOG_DEBUG("Rendering frame %u", game_state->frame_count);
     
     // Update score based on frame count
     game_state->score += 10;
@@ -79,12 +155,12 @@ void gaming_process_input(void) {
     static int input_counter = 0;
     
     if (input_counter++ % 60 == 0) {
-        printf("Processing input...\n");
+        LOG_DEBUG("Processing input...");
         
         // Simulate random input events
         if (rand() % 100 > 80) {
             game_state->score += 50;
-            printf("Bonus score! Total: %u\n", game_state->score);
+            LOG_DEBUG("Bonus score! Total: %u", game_state->score);
         }
     }
 }
@@ -98,8 +174,8 @@ void gaming_calculate_score(void) {
     
     game_state->score = time_bonus + frame_bonus;
     
-    printf("Score calculated: %u (Time: %u, Frame: %u)\n",
-           game_state->score, time_bonus, frame_bonus);
+    LOG_DEBUG("Score calculated: %u (Time: %u, Frame: %u)",
+              game_state->score, time_bonus, frame_bonus);
 }
 
 game_object_t* create_game_object(memory_partition_t* partition) {
@@ -119,15 +195,20 @@ game_object_t* create_game_object(memory_partition_t* partition) {
         if (game_state) {
             game_state->active_objects++;
         }
+        track_object(obj);
     }
     
     return obj;
 }
 
 void destroy_game_object(game_object_t* obj) {
+    if (obj) {
+        untrack_object(obj);
+    }
+    
     if (obj && game_state) {
         game_state->active_objects--;
-        printf("Game object %u destroyed\n", obj->id);
+        LOG_DEBUG("Game object %u destroyed", obj->id);
     }
 }
 
@@ -151,7 +232,7 @@ void gaming_end_frame(void) {
         frame_count = 0;
         fps_start_time = frame_end_time;
         
-        printf("FPS: %.2f\n", fps);
+        LOG_DEBUG("FPS: %.2f", fps);
     }
     
     // Cap frame rate (simulation)
@@ -169,3 +250,463 @@ void gaming_end_frame(void) {
 float gaming_get_fps(void) {
     return fps;
 }
+
+// ---------------------------------------------------------------------------
+// Pipelined frame execution
+// ---------------------------------------------------------------------------
+
+typedef enum {
+    SLOT_FREE,            // Ready for the input stage
+    SLOT_INPUT_READY,     // Input sampled, waiting for simulation
+    SLOT_SIM_READY        // Snapshot published, waiting for render
+} slot_state_t;
+
+typedef struct {
+    _Atomic int state;        // slot_state_t
+    uint32_t frame;
+    uint64_t input_start_ns;
+    uint32_t input_bonus;
+    uint32_t visible;
+    game_state_t snapshot;
+    game_object_t* objects;
+} frame_slot_t;
+
+typedef struct {
+    uint64_t total_ns;
+    uint64_t max_ns;
+} stage_timer_t;
+
+typedef struct {
+    frame_slot_t slots[GAMING_PIPELINE_SLOTS];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    atomic_int waiters;
+    atomic_bool stopping;       // Stages give up waiting for their slots
+    int spin_limit;
+    uint32_t frames;
+    uint32_t object_count;
+    game_state_t sim_state;
+    game_object_t* sim_objects;
+    // Simulation helpers, each integrating one slice of the objects
+    uint32_t sim_workers;
+    pthread_barrier_t sim_start;
+    pthread_barrier_t sim_done;
+    frame_slot_t* sim_slot;
+    bool sim_ready;
+    bool sim_exit;
+    uint64_t* frame_times_ns;
+    void (*on_frame)(void* context, uint32_t frame, uint64_t latency_ns);
+    void* on_frame_context;
+    uint64_t last_frame_end_ns;
+    unsigned int input_seed;
+    stage_timer_t input;
+    stage_timer_t simulate;
+    stage_timer_t render;
+    uint64_t latency_ns;
+} frame_pipeline_t;
+
+static size_t pipeline_bytes(uint32_t count) {
+    return (size_t)count * sizeof(game_object_t) * (GAMING_PIPELINE_SLOTS + 1);
+}
+
+// Snapshot buffers live in the gaming partition and are reused across
+// runs. They grow at least twofold, so a rising object count regrows them
+// only a few times. Adds what it allocates to `*allocated`.
+static game_object_t* pipeline_reserve(uint32_t count, size_t* allocated) {
+    if (count <= pipeline_buffer_capacity) return pipeline_buffers;
+    
+    uint32_t capacity = pipeline_buffer_capacity * 2;
+    if (capacity < count) capacity = count;
+    
+    // The partition's bump allocator frees nothing, but buffers that are
+    // still its latest allocation can grow in place
+    if (pipeline_buffers) {
+        size_t old_size = pipeline_bytes(pipeline_buffer_capacity);
+        uint8_t* top = gaming_partition->base_address + gaming_partition->used;
+        size_t room = gaming_partition->size - gaming_partition->used;
+        if ((uint8_t*)pipeline_buffers + old_size == top) {
+            if (pipeline_bytes(capacity) - old_size > room) capacity = count;
+            if (pipeline_bytes(capacity) - old_size > room) return NULL;
+            
+            gaming_partition->used += pipeline_bytes(capacity) - old_size;
+            *allocated += pipeline_bytes(capacity) - old_size;
+            pipeline_buffer_capacity = capacity;
+            return pipeline_buffers;
+        }
+    }
+    
+    // Otherwise objects were created since and the old buffers stay behind
+    // them, unused. Doubling keeps all of those together smaller than the
+    // buffers that replace them.
+    game_object_t* buffers = (game_object_t*)partition_alloc(gaming_partition,
+                                                             pipeline_bytes(capacity));
+    if (!buffers && capacity > count) {
+        buffers = (game_object_t*)partition_alloc(gaming_partition, pipeline_bytes(count));
+        capacity = count;
+    }
+    if (!buffers) return NULL;
+    
+    *allocated += pipeline_bytes(capacity);
+    pipeline_buffers = buffers;
+    pipeline_buffer_capacity = capacity;
+    return buffers;
+}
+
+static void stage_record(stage_timer_t* timer, uint64_t start) {
+    uint64_t elapsed = now_ns() - start;
+    timer->total_ns += elapsed;
+    if (elapsed > timer->max_ns) timer->max_ns = elapsed;
+}
+
+// Hand-offs are usually a few microseconds apart, so poll briefly before
+// paying for a sleep/wake-up through the condition variable. NULL once the
+// pipeline is stopping.
+static frame_slot_t* slot_acquire(frame_pipeline_t* p, uint32_t frame, slot_state_t wanted) {
+    frame_slot_t* slot = &p->slots[frame % GAMING_PIPELINE_SLOTS];
+    
+    for (int spin = 0; spin < p->spin_limit; spin++) {
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) == (int)wanted) {
+            return slot;
+        }
+    }
+    
+    pthread_mutex_lock(&p->lock);
+    atomic_fetch_add(&p->waiters, 1);
+    while (atomic_load(&slot->state) != (int)wanted && !atomic_load(&p->stopping)) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    atomic_fetch_sub(&p->waiters, 1);
+    bool stopping = atomic_load(&p->stopping);
+    pthread_mutex_unlock(&p->lock);
+    
+    return stopping ? NULL : slot;
+}
+
+// Wake every stage and make it return
+static void pipeline_stop(frame_pipeline_t* p) {
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->stopping, true);
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void slot_publish(frame_pipeline_t* p, frame_slot_t* slot, slot_state_t next) {
+    atomic_store(&slot->state, (int)next);
+    
+    if (atomic_load(&p->waiters) > 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void input_stage(frame_pipeline_t* p, frame_slot_t* slot, uint32_t frame) {
+    uint64_t start = now_ns();
+    
+    slot->frame = frame;
+    slot->input_start_ns = start;
+    slot->input_bonus = 0;
+    
+    // Same cadence as gaming_process_input()
+    if (frame % 60 == 0 && rand_r(&p->input_seed) % 100 > 80) {
+        slot->input_bonus = 50;
+    }
+    
+    stage_record(&p->input, start);
+}
+
+// Integrate and snapshot worker `worker`'s share of the objects
+static void simulate_slice(frame_pipeline_t* p, frame_slot_t* slot, uint32_t worker) {
+    uint32_t per_worker = (p->object_count + p->sim_workers - 1) / p->sim_workers;
+    uint32_t begin = worker * per_worker;
+    uint32_t end = begin + per_worker;
+    if (end > p->object_count) end = p->object_count;
+    if (begin >= end) return;
+    
+    if (!p->sim_state.paused) {
+        for (uint32_t i = begin; i < end; i++) {
+            integrate_object(&p->sim_objects[i]);
+        }
+    }
+    memcpy(slot->objects + begin, p->sim_objects + begin,
+           (end - begin) * sizeof(game_object_t));
+}
+
+static void* simulate_helper(void* arg) {
+    frame_pipeline_t* p = ((void**)arg)[0];
+    uint32_t worker = (uint32_t)(uintptr_t)((void**)arg)[1];
+    
+    // Wait until every helper exists, otherwise the barriers never fill
+    pthread_mutex_lock(&p->lock);
+    while (!p->sim_ready && !p->sim_exit) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    bool exit_now = p->sim_exit;
+    pthread_mutex_unlock(&p->lock);
+    if (exit_now) return NULL;
+    
+    for (;;) {
+        pthread_barrier_wait(&p->sim_start);
+        if (p->sim_exit) break;
+        simulate_slice(p, p->sim_slot, worker);
+        pthread_barrier_wait(&p->sim_done);
+    }
+    return NULL;
+}
+
+static void simulate_stage(frame_pipeline_t* p, frame_slot_t* slot) {
+    uint64_t start = now_ns();
+    game_state_t* state = &p->sim_state;
+    
+    if (p->sim_workers > 1) {
+        p->sim_slot = slot;
+        pthread_barrier_wait(&p->sim_start);
+        simulate_slice(p, slot, 0);
+        pthread_barrier_wait(&p->sim_done);
+    } else {
+        simulate_slice(p, slot, 0);
+    }
+    
+    if (!state->paused) {
+        state->frame_count++;
+        state->game_time += FRAME_DT;
+    }
+    
+    // Same formula as gaming_calculate_score(), plus sampled input bonuses
+    state->score = (uint32_t)(state->game_time * 10) + state->frame_count * 5 +
+                   slot->input_bonus;
+    
+    slot->snapshot = *state;
+    
+    stage_record(&p->simulate, start);
+}
+
+static void render_stage(frame_pipeline_t* p, frame_slot_t* slot) {
+    uint64_t start = now_ns();
+    uint32_t visible = 0;
+    
+    // Simulated rasterisation: cull against the viewport
+    for (uint32_t i = 0; i < p->object_count; i++) {
+        const game_object_t* obj = &slot->objects[i];
+        if (obj->health > 0 &&
+            obj->position_x >= 0.0f && obj->position_x <= WORLD_SIZE &&
+            obj->position_y >= 0.0f && obj->position_y <= WORLD_SIZE) {
+            visible++;
+        }
+    }
+    slot->visible = visible;
+    
+    uint64_t end = now_ns();
+    p->latency_ns += end - slot->input_start_ns;
+    if (p->frame_times_ns) {
+        p->frame_times_ns[slot->frame] = end - p->last_frame_end_ns;
+    }
+    p->last_frame_end_ns = end;
+    stage_record(&p->render, start);
+    if (p->on_frame) {
+        p->on_frame(p->on_frame_context, slot->frame, end - slot->input_start_ns);
+    }
+}
+
+static void* input_thread(void* arg) {
+    frame_pipeline_t* p = arg;
+    for (uint32_t f = 0; f < p->frames; f++) {
+        frame_slot_t* slot = slot_acquire(p, f, SLOT_FREE);
+        if (!slot) break;
+        input_stage(p, slot, f);
+        slot_publish(p, slot, SLOT_INPUT_READY);
+    }
+    return NULL;
+}
+
+static void* simulate_thread(void* arg) {
+    frame_pipeline_t* p = arg;
+    for (uint32_t f = 0; f < p->frames; f++) {
+        frame_slot_t* slot = slot_acquire(p, f, SLOT_INPUT_READY);
+        if (!slot) break;
+        simulate_stage(p, slot);
+        slot_publish(p, slot, SLOT_SIM_READY);
+    }
+    return NULL;
+}
+
+static void* render_thread(void* arg) {
+    frame_pipeline_t* p = arg;
+    for (uint32_t f = 0; f < p->frames; f++) {
+        frame_slot_t* slot = slot_acquire(p, f, SLOT_SIM_READY);
+        if (!slot) break;
+        render_stage(p, slot);
+        slot_publish(p, slot, SLOT_FREE);
+    }
+    return NULL;
+}
+
+static void fill_stage_stats(gaming_stage_stats_t* out, const stage_timer_t* timer,
+                             uint32_t frames) {
+    out->avg_us = frames ? timer->total_ns / 1000.0 / frames : 0.0;
+    out->max_us = timer->max_ns / 1000.0;
+    out->total_ms = timer->total_ns / 1000000.0;
+}
+
+int gaming_run_pipeline(const gaming_pipeline_config_t* config,
+                        gaming_pipeline_stats_t* stats) {
+    if (!config || !game_state || !gaming_partition) return MEM_INVALID;
+    
+    // Everything a run allocates is set up here; the stages allocate nothing
+    uint32_t count = object_count;
+    size_t allocated = 0;
+    game_object_t* buffers = pipeline_reserve(count, &allocated);
+    if (!buffers && count > 0) return MEM_FULL;
+    
+    frame_pipeline_t* p = calloc(1, sizeof(frame_pipeline_t));
+    if (!p) return MEM_ERROR;
+    allocated += sizeof(frame_pipeline_t);
+    
+    p->frames = config->frames;
+    p->object_count = count;
+    p->sim_workers = config->sim_workers > 1 ? config->sim_workers : 1;
+    p->frame_times_ns = config->frame_times_ns;
+    p->on_frame = config->on_frame;
+    p->on_frame_context = config->on_frame_context;
+    p->sim_state = *game_state;
+    p->sim_objects = buffers;
+    p->input_seed = (unsigned int)time(NULL);
+    // Polling only helps when the other stages have a core of their own
+    p->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? STAGE_SPIN_LIMIT : 0;
+    for (int i = 0; i < GAMING_PIPELINE_SLOTS; i++) {
+        atomic_init(&p->slots[i].state, SLOT_FREE);
+        p->slots[i].objects = buffers + (size_t)(i + 1) * count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        p->sim_objects[i] = *objects[i];
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+    
+    int result = MEM_SUCCESS;
+    
+    pthread_t* helpers = NULL;
+    void* (*helper_args)[2] = NULL;
+    uint32_t helpers_started = 0;
+    if (p->sim_workers > 1) {
+        helpers = calloc(p->sim_workers, sizeof(pthread_t));
+        helper_args = calloc(p->sim_workers, sizeof(*helper_args));
+        if (!helpers || !helper_args) {
+            p->sim_workers = 1;
+        } else {
+            allocated += p->sim_workers * (sizeof(pthread_t) + sizeof(*helper_args));
+            pthread_barrier_init(&p->sim_start, NULL, p->sim_workers);
+            pthread_barrier_init(&p->sim_done, NULL, p->sim_workers);
+            for (uint32_t w = 1; w < p->sim_workers; w++) {
+                helper_args[w][0] = p;
+                helper_args[w][1] = (void*)(uintptr_t)w;
+                if (pthread_create(&helpers[w], NULL, simulate_helper, helper_args[w]) != 0) {
+                    break;
+                }
+                helpers_started++;
+            }
+            pthread_mutex_lock(&p->lock);
+            if (helpers_started + 1 < p->sim_workers) {
+                result = MEM_ERROR;
+                p->sim_exit = true;
+            } else {
+                p->sim_ready = true;
+            }
+            pthread_cond_broadcast(&p->changed);
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    
+    uint64_t start = now_ns();
+    p->last_frame_end_ns = start;
+    
+    if (result != MEM_SUCCESS) {
+        // Helper start-up failed; fall through to shutdown
+    } else if (config->pipelined) {
+        pthread_t threads[3];
+        void* (*stages[3])(void*) = { input_thread, simulate_thread, render_thread };
+        int started = 0;
+        
+        for (; started < 3; started++) {
+            if (pthread_create(&threads[started], NULL, stages[started], p) != 0) {
+                break;
+            }
+        }
+        
+        if (started < 3) {
+            // Cannot run a partial pipeline; stop what was started
+            result = MEM_ERROR;
+            pipeline_stop(p);
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    } else {
+        for (uint32_t f = 0; f < p->frames; f++) {
+            frame_slot_t* slot = &p->slots[f % GAMING_PIPELINE_SLOTS];
+            input_stage(p, slot, f);
+            simulate_stage(p, slot);
+            render_stage(p, slot);
+        }
+    }
+    
+    uint64_t wall_ns = now_ns() - start;
+    
+    if (p->sim_workers > 1) {
+        if (p->sim_ready) {
+            p->sim_exit = true;
+            pthread_barrier_wait(&p->sim_start);
+        }
+        for (uint32_t w = 1; w <= helpers_started; w++) {
+            pthread_join(helpers[w], NULL);
+        }
+        pthread_barrier_destroy(&p->sim_start);
+        pthread_barrier_destroy(&p->sim_done);
+    }
+    free(helpers);
+    free(helper_args);
+    
+    // Publish the simulated state back to the live game
+    if (result == MEM_SUCCESS) {
+        *game_state = p->sim_state;
+        for (uint32_t i = 0; i < count; i++) {
+            *objects[i] = p->sim_objects[i];
+        }
+    }
+    
+    if (stats) {
+        uint32_t frames = result == MEM_SUCCESS ? p->frames : 0;
+        memset(stats, 0, sizeof(gaming_pipeline_stats_t));
+        stats->frames = frames;
+        stats->objects = count;
+        stats->bytes_allocated = allocated;
+        stats->wall_time_ms = wall_ns / 1000000.0;
+        stats->frames_per_second = wall_ns ? frames / (wall_ns / 1e9) : 0.0;
+        stats->frame_latency_us = frames ? p->latency_ns / 1000.0 / frames : 0.0;
+        fill_stage_stats(&stats->input, &p->input, frames);
+        fill_stage_stats(&stats->simulate, &p->simulate, frames);
+        fill_stage_stats(&stats->render, &p->render, frames);
+    }
+    
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    
+    return result;
+}
+
+void print_pipeline_stats(const gaming_pipeline_stats_t* stats) {
+    if (!stats) return;
+    
+    printf("  Frames: %u, Objects: %u, Wall time: %.2f ms (%.1f FPS)\n",
+           stats->frames, stats->objects, stats->wall_time_ms,
+           stats->frames_per_second);
+    printf("  Stage      avg (us)   max (us)   busy (ms)\n");
+    printf("  Input    %10.2f %10.2f %11.2f\n",
+           stats->input.avg_us, stats->input.max_us, stats->input.total_ms);
+    printf("  Simulate %10.2f %10.2f %11.2f\n",
+           stats->simulate.avg_us, stats->simulate.max_us, stats->simulate.total_ms);
+    printf("  Render   %10.2f %10.2f %11.2f\n",
+           stats->render.avg_us, stats->render.max_us, stats->render.total_ms);
+    printf("  Frame latency: %.2f us\n", stats->frame_latency_us);
+}
@@ -27,6 +27,8 @@ typedef struct {
 
 // Gaming functions
 void gaming_init(memory_partition_t* partition);
+// Forget the partition and its objects; gaming_init() starts over
+void gaming_shutdown(void);
 void gaming_load_textures(void);
 void gaming_update_physics(void);
 void gaming_render_frame(void);
@@ -43,4 +45,45 @@ void gaming_start_frame(void);
 void gaming_end_frame(void);
 float gaming_get_fps(void);
 
+// Pipelined frame execution
+//
+// Input, simulation and render run as separate stages over a ring of
+// GAMING_PIPELINE_SLOTS snapshots (game_state_t plus a copy of every tracked
+// object). With `pipelined` set each stage gets its own thread, so frame N+1
+// is simulated while frame N renders and throughput is bounded by the
+// slowest stage. Without it the same stages run back to back on the caller.
+#define GAMING_PIPELINE_SLOTS 3
+
+typedef struct {
+    uint32_t frames;          // Number of frames to run
+    bool pipelined;           // Run each stage on its own thread
+    uint32_t sim_workers;     // Threads sharing the physics step (0/1 = none)
+    uint64_t* frame_times_ns; // Optional, `frames` entries: render-to-render time
+    // Optional, called on the render stage's thread as each frame is done
+    void (*on_frame)(void* context, uint32_t frame, uint64_t latency_ns);
+    void* on_frame_context;
+} gaming_pipeline_config_t;
+
+typedef struct {
+    double avg_us;            // Mean processing time per frame
+    double max_us;            // Worst frame
+    double total_ms;          // Busy time over the whole run
+} gaming_stage_stats_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t objects;
+    uint64_t bytes_allocated;   // Partition and heap memory the run allocated
+    double wall_time_ms;
+    double frames_per_second;
+    double frame_latency_us;  // Mean input start -> render end
+    gaming_stage_stats_t input;
+    gaming_stage_stats_t simulate;
+    gaming_stage_stats_t render;
+} gaming_pipeline_stats_t;
+
+int gaming_run_pipeline(const gaming_pipeline_config_t* config,
+                        gaming_pipeline_stats_t* stats);
+void print_pipeline_stats(const gaming_pipeline_stats_t* stats);
+
 #endif // GAMING_PARTITION_H
@@ -0,0 +1,697 @@
+#define _GNU_SOURCE
+#include "log.h"
+#include "config.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#define RING_SLOTS      512     // Messages buffered per thread
+#define PAYLOAD_SIZE    232     // Argument bytes per message
+#define LINE_SIZE       1024    // Longest formatted line
+
+// Arguments are stored as a tag byte and 8 bytes of value; strings as the
+// tag, a 2-byte length and the characters. The format string itself is
+// not copied, only referenced.
+enum {
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_PTR,
+    ARG_STR
+};
+
+typedef struct {
+    uint64_t timestamp_ns;
+    const char* format;
+    uint8_t level;
+    bool truncated;                 // Ran out of payload
+    uint16_t length;
+    uint8_t payload[PAYLOAD_SIZE];
+} log_entry_t;
+
+// Single producer (the owning thread), single consumer (whoever holds
+// drain_mutex, normally the writer)
+typedef struct log_ring {
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    atomic_uint_least64_t dropped;
+    atomic_bool owned;              // Cleared when the owning thread exits
+    struct log_ring* next;
+    log_entry_t entries[RING_SLOTS];
+} log_ring_t;
+
+typedef enum {
+    LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T, LEN_BIG_L
+} length_mod_t;
+
+typedef struct {
+    const char* flags;
+    size_t flags_len;
+    const char* width;              // Digits, or NULL
+    size_t width_len;
+    const char* precision;          // Digits after '.', or NULL
+    size_t precision_len;
+    bool has_precision;
+    bool star_width;
+    bool star_precision;
+    length_mod_t length;
+    char conversion;
+} spec_t;
+
+atomic_int log_level = LOG_LEVEL_INFO;
+
+static _Atomic(log_ring_t*) rings = NULL;
+static _Thread_local log_ring_t* my_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_uint ring_count = 0;
+
+static log_config_t config;
+static uint64_t start_ns = 0;
+static atomic_uint_least64_t written = 0;
+static atomic_uint_least64_t dropped_total = 0;
+
+// Output is written by one thread at a time: the writer, or callers while
+// it is not running
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Background writer
+static pthread_t writer_thread;
+static atomic_bool writer_running = false;
+static bool writer_stop = false;
+static uint64_t flush_requested = 0;
+static uint64_t flush_done = 0;
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Format strings
+// ---------------------------------------------------------------------------
+
+// Parse the conversion after a '%'; returns the character following it
+static const char* parse_spec(const char* p, spec_t* spec) {
+    memset(spec, 0, sizeof(*spec));
+
+    spec->flags = p;
+    while (*p && strchr("-+ #0'", *p)) p++;
+    spec->flags_len = (size_t)(p - spec->flags);
+
+    if (*p == '*') {
+        spec->star_width = true;
+        p++;
+    } else {
+        spec->width = p;
+        while (*p >= '0' && *p <= '9') p++;
+        spec->width_len = (size_t)(p - spec->width);
+        if (spec->width_len == 0) spec->width = NULL;
+    }
+
+    if (*p == '.') {
+        spec->has_precision = true;
+        p++;
+        if (*p == '*') {
+            spec->star_precision = true;
+            p++;
+        } else {
+            spec->precision = p;
+            while (*p >= '0' && *p <= '9') p++;
+            spec->precision_len = (size_t)(p - spec->precision);
+        }
+    }
+
+    switch (*p) {
+        case 'h':
+            p++;
+            spec->length = *p == 'h' ? (p++, LEN_HH) : LEN_H;
+            break;
+        case 'l':
+            p++;
+            spec->length = *p == 'l' ? (p++, LEN_LL) : LEN_L;
+            break;
+        case 'z': p++; spec->length = LEN_Z; break;
+        case 'j': p++; spec->length = LEN_J; break;
+        case 't': p++; spec->length = LEN_T; break;
+        case 'L': p++; spec->length = LEN_BIG_L; break;
+        default: break;
+    }
+
+    spec->conversion = *p;
+    return *p ? p + 1 : p;
+}
+
+static void put_value(log_entry_t* entry, uint8_t tag, const void* value) {
+    if (entry->length + 9 > PAYLOAD_SIZE) {
+        entry->truncated = true;
+        return;
+    }
+    entry->payload[entry->length++] = tag;
+    memcpy(entry->payload + entry->length, value, 8);
+    entry->length += 8;
+}
+
+// At most `max` bytes of `s`: with a precision the argument need not be
+// terminated
+static void put_string(log_entry_t* entry, const char* s, size_t max) {
+    size_t room = PAYLOAD_SIZE - entry->length;
+    if (room < 4) {
+        entry->truncated = true;
+        return;
+    }
+
+    if (max > room - 3) max = room - 3;
+    uint16_t n = (uint16_t)strnlen(s ? s : "(null)", max);
+    entry->payload[entry->length++] = ARG_STR;
+    memcpy(entry->payload + entry->length, &n, 2);
+    memcpy(entry->payload + entry->length + 2, s ? s : "(null)", n);
+    entry->length += 2 + n;
+}
+
+static void put_int(log_entry_t* entry, int64_t value) {
+    put_value(entry, ARG_INT, &value);
+}
+
+static void put_uint(log_entry_t* entry, uint64_t value) {
+    put_value(entry, ARG_UINT, &value);
+}
+
+// Copy the arguments the format refers to; formatting waits for the writer
+static void capture(log_entry_t* entry, va_list ap) {
+    for (const char* p = entry->format; *p; ) {
+        if (*p++ != '%') continue;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        spec_t spec;
+        p = parse_spec(p, &spec);
+        if (spec.star_width) put_int(entry, va_arg(ap, int));
+        size_t max = SIZE_MAX;
+        if (spec.star_precision) {
+            int precision = va_arg(ap, int);
+            put_int(entry, precision);
+            if (precision >= 0) max = (size_t)precision;
+        } else if (spec.has_precision) {
+            max = spec.precision ? (size_t)atoi(spec.precision) : 0;
+        }
+
+        switch (spec.conversion) {
+            case 'd':
+            case 'i':
+                switch (spec.length) {
+                    case LEN_HH: put_int(entry, (signed char)va_arg(ap, int)); break;
+                    case LEN_H: put_int(entry, (short)va_arg(ap, int)); break;
+                    case LEN_L: put_int(entry, va_arg(ap, long)); break;
+                    case LEN_LL: put_int(entry, va_arg(ap, long long)); break;
+                    case LEN_Z: put_int(entry, (int64_t)va_arg(ap, size_t)); break;
+                    case LEN_J: put_int(entry, va_arg(ap, intmax_t)); break;
+                    case LEN_T: put_int(entry, va_arg(ap, ptrdiff_t)); break;
+                    default: put_int(entry, va_arg(ap, int)); break;
+                }
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                switch (spec.length) {
+                    case LEN_HH: put_uint(entry, (unsigned char)va_arg(ap, unsigned)); break;
+                    case LEN_H: put_uint(entry, (unsigned short)va_arg(ap, unsigned)); break;
+                    case LEN_L: put_uint(entry, va_arg(ap, unsigned long)); break;
+                    case LEN_LL: put_uint(entry, va_arg(ap, unsigned long long)); break;
+                    case LEN_Z: put_uint(entry, va_arg(ap, size_t)); break;
+                    case LEN_J: put_uint(entry, va_arg(ap, uintmax_t)); break;
+                    case LEN_T: put_uint(entry, (uint64_t)va_arg(ap, ptrdiff_t)); break;
+                    default: put_uint(entry, va_arg(ap, unsigned)); break;
+                }
+                break;
+            case 'c':
+                put_int(entry, va_arg(ap, int));
+                break;
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A': {
+                double value = spec.length == LEN_BIG_L ? (double)va_arg(ap, long double)
+                                                        : va_arg(ap, double);
+                put_value(entry, ARG_DOUBLE, &value);
+                break;
+            }
+            case 's':
+                put_string(entry, va_arg(ap, const char*), max);
+                break;
+            case 'p': {
+                void* value = va_arg(ap, void*);
+                put_value(entry, ARG_PTR, &value);
+                break;
+            }
+            default:
+                // %n or something unknown: the remaining argument types
+                // cannot be told, so stop here
+                entry->truncated = true;
+                return;
+        }
+    }
+}
+
+typedef struct {
+    const log_entry_t* entry;
+    size_t offset;
+} reader_t;
+
+static bool take(reader_t* r, uint8_t* tag, uint64_t* value, const char** str, uint16_t* len) {
+    if (r->offset >= r->entry->length) return false;
+
+    *tag = r->entry->payload[r->offset++];
+    if (*tag == ARG_STR) {
+        memcpy(len, r->entry->payload + r->offset, 2);
+        *str = (const char*)r->entry->payload + r->offset + 2;
+        r->offset += 2 + *len;
+    } else {
+        memcpy(value, r->entry->payload + r->offset, 8);
+        r->offset += 8;
+    }
+    return true;
+}
+
+static size_t append(char* line, size_t pos, const char* s, size_t n) {
+    if (pos >= LINE_SIZE - 1) return pos;
+    if (n > LINE_SIZE - 1 - pos) n = LINE_SIZE - 1 - pos;
+    memcpy(line + pos, s, n);
+    return pos + n;
+}
+
+static size_t advance(size_t pos, int n) {
+    if (n < 0) return pos;
+    pos += (size_t)n;
+    return pos < LINE_SIZE - 1 ? pos : LINE_SIZE - 1;
+}
+
+// Format one entry into `line`; returns its length
+static size_t render(const log_entry_t* entry, char* line) {
+    static const char* tags[] = { "", "", "", "[WARN] ", "[ERROR] " };
+    reader_t reader = { entry, 0 };
+    size_t pos = 0;
+
+    if (config.timestamps) {
+        uint64_t t = entry->timestamp_ns > start_ns ? entry->timestamp_ns - start_ns : 0;
+        pos = advance(pos, snprintf(line, LINE_SIZE, "[%12.6f] ", t / 1e9));
+    }
+    if (entry->level < sizeof(tags) / sizeof(tags[0])) {
+        pos = append(line, pos, tags[entry->level], strlen(tags[entry->level]));
+    }
+
+    for (const char* p = entry->format; *p; ) {
+        const char* literal = p;
+        while (*p && *p != '%') p++;
+        pos = append(line, pos, literal, (size_t)(p - literal));
+        if (!*p) break;
+
+        p++;
+        if (*p == '%') {
+            pos = append(line, pos, "%", 1);
+            p++;
+            continue;
+        }
+
+        spec_t spec;
+        p = parse_spec(p, &spec);
+
+        uint8_t tag;
+        uint64_t value = 0;
+        const char* str = NULL;
+        uint16_t len = 0;
+        int star_width = 0, star_precision = 0;
+        bool ok = true;
+        if (spec.star_width) {
+            ok = take(&reader, &tag, &value, &str, &len);
+            star_width = (int)(int64_t)value;
+        }
+        if (ok && spec.star_precision) {
+            ok = take(&reader, &tag, &value, &str, &len);
+            star_precision = (int)(int64_t)value;
+        }
+        if (!ok || !take(&reader, &tag, &value, &str, &len)) {
+            pos = append(line, pos, "<?>", 3);
+            continue;
+        }
+
+        // Rebuild the conversion with stars filled in and integer lengths
+        // widened to match the stored 64-bit value
+        char head[32], precision[16] = "", sub[64];
+        int n = snprintf(head, sizeof(head), "%%%.*s", (int)spec.flags_len, spec.flags);
+        if (spec.star_width) {
+            snprintf(head + n, sizeof(head) - n, "%d", star_width);
+        } else if (spec.width) {
+            snprintf(head + n, sizeof(head) - n, "%.*s", (int)spec.width_len, spec.width);
+        }
+        int precision_value = -1;
+        if (spec.star_precision) {
+            precision_value = star_precision;
+        } else if (spec.has_precision) {
+            precision_value = spec.precision ? atoi(spec.precision) : 0;
+        }
+        if (precision_value >= 0) snprintf(precision, sizeof(precision), ".%d", precision_value);
+
+        char* out = line + pos;
+        size_t room = LINE_SIZE - pos;
+        int written_chars = -1;
+        switch (tag) {
+            case ARG_INT:
+                if (spec.conversion == 'c') {
+                    snprintf(sub, sizeof(sub), "%sc", head);
+                    written_chars = snprintf(out, room, sub, (int)(int64_t)value);
+                } else {
+                    snprintf(sub, sizeof(sub), "%s%sll%c", head, precision, spec.conversion);
+                    written_chars = snprintf(out, room, sub, (long long)value);
+                }
+                break;
+            case ARG_UINT:
+                snprintf(sub, sizeof(sub), "%s%sll%c", head, precision, spec.conversion);
+                written_chars = snprintf(out, room, sub, (unsigned long long)value);
+                break;
+            case ARG_DOUBLE: {
+                double d;
+                memcpy(&d, &value, sizeof(d));
+                snprintf(sub, sizeof(sub), "%s%s%c", head, precision, spec.conversion);
+                written_chars = snprintf(out, room, sub, d);
+                break;
+            }
+            case ARG_PTR:
+                snprintf(sub, sizeof(sub), "%sp", head);
+                written_chars = snprintf(out, room, sub, (void*)(uintptr_t)value);
+                break;
+            case ARG_STR:
+                // The stored copy is not terminated
+                if (precision_value >= 0 && precision_value < len) len = (uint16_t)precision_value;
+                snprintf(sub, sizeof(sub), "%s.*s", head);
+                written_chars = snprintf(out, room, sub, (int)len, str);
+                break;
+        }
+        pos = advance(pos, written_chars);
+    }
+
+    if (entry->truncated) pos = append(line, pos, " ...", 4);
+    line[pos++] = '\n';
+    line[pos] = '\0';
+    return pos;
+}
+
+static void emit(const log_entry_t* entry) {
+    char line[LINE_SIZE + 1];
+    size_t n = render(entry, line);
+
+    FILE* out = entry->level >= LOG_LEVEL_WARN ?
+        (config.error_output ? config.error_output : stderr) :
+        (config.output ? config.output : stdout);
+
+    pthread_mutex_lock(&output_mutex);
+    fwrite(line, 1, n, out);
+    pthread_mutex_unlock(&output_mutex);
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Per-thread rings
+// ---------------------------------------------------------------------------
+
+static void ring_release(void* arg) {
+    log_ring_t* ring = arg;
+    atomic_store_explicit(&ring->owned, false, memory_order_release);
+}
+
+static void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+// Take over the ring of a thread that exited, or add a new one. Rings are
+// never freed; there are as many as threads ever logged at once.
+static log_ring_t* ring_acquire(void) {
+    pthread_once(&ring_key_once, ring_key_create);
+
+    log_ring_t* ring;
+    for (ring = atomic_load(&rings); ring; ring = ring->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&ring->owned, &expected, true)) break;
+    }
+
+    if (!ring) {
+        size_t size = (sizeof(log_ring_t) + 63) / 64 * 64;
+        ring = aligned_alloc(64, size);
+        if (!ring) return NULL;
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->dropped, 0);
+        atomic_init(&ring->owned, true);
+
+        ring->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+        }
+        atomic_fetch_add(&ring_count, 1);
+    }
+
+    pthread_setspecific(ring_key, ring);
+    my_ring = ring;
+    return ring;
+}
+
+typedef struct {
+    log_ring_t* ring;
+    size_t tail;
+    size_t head;
+} cursor_t;
+
+// Write out everything in the rings, oldest first across threads. Caller
+// holds drain_mutex.
+static size_t drain(void) {
+    static cursor_t* cursors = NULL;
+    static size_t capacity = 0;
+
+    size_t count = 0;
+    for (log_ring_t* ring = atomic_load(&rings); ring; ring = ring->next) {
+        if (count == capacity) {
+            size_t grown_capacity = capacity ? capacity * 2 : 16;
+            cursor_t* grown = realloc(cursors, grown_capacity * sizeof(cursor_t));
+            if (!grown) break;
+            cursors = grown;
+            capacity = grown_capacity;
+        }
+        cursors[count].ring = ring;
+        cursors[count].tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        cursors[count].head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        count++;
+    }
+
+    size_t total = 0;
+    for (;;) {
+        cursor_t* oldest = NULL;
+        for (size_t i = 0; i < count; i++) {
+            cursor_t* c = &cursors[i];
+            if (c->tail == c->head) continue;
+            if (!oldest || c->ring->entries[c->tail % RING_SLOTS].timestamp_ns <
+                           oldest->ring->entries[oldest->tail % RING_SLOTS].timestamp_ns) {
+                oldest = c;
+            }
+        }
+        if (!oldest) break;
+
+        emit(&oldest->ring->entries[oldest->tail % RING_SLOTS]);
+        oldest->tail++;
+        atomic_store_explicit(&oldest->ring->tail, oldest->tail, memory_order_release);
+        total++;
+    }
+
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < count; i++) {
+        dropped += atomic_exchange_explicit(&cursors[i].ring->dropped, 0, memory_order_relaxed);
+    }
+    if (dropped) {
+        atomic_fetch_add_explicit(&dropped_total, dropped, memory_order_relaxed);
+        log_entry_t note = { now_ns(), "log: %llu messages dropped", LOG_LEVEL_WARN, false, 0, {0} };
+        put_uint(&note, dropped);
+        emit(&note);
+    }
+
+    return total;
+}
+
+void log_write(int level, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+
+    log_ring_t* ring = NULL;
+    if (atomic_load_explicit(&writer_running, memory_order_acquire)) {
+        ring = my_ring ? my_ring : ring_acquire();
+    }
+
+    if (!ring) {
+        // Synchronous: format on the caller's thread
+        log_entry_t entry = { now_ns(), format, (uint8_t)level, false, 0, {0} };
+        capture(&entry, ap);
+        emit(&entry);
+        va_end(ap);
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= RING_SLOTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+
+    log_entry_t* entry = &ring->entries[head % RING_SLOTS];
+    entry->timestamp_ns = now_ns();
+    entry->format = format;
+    entry->level = (uint8_t)level;
+    entry->truncated = false;
+    entry->length = 0;
+    capture(entry, ap);
+    va_end(ap);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // Half full: do not wait for the writer's next tick
+    if (head + 1 - tail == RING_SLOTS / 2) {
+        pthread_cond_signal(&writer_cond);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Background writer
+// ---------------------------------------------------------------------------
+
+static void flush_outputs(void) {
+    pthread_mutex_lock(&output_mutex);
+    fflush(config.output ? config.output : stdout);
+    fflush(config.error_output ? config.error_output : stderr);
+    pthread_mutex_unlock(&output_mutex);
+}
+
+static void* writer_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&writer_mutex);
+    for (;;) {
+        uint64_t ticket = flush_requested;
+        bool stop = writer_stop;
+        pthread_mutex_unlock(&writer_mutex);
+
+        pthread_mutex_lock(&drain_mutex);
+        size_t n = drain();
+        pthread_mutex_unlock(&drain_mutex);
+        if (n || ticket) flush_outputs();
+
+        pthread_mutex_lock(&writer_mutex);
+        if (ticket > flush_done) {
+            flush_done = ticket;
+            pthread_cond_broadcast(&flush_cond);
+        }
+        if (stop) break;
+        if (n > 0 || flush_requested != ticket || writer_stop) continue;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)config.flush_interval_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+        pthread_cond_timedwait(&writer_cond, &writer_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&writer_mutex);
+
+    return NULL;
+}
+
+void log_set_level(int level) {
+    if (level < LOG_LEVEL_TRACE) level = LOG_LEVEL_TRACE;
+    if (level > LOG_LEVEL_OFF) level = LOG_LEVEL_OFF;
+    atomic_store(&log_level, level);
+}
+
+int log_get_level(void) {
+    return atomic_load(&log_level);
+}
+
+int log_parse_level(const char* name, int* level) {
+    static const char* names[] = { "trace", "debug", "info", "warn", "error", "off" };
+    if (!name || !level) return MEM_INVALID;
+
+    for (int i = 0; i <= LOG_LEVEL_OFF; i++) {
+        if (!strcmp(name, names[i])) {
+            *level = i;
+            return MEM_SUCCESS;
+        }
+    }
+    return MEM_INVALID;
+}
+
+int log_start(const log_config_t* cfg) {
+    if (atomic_load(&writer_running)) return MEM_ERROR;
+
+    log_config_t defaults = { NULL, NULL, 10, false };
+    config = cfg ? *cfg : defaults;
+    if (config.flush_interval_ms == 0) config.flush_interval_ms = defaults.flush_interval_ms;
+    start_ns = now_ns();
+    writer_stop = false;
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) return MEM_ERROR;
+    atomic_store_explicit(&writer_running, true, memory_order_release);
+    return MEM_SUCCESS;
+}
+
+void log_flush(void) {
+    if (atomic_load(&writer_running)) {
+        pthread_mutex_lock(&writer_mutex);
+        uint64_t ticket = ++flush_requested;
+        pthread_cond_signal(&writer_cond);
+        while (flush_done < ticket) {
+            pthread_cond_wait(&flush_cond, &writer_mutex);
+        }
+        pthread_mutex_unlock(&writer_mutex);
+        return;
+    }
+
+    // No writer; pick up anything left from when there was one
+    pthread_mutex_lock(&drain_mutex);
+    drain();
+    pthread_mutex_unlock(&drain_mutex);
+    flush_outputs();
+}
+
+void log_stop(void) {
+    if (!atomic_load(&writer_running)) return;
+
+    // New messages are written synchronously from here on
+    atomic_store(&writer_running, false);
+
+    pthread_mutex_lock(&writer_mutex);
+    writer_stop = true;
+    flush_requested++;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_mutex);
+    pthread_join(writer_thread, NULL);
+
+    // Callers that saw the writer running just before it stopped
+    log_flush();
+
+    pthread_mutex_lock(&output_mutex);
+    memset(&config, 0, sizeof(config));
+    pthread_mutex_unlock(&output_mutex);
+}
+
+log_stats_t log_get_stats(void) {
+    log_stats_t stats;
+    stats.written = atomic_load(&written);
+    stats.dropped = atomic_load(&dropped_total);
+    stats.rings = atomic_load(&ring_count);
+    return stats;
+}
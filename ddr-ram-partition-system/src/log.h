@@ -0,0 +1,105 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Leveled logging
+//
+// LOG_DEBUG("Wrote %zu bytes to block %u", size, id) costs a level check
+// when the level is off and, when on, a copy of the raw arguments into a
+// per-thread ring buffer: no formatting, no locks, no I/O on the caller's
+// thread. A background writer formats the messages and writes them out.
+// Until log_start() is called, and after log_stop(), messages are written
+// synchronously. Messages get a trailing newline; WARN and ERROR go to
+// the error stream.
+//
+// Levels below LOG_COMPILE_LEVEL compile to nothing: their arguments are
+// type-checked but never evaluated. Format strings must be literals, and
+// %n is not supported.
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF   5
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+typedef struct {
+    FILE* output;                   // NULL: stdout
+    FILE* error_output;             // WARN and ERROR; NULL: stderr
+    uint32_t flush_interval_ms;     // Writer wakes at least this often
+    bool timestamps;                // Prefix seconds since log_start()
+} log_config_t;
+
+typedef struct {
+    uint64_t written;
+    uint64_t dropped;               // Ring full; the caller never waits
+    uint32_t rings;                 // Threads that have logged
+} log_stats_t;
+
+extern atomic_int log_level;
+
+void log_write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_ENABLED(level) \
+    ((level) >= LOG_COMPILE_LEVEL && \
+     (level) >= atomic_load_explicit(&log_level, memory_order_relaxed))
+
+#define LOG_AT(level, ...) \
+    do { if (LOG_ENABLED(level)) log_write((level), __VA_ARGS__); } while (0)
+#define LOG_NOTHING(level, ...) \
+    do { if (0) log_write((level), __VA_ARGS__); } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) LOG_NOTHING(LOG_LEVEL_TRACE, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_NOTHING(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_NOTHING(LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_NOTHING(LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_NOTHING(LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
+
+// Runtime threshold; INFO by default
+void log_set_level(int level);
+int log_get_level(void);
+// Parse "trace", "debug", ..., "off"; MEM_INVALID if unknown
+int log_parse_level(const char* name, int* level);
+
+// Start the background writer; NULL config for the defaults
+int log_start(const log_config_t* config);
+// Write everything logged so far before returning
+void log_flush(void);
+// Flush, stop the writer and go back to synchronous output on
+// stdout/stderr
+void log_stop(void);
+log_stats_t log_get_stats(void);
+
+#endif // LOG_H
@@ -0,0 +1,218 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH        4
+#define LZ_HASH_LOG         12
+#define LZ_LAST_LITERALS    5       // The block always ends with literals
+#define LZ_MFLIMIT          12      // No match may start closer to the end
+#define LZ_MAX_OFFSET       65535
+#define LZ_SKIP_TRIGGER     6       // Misses before the scan speeds up
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// Lengths of 15 or more spill into 255-valued continuation bytes
+static inline size_t length_bytes(size_t len) {
+    return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+static inline uint8_t* put_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_capacity) {
+    if (!src || !dst) return 0;
+
+    const uint8_t* base = (const uint8_t*)src;
+    const uint8_t* ip = base;
+    const uint8_t* anchor = base;
+    const uint8_t* end = base + src_size;
+    uint8_t* op = (uint8_t*)dst;
+    uint8_t* oend = op + dst_capacity;
+    uint32_t table[1 << LZ_HASH_LOG];
+
+    if (src_size > LZ_MFLIMIT) {
+        const uint8_t* mflimit = end - LZ_MFLIMIT;
+        const uint8_t* matchlimit = end - LZ_LAST_LITERALS;
+        uint32_t misses = 0;
+
+        memset(table, 0, sizeof(table));
+        ip++;
+
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const uint8_t* ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+                // Incompressible stretches are skipped ever faster
+                ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t* mp = ip + LZ_MIN_MATCH;
+            const uint8_t* rp = ref + LZ_MIN_MATCH;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            // Compare a word at a time; the first differing byte is the
+            // lowest set byte of the xor
+            while (mp + 8 <= matchlimit) {
+                uint64_t diff = read64(mp) ^ read64(rp);
+                if (diff) {
+                    mp += __builtin_ctzll(diff) >> 3;
+                    goto match_found;
+                }
+                mp += 8;
+                rp += 8;
+            }
+#endif
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        match_found:;
+#endif
+
+            size_t literals = (size_t)(ip - anchor);
+            size_t match = (size_t)(mp - ip) - LZ_MIN_MATCH;
+            size_t need = 1 + length_bytes(literals) + literals + 2 + length_bytes(match);
+            if (need > (size_t)(oend - op)) return 0;
+
+            uint8_t* token = op++;
+            *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) op = put_length(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            uint16_t offset = (uint16_t)(ip - ref);
+            *op++ = (uint8_t)(offset & 0xff);
+            *op++ = (uint8_t)(offset >> 8);
+
+            *token |= (uint8_t)(match >= 15 ? 15 : match);
+            if (match >= 15) op = put_length(op, match - 15);
+
+            ip = mp;
+            anchor = ip;
+            if (ip < mflimit) {
+                table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+            }
+        }
+    }
+
+    size_t literals = (size_t)(end - anchor);
+    if (1 + length_bytes(literals) + literals > (size_t)(oend - op)) return 0;
+
+    *op++ = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) op = put_length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return (size_t)(op - (uint8_t*)dst);
+}
+
+size_t lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_capacity) {
+    if (!src || !dst) return 0;
+
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* iend = ip + src_size;
+    uint8_t* op = (uint8_t*)dst;
+    uint8_t* oend = op + dst_capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) return 0;
+        if (literals <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            memcpy(op, ip, 16);     // Fixed size: a couple of moves, no call
+        } else {
+            memcpy(op, ip, literals);
+        }
+        op += literals;
+        ip += literals;
+
+        // The final sequence carries literals only
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return 0;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t*)dst)) return 0;
+
+        size_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > (size_t)(oend - op)) return 0;
+
+        const uint8_t* ref = op - offset;
+        if (offset >= 8 && (size_t)(oend - op) >= match + 8) {
+            // Word copies may overshoot by up to 7 bytes, which the next
+            // sequence rewrites. Each word reads at least `offset` behind
+            // where it writes, so repeating patterns come out right.
+            uint8_t* target = op + match;
+            do {
+                memcpy(op, ref, 8);
+                op += 8;
+                ref += 8;
+            } while (op < target);
+            op = target;
+            continue;
+        }
+
+        // Overlapping copies repeat the last `offset` bytes; copy in
+        // doubling non-overlapping chunks
+        while (match > 0) {
+            size_t chunk = (size_t)(op - ref);
+            if (chunk > match) chunk = match;
+            memcpy(op, ref, chunk);
+            op += chunk;
+            match -= chunk;
+        }
+    }
+
+    return (size_t)(op - (uint8_t*)dst);
+}
@@ -0,0 +1,22 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fast LZ77 codec producing the LZ4 block format: greedy matching over a
+// 4-byte hash table, no entropy coding. Meant for compressing cold data in
+// place, where speed matters more than ratio.
+
+// Worst-case output size for `size` input bytes
+size_t lz_compress_bound(size_t size);
+
+// Returns the compressed size, or 0 if it would exceed `dst_capacity`.
+// Passing a capacity below the input size doubles as a "not worth it"
+// cut-off: compression stops as soon as the output cannot fit.
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_capacity);
+
+// Returns the decompressed size, or 0 on malformed input or overflow
+size_t lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_capacity);
+
+#endif // LZ_H
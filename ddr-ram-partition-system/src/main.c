@@ -9,6 +9,7 @@
 #include "rw_partition.h"
 #include "userspace_app.h"
 #include "config.h"
+#include "log.h"
 #include "startup_code.h"
 
 // Global memory pointers
@@ -144,6 +145,25 @@ void demo_gaming_partition(void) {
         printf("  Active Objects: %u\n", state->active_objects);
         printf("  FPS: %.2f\n", gaming_get_fps());
     }
+    
+    // Compare sequential and pipelined frame execution on a larger scene
+    for (int i = 0; i < 5000; i++) {
+        create_game_object(gaming_partition);
+    }
+    
+    gaming_pipeline_config_t config = { .frames = 240, .pipelined = false };
+    gaming_pipeline_stats_t pipeline_stats;
+    
+    printf("\nSequential frame execution:\n");
+    if (gaming_run_pipeline(&config, &pipeline_stats) == MEM_SUCCESS) {
+        print_pipeline_stats(&pipeline_stats);
+    }
+    
+    config.pipelined = true;
+    printf("\nPipelined frame execution:\n");
+    if (gaming_run_pipeline(&config, &pipeline_stats) == MEM_SUCCESS) {
+        print_pipeline_stats(&pipeline_stats);
+    }
 }
 
 void demo_rw_partition(void) {
@@ -167,7 +187,49 @@ void demo_rw_partition(void) {
         }
     }
     
+    // Read all blocks back in a single batch
+    char read_back[5][100];
+    rw_op_t ops[5];
+    size_t op_count = 0;
+    for (int i = 0; i < 5; i++) {
+        if (blocks[i]) {
+            ops[op_count++] = (rw_op_t){ RW_OP_READ, blocks[i], 0,
+                                         read_back[i], sizeof(read_back[i]), 0 };
+        }
+    }
+    printf("Batch read: %zu of %zu operations completed\n",
+           rw_submit_batch(ops, op_count), op_count);
+    
+    // Keep reading two of them, then gather the busy blocks in one place
+    for (int round = 0; round < 200; round++) {
+        rw_submit_batch(ops, op_count < 2 ? op_count : 2);
+    }
+    rw_heat_config_t heat_config = {
+        .hot_bytes = 64 * 1024,
+        .hot_min_accesses = 16,
+    };
+    printf("Placement pass: %zu blocks moved\n", rw_heat_pass(&heat_config));
+    print_rw_heatmap(64);
+    
+    // Scrub the live blocks in the background for a moment
+    rw_scrub_config_t scrub_config = {
+        .threads = 2,
+        .bandwidth_limit = 64 * 1024 * 1024,
+        .pass_interval_ms = 10,
+    };
+    if (rw_scrub_start(&scrub_config) == MEM_SUCCESS) {
+        usleep(50000);
+        rw_scrub_stop();
+        
+        rw_scrub_stats_t scrub = get_rw_scrub_stats();
+        printf("Background scrub: %llu passes, %llu blocks checked, %llu corrupted\n",
+               (unsigned long long)scrub.passes,
+               (unsigned long long)scrub.blocks_checked,
+               (unsigned long long)scrub.corruptions);
+    }
+    
     // Verify and clean up
+    rw_verify_integrity();
     for (int i = 0; i < 5; i++) {
         if (blocks[i]) {
             rw_delete_data_block(blocks[i]);
@@ -175,7 +237,12 @@ void demo_rw_partition(void) {
     }
     
     rw_defragment();
-    rw_verify_integrity();
+}
+
+// Runs on the render thread
+static void post_frame_event(void* context, uint32_t frame, uint64_t latency_ns) {
+    (void)latency_ns;
+    userspace_post_event(*(userspace_mailbox_t*)context, USERSPACE_EVENT_FRAME, frame, NULL, 0);
 }
 
 void demo_userspace_partition(void) {
@@ -185,9 +252,20 @@ void demo_userspace_partition(void) {
     
     // Start some applications
     userspace_start_app("Web Browser", APP_TYPE_GUI, 50 * 1024 * 1024);
-    userspace_start_app("Media Player", APP_TYPE_GUI, 30 * 1024 * 1024);
+    user_app_t* player = userspace_start_app("Media Player", APP_TYPE_GUI, 30 * 1024 * 1024);
     userspace_start_app("Background Service", APP_TYPE_SERVICE, 5 * 1024 * 1024);
     
+    // The game posts each frame to the media player from its render thread
+    userspace_mailbox_t player_mailbox = userspace_open_mailbox(player);
+    gaming_pipeline_config_t frames = {
+        .frames = 60,
+        .pipelined = true,
+        .on_frame = post_frame_event,
+        .on_frame_context = &player_mailbox,
+    };
+    gaming_pipeline_stats_t frame_stats;
+    gaming_run_pipeline(&frames, &frame_stats);
+    
     // Run user space operations
     for (int i = 0; i < 10; i++) {
         userspace_run_scheduler();
@@ -198,14 +276,37 @@ void demo_userspace_partition(void) {
             userspace_garbage_collect();
         }
         
+        if (i == 2) {
+            // Handled by userspace_handle_events() on the next iteration
+            const char* name = "Text Editor";
+            userspace_post_event(USERSPACE_SYSTEM_MAILBOX, USERSPACE_EVENT_START_APP,
+                                 10 * 1024 * 1024, name, strlen(name));
+        }
+        
         if (i == 5) {
             // Stop an app
-            userspace_stop_app(1001);  // File Manager
+            userspace_post_event(USERSPACE_SYSTEM_MAILBOX, USERSPACE_EVENT_STOP_APP,
+                                 1001, NULL, 0);  // File Manager
         }
         
         usleep(50000);  // 50ms delay
     }
     
+    userspace_event_t events[64];
+    uint32_t received = 0;
+    uint32_t n;
+    while ((n = userspace_receive_events(player_mailbox, events, 64)) > 0) {
+        received += n;
+    }
+    printf("Media Player received %u frame events\n", received);
+    
+    // Same apps on one worker per core for a moment
+    userspace_smp_config_t smp = { .workers = 0 };
+    if (userspace_smp_start(&smp) == MEM_SUCCESS) {
+        usleep(100000);
+        userspace_smp_stop();
+    }
+    
     // List all applications
     userspace_list_apps();
 }
@@ -222,7 +323,18 @@ void print_system_status(void) {
     printf("System Ready: %s\n", status->system_ready ? "Yes" : "No");
 }
 
-int main(void) {
+int main(int argc, char* argv[]) {
+    // Per-operation messages are DEBUG; --log-level debug shows them
+    int level = LOG_LEVEL_INFO;
+    if (argc == 3 && !strcmp(argv[1], "--log-level") &&
+        log_parse_level(argv[2], &level) == MEM_SUCCESS) {
+        log_set_level(level);
+    } else if (argc > 1) {
+        fprintf(stderr, "usage: %s [--log-level trace|debug|info|warn|error|off]\n", argv[0]);
+        return 1;
+    }
+    log_start(NULL);
+    
     printf("=== DDR RAM Partition System ===\n");
     printf("Three Partition Memory Management System\n");
     
@@ -231,6 +343,7 @@ int main(void) {
     
     // Run startup code
     startup_code();
+    log_flush();
     
     // Print memory layout
     printf("\n=== Memory Layout ===\n");
@@ -249,10 +362,14 @@ int main(void) {
            USERSPACE_PARTITION_BASE + PARTITION_SIZE - 1,
            PARTITION_SIZE / (1024 * 1024));
     
-    // Demo each partition
+    // Demo each partition; module messages are written in the background,
+    // so let them catch up before the next section
     demo_gaming_partition();
+    log_flush();
     demo_rw_partition();
+    log_flush();
     demo_userspace_partition();
+    log_flush();
     
     // Print statistics
     print_memory_stats(ddr_memory);
@@ -266,10 +383,12 @@ int main(void) {
     printf("\n=== System Shutdown ===\n");
     disable_interrupts();
     
+    gaming_shutdown();
     if (ddr_memory) {
         ddr_deinit(ddr_memory);
     }
     
+    log_stop();
     printf("System shutdown complete. Goodbye!\n");
     
     return 0;
@@ -0,0 +1,196 @@
+#include "rw_internal.h"
+#include <string.h>
+
+// Size-class allocator for RW partition memory.
+//
+// Chunks come from the partition's bump allocator and return to a free
+// list per size class, so memory released by compression (or anything
+// else that gives buffers back) is reused instead of lost. Classes are
+// 16-byte steps up to 64 bytes, then four per power of two, which keeps
+// rounding waste under 25%.
+//
+// The hot region, once placement reserves it, is a second arena carved out
+// of the partition: its chunks are only handed out by rw_alloc_hot_locked(),
+// and rw_free_locked() sends them back to its own free lists, so cold
+// allocations never land between hot blocks.
+//
+// All functions are called with the registry lock held.
+
+#define CLASS_COUNT     RW_ALLOC_CLASSES
+#define SMALL_LIMIT     64
+
+typedef struct free_chunk {
+    struct free_chunk* next;
+} free_chunk_t;
+
+typedef struct {
+    free_chunk_t* free_lists[CLASS_COUNT];
+    size_t free_bytes;
+    uint8_t* base;                  // Hot region only: its bump allocator
+    size_t size;
+    size_t used;
+} arena_t;
+
+static memory_partition_t* partition = NULL;
+static arena_t main_arena;
+static arena_t hot_arena;
+
+static unsigned size_class(size_t size, size_t* class_size) {
+    if (size <= SMALL_LIMIT) {
+        unsigned index = (unsigned)((size + 15) / 16);
+        if (index == 0) index = 1;
+        *class_size = (size_t)index * 16;
+        return index - 1;
+    }
+
+    // size is in (2^p, 2^(p+1)], split into four steps of 2^(p-2)
+    unsigned p = 63 - (unsigned)__builtin_clzll((unsigned long long)(size - 1));
+    size_t step = (size_t)1 << (p - 2);
+    size_t sub = (size - ((size_t)1 << p) + step - 1) / step;
+    *class_size = ((size_t)1 << p) + sub * step;
+    return 4 + (p - 6) * 4 + (unsigned)(sub - 1);
+}
+
+// Size of class `index`
+static void size_class_at(unsigned index, size_t* class_size) {
+    if (index < 4) {
+        *class_size = (size_t)(index + 1) * 16;
+        return;
+    }
+    unsigned p = 6 + (index - 4) / 4;
+    size_t step = (size_t)1 << (p - 2);
+    *class_size = ((size_t)1 << p) + ((index - 4) % 4 + 1) * step;
+}
+
+// Largest class that fits in `size` bytes (size >= 16)
+static unsigned size_class_below(size_t size, size_t* class_size) {
+    size_t rounded;
+    unsigned index = size_class(size, &rounded);
+    if (rounded > size) index--;
+    size_class_at(index, class_size);
+    return index;
+}
+
+void rw_alloc_reset_locked(memory_partition_t* target) {
+    partition = target;
+    memset(&main_arena, 0, sizeof(main_arena));
+    memset(&hot_arena, 0, sizeof(hot_arena));
+}
+
+size_t rw_alloc_size(size_t size) {
+    size_t class_size;
+    size_class(size, &class_size);
+    return class_size;
+}
+
+static void* arena_bump(arena_t* arena, size_t size) {
+    if (arena == &main_arena) return partition_alloc(partition, size);
+    if (size > arena->size - arena->used) return NULL;
+
+    void* ptr = arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+static void* arena_alloc(arena_t* arena, size_t size, bool zero) {
+    size_t class_size;
+    unsigned index = size_class(size, &class_size);
+
+    if (index < CLASS_COUNT && arena->free_lists[index]) {
+        free_chunk_t* chunk = arena->free_lists[index];
+        arena->free_lists[index] = chunk->next;
+        arena->free_bytes -= class_size;
+        if (zero) memset(chunk, 0, class_size);
+        return chunk;
+    }
+
+    // Fresh partition memory is already zeroed; the hot region is not
+    void* fresh = arena_bump(arena, class_size);
+    if (fresh) {
+        if (zero && arena != &main_arena) memset(fresh, 0, class_size);
+        return fresh;
+    }
+
+    // Arena exhausted: carve the chunk out of a larger free one and keep
+    // what is left over, rounded down to a class
+    for (unsigned larger = index + 1; larger < CLASS_COUNT; larger++) {
+        free_chunk_t* chunk = arena->free_lists[larger];
+        if (!chunk) continue;
+
+        size_t larger_size;
+        size_class_at(larger, &larger_size);
+        arena->free_lists[larger] = chunk->next;
+        arena->free_bytes -= larger_size;
+
+        size_t rest = larger_size - class_size;
+        if (rest >= 16) {
+            size_t rest_size;
+            unsigned rest_index = size_class_below(rest, &rest_size);
+            free_chunk_t* tail = (free_chunk_t*)((uint8_t*)chunk + class_size);
+            tail->next = arena->free_lists[rest_index];
+            arena->free_lists[rest_index] = tail;
+            arena->free_bytes += rest_size;
+        }
+
+        if (zero) memset(chunk, 0, class_size);
+        return chunk;
+    }
+    return NULL;
+}
+
+void* rw_alloc_locked(size_t size, bool zero) {
+    if (!partition || size == 0) return NULL;
+    return arena_alloc(&main_arena, size, zero);
+}
+
+void* rw_alloc_hot_locked(size_t size) {
+    if (!hot_arena.base || size == 0) return NULL;
+    return arena_alloc(&hot_arena, size, false);
+}
+
+void rw_alloc_set_hot_locked(void* base, size_t size) {
+    memset(&hot_arena, 0, sizeof(hot_arena));
+    hot_arena.base = base;
+    hot_arena.size = size;
+}
+
+static bool in_hot_arena(const void* ptr) {
+    const uint8_t* p = ptr;
+    return hot_arena.base && p >= hot_arena.base && p < hot_arena.base + hot_arena.size;
+}
+
+void rw_free_locked(void* ptr, size_t size) {
+    if (!ptr || size == 0) return;
+
+    size_t class_size;
+    unsigned index = size_class(size, &class_size);
+    if (index >= CLASS_COUNT) return;
+
+    arena_t* arena = in_hot_arena(ptr) ? &hot_arena : &main_arena;
+    free_chunk_t* chunk = ptr;
+    chunk->next = arena->free_lists[index];
+    arena->free_lists[index] = chunk;
+    arena->free_bytes += class_size;
+}
+
+size_t rw_alloc_free_bytes_locked(void) {
+    return main_arena.free_bytes;
+}
+
+size_t rw_alloc_hot_used_locked(void) {
+    return hot_arena.used - hot_arena.free_bytes;
+}
+
+unsigned rw_alloc_class(size_t size, size_t* class_size) {
+    return size_class(size, class_size);
+}
+
+size_t rw_alloc_live_bytes_locked(size_t* capacity) {
+    if (!partition) {
+        *capacity = 0;
+        return 0;
+    }
+    *capacity = partition->size;
+    // The hot region counts as one allocation, whatever it holds
+    return partition->used - main_arena.free_bytes;
+}
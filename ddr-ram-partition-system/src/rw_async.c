@@ -0,0 +1,464 @@
+#define _GNU_SOURCE
+#include "rw_async.h"
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define ASYNC_MAX_WORKERS       16
+#define ASYNC_MAX_CLIENTS       64      // Per worker
+#define ASYNC_MAX_DEPTH         65536
+#define ASYNC_DRAIN_BATCH       64      // Entries taken from a client per sweep
+#define ASYNC_SPIN_SWEEPS       2000    // Empty sweeps before a worker sleeps
+
+// Single-producer/single-consumer ring indices. The capacity is a power of
+// two and the indices run freely, so `tail - head` is the fill level.
+typedef struct {
+    _Alignas(64) atomic_uint head;      // Consumer
+    _Alignas(64) atomic_uint tail;      // Producer
+    _Alignas(64) uint32_t mask;
+} async_ring_t;
+
+typedef struct {
+    rw_async_sqe_t sqe;
+    uint64_t submit_ns;
+} async_entry_t;
+
+typedef struct async_worker async_worker_t;
+
+struct rw_async_client {
+    async_ring_t sq;                    // Client -> worker
+    async_ring_t cq;                    // Worker -> client
+    async_entry_t* sq_entries;
+    rw_async_cqe_t* cq_entries;
+    uint32_t inflight;                  // Submitted but not yet reaped
+    int event_fd;
+    rw_async_notify_fn notify;
+    void* notify_context;
+    async_worker_t* worker;
+};
+
+struct async_worker {
+    pthread_t thread;
+    // Held by the worker for each sweep, so a client is never destroyed
+    // while its rings are being served
+    pthread_mutex_t clients_lock;
+    rw_async_client_t* clients[ASYNC_MAX_CLIENTS];
+    uint32_t client_count;
+    // Sleep/wake handshake with submitters
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake_cond;
+    atomic_bool sleeping;
+    atomic_bool stop;
+};
+
+static async_worker_t workers[ASYNC_MAX_WORKERS];
+static uint32_t worker_count = 0;
+static uint32_t spin_sweeps = 0;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void ring_init(async_ring_t* ring, uint32_t capacity) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = capacity - 1;
+}
+
+static inline uint32_t ring_ready(async_ring_t* ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_acquire) -
+           atomic_load_explicit(&ring->head, memory_order_relaxed);
+}
+
+static inline uint32_t ring_space(async_ring_t* ring) {
+    return ring->mask + 1 -
+           (atomic_load_explicit(&ring->tail, memory_order_relaxed) -
+            atomic_load_explicit(&ring->head, memory_order_acquire));
+}
+
+// --- Operation execution ---------------------------------------------------
+
+static void complete(rw_async_cqe_t* cqe, const rw_async_sqe_t* sqe, int result, size_t bytes) {
+    cqe->user_data = sqe->user_data;
+    cqe->result = result;
+    cqe->block_id = sqe->block_id;
+    cqe->bytes = bytes;
+    cqe->checksum = 0;
+}
+
+// Called from run_batch(), inside its read section
+static void run_checksum(const rw_async_sqe_t* sqe, rw_async_cqe_t* cqe) {
+    data_block_t* block = rw_get_block(sqe->block_id);
+    if (!block) {
+        complete(cqe, sqe, MEM_INVALID, 0);
+        return;
+    }
+
+    if (!rw_block_acquire(block)) {
+        complete(cqe, sqe, MEM_FULL, 0);
+        return;
+    }
+
+    // Compare against a checksum that belongs to the same contents
+    uint32_t version, stored, actual;
+    do {
+        version = rw_block_read_stable(block);
+        stored = block->checksum;
+        actual = rw_block_checksum(block);
+    } while (!rw_block_read_valid(block, version));
+    rw_block_release(block);
+
+    complete(cqe, sqe, stored == actual ? MEM_SUCCESS : MEM_ERROR, block->size);
+    cqe->checksum = actual;
+}
+
+// Reads and writes are looked up under one registry lock and handed to
+// rw_submit_batch() together; the other opcodes run one at a time. Entries
+// keep their submission order. Blocks found here are not freed before the
+// batch is done, even if another client deletes them.
+static void run_batch(const async_entry_t* entries, uint32_t count, rw_async_cqe_t* cqes) {
+    rw_op_t ops[ASYNC_DRAIN_BATCH];
+    uint64_t epoch = rw_epoch_enter();
+
+    for (uint32_t i = 0; i < count; ) {
+        const rw_async_sqe_t* sqe = &entries[i].sqe;
+
+        if (sqe->opcode == RW_ASYNC_READ || sqe->opcode == RW_ASYNC_WRITE) {
+            uint32_t run = 0;
+
+            rw_registry_lock();
+            while (i + run < count &&
+                   (entries[i + run].sqe.opcode == RW_ASYNC_READ ||
+                    entries[i + run].sqe.opcode == RW_ASYNC_WRITE)) {
+                const rw_async_sqe_t* s = &entries[i + run].sqe;
+                ops[run].type = s->opcode == RW_ASYNC_WRITE ? RW_OP_WRITE : RW_OP_READ;
+                ops[run].block = rw_index_lookup_locked(s->block_id);
+                ops[run].offset = s->offset;
+                ops[run].buffer = s->buffer;
+                ops[run].size = s->size;
+                run++;
+            }
+            rw_registry_unlock();
+
+            rw_submit_batch(ops, run);
+
+            for (uint32_t k = 0; k < run; k++) {
+                int result = ops[k].block ? MEM_SUCCESS : MEM_INVALID;
+                if (ops[k].block && ops[k].result == 0) result = MEM_INVALID;
+                complete(&cqes[i + k], &entries[i + k].sqe, result, ops[k].result);
+            }
+            i += run;
+            continue;
+        }
+
+        switch (sqe->opcode) {
+            case RW_ASYNC_CREATE: {
+                data_block_t* block = rw_block_create(sqe->size);
+                complete(&cqes[i], sqe, block ? MEM_SUCCESS : MEM_FULL, 0);
+                cqes[i].block_id = block ? block->id : 0;
+                break;
+            }
+            case RW_ASYNC_DELETE: {
+                data_block_t* block = rw_get_block(sqe->block_id);
+                rw_block_destroy(block);
+                complete(&cqes[i], sqe, block ? MEM_SUCCESS : MEM_INVALID, 0);
+                break;
+            }
+            case RW_ASYNC_CHECKSUM:
+                run_checksum(sqe, &cqes[i]);
+                break;
+            default:
+                complete(&cqes[i], sqe, MEM_INVALID, 0);
+                break;
+        }
+        i++;
+    }
+    rw_epoch_exit(epoch);
+}
+
+// Serve up to one batch from a client. Never takes more submissions than
+// the completion ring has room for.
+static uint32_t drain_client(rw_async_client_t* client) {
+    uint32_t n = ring_ready(&client->sq);
+    uint32_t space = ring_space(&client->cq);
+    if (n > space) n = space;
+    if (n > ASYNC_DRAIN_BATCH) n = ASYNC_DRAIN_BATCH;
+    if (n == 0) return 0;
+
+    async_entry_t entries[ASYNC_DRAIN_BATCH];
+    rw_async_cqe_t cqes[ASYNC_DRAIN_BATCH];
+
+    uint32_t head = atomic_load_explicit(&client->sq.head, memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        entries[i] = client->sq_entries[(head + i) & client->sq.mask];
+    }
+    atomic_store_explicit(&client->sq.head, head + n, memory_order_release);
+
+    run_batch(entries, n, cqes);
+
+    uint64_t done = now_ns();
+    uint32_t tail = atomic_load_explicit(&client->cq.tail, memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        cqes[i].latency_ns = done - entries[i].submit_ns;
+        client->cq_entries[(tail + i) & client->cq.mask] = cqes[i];
+    }
+    atomic_store_explicit(&client->cq.tail, tail + n, memory_order_release);
+
+    if (client->notify) client->notify(client->notify_context, cqes, n);
+    if (client->event_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(client->event_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    return n;
+}
+
+static bool worker_has_work(async_worker_t* worker) {
+    bool pending = false;
+
+    pthread_mutex_lock(&worker->clients_lock);
+    for (uint32_t i = 0; i < worker->client_count && !pending; i++) {
+        pending = ring_ready(&worker->clients[i]->sq) > 0;
+    }
+    pthread_mutex_unlock(&worker->clients_lock);
+
+    return pending;
+}
+
+static void* async_worker(void* arg) {
+    async_worker_t* worker = arg;
+    uint32_t idle = 0;
+
+    while (!atomic_load_explicit(&worker->stop, memory_order_relaxed)) {
+        uint32_t served = 0;
+
+        pthread_mutex_lock(&worker->clients_lock);
+        for (uint32_t i = 0; i < worker->client_count; i++) {
+            served += drain_client(worker->clients[i]);
+        }
+        pthread_mutex_unlock(&worker->clients_lock);
+
+        if (served) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < spin_sweeps) {
+            sched_yield();
+            continue;
+        }
+
+        // Announce the sleep before the last look at the rings; submitters
+        // publish before they check `sleeping`, so a wakeup is never lost
+        pthread_mutex_lock(&worker->wake_mutex);
+        atomic_store(&worker->sleeping, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!atomic_load(&worker->stop) && !worker_has_work(worker)) {
+            pthread_cond_wait(&worker->wake_cond, &worker->wake_mutex);
+        }
+        atomic_store(&worker->sleeping, false);
+        pthread_mutex_unlock(&worker->wake_mutex);
+        idle = 0;
+    }
+
+    return NULL;
+}
+
+// --- Worker pool -----------------------------------------------------------
+
+int rw_async_start(uint32_t count) {
+    if (count == 0 || count > ASYNC_MAX_WORKERS) return MEM_INVALID;
+
+    pthread_mutex_lock(&pool_mutex);
+    if (worker_count) {
+        pthread_mutex_unlock(&pool_mutex);
+        return MEM_ERROR;
+    }
+
+    spin_sweeps = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? ASYNC_SPIN_SWEEPS : 0;
+
+    uint32_t started = 0;
+    for (; started < count; started++) {
+        async_worker_t* worker = &workers[started];
+        memset(worker, 0, sizeof(*worker));
+        pthread_mutex_init(&worker->clients_lock, NULL);
+        pthread_mutex_init(&worker->wake_mutex, NULL);
+        pthread_cond_init(&worker->wake_cond, NULL);
+        atomic_init(&worker->sleeping, false);
+        atomic_init(&worker->stop, false);
+
+        if (pthread_create(&worker->thread, NULL, async_worker, worker) != 0) break;
+    }
+    worker_count = started;
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (started < count) {
+        rw_async_stop();
+        return MEM_ERROR;
+    }
+
+    LOG_INFO("Async RW workers started (%u threads)", count);
+    return MEM_SUCCESS;
+}
+
+// Workers finish the sweep they are in; queued entries are left unserved.
+// Clients must be destroyed separately.
+void rw_async_stop(void) {
+    pthread_mutex_lock(&pool_mutex);
+
+    for (uint32_t i = 0; i < worker_count; i++) {
+        async_worker_t* worker = &workers[i];
+        pthread_mutex_lock(&worker->wake_mutex);
+        atomic_store(&worker->stop, true);
+        pthread_cond_signal(&worker->wake_cond);
+        pthread_mutex_unlock(&worker->wake_mutex);
+    }
+    for (uint32_t i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    worker_count = 0;
+
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+// --- Clients ---------------------------------------------------------------
+
+rw_async_client_t* rw_async_client_create(uint32_t queue_depth, bool use_eventfd) {
+    if (queue_depth == 0 || queue_depth > ASYNC_MAX_DEPTH) return NULL;
+
+    uint32_t depth = 1;
+    while (depth < queue_depth) depth <<= 1;
+
+    rw_async_client_t* client = aligned_alloc(64, sizeof(rw_async_client_t));
+    if (!client) return NULL;
+    memset(client, 0, sizeof(*client));
+
+    ring_init(&client->sq, depth);
+    ring_init(&client->cq, depth);
+    client->sq_entries = malloc(depth * sizeof(async_entry_t));
+    client->cq_entries = malloc(depth * sizeof(rw_async_cqe_t));
+    client->event_fd = use_eventfd ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+
+    if (!client->sq_entries || !client->cq_entries || (use_eventfd && client->event_fd < 0)) {
+        rw_async_client_destroy(client);
+        return NULL;
+    }
+
+    // Attach to the worker serving the fewest clients
+    pthread_mutex_lock(&pool_mutex);
+    async_worker_t* target = NULL;
+    for (uint32_t i = 0; i < worker_count; i++) {
+        if (workers[i].client_count < ASYNC_MAX_CLIENTS &&
+            (!target || workers[i].client_count < target->client_count)) {
+            target = &workers[i];
+        }
+    }
+    if (target) {
+        pthread_mutex_lock(&target->clients_lock);
+        target->clients[target->client_count++] = client;
+        pthread_mutex_unlock(&target->clients_lock);
+        client->worker = target;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (!target) {
+        rw_async_client_destroy(client);
+        return NULL;
+    }
+    return client;
+}
+
+void rw_async_client_destroy(rw_async_client_t* client) {
+    if (!client) return;
+
+    async_worker_t* worker = client->worker;
+    if (worker) {
+        pthread_mutex_lock(&pool_mutex);
+        pthread_mutex_lock(&worker->clients_lock);
+        for (uint32_t i = 0; i < worker->client_count; i++) {
+            if (worker->clients[i] == client) {
+                worker->clients[i] = worker->clients[--worker->client_count];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&worker->clients_lock);
+        pthread_mutex_unlock(&pool_mutex);
+    }
+
+    if (client->event_fd >= 0) close(client->event_fd);
+    free(client->sq_entries);
+    free(client->cq_entries);
+    free(client);
+}
+
+void rw_async_set_notify(rw_async_client_t* client, rw_async_notify_fn notify, void* context) {
+    if (!client) return;
+    client->notify = notify;
+    client->notify_context = context;
+}
+
+// Only the client's own thread may submit and poll
+uint32_t rw_async_submit(rw_async_client_t* client, const rw_async_sqe_t* sqes, uint32_t count) {
+    if (!client || !sqes || count == 0) return 0;
+
+    // In-flight entries hold a completion slot, so completions always fit
+    uint32_t capacity = client->sq.mask + 1;
+    uint32_t room = capacity - client->inflight;
+    if (count > room) count = room;
+    if (count == 0) return 0;
+
+    uint64_t now = now_ns();
+    uint32_t tail = atomic_load_explicit(&client->sq.tail, memory_order_relaxed);
+    for (uint32_t i = 0; i < count; i++) {
+        async_entry_t* entry = &client->sq_entries[(tail + i) & client->sq.mask];
+        entry->sqe = sqes[i];
+        entry->submit_ns = now;
+    }
+    atomic_store_explicit(&client->sq.tail, tail + count, memory_order_release);
+    client->inflight += count;
+
+    async_worker_t* worker = client->worker;
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&worker->sleeping)) {
+        pthread_mutex_lock(&worker->wake_mutex);
+        pthread_cond_signal(&worker->wake_cond);
+        pthread_mutex_unlock(&worker->wake_mutex);
+    }
+
+    return count;
+}
+
+uint32_t rw_async_poll(rw_async_client_t* client, rw_async_cqe_t* cqes, uint32_t max) {
+    if (!client || !cqes || max == 0) return 0;
+
+    uint32_t n = ring_ready(&client->cq);
+    if (n > max) n = max;
+    if (n == 0) return 0;
+
+    uint32_t head = atomic_load_explicit(&client->cq.head, memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        cqes[i] = client->cq_entries[(head + i) & client->cq.mask];
+    }
+    atomic_store_explicit(&client->cq.head, head + n, memory_order_release);
+    client->inflight -= n;
+
+    return n;
+}
+
+uint32_t rw_async_inflight(const rw_async_client_t* client) {
+    return client ? client->inflight : 0;
+}
+
+int rw_async_eventfd(const rw_async_client_t* client) {
+    return client ? client->event_fd : -1;
+}
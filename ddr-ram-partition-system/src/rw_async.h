@@ -0,0 +1,65 @@
+#ifndef RW_ASYNC_H
+#define RW_ASYNC_H
+
+#include "rw_partition.h"
+
+// Asynchronous RW partition operations
+//
+// Each client owns a submission ring and a completion ring, both
+// single-producer/single-consumer and lock-free. Worker threads drain the
+// submission rings of the clients assigned to them, run the operations and
+// post completions carrying the caller's tag and the submit-to-complete
+// latency. Completions are reaped by polling, or by waiting on the
+// client's eventfd.
+
+typedef enum {
+    RW_ASYNC_CREATE,        // size = block size; completion carries block_id
+    RW_ASYNC_WRITE,
+    RW_ASYNC_READ,
+    RW_ASYNC_DELETE,
+    RW_ASYNC_CHECKSUM       // Recompute and compare with the stored checksum
+} rw_async_opcode_t;
+
+typedef struct {
+    rw_async_opcode_t opcode;
+    uint32_t block_id;
+    size_t offset;
+    void* buffer;           // Source for writes, destination for reads
+    size_t size;
+    uint64_t user_data;     // Returned untouched in the completion
+} rw_async_sqe_t;
+
+typedef struct {
+    uint64_t user_data;
+    int result;             // MEM_SUCCESS, MEM_INVALID (no such block), ...
+    uint32_t block_id;
+    size_t bytes;           // Bytes transferred
+    uint32_t checksum;      // RW_ASYNC_CHECKSUM: recomputed value
+    uint64_t latency_ns;    // Submission to completion
+} rw_async_cqe_t;
+
+typedef struct rw_async_client rw_async_client_t;
+
+// Called on the worker thread with each batch of completions as it is
+// posted, e.g. to forward them as events; they are still to be polled
+typedef void (*rw_async_notify_fn)(void* context, const rw_async_cqe_t* cqes, uint32_t count);
+
+// Worker pool
+int rw_async_start(uint32_t workers);
+void rw_async_stop(void);
+
+// `queue_depth` is rounded up to a power of two and bounds the number of
+// operations in flight. With `use_eventfd` the client's eventfd is
+// signalled whenever completions are posted.
+rw_async_client_t* rw_async_client_create(uint32_t queue_depth, bool use_eventfd);
+void rw_async_client_destroy(rw_async_client_t* client);
+// Set before the client's first submission
+void rw_async_set_notify(rw_async_client_t* client, rw_async_notify_fn notify, void* context);
+
+// Returns how many entries were queued (fewer when the client is full)
+uint32_t rw_async_submit(rw_async_client_t* client, const rw_async_sqe_t* sqes, uint32_t count);
+uint32_t rw_async_poll(rw_async_client_t* client, rw_async_cqe_t* cqes, uint32_t max);
+uint32_t rw_async_inflight(const rw_async_client_t* client);
+int rw_async_eventfd(const rw_async_client_t* client);
+
+#endif // RW_ASYNC_H
@@ -0,0 +1,105 @@
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// RW partition data paths on the benchmark harness. Blocks and buffers are
+// set up before timing starts, and operations go through rw_submit_batch()
+// so nothing is logged inside the timed region.
+
+typedef struct {
+    data_block_t* block;
+    uint8_t* buffer;
+    size_t size;
+} rw_bench_case_t;
+
+static void bench_write(void* context, uint64_t iterations) {
+    rw_bench_case_t* c = context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        c->buffer[0] = (uint8_t)i;
+        rw_op_t op = { RW_OP_WRITE, c->block, 0, c->buffer, c->size, 0 };
+        rw_submit_batch(&op, 1);
+    }
+}
+
+static void bench_read(void* context, uint64_t iterations) {
+    rw_bench_case_t* c = context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        rw_op_t op = { RW_OP_READ, c->block, 0, c->buffer, c->size, 0 };
+        rw_submit_batch(&op, 1);
+        bench_do_not_optimize(c->buffer);
+    }
+}
+
+// Zero-copy access: borrow the block and touch every cache line
+static void bench_borrow(void* context, uint64_t iterations) {
+    rw_bench_case_t* c = context;
+    uint8_t sink = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        rw_view_t view;
+        if (rw_borrow(c->block, 0, c->size, &view) != MEM_SUCCESS) break;
+        for (size_t k = 0; k < view.size; k += 64) {
+            sink ^= view.data[k];
+        }
+        rw_release(&view);
+    }
+    bench_do_not_optimize(&sink);
+}
+
+static void bench_checksum(void* context, uint64_t iterations) {
+    rw_bench_case_t* c = context;
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint32_t checksum = rw_block_checksum(c->block);
+        bench_do_not_optimize(&checksum);
+    }
+}
+
+size_t rw_benchmark_sizes(const size_t* sizes, size_t count, const bench_config_t* config,
+                          bench_report_t* report) {
+    static const struct {
+        const char* name;
+        bench_fn_t fn;
+    } cases[] = {
+        { "rw_write", bench_write },
+        { "rw_read", bench_read },
+        { "rw_borrow", bench_borrow },
+        { "rw_checksum", bench_checksum },
+    };
+
+    _Static_assert(sizeof(cases) / sizeof(cases[0]) == RW_BENCH_CASES,
+                   "RW_BENCH_CASES must match the case table");
+    if (!sizes || !config || !report) return 0;
+
+    size_t done = 0;
+    for (size_t s = 0; s < count; s++) {
+        rw_bench_case_t c = { rw_block_create(sizes[s]), malloc(sizes[s]), sizes[s] };
+        if (!c.block || !c.buffer) {
+            LOG_WARN("RW benchmark: no room for a %zu byte block", sizes[s]);
+            rw_block_destroy(c.block);
+            free(c.buffer);
+            continue;
+        }
+
+        // Distinct contents, so dedup has nothing to share
+        for (size_t k = 0; k < c.size; k++) {
+            c.buffer[k] = (uint8_t)(k * 31 + s);
+        }
+        rw_op_t fill = { RW_OP_WRITE, c.block, 0, c.buffer, c.size, 0 };
+        rw_submit_batch(&fill, 1);
+
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            bench_result_t result;
+            if (bench_run(config, cases[i].name, c.size, cases[i].fn, &c, &result) == MEM_SUCCESS) {
+                bench_report_add(report, &result);
+                done++;
+            }
+        }
+
+        rw_block_destroy(c.block);
+        free(c.buffer);
+    }
+
+    return done;
+}
@@ -0,0 +1,375 @@
+#define _GNU_SOURCE
+#include "rw_internal.h"
+#include "lz.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define COMPRESS_BATCH  64      // Blocks taken from the registry at a time
+
+// Compression swaps block->data for a packed buffer and frees the raw
+// memory, so it must never run while someone uses the data. Accessors pin
+// the block and then look at its state; the compressor claims the state
+// and then looks at the pins. With both sides sequentially consistent, at
+// least one of them sees the other and backs off.
+
+static rw_compress_stats_t stats = {0};
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Background compressor
+static pthread_t compress_thread;
+static bool compress_running = false;
+static atomic_bool compress_stop_flag;
+static pthread_mutex_t compress_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compress_wait_cond = PTHREAD_COND_INITIALIZER;
+static rw_compress_config_t compress_config;
+
+static int ratio_bucket(size_t raw, size_t packed) {
+    double ratio = (double)raw / (double)packed;
+    if (ratio < 1.5) return 0;
+    if (ratio < 2.0) return 1;
+    if (ratio < 4.0) return 2;
+    if (ratio < 8.0) return 3;
+    return 4;
+}
+
+static void account_packed(const data_block_t* block, bool packed) {
+    size_t stored = rw_alloc_size(block->packed_size);
+
+    pthread_mutex_lock(&stats_mutex);
+    if (packed) {
+        stats.compressions++;
+        stats.blocks_compressed++;
+        stats.raw_bytes += block->size;
+        stats.packed_bytes += stored;
+        stats.ratio_histogram[ratio_bucket(block->size, stored)]++;
+    } else {
+        stats.decompressions++;
+        stats.blocks_compressed--;
+        stats.raw_bytes -= block->size;
+        stats.packed_bytes -= stored;
+        stats.ratio_histogram[ratio_bucket(block->size, stored)]--;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Called by the thread that moved the block to RW_BLOCK_DECOMPRESSING
+static bool block_decompress(data_block_t* block) {
+    uint8_t* data = rw_alloc_or_reclaim(block->size, false);
+    if (!data) return false;
+
+    size_t n = lz_decompress(block->packed, block->packed_size, data, block->size);
+    if (n != block->size) {
+        // Leave the damage to the checksum to report
+        LOG_ERROR("RW compression: block %u failed to decompress", block->id);
+        memset(data + n, 0, block->size - n);
+    }
+
+    account_packed(block, false);
+
+    rw_registry_lock();
+    rw_free_locked(block->packed, block->packed_size);
+    rw_registry_unlock();
+
+    block->data = data;
+    block->packed = NULL;
+    block->packed_size = 0;
+    return true;
+}
+
+// Pin the block and bring its data back; `touch` counts it as an access
+static bool block_pin(data_block_t* block, bool touch) {
+    atomic_fetch_add(&block->pins, 1);
+    if (touch) rw_block_touch(block);
+
+    for (;;) {
+        uint32_t state = atomic_load(&block->state);
+        if (state == RW_BLOCK_RAW) return true;
+
+        if (state == RW_BLOCK_COMPRESSED) {
+            uint32_t expected = RW_BLOCK_COMPRESSED;
+            if (atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_DECOMPRESSING)) {
+                if (block_decompress(block)) {
+                    atomic_store(&block->state, RW_BLOCK_RAW);
+                    return true;
+                }
+                // No room to unpack it; the access fails
+                atomic_store(&block->state, RW_BLOCK_COMPRESSED);
+                atomic_fetch_sub(&block->pins, 1);
+                return false;
+            }
+            continue;
+        }
+
+        if (state == RW_BLOCK_SPILLED) {
+            uint32_t expected = RW_BLOCK_SPILLED;
+            if (atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_FAULTING)) {
+                state = rw_tier_fault(block);
+                atomic_store(&block->state, state);
+                if (state == RW_BLOCK_SPILLED) {
+                    atomic_fetch_sub(&block->pins, 1);
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        // Being moved by another thread; wait for it to settle
+        sched_yield();
+    }
+}
+
+bool rw_block_acquire(data_block_t* block) {
+    return block_pin(block, true);
+}
+
+bool rw_block_acquire_quiet(data_block_t* block) {
+    return block_pin(block, false);
+}
+
+bool rw_block_try_acquire_raw(data_block_t* block) {
+    atomic_fetch_add(&block->pins, 1);
+    if (atomic_load(&block->state) == RW_BLOCK_RAW) return true;
+
+    atomic_fetch_sub(&block->pins, 1);
+    return false;
+}
+
+void rw_compress_drop(data_block_t* block) {
+    if (atomic_load(&block->state) != RW_BLOCK_COMPRESSED) return;
+
+    account_packed(block, false);
+
+    rw_registry_lock();
+    rw_free_locked(block->packed, block->packed_size);
+    rw_registry_unlock();
+
+    block->packed = NULL;
+    block->packed_size = 0;
+}
+
+void rw_block_release(data_block_t* block) {
+    atomic_fetch_sub_explicit(&block->pins, 1, memory_order_release);
+}
+
+typedef enum {
+    PACK_SKIPPED,
+    PACK_DONE,
+    PACK_INCOMPRESSIBLE
+} pack_result_t;
+
+static pack_result_t try_compress(data_block_t* block, const rw_compress_config_t* config,
+                                  uint8_t* scratch, uint64_t now) {
+    if (block->size < config->min_block_size) return PACK_SKIPPED;
+    if (atomic_load(&block->state) != RW_BLOCK_RAW) return PACK_SKIPPED;
+    if (atomic_load(&block->pins) != 0) return PACK_SKIPPED;
+    if (now - atomic_load_explicit(&block->last_access_ms, memory_order_relaxed) <
+        config->cold_after_ms) {
+        return PACK_SKIPPED;
+    }
+    // Unflushed journal data is about to be read by the checkpointer
+    if (rw_journal_active() && atomic_load(&block->dirty)) return PACK_SKIPPED;
+
+    uint32_t version = rw_block_read_begin(block);
+    if ((version & 1) || block->skip_version == version + 1) return PACK_SKIPPED;
+
+    uint32_t expected = RW_BLOCK_RAW;
+    if (!atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_COMPRESSING)) {
+        return PACK_SKIPPED;
+    }
+    // Storage shared with other blocks stays put
+    if (atomic_load(&block->pins) != 0 || !rw_dedup_detach(block)) {
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return PACK_SKIPPED;
+    }
+
+    // Judge the savings by what the allocator will actually hand out
+    size_t limit = block->size - block->size * config->min_savings_percent / 100;
+    size_t packed = lz_compress(block->data, block->size, scratch, limit);
+    if (packed == 0 || rw_alloc_size(packed) > limit) {
+        block->skip_version = version + 1;
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return PACK_INCOMPRESSIBLE;
+    }
+
+    rw_registry_lock();
+    uint8_t* buffer = rw_alloc_locked(packed, false);
+    rw_registry_unlock();
+    if (!buffer) {
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return PACK_SKIPPED;
+    }
+    memcpy(buffer, scratch, packed);
+
+    uint8_t* raw = block->data;
+    rw_block_write_begin(block);
+    block->packed = buffer;
+    block->packed_size = (uint32_t)packed;
+    block->data = NULL;
+    rw_block_write_end(block);
+
+    rw_registry_lock();
+    rw_free_locked(raw, block->size);
+    rw_registry_unlock();
+
+    account_packed(block, true);
+    atomic_store(&block->state, RW_BLOCK_COMPRESSED);
+    return PACK_DONE;
+}
+
+size_t rw_compress_pass(const rw_compress_config_t* config) {
+    if (!config) return 0;
+
+    data_block_t* batch[COMPRESS_BATCH];
+    uint8_t* scratch = NULL;
+    size_t scratch_size = 0;
+    size_t compressed = 0, incompressible = 0;
+    uint64_t now = rw_coarse_ms();
+    size_t n;
+
+    for (size_t start = 0; !atomic_load(&compress_stop_flag); start += n) {
+        // Blocks of the batch deleted meanwhile stay allocated until it is done
+        uint64_t epoch = rw_epoch_enter();
+        n = rw_registry_snapshot(start, batch, COMPRESS_BATCH);
+        if (n == 0) {
+            rw_epoch_exit(epoch);
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i]->size > scratch_size) {
+                uint8_t* grown = realloc(scratch, batch[i]->size);
+                if (!grown) continue;
+                scratch = grown;
+                scratch_size = batch[i]->size;
+            }
+
+            switch (try_compress(batch[i], config, scratch, now)) {
+                case PACK_DONE:
+                    compressed++;
+                    break;
+                case PACK_INCOMPRESSIBLE:
+                    incompressible++;
+                    break;
+                case PACK_SKIPPED:
+                    break;
+            }
+        }
+        rw_epoch_exit(epoch);
+    }
+
+    free(scratch);
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.incompressible += incompressible;
+    pthread_mutex_unlock(&stats_mutex);
+
+    return compressed;
+}
+
+static void* compress_background(void* arg) {
+    (void)arg;
+
+#ifdef SCHED_IDLE
+    struct sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    while (!atomic_load(&compress_stop_flag)) {
+        rw_compress_pass(&compress_config);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)compress_config.scan_interval_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+
+        pthread_mutex_lock(&compress_wait_mutex);
+        while (!atomic_load(&compress_stop_flag)) {
+            if (pthread_cond_timedwait(&compress_wait_cond, &compress_wait_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&compress_wait_mutex);
+    }
+
+    return NULL;
+}
+
+int rw_compress_start(const rw_compress_config_t* config) {
+    if (!config) return MEM_INVALID;
+    if (compress_running) return MEM_ERROR;
+
+    compress_config = *config;
+    atomic_store(&compress_stop_flag, false);
+
+    if (pthread_create(&compress_thread, NULL, compress_background, NULL) != 0) {
+        return MEM_ERROR;
+    }
+
+    compress_running = true;
+    LOG_INFO("Background compression started (cold after %u ms, min savings %u%%)",
+           config->cold_after_ms, config->min_savings_percent);
+    return MEM_SUCCESS;
+}
+
+void rw_compress_stop(void) {
+    if (!compress_running) return;
+
+    pthread_mutex_lock(&compress_wait_mutex);
+    atomic_store(&compress_stop_flag, true);
+    pthread_cond_broadcast(&compress_wait_cond);
+    pthread_mutex_unlock(&compress_wait_mutex);
+
+    pthread_join(compress_thread, NULL);
+    compress_running = false;
+    atomic_store(&compress_stop_flag, false);
+}
+
+bool rw_block_is_compressed(const data_block_t* block) {
+    return block && atomic_load(&block->state) == RW_BLOCK_COMPRESSED;
+}
+
+double rw_block_compression_ratio(const data_block_t* block) {
+    if (!rw_block_is_compressed(block) || block->packed_size == 0) return 1.0;
+    return (double)block->size / (double)block->packed_size;
+}
+
+rw_compress_stats_t* get_rw_compress_stats(void) {
+    return &stats;
+}
+
+void print_rw_compress_stats(void) {
+    static const char* buckets[RW_COMPRESS_RATIO_BUCKETS] = {
+        "<1.5x", "1.5-2x", "2-4x", "4-8x", ">=8x"
+    };
+
+    pthread_mutex_lock(&stats_mutex);
+    rw_compress_stats_t snapshot = stats;
+    pthread_mutex_unlock(&stats_mutex);
+
+    printf("\n=== RW Compression Statistics ===\n");
+    printf("Compressed blocks: %llu (%.2f MB -> %.2f MB",
+           (unsigned long long)snapshot.blocks_compressed,
+           snapshot.raw_bytes / (1024.0 * 1024.0),
+           snapshot.packed_bytes / (1024.0 * 1024.0));
+    if (snapshot.packed_bytes) {
+        printf(", %.2fx", (double)snapshot.raw_bytes / snapshot.packed_bytes);
+    }
+    printf(")\n");
+    printf("Compressions: %llu, decompressions: %llu, incompressible: %llu\n",
+           (unsigned long long)snapshot.compressions,
+           (unsigned long long)snapshot.decompressions,
+           (unsigned long long)snapshot.incompressible);
+
+    printf("Ratio histogram:");
+    for (int i = 0; i < RW_COMPRESS_RATIO_BUCKETS; i++) {
+        printf(" %s=%llu", buckets[i], (unsigned long long)snapshot.ratio_histogram[i]);
+    }
+    printf("\n");
+}
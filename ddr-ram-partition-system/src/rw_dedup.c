@@ -0,0 +1,382 @@
+#include "rw_internal.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+// Content-addressed deduplication.
+//
+// Every block written through rw_write_data() while dedup is on has its
+// storage registered as a chunk, keyed by (size, checksum type, checksum).
+// The block checksum is maintained on every write anyway, so finding
+// candidates costs nothing; a keyed SipHash-128 of the contents confirms a
+// match and is only computed once a candidate turns up. Chunks are
+// immutable: the first write to a block whose chunk has other users copies
+// it, and a block that is the sole user simply takes its chunk back.
+//
+// Lock order: the dedup lock is never held while taking the registry lock.
+
+#define DEDUP_MIN_BUCKETS 256
+
+static pthread_mutex_t dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rw_chunk_t** buckets = NULL;
+static size_t bucket_count = 0;
+static size_t chunk_count = 0;
+static uint64_t hash_key[2];
+static atomic_bool dedup_enabled = false;
+
+static inline uint64_t rotl64(uint64_t v, int bits) {
+    return (v << bits) | (v >> (64 - bits));
+}
+
+#define SIPROUND(v0, v1, v2, v3) do {                               \
+        v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32); \
+        v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2;                      \
+        v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0;                      \
+        v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32); \
+    } while (0)
+
+// SipHash-2-4 with 128-bit output
+static void siphash128(const uint8_t* data, size_t size, uint64_t out[2]) {
+    uint64_t v0 = hash_key[0] ^ 0x736f6d6570736575ull;
+    uint64_t v1 = hash_key[1] ^ 0x646f72616e646f6dull ^ 0xee;
+    uint64_t v2 = hash_key[0] ^ 0x6c7967656e657261ull;
+    uint64_t v3 = hash_key[1] ^ 0x7465646279746573ull;
+    const uint8_t* end = data + (size & ~(size_t)7);
+
+    for (const uint8_t* p = data; p < end; p += 8) {
+        uint64_t m;
+        memcpy(&m, p, sizeof(m));
+        v3 ^= m;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t last = (uint64_t)size << 56;
+    for (size_t i = 0; i < (size & 7); i++) {
+        last |= (uint64_t)end[i] << (8 * i);
+    }
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xee;
+    for (int i = 0; i < 4; i++) SIPROUND(v0, v1, v2, v3);
+    out[0] = v0 ^ v1 ^ v2 ^ v3;
+
+    v1 ^= 0xdd;
+    for (int i = 0; i < 4; i++) SIPROUND(v0, v1, v2, v3);
+    out[1] = v0 ^ v1 ^ v2 ^ v3;
+}
+
+static inline size_t bucket_of(size_t size, rw_checksum_type_t type, uint32_t checksum) {
+    uint64_t key = ((uint64_t)checksum << 32) ^ (uint64_t)size ^ ((uint64_t)type << 31);
+    key *= 0x9E3779B97F4A7C15ull;
+    return (size_t)(key >> 32) & (bucket_count - 1);
+}
+
+static inline bool chunk_matches(const rw_chunk_t* chunk, size_t size,
+                                 rw_checksum_type_t type, uint32_t checksum) {
+    return chunk->size == size && chunk->checksum_type == type &&
+           chunk->checksum == checksum;
+}
+
+static void grow_locked(void) {
+    size_t count = bucket_count ? bucket_count * 2 : DEDUP_MIN_BUCKETS;
+    rw_chunk_t** grown = calloc(count, sizeof(rw_chunk_t*));
+    if (!grown) return;
+
+    rw_chunk_t** old = buckets;
+    size_t old_count = bucket_count;
+    buckets = grown;
+    bucket_count = count;
+
+    for (size_t i = 0; i < old_count; i++) {
+        rw_chunk_t* chunk = old[i];
+        while (chunk) {
+            rw_chunk_t* next = chunk->next;
+            size_t b = bucket_of(chunk->size, chunk->checksum_type, chunk->checksum);
+            chunk->next = buckets[b];
+            buckets[b] = chunk;
+            chunk = next;
+        }
+    }
+    free(old);
+}
+
+static bool insert_locked(rw_chunk_t* chunk) {
+    if (chunk_count >= bucket_count) grow_locked();
+    if (!buckets) return false;
+
+    size_t b = bucket_of(chunk->size, chunk->checksum_type, chunk->checksum);
+    chunk->next = buckets[b];
+    buckets[b] = chunk;
+    chunk_count++;
+    return true;
+}
+
+static void remove_locked(rw_chunk_t* chunk) {
+    rw_chunk_t** link = &buckets[bucket_of(chunk->size, chunk->checksum_type, chunk->checksum)];
+    while (*link && *link != chunk) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = chunk->next;
+        chunk_count--;
+    }
+}
+
+static inline void count_saved(size_t bytes, bool add) {
+    rw_metrics_t* metrics = rw_metrics_shard();
+    if (add) {
+        __atomic_fetch_add(&metrics->dedup_bytes_saved, bytes, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_sub(&metrics->dedup_bytes_saved, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void count_lookup(bool hit) {
+    rw_metrics_t* metrics = rw_metrics_shard();
+    __atomic_fetch_add(&metrics->dedup_lookups, 1, __ATOMIC_RELAXED);
+    if (hit) __atomic_fetch_add(&metrics->dedup_hits, 1, __ATOMIC_RELAXED);
+}
+
+void rw_dedup_reset(void) {
+    pthread_mutex_lock(&dedup_mutex);
+    for (size_t i = 0; i < bucket_count; i++) {
+        rw_chunk_t* chunk = buckets[i];
+        while (chunk) {
+            rw_chunk_t* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+    chunk_count = 0;
+
+    // A secret key keeps crafted contents from colliding on purpose
+    if (getrandom(hash_key, sizeof(hash_key), 0) != sizeof(hash_key)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        hash_key[0] = (uint64_t)ts.tv_nsec * 0x9E3779B97F4A7C15ull;
+        hash_key[1] = (uint64_t)ts.tv_sec ^ (uint64_t)(uintptr_t)&hash_key;
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+}
+
+void rw_set_dedup(bool enabled) {
+    // Blocks already sharing storage keep doing so
+    atomic_store(&dedup_enabled, enabled);
+}
+
+bool rw_get_dedup(void) {
+    return atomic_load(&dedup_enabled);
+}
+
+rw_chunk_t* rw_dedup_share_zero(size_t size, uint32_t checksum) {
+    if (!atomic_load(&dedup_enabled)) return NULL;
+
+    rw_chunk_t* found = NULL;
+    pthread_mutex_lock(&dedup_mutex);
+    if (buckets) {
+        for (rw_chunk_t* chunk = buckets[bucket_of(size, RW_CHECKSUM_CRC32C, checksum)];
+             chunk; chunk = chunk->next) {
+            if (chunk->zero && chunk_matches(chunk, size, RW_CHECKSUM_CRC32C, checksum)) {
+                chunk->refs++;
+                found = chunk;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+
+    count_lookup(found != NULL);
+    if (found) count_saved(size, true);
+    return found;
+}
+
+void rw_dedup_register_zero(data_block_t* block) {
+    if (!atomic_load(&dedup_enabled)) return;
+
+    rw_chunk_t* chunk = calloc(1, sizeof(rw_chunk_t));
+    if (!chunk) return;
+    chunk->data = block->data;
+    chunk->size = block->size;
+    chunk->checksum_type = block->checksum_type;
+    chunk->checksum = block->checksum;
+    chunk->refs = 1;
+    chunk->zero = true;
+
+    pthread_mutex_lock(&dedup_mutex);
+    bool inserted = insert_locked(chunk);
+    pthread_mutex_unlock(&dedup_mutex);
+
+    if (inserted) {
+        block->shared = chunk;
+    } else {
+        free(chunk);
+    }
+}
+
+void rw_dedup_block(data_block_t* block) {
+    if (!atomic_load(&dedup_enabled) || !block) return;
+
+    // Claim the block like the compressor does: nobody may be using
+    // block->data while it is swapped
+    uint32_t expected = RW_BLOCK_RAW;
+    if (!atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_REMAPPING)) return;
+    if (atomic_load(&block->pins) != 0 || block->shared) {
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return;
+    }
+
+    // Stable now: writers pin before they start
+    size_t size = block->size;
+    rw_checksum_type_t type = block->checksum_type;
+    uint32_t checksum = block->checksum;
+    uint64_t hash[2];
+    bool hashed = false;
+    rw_chunk_t* found = NULL;
+
+    pthread_mutex_lock(&dedup_mutex);
+    for (rw_chunk_t* chunk = buckets ? buckets[bucket_of(size, type, checksum)] : NULL;
+         chunk; chunk = chunk->next) {
+        if (!chunk_matches(chunk, size, type, checksum)) continue;
+
+        if (!hashed) {
+            siphash128(block->data, size, hash);
+            hashed = true;
+        }
+        if (!chunk->hashed) {
+            siphash128(chunk->data, chunk->size, chunk->hash);
+            chunk->hashed = true;
+        }
+        if (chunk->hash[0] == hash[0] && chunk->hash[1] == hash[1]) {
+            chunk->refs++;
+            found = chunk;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+
+    count_lookup(found != NULL);
+
+    if (found) {
+        uint8_t* own = block->data;
+        rw_block_write_begin(block);
+        block->data = found->data;
+        block->shared = found;
+        rw_block_write_end(block);
+        count_saved(size, true);
+
+        rw_registry_lock();
+        rw_free_locked(own, size);
+        rw_registry_unlock();
+    } else {
+        // Offer this block's contents to later writers
+        rw_chunk_t* chunk = calloc(1, sizeof(rw_chunk_t));
+        if (chunk) {
+            chunk->data = block->data;
+            chunk->size = size;
+            chunk->checksum_type = type;
+            chunk->checksum = checksum;
+            chunk->refs = 1;
+            if (hashed) {
+                memcpy(chunk->hash, hash, sizeof(hash));
+                chunk->hashed = true;
+            }
+
+            pthread_mutex_lock(&dedup_mutex);
+            bool inserted = insert_locked(chunk);
+            pthread_mutex_unlock(&dedup_mutex);
+
+            if (inserted) {
+                block->shared = chunk;
+            } else {
+                free(chunk);
+            }
+        }
+    }
+
+    atomic_store(&block->state, RW_BLOCK_RAW);
+}
+
+bool rw_dedup_detach(data_block_t* block) {
+    rw_chunk_t* chunk = block->shared;
+    if (!chunk) return true;
+
+    pthread_mutex_lock(&dedup_mutex);
+    bool sole = chunk->refs == 1;
+    if (sole) remove_locked(chunk);
+    pthread_mutex_unlock(&dedup_mutex);
+
+    if (!sole) return false;
+
+    // The block keeps the storage it already points at
+    block->shared = NULL;
+    free(chunk);
+    return true;
+}
+
+bool rw_dedup_unshare(data_block_t* block) {
+    if (rw_dedup_detach(block)) return true;
+
+    rw_chunk_t* chunk = block->shared;
+
+    uint8_t* copy = rw_alloc_or_reclaim(block->size, false);
+    if (!copy) return false;
+
+    memcpy(copy, chunk->data, block->size);
+
+    pthread_mutex_lock(&dedup_mutex);
+    bool last = --chunk->refs == 0;
+    if (last) remove_locked(chunk);
+    pthread_mutex_unlock(&dedup_mutex);
+
+    block->shared = NULL;
+    if (last) {
+        // The other users left meanwhile: keep the storage, drop the copy
+        rw_registry_lock();
+        rw_free_locked(copy, block->size);
+        rw_registry_unlock();
+        free(chunk);
+    } else {
+        block->data = copy;
+        count_saved(block->size, false);
+    }
+    return true;
+}
+
+void rw_dedup_put(rw_chunk_t* chunk, size_t size) {
+    if (!chunk) return;
+
+    pthread_mutex_lock(&dedup_mutex);
+    bool last = --chunk->refs == 0;
+    if (last) remove_locked(chunk);
+    pthread_mutex_unlock(&dedup_mutex);
+
+    if (last) {
+        // Nobody points at the storage any more
+        rw_registry_lock();
+        rw_free_locked(chunk->data, size);
+        rw_registry_unlock();
+        free(chunk);
+    } else {
+        count_saved(size, false);
+    }
+}
+
+bool rw_block_is_shared(const data_block_t* block) {
+    if (!block || !block->shared) return false;
+
+    pthread_mutex_lock(&dedup_mutex);
+    bool shared = block->shared && block->shared->refs > 1;
+    pthread_mutex_unlock(&dedup_mutex);
+    return shared;
+}
@@ -0,0 +1,131 @@
+#include "rw_internal.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Epoch-based reclamation of deleted blocks.
+//
+// Threads that use block pointers they did not pin register in the global
+// epoch, on a sharded counter, for the duration of a read section. A
+// deleted block is retired with the epoch it was unlinked in. The epoch
+// only moves on once nobody is left registered in the one before it, so
+// when it is two ahead of a retired block, every section that could have
+// found that block has ended and its memory can go back to the allocator.
+//
+// Readers pay two uncontended atomic adds per section; deleters never
+// wait: blocks that are not yet safe stay on the limbo list until a later
+// deletion collects them.
+
+#define READER_SHARDS 32
+
+typedef struct {
+    _Alignas(64) atomic_ulong readers[3];   // By epoch % 3
+} reader_shard_t;
+
+typedef struct {
+    data_block_t* block;
+    uint64_t epoch;                         // Unlinked in
+} retired_t;
+
+static reader_shard_t shards[READER_SHARDS];
+static atomic_uint next_shard;
+static _Thread_local unsigned my_shard = READER_SHARDS;
+
+static _Atomic uint64_t global_epoch = 1;
+
+static pthread_mutex_t limbo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static retired_t* limbo = NULL;
+static size_t limbo_count = 0, limbo_capacity = 0;
+
+uint64_t rw_epoch_enter(void) {
+    if (my_shard == READER_SHARDS) {
+        my_shard = atomic_fetch_add(&next_shard, 1) % READER_SHARDS;
+    }
+    reader_shard_t* shard = &shards[my_shard];
+
+    for (;;) {
+        uint64_t epoch = atomic_load(&global_epoch);
+        atomic_fetch_add(&shard->readers[epoch % 3], 1);
+        // Registered before the epoch moved on, or we see it and retry
+        if (atomic_load(&global_epoch) == epoch) return epoch;
+        atomic_fetch_sub(&shard->readers[epoch % 3], 1);
+    }
+}
+
+void rw_epoch_exit(uint64_t epoch) {
+    atomic_fetch_sub_explicit(&shards[my_shard].readers[epoch % 3], 1, memory_order_release);
+}
+
+// Move the epoch on if nobody is still in the previous one
+static bool try_advance(void) {
+    uint64_t epoch = atomic_load(&global_epoch);
+    uint64_t pending = 0;
+    for (int i = 0; i < READER_SHARDS; i++) {
+        pending += atomic_load(&shards[i].readers[(epoch - 1) % 3]);
+    }
+    if (pending != 0) return false;
+
+    return atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+}
+
+size_t rw_epoch_collect(void) {
+    // Two steps make the blocks retired in the current epoch safe
+    if (try_advance()) try_advance();
+    uint64_t epoch = atomic_load(&global_epoch);
+
+    pthread_mutex_lock(&limbo_mutex);
+    retired_t* ready = malloc((limbo_count ? limbo_count : 1) * sizeof(retired_t));
+    size_t ready_count = 0, kept = 0;
+    for (size_t i = 0; i < limbo_count; i++) {
+        data_block_t* block = limbo[i].block;
+        // Views and checkpoints pin for longer than a read section, and
+        // snapshots keep deleted blocks readable until they are released
+        bool safe = ready && limbo[i].epoch + 2 <= epoch &&
+                    atomic_load(&block->pins) == 0 && !rw_snapshot_holds(block);
+        if (safe) {
+            ready[ready_count++] = limbo[i];
+        } else {
+            limbo[kept++] = limbo[i];
+        }
+    }
+    limbo_count = kept;
+    pthread_mutex_unlock(&limbo_mutex);
+
+    for (size_t i = 0; i < ready_count; i++) {
+        rw_block_free(ready[i].block);
+    }
+    free(ready);
+
+    return ready_count;
+}
+
+void rw_epoch_retire(data_block_t* block) {
+    uint64_t epoch = atomic_load(&global_epoch);
+
+    pthread_mutex_lock(&limbo_mutex);
+    if (limbo_count == limbo_capacity) {
+        size_t capacity = limbo_capacity ? limbo_capacity * 2 : 64;
+        retired_t* grown = realloc(limbo, capacity * sizeof(retired_t));
+        if (!grown) {
+            // Leaked rather than freed under a reader
+            pthread_mutex_unlock(&limbo_mutex);
+            return;
+        }
+        limbo = grown;
+        limbo_capacity = capacity;
+    }
+    limbo[limbo_count].block = block;
+    limbo[limbo_count].epoch = epoch;
+    limbo_count++;
+    pthread_mutex_unlock(&limbo_mutex);
+
+    rw_epoch_collect();
+}
+
+void rw_epoch_reset(void) {
+    // Retired blocks go with the partition
+    pthread_mutex_lock(&limbo_mutex);
+    limbo_count = 0;
+    pthread_mutex_unlock(&limbo_mutex);
+}
@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+// Access heatmap and hot/cold placement.
+//
+// Access counts come from rw_block_touch(), sampled, and every pass
+// halves them after reading, so they weigh recent use. Moves claim the
+// block the way the compressor does (RAW -> REMAPPING with no pins), copy
+// its data to the other side and free the old buffer; the allocator sends
+// it back to the free lists it came from.
+
+#define HEAT_BATCH      256
+#define HUGE_PAGE_SIZE  (2u * 1024 * 1024)
+
+typedef struct {
+    data_block_t* block;
+    uint32_t accesses;
+    size_t size;                    // Allocated, class-rounded
+    bool hot;                       // Data in the hot region now
+    bool wanted;                    // ...and after this pass
+} candidate_t;
+
+_Thread_local uint32_t rw_heat_seed;
+
+static memory_partition_t* heat_partition = NULL;
+static uint8_t* region_base = NULL;
+static size_t region_size = 0;
+
+static pthread_mutex_t pass_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rw_heat_stats_t stats = {0};
+
+static rw_heat_config_t heat_config;
+static pthread_t heat_thread;
+static bool heat_running = false;
+static atomic_bool heat_stop_flag;
+static pthread_mutex_t heat_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t heat_wait_cond = PTHREAD_COND_INITIALIZER;
+
+static inline bool in_region(const uint8_t* data) {
+    return data && region_base && data >= region_base && data < region_base + region_size;
+}
+
+void rw_heat_reset(memory_partition_t* partition) {
+    // The allocator forgot the region along with everything else
+    pthread_mutex_lock(&pass_mutex);
+    heat_partition = partition;
+    region_base = NULL;
+    region_size = 0;
+    pthread_mutex_unlock(&pass_mutex);
+
+    pthread_mutex_lock(&stats_mutex);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Straight from the partition's bump allocator: a size class would round
+// a large region up by as much as a quarter
+static void reserve_region(size_t size) {
+    bool huge = size >= HUGE_PAGE_SIZE;
+    size_t align = huge ? HUGE_PAGE_SIZE : 64;
+    size = huge ? size & ~(size_t)(HUGE_PAGE_SIZE - 1) : (size + 63) & ~(size_t)63;
+
+    rw_registry_lock();
+    uint8_t* raw = partition_alloc(heat_partition, size + align);
+    uint8_t* base = NULL;
+    if (raw) {
+        base = (uint8_t*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+        rw_alloc_set_hot_locked(base, size);
+    }
+    rw_registry_unlock();
+
+    if (!base) {
+        LOG_WARN("No room for a %zu byte hot region", size);
+        return;
+    }
+
+    bool advised = false;
+#ifdef MADV_HUGEPAGE
+    advised = huge && madvise(base, size, MADV_HUGEPAGE) == 0;
+#endif
+
+    region_base = base;
+    region_size = size;
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.hot_bytes = size;
+    stats.huge_pages = advised;
+    pthread_mutex_unlock(&stats_mutex);
+
+    LOG_INFO("Hot region reserved: %zu KB%s", size / 1024, advised ? ", huge pages" : "");
+}
+
+static bool move_block(data_block_t* block, bool to_hot) {
+    uint32_t expected = RW_BLOCK_RAW;
+    if (!atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_REMAPPING)) return false;
+    if (atomic_load(&block->pins) != 0 || block->shared || !block->data ||
+        in_region(block->data) == to_hot) {
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return false;
+    }
+
+    uint8_t* data;
+    if (to_hot) {
+        rw_registry_lock();
+        data = rw_alloc_hot_locked(block->size);
+        rw_registry_unlock();
+    } else {
+        data = rw_alloc_or_reclaim(block->size, false);
+    }
+    if (!data) {
+        atomic_store(&block->state, RW_BLOCK_RAW);
+        return false;
+    }
+
+    // Same contents: checksum and dirty state stay as they are; the version
+    // moves for readers still copying from the old buffer
+    uint8_t* old = block->data;
+    memcpy(data, old, block->size);
+    rw_block_write_begin(block);
+    block->data = data;
+    rw_block_write_end(block);
+
+    rw_registry_lock();
+    rw_free_locked(old, block->size);
+    rw_registry_unlock();
+
+    atomic_store(&block->state, RW_BLOCK_RAW);
+    return true;
+}
+
+// Accesses per allocated byte, hottest first
+static int compare_density(const void* a, const void* b) {
+    const candidate_t* x = a;
+    const candidate_t* y = b;
+    double dx = (double)x->accesses / (double)x->size;
+    double dy = (double)y->accesses / (double)y->size;
+    return (dx < dy) - (dx > dy);
+}
+
+size_t rw_heat_pass(const rw_heat_config_t* config) {
+    if (!config) return 0;
+
+    pthread_mutex_lock(&pass_mutex);
+    if (!heat_partition) {
+        pthread_mutex_unlock(&pass_mutex);
+        return 0;
+    }
+    if (!region_base && config->hot_bytes > 0) reserve_region(config->hot_bytes);
+
+    candidate_t* candidates = NULL;
+    size_t count = 0, capacity = 0;
+    data_block_t* batch[HEAT_BATCH];
+    size_t n;
+
+    // One read section for the whole pass: candidates deleted meanwhile
+    // stay allocated until it ends
+    uint64_t epoch = rw_epoch_enter();
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, HEAT_BATCH)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            data_block_t* block = batch[i];
+            uint32_t accesses = atomic_load_explicit(&block->access_count, memory_order_relaxed);
+            atomic_store_explicit(&block->access_count, accesses / 2, memory_order_relaxed);
+
+            if (!rw_block_try_acquire_raw(block)) continue;
+            const uint8_t* data = block->data;
+            bool shared = block->shared != NULL;
+            rw_block_release(block);
+            if (!data || shared) continue;
+
+            if (count == capacity) {
+                size_t grown_capacity = capacity ? capacity * 2 : 256;
+                candidate_t* grown = realloc(candidates, grown_capacity * sizeof(candidate_t));
+                if (!grown) continue;
+                candidates = grown;
+                capacity = grown_capacity;
+            }
+            candidates[count++] = (candidate_t){
+                block, accesses, rw_alloc_size(block->size), in_region(data), false
+            };
+        }
+    }
+
+    qsort(candidates, count, sizeof(candidate_t), compare_density);
+
+    size_t budget = region_size;
+    for (size_t i = 0; i < count; i++) {
+        candidate_t* c = &candidates[i];
+        if (c->accesses == 0 || c->accesses < config->hot_min_accesses) break;
+        if (c->size > budget) continue;
+        c->wanted = true;
+        budget -= c->size;
+    }
+
+    // Make room first, then fill it
+    size_t promotions = 0, demotions = 0, hot_blocks = 0;
+    for (size_t i = 0; i < count; i++) {
+        candidate_t* c = &candidates[i];
+        if (c->hot && !c->wanted && move_block(c->block, false)) {
+            c->hot = false;
+            demotions++;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        candidate_t* c = &candidates[i];
+        if (!c->hot && c->wanted && move_block(c->block, true)) {
+            c->hot = true;
+            promotions++;
+        }
+        if (c->hot) hot_blocks++;
+    }
+    rw_epoch_exit(epoch);
+    free(candidates);
+
+    rw_registry_lock();
+    size_t used = region_base ? rw_alloc_hot_used_locked() : 0;
+    rw_registry_unlock();
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.passes++;
+    stats.promotions += promotions;
+    stats.demotions += demotions;
+    stats.hot_blocks = hot_blocks;
+    stats.hot_bytes_used = used;
+    pthread_mutex_unlock(&stats_mutex);
+
+    pthread_mutex_unlock(&pass_mutex);
+
+    LOG_DEBUG("Placement pass: %zu promoted, %zu demoted, %zu hot", promotions, demotions, hot_blocks);
+    return promotions + demotions;
+}
+
+size_t rw_heatmap(uint64_t* heat, size_t regions) {
+    if (!heat || regions == 0) return 0;
+
+    pthread_mutex_lock(&pass_mutex);
+    memory_partition_t* partition = heat_partition;
+    pthread_mutex_unlock(&pass_mutex);
+    if (!partition || partition->size == 0) return 0;
+
+    memset(heat, 0, regions * sizeof(uint64_t));
+    size_t slice = (partition->size + regions - 1) / regions;
+    const uint8_t* base = partition->base_address;
+
+    data_block_t* batch[HEAT_BATCH];
+    size_t n;
+    uint64_t epoch = rw_epoch_enter();
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, HEAT_BATCH)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            data_block_t* block = batch[i];
+            if (!rw_block_try_acquire_raw(block)) continue;
+            const uint8_t* data = block->data;
+            rw_block_release(block);
+
+            if (!data || data < base || data >= base + partition->size) continue;
+            heat[(size_t)(data - base) / slice] +=
+                atomic_load_explicit(&block->access_count, memory_order_relaxed);
+        }
+    }
+    rw_epoch_exit(epoch);
+
+    return slice;
+}
+
+void print_rw_heatmap(size_t regions) {
+    static const char shades[] = " .:-=+*#%@";
+
+    if (regions == 0) return;
+    uint64_t* heat = calloc(regions, sizeof(uint64_t));
+    if (!heat) return;
+
+    size_t slice = rw_heatmap(heat, regions);
+    if (slice == 0) {
+        free(heat);
+        return;
+    }
+
+    uint64_t max = 0;
+    for (size_t i = 0; i < regions; i++) {
+        if (heat[i] > max) max = heat[i];
+    }
+
+    printf("\n=== RW Access Heatmap (%zu KB per cell, max %llu) ===\n",
+           slice / 1024, (unsigned long long)max);
+    // Shade by share of the hottest cell; anything accessed gets a dot
+    for (size_t i = 0; i < regions; i++) {
+        size_t level = 0;
+        if (heat[i] > 0) level = 1 + (size_t)((double)heat[i] / (double)max * 8.0);
+        putchar(shades[level]);
+        if (i % 64 == 63 || i == regions - 1) putchar('\n');
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    rw_heat_stats_t snapshot = stats;
+    pthread_mutex_unlock(&stats_mutex);
+    if (snapshot.hot_bytes) {
+        printf("Hot region: %llu of %llu KB used by %llu blocks%s\n",
+               (unsigned long long)(snapshot.hot_bytes_used / 1024),
+               (unsigned long long)(snapshot.hot_bytes / 1024),
+               (unsigned long long)snapshot.hot_blocks,
+               snapshot.huge_pages ? ", huge pages" : "");
+    }
+
+    free(heat);
+}
+
+static void* heat_background(void* arg) {
+    (void)arg;
+
+#ifdef SCHED_IDLE
+    struct sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    while (!atomic_load(&heat_stop_flag)) {
+        rw_heat_pass(&heat_config);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)heat_config.scan_interval_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+
+        pthread_mutex_lock(&heat_wait_mutex);
+        while (!atomic_load(&heat_stop_flag)) {
+            if (pthread_cond_timedwait(&heat_wait_cond, &heat_wait_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&heat_wait_mutex);
+    }
+
+    return NULL;
+}
+
+int rw_heat_start(const rw_heat_config_t* config) {
+    if (!config) return MEM_INVALID;
+    if (heat_running) return MEM_ERROR;
+
+    heat_config = *config;
+    atomic_store(&heat_stop_flag, false);
+
+    if (pthread_create(&heat_thread, NULL, heat_background, NULL) != 0) {
+        return MEM_ERROR;
+    }
+
+    heat_running = true;
+    LOG_INFO("Background placement started (%zu KB hot region, min %u accesses)",
+             config->hot_bytes / 1024, config->hot_min_accesses);
+    return MEM_SUCCESS;
+}
+
+void rw_heat_stop(void) {
+    if (!heat_running) return;
+
+    pthread_mutex_lock(&heat_wait_mutex);
+    atomic_store(&heat_stop_flag, true);
+    pthread_cond_broadcast(&heat_wait_cond);
+    pthread_mutex_unlock(&heat_wait_mutex);
+
+    pthread_join(heat_thread, NULL);
+    heat_running = false;
+    atomic_store(&heat_stop_flag, false);
+}
+
+bool rw_block_is_hot(const data_block_t* block) {
+    if (!block) return false;
+
+    pthread_mutex_lock(&pass_mutex);
+    bool hot = atomic_load(&block->state) == RW_BLOCK_RAW && in_region(block->data);
+    pthread_mutex_unlock(&pass_mutex);
+    return hot;
+}
+
+rw_heat_stats_t* get_rw_heat_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,210 @@
+#include "rw_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Block id -> data_block_t* index.
+//
+// Open addressing over 64-byte buckets of five (id, block) pairs, probed
+// linearly bucket by bucket, so a lookup usually touches one cache line.
+// Growing allocates a table twice the size and migrates a few buckets on
+// every subsequent operation instead of rehashing everything at once;
+// until migration finishes lookups consult both tables. A migrated entry
+// leaves a tombstone behind, so every id is in one table only. Inserts
+// move enough buckets that the old table is drained before the new one
+// can fill up to the next resize.
+//
+// All functions are called with the registry lock held.
+
+#define BUCKET_SLOTS        5
+#define SLOT_EMPTY          0u           // Block ids start at 1
+#define SLOT_TOMBSTONE      UINT32_MAX
+#define MIGRATE_PER_OP      4            // Old buckets moved per operation
+#define MIN_BUCKETS         64
+#define MAX_LOAD_PERCENT    75
+
+typedef struct {
+    uint32_t ids[BUCKET_SLOTS];
+    uint32_t pad;
+    data_block_t* blocks[BUCKET_SLOTS];
+} __attribute__((aligned(64))) index_bucket_t;
+
+typedef struct {
+    index_bucket_t* buckets;
+    size_t bucket_count;        // Power of two
+    unsigned shift;             // 64 - log2(bucket_count)
+    size_t live;
+    size_t tombstones;
+} index_table_t;
+
+static index_table_t current = {0};
+static index_table_t old = {0};       // Being drained into `current`
+static size_t migrate_pos = 0;
+static size_t migrate_quota = MIGRATE_PER_OP;   // Old buckets moved per insert
+
+_Static_assert(sizeof(index_bucket_t) == 64, "index bucket must fill one cache line");
+
+static inline size_t bucket_of(const index_table_t* table, uint32_t id) {
+    // Fibonacci hashing spreads sequential ids across buckets
+    return (size_t)(((uint64_t)id * 0x9E3779B97F4A7C15ull) >> table->shift);
+}
+
+static bool table_init(index_table_t* table, size_t bucket_count) {
+    index_bucket_t* buckets = aligned_alloc(64, bucket_count * sizeof(index_bucket_t));
+    if (!buckets) return false;
+    memset(buckets, 0, bucket_count * sizeof(index_bucket_t));
+
+    unsigned log2 = 0;
+    while (((size_t)1 << log2) < bucket_count) log2++;
+
+    table->buckets = buckets;
+    table->bucket_count = bucket_count;
+    table->shift = 64 - log2;
+    table->live = 0;
+    table->tombstones = 0;
+    return true;
+}
+
+static void table_free(index_table_t* table) {
+    free(table->buckets);
+    memset(table, 0, sizeof(index_table_t));
+}
+
+static void table_put(index_table_t* table, uint32_t id, data_block_t* block) {
+    size_t mask = table->bucket_count - 1;
+
+    for (size_t b = bucket_of(table, id);; b = (b + 1) & mask) {
+        index_bucket_t* bucket = &table->buckets[b];
+        for (int s = 0; s < BUCKET_SLOTS; s++) {
+            uint32_t slot = bucket->ids[s];
+            if (slot == SLOT_EMPTY || slot == SLOT_TOMBSTONE) {
+                if (slot == SLOT_TOMBSTONE) table->tombstones--;
+                bucket->ids[s] = id;
+                bucket->blocks[s] = block;
+                table->live++;
+                return;
+            }
+        }
+    }
+}
+
+// Returns the slot holding `id`, or NULL. A bucket with an empty slot ends
+// the probe sequence because inserts never skip past one.
+static uint32_t* table_find(const index_table_t* table, uint32_t id, data_block_t*** block) {
+    if (!table->buckets) return NULL;
+    size_t mask = table->bucket_count - 1;
+
+    for (size_t b = bucket_of(table, id), probes = 0; probes < table->bucket_count;
+         b = (b + 1) & mask, probes++) {
+        index_bucket_t* bucket = &table->buckets[b];
+        bool has_empty = false;
+
+        for (int s = 0; s < BUCKET_SLOTS; s++) {
+            if (bucket->ids[s] == id) {
+                if (block) *block = &bucket->blocks[s];
+                return &bucket->ids[s];
+            }
+            has_empty |= bucket->ids[s] == SLOT_EMPTY;
+        }
+        if (has_empty) return NULL;
+    }
+    return NULL;
+}
+
+static void migrate_step(size_t buckets) {
+    if (!old.buckets) return;
+
+    for (size_t n = 0; n < buckets && migrate_pos < old.bucket_count; n++, migrate_pos++) {
+        index_bucket_t* bucket = &old.buckets[migrate_pos];
+        for (int s = 0; s < BUCKET_SLOTS; s++) {
+            uint32_t id = bucket->ids[s];
+            if (id != SLOT_EMPTY && id != SLOT_TOMBSTONE) {
+                table_put(&current, id, bucket->blocks[s]);
+                bucket->ids[s] = SLOT_TOMBSTONE;
+                old.live--;
+                old.tombstones++;
+            }
+        }
+    }
+
+    if (migrate_pos >= old.bucket_count) {
+        table_free(&old);
+        migrate_pos = 0;
+    }
+}
+
+static bool index_grow(void) {
+    size_t used = current.live + current.tombstones;
+    size_t capacity = current.bucket_count * BUCKET_SLOTS;
+    if (current.buckets && used * 100 < capacity * MAX_LOAD_PERCENT) return true;
+
+    // Mostly tombstones: rebuild at the same size, otherwise double
+    size_t bucket_count = MIN_BUCKETS;
+    if (current.buckets) {
+        bucket_count = current.bucket_count;
+        if (current.live * 100 >= capacity * MAX_LOAD_PERCENT / 2) bucket_count *= 2;
+    }
+
+    index_table_t grown;
+    if (!table_init(&grown, bucket_count)) return false;
+
+    old = current;
+    current = grown;
+    migrate_pos = 0;
+    if (!old.buckets) memset(&old, 0, sizeof(old));
+
+    // Inserts left before `current` reaches the load limit, counting every
+    // entry still to come over from `old`; spread the migration over them
+    size_t limit = current.bucket_count * BUCKET_SLOTS * MAX_LOAD_PERCENT / 100;
+    size_t inserts = limit > old.live + 1 ? limit - old.live - 1 : 1;
+    migrate_quota = (old.bucket_count + inserts - 1) / inserts;
+    if (migrate_quota < MIGRATE_PER_OP) migrate_quota = MIGRATE_PER_OP;
+    return true;
+}
+
+bool rw_index_insert_locked(data_block_t* block) {
+    // Drains `old` by the time the load check below can ask for a resize
+    migrate_step(migrate_quota);
+
+    size_t capacity = current.bucket_count * BUCKET_SLOTS;
+    if (!current.buckets ||
+        (current.live + current.tombstones + 1) * 100 > capacity * MAX_LOAD_PERCENT) {
+        if (!index_grow()) return false;
+        migrate_step(migrate_quota);
+    }
+
+    table_put(&current, block->id, block);
+    return true;
+}
+
+void rw_index_remove_locked(uint32_t id) {
+    migrate_step(MIGRATE_PER_OP);
+
+    index_table_t* tables[2] = { &current, &old };
+    for (int t = 0; t < 2; t++) {
+        uint32_t* slot = table_find(tables[t], id, NULL);
+        if (slot) {
+            *slot = SLOT_TOMBSTONE;
+            tables[t]->live--;
+            tables[t]->tombstones++;
+            return;
+        }
+    }
+}
+
+data_block_t* rw_index_lookup_locked(uint32_t id) {
+    if (id == SLOT_EMPTY || id == SLOT_TOMBSTONE) return NULL;
+
+    migrate_step(MIGRATE_PER_OP);
+
+    data_block_t** block = NULL;
+    if (table_find(&current, id, &block)) return *block;
+    if (table_find(&old, id, &block)) return *block;
+    return NULL;
+}
+
+void rw_index_reset_locked(void) {
+    table_free(&current);
+    table_free(&old);
+    migrate_pos = 0;
+    migrate_quota = MIGRATE_PER_OP;
+}
@@ -0,0 +1,267 @@
+#ifndef RW_INTERNAL_H
+#define RW_INTERNAL_H
+
+// Shared between the Read/Write partition modules; not part of the public API
+
+#include "rw_partition.h"
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+
+#define RW_SLOT_NONE UINT32_MAX
+
+// The registry lock protects the live block registry and every allocation
+// from the RW partition.
+void rw_registry_lock(void);
+void rw_registry_unlock(void);
+
+// Copy up to `max` live block pointers starting at registry position
+// `start`. Returns the number copied; 0 once `start` is past the end.
+size_t rw_registry_snapshot(size_t start, data_block_t** out, size_t max);
+size_t rw_registry_count(void);
+
+// True if `block` is still registered under `id` (caller holds the lock)
+bool rw_block_is_live_locked(const data_block_t* block, uint32_t id);
+
+// Create/delete without logging, for callers issuing many operations
+data_block_t* rw_block_create(size_t size);
+void rw_block_destroy(data_block_t* block);
+// Return a retired block's memory to the allocator
+void rw_block_free(data_block_t* block);
+
+// Deleted blocks wait here until no read section can still see them
+// (rw_epoch.c)
+void rw_epoch_retire(data_block_t* block);
+void rw_epoch_reset(void);
+
+// This thread's share of the metrics; add to it with relaxed atomics
+rw_metrics_t* rw_metrics_shard(void);
+// Recreate a block under its old id during journal recovery
+data_block_t* rw_block_restore(uint32_t id, size_t size);
+
+// Size-class allocator over the RW partition (rw_alloc.c), caller holds
+// the registry lock
+void rw_alloc_reset_locked(memory_partition_t* partition);
+void* rw_alloc_locked(size_t size, bool zero);
+void rw_free_locked(void* ptr, size_t size);
+size_t rw_alloc_size(size_t size);
+size_t rw_alloc_free_bytes_locked(void);
+// Bytes in use by blocks, out of `capacity`
+size_t rw_alloc_live_bytes_locked(size_t* capacity);
+#define RW_ALLOC_CLASSES (4 + (64 - 6) * 4)
+unsigned rw_alloc_class(size_t size, size_t* class_size);
+// Like rw_alloc_locked(), taking the registry lock itself; when the
+// partition is full and tiering is on, spills cold blocks to make room
+void* rw_alloc_or_reclaim(size_t size, bool zero);
+// Hot region (rw_heat.c): a range of the partition set aside for blocks
+// placement found hot, with its own free lists. Not zeroed.
+void rw_alloc_set_hot_locked(void* base, size_t size);
+void* rw_alloc_hot_locked(size_t size);
+size_t rw_alloc_hot_used_locked(void);
+
+// Storage shared by blocks with identical contents (rw_dedup.c). Chunk
+// data is immutable; writers get a private copy first.
+struct rw_chunk {
+    uint8_t* data;
+    size_t size;
+    rw_checksum_type_t checksum_type;
+    uint32_t checksum;
+    uint32_t refs;                  // Blocks pointing at data
+    bool zero;                      // Fresh, never-written storage
+    bool hashed;                    // `hash` computed
+    uint64_t hash[2];
+    struct rw_chunk* next;          // Dedup table chain
+};
+
+void rw_dedup_reset(void);
+// New CRC32C block of zeros: a reference to existing zeroed storage, or NULL
+rw_chunk_t* rw_dedup_share_zero(size_t size, uint32_t checksum);
+// Offer a new, unpublished zeroed block's storage for sharing
+void rw_dedup_register_zero(data_block_t* block);
+// Share storage with an identical block, or offer this block's storage
+void rw_dedup_block(data_block_t* block);
+// Before a write, from inside the write section: make the storage private
+bool rw_dedup_unshare(data_block_t* block);
+// Take back storage nobody else shares, without copying; false if shared
+bool rw_dedup_detach(data_block_t* block);
+// Give up a reference; the last one frees the storage
+void rw_dedup_put(rw_chunk_t* chunk, size_t size);
+
+// Block id index (rw_index.c), caller holds the registry lock
+bool rw_index_insert_locked(data_block_t* block);
+void rw_index_remove_locked(uint32_t id);
+data_block_t* rw_index_lookup_locked(uint32_t id);
+void rw_index_reset_locked(void);
+
+// Write-ahead journal hooks (rw_journal.c). Records are appended while the
+// block's write section is open, so a checkpoint never copies a block
+// between logging and applying a write; rw_journal_commit() then waits
+// for the record to be durable according to the journal mode. A creation
+// holds off log rotation until rw_journal_create_done(), called once the
+// block is published (or its deletion logged).
+bool rw_journal_active(void);
+uint64_t rw_journal_log_create(uint32_t id, size_t size);
+void rw_journal_create_done(void);
+uint64_t rw_journal_log_write(uint32_t id, size_t offset, const rw_iovec_t* iov, int iovcnt);
+uint64_t rw_journal_log_delete(uint32_t id);
+void rw_journal_commit(uint64_t lsn);
+
+// Snapshots (rw_snapshot.c). Old contents of a block, newest first; seen
+// by snapshots in [birth_epoch, end_epoch).
+struct rw_version {
+    uint8_t* data;
+    size_t size;
+    uint64_t birth_epoch;
+    uint64_t end_epoch;
+    struct rw_version* next;
+};
+
+uint64_t rw_snapshot_current_epoch(void);
+// Bracket every write; the epoch is stored as the block's birth_epoch
+uint64_t rw_snapshot_enter(void);
+void rw_snapshot_exit(uint64_t epoch);
+// Inside the write section: keep the contents if a snapshot still sees them
+bool rw_snapshot_preserve(data_block_t* block, uint64_t epoch);
+// Block deleted
+void rw_snapshot_bury(data_block_t* block);
+// Deleted block still readable through a snapshot, or has old versions
+bool rw_snapshot_holds(data_block_t* block);
+void rw_snapshot_reset(void);
+
+// Where a block's contents live (rw_compress.c, rw_tier.c)
+enum {
+    RW_BLOCK_RAW,
+    RW_BLOCK_COMPRESSING,
+    RW_BLOCK_COMPRESSED,
+    RW_BLOCK_DECOMPRESSING,
+    RW_BLOCK_REMAPPING,             // Storage being swapped by dedup
+    RW_BLOCK_EVICTING,
+    RW_BLOCK_SPILLED,               // Contents only in the spill file
+    RW_BLOCK_FAULTING
+};
+
+// Block freed: give its packed buffer back (rw_compress.c)
+void rw_compress_drop(data_block_t* block);
+
+// Tiering (rw_tier.c). Called by rw_block_acquire() on a block it moved to
+// RW_BLOCK_FAULTING; returns the state the block is in after reading it
+// back, or RW_BLOCK_SPILLED on failure.
+uint32_t rw_tier_fault(data_block_t* block);
+// Block deleted: give its spill slot back
+void rw_tier_drop(data_block_t* block);
+void rw_tier_reset(void);
+
+// Hot/cold placement (rw_heat.c)
+void rw_heat_reset(memory_partition_t* partition);
+
+// Merkle tree (rw_merkle.c). Writers mark the chunks they change from
+// inside the write section; trees live in partition memory.
+void rw_merkle_touch(rw_merkle_t* merkle, size_t offset, size_t size);
+void rw_merkle_free_locked(rw_merkle_t* merkle);
+void rw_merkle_reset(void);
+
+// Every access to block->data goes through acquire/release: the block is
+// pinned, so it is not compressed or spilled underneath the caller, and
+// read back and decompressed first if needed. Fails only when there is no
+// room to bring the data back.
+bool rw_block_acquire(data_block_t* block);
+void rw_block_release(data_block_t* block);
+// Same, for maintenance reads (checksums, checkpoints) that must not make
+// the block look hot
+bool rw_block_acquire_quiet(data_block_t* block);
+// Pin only if the data is already raw; used by readers that should not
+// warm up cold blocks (scrubbing)
+bool rw_block_try_acquire_raw(data_block_t* block);
+
+static inline uint64_t rw_coarse_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+// Access counting: exact up to RW_HEAT_EXACT, where tiering tells cold
+// blocks apart, then sampled: a random one in RW_HEAT_SAMPLE accesses per
+// thread adds RW_HEAT_SAMPLE, so readers of a hot block rarely write to
+// its header
+#define RW_HEAT_EXACT  64
+#define RW_HEAT_SAMPLE 8
+
+extern _Thread_local uint32_t rw_heat_seed;
+
+static inline void rw_block_count_access(data_block_t* block) {
+    if (atomic_load_explicit(&block->access_count, memory_order_relaxed) < RW_HEAT_EXACT) {
+        atomic_fetch_add_explicit(&block->access_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint32_t x = rw_heat_seed;
+    if (x == 0) x = (uint32_t)(uintptr_t)&x | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rw_heat_seed = x;
+    if ((x & (RW_HEAT_SAMPLE - 1)) == 0) {
+        atomic_fetch_add_explicit(&block->access_count, RW_HEAT_SAMPLE, memory_order_relaxed);
+    }
+}
+
+// Count an access and note its time, at most one store per millisecond
+static inline void rw_block_touch(data_block_t* block) {
+    rw_block_count_access(block);
+
+    uint64_t now = rw_coarse_ms();
+    if (atomic_load_explicit(&block->last_access_ms, memory_order_relaxed) != now) {
+        atomic_store_explicit(&block->last_access_ms, now, memory_order_relaxed);
+    }
+}
+
+// Per-block sequence counter. Writers make it odd for the duration of a
+// change to data/checksum, taking turns: a writer finding it odd waits.
+// Readers take no lock; they copy, then retry (or, like the scrubber, give
+// up) when the counter moved meanwhile. Whoever takes a raw block's buffer
+// away (compression, eviction, dedup, placement) does so inside a write
+// too, for the readers that copy from it without a pin.
+static inline void rw_block_write_begin(data_block_t* block) {
+    uint32_t v = atomic_load_explicit(&block->version, memory_order_relaxed);
+    for (;;) {
+        if (v & 1) {
+            sched_yield();
+            v = atomic_load_explicit(&block->version, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&block->version, &v, v + 1,
+                                                  memory_order_acquire,
+                                                  memory_order_relaxed)) {
+            break;
+        }
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void rw_block_write_end(data_block_t* block) {
+    uint32_t v = atomic_load_explicit(&block->version, memory_order_relaxed);
+    atomic_store_explicit(&block->version, v + 1, memory_order_release);
+}
+
+// Returns the stable (even) version, or an odd value if a write is in
+// progress.
+static inline uint32_t rw_block_read_begin(const data_block_t* block) {
+    return atomic_load_explicit(&block->version, memory_order_acquire);
+}
+
+// Wait out a write in progress; returns the (even) version
+static inline uint32_t rw_block_read_stable(const data_block_t* block) {
+    uint32_t version;
+    while ((version = rw_block_read_begin(block)) & 1) {
+        sched_yield();
+    }
+    return version;
+}
+
+static inline bool rw_block_read_valid(const data_block_t* block, uint32_t version) {
+    atomic_thread_fence(memory_order_acquire);
+    return (version & 1) == 0 &&
+           atomic_load_explicit(&block->version, memory_order_relaxed) == version;
+}
+
+#endif // RW_INTERNAL_H
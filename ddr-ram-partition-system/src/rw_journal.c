@@ -0,0 +1,968 @@
+#define _GNU_SOURCE
+#include "rw_journal.h"
+#include "rw_internal.h"
+#include "checksum.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MANIFEST_MAGIC      0x4B435752u     // "RWCK"
+#define MANIFEST_VERSION    1
+#define FLUSH_RUN_BYTES     (4u * 1024 * 1024)  // Staged per pwrite()
+#define SNAPSHOT_BATCH      256
+
+// Log record, followed by `length` payload bytes. The CRC covers the
+// payload and then the rest of the header, so it can be computed over the
+// payload before the LSN is known.
+typedef enum {
+    REC_CREATE = 1,                 // offset = block size
+    REC_WRITE  = 2,
+    REC_DELETE = 3
+} record_type_t;
+
+typedef struct {
+    uint32_t crc;
+    uint32_t length;
+    uint64_t lsn;
+    uint64_t offset;
+    uint32_t block_id;
+    uint32_t type;
+} record_header_t;
+
+_Static_assert(sizeof(record_header_t) == 32, "log record header must stay compact");
+
+// The manifest lists the blocks of the last checkpoint and where their
+// contents live in the data file. Replaced atomically with rename().
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t lsn;                   // Log records up to here are covered
+    uint32_t count;
+    uint32_t crc;                   // CRC32C of the entries
+} manifest_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t pad;
+    uint64_t size;
+    int64_t offset;
+} manifest_entry_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} log_buffer_t;
+
+static rw_journal_config_t config;
+static char* log_path = NULL;
+static char* old_log_path = NULL;       // Log segment being checkpointed
+static char* manifest_path = NULL;
+static char* manifest_tmp_path = NULL;
+static atomic_bool active;
+static int log_fd = -1;
+static int data_fd = -1;
+static rw_journal_stats_t stats = {0};
+
+// Log state. One thread at a time (`flushing`) writes the buffered
+// records while the others keep appending to a fresh buffer.
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t durable_cond = PTHREAD_COND_INITIALIZER;
+static log_buffer_t pending = {0};
+static log_buffer_t spare = {0};
+static uint64_t appended_lsn = 0;
+static uint64_t durable_lsn = 0;
+static bool flushing = false;
+static bool log_failed = false;
+
+// Checkpoint state. Creations hold `create_lock` shared from their record
+// until the block is published, so the log is never rotated in between.
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t create_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int64_t data_end = 0;
+static bool old_log_present = false;    // Left behind by a failed checkpoint
+static uint64_t old_log_lsn = 0;
+
+// Data file slots. A block takes one at its first checkpoint and keeps it
+// until a manifest that no longer lists the block is in place; before
+// that, a crash would recover from one that does. Freed slots become free
+// extents, merged with their neighbours, which new blocks use before the
+// file grows; a free tail is cut off the file.
+typedef struct {
+    int64_t offset;
+    uint64_t size;
+} data_extent_t;
+
+static manifest_entry_t* owned = NULL;  // Blocks holding a slot
+static size_t owned_count = 0, owned_capacity = 0;
+static data_extent_t* free_extents = NULL;
+static size_t free_count = 0, free_capacity = 0;
+
+// Background flusher/checkpointer
+static pthread_t background_thread;
+static bool background_running = false;
+static bool background_stop = false;
+static pthread_mutex_t background_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t background_cond = PTHREAD_COND_INITIALIZER;
+
+static char* path_with_suffix(const char* path, const char* suffix) {
+    size_t len = strlen(path) + strlen(suffix) + 1;
+    char* out = malloc(len);
+    if (out) snprintf(out, len, "%s%s", path, suffix);
+    return out;
+}
+
+// rename() is only durable once the directory itself is synced
+static void sync_parent_dir(const char* path) {
+    char* copy = strdup(path);
+    if (!copy) return;
+
+    char* slash = strrchr(copy, '/');
+    const char* dir = ".";
+    if (slash) {
+        *slash = '\0';
+        dir = copy[0] ? copy : "/";
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(copy);
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    const uint8_t* p = data;
+
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return MEM_ERROR;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return MEM_SUCCESS;
+}
+
+static int pread_all(int fd, void* data, size_t size, off_t offset) {
+    uint8_t* p = data;
+
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return MEM_ERROR;
+        p += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return MEM_SUCCESS;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    *size = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    uint8_t* data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = malloc((size_t)st.st_size);
+        if (data && pread_all(fd, data, (size_t)st.st_size, 0) == MEM_SUCCESS) {
+            *size = (size_t)st.st_size;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+    return data;
+}
+
+static bool buffer_reserve(log_buffer_t* buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) return true;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 64 * 1024;
+    while (capacity < buffer->size + extra) capacity *= 2;
+
+    uint8_t* grown = realloc(buffer->data, capacity);
+    if (!grown) return false;
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return true;
+}
+
+// --- Appending and committing ----------------------------------------------
+
+// Write out everything appended so far. Called and returns with log_mutex
+// held; the lock is dropped during the I/O.
+static void flush_locked(void) {
+    while (flushing) {
+        pthread_cond_wait(&durable_cond, &log_mutex);
+    }
+    if (durable_lsn >= appended_lsn || log_failed) return;
+
+    log_buffer_t out = pending;
+    pending = spare;
+    pending.size = 0;
+    uint64_t target = appended_lsn;
+    flushing = true;
+    pthread_mutex_unlock(&log_mutex);
+
+    int rc = write_all(log_fd, out.data, out.size);
+    if (rc == MEM_SUCCESS && fdatasync(log_fd) != 0) rc = MEM_ERROR;
+
+    pthread_mutex_lock(&log_mutex);
+    spare = out;
+    spare.size = 0;
+    flushing = false;
+    stats.syncs++;
+    if (rc == MEM_SUCCESS) {
+        durable_lsn = target;
+    } else if (!log_failed) {
+        log_failed = true;
+        LOG_ERROR("RW journal: log write failed: %s", strerror(errno));
+    }
+    pthread_cond_broadcast(&durable_cond);
+}
+
+static uint64_t journal_append(record_type_t type, uint32_t id, uint64_t offset,
+                               const rw_iovec_t* iov, int iovcnt) {
+    record_header_t header = { 0, 0, 0, offset, id, (uint32_t)type };
+
+    uint32_t crc = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        crc = crc32c_update(crc, iov[i].base, iov[i].len);
+        header.length += (uint32_t)iov[i].len;
+    }
+
+    pthread_mutex_lock(&log_mutex);
+    if (log_failed || !buffer_reserve(&pending, sizeof(header) + header.length)) {
+        pthread_mutex_unlock(&log_mutex);
+        return 0;
+    }
+
+    header.lsn = ++appended_lsn;
+    header.crc = crc32c_update(crc, (const uint8_t*)&header + sizeof(uint32_t),
+                               sizeof(header) - sizeof(uint32_t));
+
+    memcpy(pending.data + pending.size, &header, sizeof(header));
+    pending.size += sizeof(header);
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(pending.data + pending.size, iov[i].base, iov[i].len);
+        pending.size += iov[i].len;
+    }
+    stats.records++;
+    stats.bytes_logged += sizeof(header) + header.length;
+
+    // Synchronous mode: nothing is shared, every record pays its own sync
+    if (config.mode == RW_JOURNAL_SYNC) {
+        int rc = write_all(log_fd, pending.data, pending.size);
+        if (rc == MEM_SUCCESS && fdatasync(log_fd) != 0) rc = MEM_ERROR;
+        pending.size = 0;
+        stats.syncs++;
+        if (rc == MEM_SUCCESS) {
+            durable_lsn = header.lsn;
+        } else {
+            log_failed = true;
+        }
+    }
+
+    uint64_t lsn = header.lsn;
+    pthread_mutex_unlock(&log_mutex);
+    return lsn;
+}
+
+bool rw_journal_active(void) {
+    return atomic_load_explicit(&active, memory_order_relaxed);
+}
+
+uint64_t rw_journal_log_create(uint32_t id, size_t size) {
+    pthread_rwlock_rdlock(&create_lock);
+    return journal_append(REC_CREATE, id, size, NULL, 0);
+}
+
+void rw_journal_create_done(void) {
+    pthread_rwlock_unlock(&create_lock);
+}
+
+uint64_t rw_journal_log_write(uint32_t id, size_t offset, const rw_iovec_t* iov, int iovcnt) {
+    return journal_append(REC_WRITE, id, offset, iov, iovcnt);
+}
+
+uint64_t rw_journal_log_delete(uint32_t id) {
+    return journal_append(REC_DELETE, id, 0, NULL, 0);
+}
+
+// Group commit: the first committer to find no flush running becomes the
+// leader and writes every record buffered so far; the others wait for it.
+void rw_journal_commit(uint64_t lsn) {
+    if (lsn == 0 || config.mode != RW_JOURNAL_GROUP) return;
+
+    pthread_mutex_lock(&log_mutex);
+    while (durable_lsn < lsn && !log_failed) {
+        if (flushing) {
+            pthread_cond_wait(&durable_cond, &log_mutex);
+        } else {
+            flush_locked();
+        }
+    }
+    stats.commits++;
+    pthread_mutex_unlock(&log_mutex);
+}
+
+// --- Data file slots ---------------------------------------------------------
+
+static bool grow_array(void** array, size_t* capacity, size_t count, size_t item) {
+    if (count < *capacity) return true;
+    size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+    void* grown = realloc(*array, grown_capacity * item);
+    if (!grown) return false;
+    *array = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+static void extent_free(int64_t offset, uint64_t size) {
+    // Out of memory: the space stays unused until the next recovery
+    if (!grow_array((void**)&free_extents, &free_capacity, free_count, sizeof(data_extent_t))) {
+        return;
+    }
+    free_extents[free_count++] = (data_extent_t){ offset, size };
+}
+
+// Best fit among the free extents, or the end of the file
+static int64_t slot_take(uint64_t size) {
+    size_t best = free_count;
+    for (size_t i = 0; i < free_count; i++) {
+        if (free_extents[i].size >= size &&
+            (best == free_count || free_extents[i].size < free_extents[best].size)) {
+            best = i;
+            if (free_extents[i].size == size) break;
+        }
+    }
+    if (best == free_count) {
+        int64_t offset = data_end;
+        data_end += (int64_t)size;
+        return offset;
+    }
+
+    int64_t offset = free_extents[best].offset;
+    free_extents[best].offset += (int64_t)size;
+    free_extents[best].size -= size;
+    if (free_extents[best].size == 0) free_extents[best] = free_extents[--free_count];
+    return offset;
+}
+
+static void slot_own(const data_block_t* block) {
+    // Untracked, the slot is never freed: wasted, but never reused early
+    if (!grow_array((void**)&owned, &owned_capacity, owned_count, sizeof(manifest_entry_t))) {
+        return;
+    }
+    owned[owned_count++] = (manifest_entry_t){
+        .id = block->id, .size = block->size, .offset = block->file_offset };
+}
+
+static int compare_extents(const void* a, const void* b) {
+    int64_t x = ((const data_extent_t*)a)->offset;
+    int64_t y = ((const data_extent_t*)b)->offset;
+    return (x > y) - (x < y);
+}
+
+// Merge neighbouring free extents and give a free tail back to the file
+static void extents_merge(void) {
+    if (free_count > 1) qsort(free_extents, free_count, sizeof(data_extent_t), compare_extents);
+
+    size_t merged = 0;
+    for (size_t i = 0; i < free_count; i++) {
+        if (merged > 0 && free_extents[merged - 1].offset + (int64_t)free_extents[merged - 1].size ==
+                          free_extents[i].offset) {
+            free_extents[merged - 1].size += free_extents[i].size;
+        } else {
+            free_extents[merged++] = free_extents[i];
+        }
+    }
+    free_count = merged;
+
+    if (free_count > 0 &&
+        free_extents[free_count - 1].offset + (int64_t)free_extents[free_count - 1].size ==
+            data_end &&
+        ftruncate(data_fd, (off_t)free_extents[free_count - 1].offset) == 0) {
+        data_end = free_extents[--free_count].offset;
+    }
+    stats.data_file_bytes = (uint64_t)data_end;
+}
+
+static int compare_slot_offsets(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// A manifest listing `blocks` is in place: slots it leaves out are free.
+// Slots are matched by offset, not id, as an id can come back for a new
+// block while the old one's slot is still owned.
+static void slots_settle(data_block_t** blocks, size_t count) {
+    int64_t* listed = malloc((count ? count : 1) * sizeof(int64_t));
+    if (!listed) return;
+    for (size_t i = 0; i < count; i++) {
+        listed[i] = blocks[i]->file_offset;
+    }
+    qsort(listed, count, sizeof(int64_t), compare_slot_offsets);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < owned_count; i++) {
+        if (bsearch(&owned[i].offset, listed, count, sizeof(int64_t), compare_slot_offsets)) {
+            owned[kept++] = owned[i];
+        } else {
+            extent_free(owned[i].offset, owned[i].size);
+        }
+    }
+    owned_count = kept;
+    free(listed);
+
+    extents_merge();
+}
+
+// --- Checkpoints -------------------------------------------------------------
+
+static int compare_offsets(const void* a, const void* b) {
+    const data_block_t* x = *(data_block_t* const*)a;
+    const data_block_t* y = *(data_block_t* const*)b;
+    return (x->file_offset > y->file_offset) - (x->file_offset < y->file_offset);
+}
+
+// Copy a block as of a moment no write to it was in progress
+static void copy_stable(const data_block_t* block, uint8_t* out) {
+    uint32_t version;
+    do {
+        version = rw_block_read_stable(block);
+        memcpy(out, block->data, block->size);
+    } while (!rw_block_read_valid(block, version));
+}
+
+// Write one run of blocks occupying consecutive slots, `total` bytes
+static int flush_run(data_block_t** blocks, size_t count, size_t total) {
+    uint8_t* stage = malloc(total);
+    if (!stage) return MEM_FULL;
+
+    size_t at = 0;
+    for (size_t i = 0; i < count; i++) {
+        copy_stable(blocks[i], stage + at);
+        at += blocks[i]->size;
+    }
+
+    int rc = MEM_SUCCESS;
+    off_t offset = blocks[0]->file_offset;
+    for (size_t done = 0; done < total; ) {
+        ssize_t w = pwrite(data_fd, stage + done, total - done, offset + (off_t)done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            rc = MEM_ERROR;
+            break;
+        }
+        done += (size_t)w;
+    }
+
+    free(stage);
+    return rc;
+}
+
+// Blocks are copied after the log was rotated, each once no write to it
+// is in progress. Every record of the retired segment was appended inside
+// a write section that had begun by then, so the copy includes it; it may
+// include later writes too, which replay over it again harmlessly.
+static int flush_blocks(data_block_t** blocks, size_t count) {
+    data_block_t** dirty = malloc((count ? count : 1) * sizeof(data_block_t*));
+    if (!dirty) return MEM_FULL;
+
+    size_t ndirty = 0;
+    for (size_t i = 0; i < count; i++) {
+        data_block_t* block = blocks[i];
+        bool was_dirty = atomic_exchange(&block->dirty, false);
+        if (block->file_offset < 0) {
+            block->file_offset = slot_take(block->size);
+            slot_own(block);
+            was_dirty = true;
+        }
+        if (!was_dirty) continue;
+        // Compressed blocks are unpacked for the copy, without counting
+        // as an access
+        if (!rw_block_acquire_quiet(block)) {
+            atomic_store(&block->dirty, true);
+            continue;
+        }
+        dirty[ndirty++] = block;
+    }
+
+    qsort(dirty, ndirty, sizeof(data_block_t*), compare_offsets);
+
+    int rc = MEM_SUCCESS;
+    for (size_t start = 0; start < ndirty && rc == MEM_SUCCESS; ) {
+        size_t end = start + 1;
+        size_t total = dirty[start]->size;
+        while (end < ndirty && total + dirty[end]->size <= FLUSH_RUN_BYTES &&
+               dirty[end]->file_offset ==
+                   dirty[end - 1]->file_offset + (int64_t)dirty[end - 1]->size) {
+            total += dirty[end]->size;
+            end++;
+        }
+        rc = flush_run(&dirty[start], end - start, total);
+        stats.bytes_flushed += total;
+        start = end;
+    }
+    if (rc == MEM_SUCCESS && fdatasync(data_fd) != 0) rc = MEM_ERROR;
+
+    if (rc != MEM_SUCCESS) {
+        // Try again on the next checkpoint
+        for (size_t i = 0; i < ndirty; i++) {
+            atomic_store(&dirty[i]->dirty, true);
+        }
+    } else {
+        stats.blocks_flushed += ndirty;
+    }
+
+    for (size_t i = 0; i < ndirty; i++) {
+        rw_block_release(dirty[i]);
+    }
+    free(dirty);
+    return rc;
+}
+
+static int write_manifest(data_block_t** blocks, size_t count, uint64_t lsn) {
+    manifest_entry_t* entries = calloc(count ? count : 1, sizeof(manifest_entry_t));
+    if (!entries) return MEM_FULL;
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].id = blocks[i]->id;
+        entries[i].size = blocks[i]->size;
+        entries[i].offset = blocks[i]->file_offset;
+    }
+
+    manifest_header_t header = {
+        .magic = MANIFEST_MAGIC,
+        .version = MANIFEST_VERSION,
+        .lsn = lsn,
+        .count = (uint32_t)count,
+        .crc = crc32c(entries, count * sizeof(manifest_entry_t)),
+    };
+
+    int rc = MEM_ERROR;
+    int fd = open(manifest_tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        if (write_all(fd, &header, sizeof(header)) == MEM_SUCCESS &&
+            write_all(fd, entries, count * sizeof(manifest_entry_t)) == MEM_SUCCESS &&
+            fsync(fd) == 0) {
+            rc = MEM_SUCCESS;
+        }
+        close(fd);
+    }
+    if (rc == MEM_SUCCESS && rename(manifest_tmp_path, manifest_path) != 0) rc = MEM_ERROR;
+    if (rc == MEM_SUCCESS) sync_parent_dir(manifest_path);
+
+    free(entries);
+    return rc;
+}
+
+// Pin and collect every live block
+static data_block_t** collect_blocks(size_t* count) {
+    size_t capacity = rw_registry_count() + SNAPSHOT_BATCH;
+    data_block_t** blocks = malloc(capacity * sizeof(data_block_t*));
+    size_t n = 0, got;
+
+    while (blocks && (got = rw_registry_snapshot(n, blocks + n, capacity - n)) > 0) {
+        n += got;
+        if (n == capacity) {
+            capacity *= 2;
+            data_block_t** grown = realloc(blocks, capacity * sizeof(data_block_t*));
+            if (!grown) free(blocks);
+            blocks = grown;
+        }
+    }
+
+    for (size_t i = 0; blocks && i < n; i++) {
+        atomic_fetch_add(&blocks[i]->pins, 1);
+    }
+    *count = blocks ? n : 0;
+    return blocks;
+}
+
+static void release_blocks(data_block_t** blocks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        atomic_fetch_sub(&blocks[i]->pins, 1);
+    }
+    free(blocks);
+}
+
+// Write every dirty block and a manifest covering log records up to `lsn`
+static int checkpoint_to(uint64_t lsn) {
+    size_t count;
+    data_block_t** blocks = collect_blocks(&count);
+    if (!blocks) return MEM_FULL;
+
+    int rc = flush_blocks(blocks, count);
+    if (rc == MEM_SUCCESS) rc = write_manifest(blocks, count, lsn);
+    if (rc == MEM_SUCCESS) slots_settle(blocks, count);
+
+    release_blocks(blocks, count);
+    return rc;
+}
+
+// Move the current log aside so the checkpoint can drop it afterwards.
+// Returns the last LSN it holds. Blocks whose creation it records are
+// published by the time this returns.
+static int rotate_log(uint64_t* covered) {
+    pthread_rwlock_wrlock(&create_lock);
+    pthread_mutex_lock(&log_mutex);
+
+    // Everything appended so far goes into the segment being retired
+    while (durable_lsn < appended_lsn && !log_failed) {
+        flush_locked();
+    }
+    while (flushing) {
+        pthread_cond_wait(&durable_cond, &log_mutex);
+    }
+
+    int rc = log_failed ? MEM_ERROR : MEM_SUCCESS;
+    int fd = -1;
+    if (rc == MEM_SUCCESS && rename(log_path, old_log_path) != 0) rc = MEM_ERROR;
+    if (rc == MEM_SUCCESS) {
+        fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            rename(old_log_path, log_path);
+            rc = MEM_ERROR;
+        }
+    }
+    if (rc == MEM_SUCCESS) {
+        close(log_fd);
+        log_fd = fd;
+        *covered = appended_lsn;
+        sync_parent_dir(log_path);
+    }
+
+    pthread_mutex_unlock(&log_mutex);
+    pthread_rwlock_unlock(&create_lock);
+    return rc;
+}
+
+static int checkpoint_locked(void) {
+    // A failed checkpoint leaves the retired segment in place; reuse it
+    // rather than overwriting it with a newer one
+    if (!old_log_present) {
+        if (rotate_log(&old_log_lsn) != MEM_SUCCESS) return MEM_ERROR;
+        old_log_present = true;
+    }
+
+    int rc = checkpoint_to(old_log_lsn);
+    if (rc != MEM_SUCCESS) return rc;
+
+    unlink(old_log_path);
+    old_log_present = false;
+    stats.checkpoints++;
+    return MEM_SUCCESS;
+}
+
+int rw_journal_checkpoint(void) {
+    if (!rw_journal_active()) return MEM_ERROR;
+
+    pthread_mutex_lock(&checkpoint_mutex);
+    int rc = checkpoint_locked();
+    pthread_mutex_unlock(&checkpoint_mutex);
+    return rc;
+}
+
+// --- Recovery ----------------------------------------------------------------
+
+static int compare_entry_offsets(const void* a, const void* b) {
+    int64_t x = ((const manifest_entry_t*)a)->offset;
+    int64_t y = ((const manifest_entry_t*)b)->offset;
+    return (x > y) - (x < y);
+}
+
+static int load_manifest(uint64_t* lsn) {
+    size_t size;
+    uint8_t* data = read_file(manifest_path, &size);
+    *lsn = 0;
+    if (!data) return MEM_SUCCESS;      // First start
+
+    manifest_header_t header;
+    if (size < sizeof(header)) {
+        free(data);
+        return MEM_ERROR;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    const manifest_entry_t* entries = (const manifest_entry_t*)(data + sizeof(header));
+    size_t bytes = (size_t)header.count * sizeof(manifest_entry_t);
+    if (header.magic != MANIFEST_MAGIC || header.version != MANIFEST_VERSION ||
+        size < sizeof(header) + bytes || crc32c(entries, bytes) != header.crc) {
+        free(data);
+        return MEM_ERROR;
+    }
+
+    int rc = MEM_SUCCESS;
+    for (uint32_t i = 0; i < header.count && rc == MEM_SUCCESS; i++) {
+        data_block_t* block = rw_block_restore(entries[i].id, entries[i].size);
+        if (!block) {
+            rc = MEM_FULL;
+            break;
+        }
+        rc = pread_all(data_fd, block->data, block->size, entries[i].offset);
+        block->checksum = rw_block_checksum(block);
+        block->file_offset = entries[i].offset;
+        slot_own(block);
+
+        int64_t end = entries[i].offset + (int64_t)entries[i].size;
+        if (end > data_end) data_end = end;
+        stats.blocks_recovered++;
+    }
+
+    // Whatever lies between the listed slots is free
+    if (owned_count > 1) {
+        qsort(owned, owned_count, sizeof(manifest_entry_t), compare_entry_offsets);
+    }
+    int64_t at = 0;
+    for (size_t i = 0; i < owned_count; i++) {
+        if (owned[i].offset > at) extent_free(at, (uint64_t)(owned[i].offset - at));
+        at = owned[i].offset + (int64_t)owned[i].size;
+    }
+    extents_merge();
+
+    *lsn = header.lsn;
+    free(data);
+    return rc;
+}
+
+static void replay_record(const record_header_t* header, const uint8_t* payload) {
+    switch (header->type) {
+        case REC_CREATE:
+            // Already present when the checkpoint saw it being created
+            rw_block_restore(header->block_id, header->offset);
+            break;
+        case REC_WRITE: {
+            rw_op_t op = { RW_OP_WRITE, rw_get_block(header->block_id), header->offset,
+                           (void*)payload, header->length, 0 };
+            rw_submit_batch(&op, 1);
+            break;
+        }
+        case REC_DELETE:
+            rw_block_destroy(rw_get_block(header->block_id));
+            break;
+    }
+}
+
+// Apply the records newer than `covered`. Stops at the first torn or
+// corrupt record and returns the length of the valid prefix.
+static size_t replay_log(const char* path, uint64_t covered, uint64_t* last_lsn) {
+    size_t size;
+    uint8_t* data = read_file(path, &size);
+    if (!data) return 0;
+
+    size_t pos = 0;
+    while (pos + sizeof(record_header_t) <= size) {
+        record_header_t header;
+        memcpy(&header, data + pos, sizeof(header));
+
+        const uint8_t* payload = data + pos + sizeof(header);
+        if (header.length > size - pos - sizeof(header)) break;
+
+        uint32_t crc = crc32c_update(crc32c(payload, header.length),
+                                     (const uint8_t*)&header + sizeof(uint32_t),
+                                     sizeof(header) - sizeof(uint32_t));
+        if (crc != header.crc) break;
+
+        if (header.lsn > covered) {
+            replay_record(&header, payload);
+            stats.records_replayed++;
+        }
+        if (header.lsn > *last_lsn) *last_lsn = header.lsn;
+        pos += sizeof(header) + header.length;
+    }
+
+    free(data);
+    return pos;
+}
+
+static int recover(void) {
+    uint64_t covered;
+    if (load_manifest(&covered) != MEM_SUCCESS) {
+        LOG_ERROR("RW journal: unreadable manifest %s", manifest_path);
+        return MEM_ERROR;
+    }
+
+    uint64_t last = covered;
+    bool old_present = access(old_log_path, F_OK) == 0;
+    if (old_present) replay_log(old_log_path, covered, &last);
+    size_t valid = replay_log(log_path, covered, &last);
+
+    appended_lsn = durable_lsn = last;
+
+    if (stats.records_replayed > 0 || old_present) {
+        // Fold the replayed records into a fresh checkpoint before any new
+        // record is written, then start over with an empty log
+        if (checkpoint_to(last) != MEM_SUCCESS) return MEM_ERROR;
+        unlink(old_log_path);
+        valid = 0;
+    }
+    if (ftruncate(log_fd, (off_t)valid) != 0) return MEM_ERROR;
+
+    return MEM_SUCCESS;
+}
+
+// --- Lifecycle ---------------------------------------------------------------
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+static void* journal_background(void* arg) {
+    (void)arg;
+    uint64_t next_checkpoint = now_ms() + config.checkpoint_interval_ms;
+
+    pthread_mutex_lock(&background_mutex);
+    while (!background_stop) {
+        uint32_t wait_ms = config.mode == RW_JOURNAL_ASYNC ? config.flush_interval_ms : 0;
+        if (config.checkpoint_interval_ms &&
+            (wait_ms == 0 || wait_ms > config.checkpoint_interval_ms)) {
+            wait_ms = config.checkpoint_interval_ms;
+        }
+        if (wait_ms == 0) wait_ms = 1000;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)wait_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+        pthread_cond_timedwait(&background_cond, &background_mutex, &deadline);
+        if (background_stop) break;
+        pthread_mutex_unlock(&background_mutex);
+
+        if (config.mode == RW_JOURNAL_ASYNC) {
+            pthread_mutex_lock(&log_mutex);
+            flush_locked();
+            pthread_mutex_unlock(&log_mutex);
+        }
+        if (config.checkpoint_interval_ms && now_ms() >= next_checkpoint) {
+            rw_journal_checkpoint();
+            next_checkpoint = now_ms() + config.checkpoint_interval_ms;
+        }
+
+        pthread_mutex_lock(&background_mutex);
+    }
+    pthread_mutex_unlock(&background_mutex);
+
+    return NULL;
+}
+
+static void release_paths(void) {
+    free(log_path);
+    free(old_log_path);
+    free(manifest_path);
+    free(manifest_tmp_path);
+    log_path = old_log_path = manifest_path = manifest_tmp_path = NULL;
+}
+
+int rw_journal_open(const rw_journal_config_t* cfg) {
+    if (!cfg || !cfg->log_path || !cfg->data_path) return MEM_INVALID;
+    if (rw_journal_active()) return MEM_ERROR;
+
+    config = *cfg;
+    if (config.mode == RW_JOURNAL_ASYNC && config.flush_interval_ms == 0) {
+        config.flush_interval_ms = 10;
+    }
+
+    log_path = strdup(cfg->log_path);
+    old_log_path = path_with_suffix(cfg->log_path, ".old");
+    manifest_path = path_with_suffix(cfg->data_path, ".manifest");
+    manifest_tmp_path = path_with_suffix(cfg->data_path, ".manifest.tmp");
+    if (!log_path || !old_log_path || !manifest_path || !manifest_tmp_path) {
+        release_paths();
+        return MEM_FULL;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    data_end = 0;
+    owned_count = free_count = 0;
+    old_log_present = false;
+    log_failed = false;
+    pending.size = spare.size = 0;
+
+    log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    data_fd = open(cfg->data_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0 || data_fd < 0 || recover() != MEM_SUCCESS) {
+        if (log_fd >= 0) close(log_fd);
+        if (data_fd >= 0) close(data_fd);
+        log_fd = data_fd = -1;
+        release_paths();
+        return MEM_ERROR;
+    }
+
+    atomic_store(&active, true);
+
+    background_stop = false;
+    background_running =
+        (config.mode == RW_JOURNAL_ASYNC || config.checkpoint_interval_ms) &&
+        pthread_create(&background_thread, NULL, journal_background, NULL) == 0;
+
+    LOG_INFO("RW journal opened (%s mode): %llu blocks recovered, %llu records replayed",
+           config.mode == RW_JOURNAL_SYNC ? "sync" :
+           config.mode == RW_JOURNAL_GROUP ? "group commit" : "async",
+           (unsigned long long)stats.blocks_recovered,
+           (unsigned long long)stats.records_replayed);
+    return MEM_SUCCESS;
+}
+
+// No RW operations may run concurrently with closing
+void rw_journal_close(void) {
+    if (!rw_journal_active()) return;
+
+    if (background_running) {
+        pthread_mutex_lock(&background_mutex);
+        background_stop = true;
+        pthread_cond_signal(&background_cond);
+        pthread_mutex_unlock(&background_mutex);
+        pthread_join(background_thread, NULL);
+        background_running = false;
+    }
+
+    if (rw_journal_checkpoint() != MEM_SUCCESS) {
+        // The log still holds everything; recovery will replay it
+        pthread_mutex_lock(&log_mutex);
+        flush_locked();
+        pthread_mutex_unlock(&log_mutex);
+    }
+
+    atomic_store(&active, false);
+    close(log_fd);
+    close(data_fd);
+    log_fd = data_fd = -1;
+
+    free(pending.data);
+    free(spare.data);
+    memset(&pending, 0, sizeof(pending));
+    memset(&spare, 0, sizeof(spare));
+    free(owned);
+    free(free_extents);
+    owned = NULL;
+    free_extents = NULL;
+    owned_count = owned_capacity = free_count = free_capacity = 0;
+    release_paths();
+
+    LOG_INFO("RW journal closed");
+}
+
+rw_journal_stats_t* get_rw_journal_stats(void) {
+    return &stats;
+}
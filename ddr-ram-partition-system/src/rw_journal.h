@@ -0,0 +1,48 @@
+#ifndef RW_JOURNAL_H
+#define RW_JOURNAL_H
+
+#include "rw_partition.h"
+
+// Write-ahead journal for the RW partition
+//
+// While the journal is open, block creation, writes and deletions append
+// compact redo records to a log file. A background checkpointer writes
+// dirty blocks to a data file and a manifest describing them, then drops
+// the log records the checkpoint covers. Opening the journal recovers the
+// partition from the manifest and replays the log on top of it.
+
+typedef enum {
+    RW_JOURNAL_SYNC,        // Every commit does its own fdatasync
+    RW_JOURNAL_GROUP,       // Concurrent commits share one fdatasync
+    RW_JOURNAL_ASYNC        // Commits return at once; flushed periodically
+} rw_journal_mode_t;
+
+typedef struct {
+    const char* log_path;
+    const char* data_path;          // Manifest goes to <data_path>.manifest
+    rw_journal_mode_t mode;
+    uint32_t flush_interval_ms;     // RW_JOURNAL_ASYNC log flush period
+    uint32_t checkpoint_interval_ms; // 0 = only on rw_journal_checkpoint()
+} rw_journal_config_t;
+
+typedef struct {
+    uint64_t records;
+    uint64_t bytes_logged;
+    uint64_t commits;               // Group commit waits
+    uint64_t syncs;                 // fdatasync calls on the log
+    uint64_t checkpoints;
+    uint64_t blocks_flushed;
+    uint64_t bytes_flushed;
+    uint64_t blocks_recovered;      // Loaded from the data file
+    uint64_t records_replayed;
+    uint64_t data_file_bytes;       // Slots of deleted blocks are reused
+} rw_journal_stats_t;
+
+// Call after rw_init(); recovers existing state before returning
+int rw_journal_open(const rw_journal_config_t* config);
+// Final checkpoint, then stop journaling
+void rw_journal_close(void);
+int rw_journal_checkpoint(void);
+rw_journal_stats_t* get_rw_journal_stats(void);
+
+#endif // RW_JOURNAL_H
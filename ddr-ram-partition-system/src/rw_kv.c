@@ -0,0 +1,768 @@
+#define _GNU_SOURCE
+#include "rw_kv.h"
+#include "rw_internal.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Key-value store over RW blocks.
+//
+// Segment layout: a header naming the store, then records back to back,
+// each a kv_record_t, the key and the value, padded to 8 bytes. Space
+// never written is zero, and a zero key length ends the segment.
+//
+// The index is a Swiss table: slots in groups of 16, with one control
+// byte per slot, either empty, deleted or the low 7 bits of the key hash.
+// A lookup starts at the group picked by the rest of the hash, compares
+// the whole group's control bytes against those 7 bits at once, checks
+// the full hash stored in each candidate slot and only then reads the key
+// from its segment. It stops at the first group with an empty slot, and
+// moves on to further groups by triangular steps, which visit them all.
+
+#define KV_SEGMENT_MAGIC    0x3147455356574B52ull   // "RKWVSEG1"
+#define KV_DEFAULT_SEGMENT  (1024 * 1024)
+#define KV_GROUP            16
+#define KV_MIN_SLOTS        64
+#define KV_NONE             UINT32_MAX
+#define KV_BACKOFF_MAX      1024         // Compaction chances skipped, at most
+
+#define CTRL_EMPTY          0x80
+#define CTRL_DELETED        0xFE
+
+enum {
+    RECORD_LIVE = 1,
+    RECORD_DEAD = 2
+};
+
+typedef struct {
+    uint64_t magic;
+    uint32_t store_id;
+    uint32_t reserved;
+    uint64_t sequence;              // Segments are loaded in this order
+} kv_segment_header_t;
+
+typedef struct {
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t state;
+} kv_record_t;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t segment;
+    uint32_t offset;
+} kv_slot_t;
+
+typedef struct {
+    data_block_t* block;            // NULL once dropped
+    uint64_t sequence;
+    size_t used;                    // Bytes up to the end of the last record
+    size_t live_bytes;
+} kv_segment_t;
+
+struct rw_kv {
+    uint32_t store_id;
+    size_t segment_size;
+    uint64_t seed;
+    pthread_rwlock_t lock;
+
+    // Index, in partition memory
+    uint8_t* ctrl;
+    kv_slot_t* slots;
+    size_t capacity;                // Slots, a power of two
+    size_t count;
+    size_t tombstones;
+
+    // Segment table, host memory; slots refer to segments by position
+    kv_segment_t* segments;
+    size_t segment_count;
+    size_t segment_capacity;
+    uint32_t active;                // Being filled, KV_NONE if none yet
+    uint64_t next_sequence;
+    bool compacting;
+    uint32_t compact_backoff;       // Grows with every compaction cut short
+    uint32_t compact_wait;          // Chances to skip before the next try
+
+    rw_kv_stats_t stats;
+};
+
+static int append_record(rw_kv_t* kv, const void* key, size_t key_len,
+                         const void* value, size_t value_len,
+                         uint32_t* segment, uint32_t* offset);
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Seeded per open, so no fixed set of keys collides every time
+static uint64_t key_hash(uint64_t seed, const uint8_t* key, size_t len) {
+    uint64_t h = seed ^ ((uint64_t)len * 0x9E3779B97F4A7C15ull);
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, key, 8);
+        h = (h ^ mix64(word)) * 0x9E3779B97F4A7C15ull;
+        key += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        uint64_t word = 0;
+        memcpy(&word, key, len);
+        h = (h ^ mix64(word)) * 0x9E3779B97F4A7C15ull;
+    }
+    return mix64(h);
+}
+
+static inline uint8_t hash_tag(uint64_t hash) {
+    return (uint8_t)(hash & 0x7F);
+}
+
+// Bit i set if control byte i of the group equals `value`
+static inline uint32_t group_match(const uint8_t* ctrl, uint8_t value) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < KV_GROUP; i++) {
+        mask |= (uint32_t)(ctrl[i] == value) << i;
+    }
+    return mask;
+#endif
+}
+
+// Empty or deleted slots: their control bytes have the top bit set
+static inline uint32_t group_free(const uint8_t* ctrl) {
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < KV_GROUP; i++) {
+        mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline size_t record_size(size_t key_len, size_t value_len) {
+    return (sizeof(kv_record_t) + key_len + value_len + 7) & ~(size_t)7;
+}
+
+static int record_has_key(rw_kv_t* kv, const kv_slot_t* slot, const void* key, size_t key_len) {
+    data_block_t* block = kv->segments[slot->segment].block;
+    if (!rw_block_acquire(block)) return MEM_FULL;
+
+    const kv_record_t* record = (const kv_record_t*)(block->data + slot->offset);
+    bool equal = record->key_len == key_len && memcmp(record + 1, key, key_len) == 0;
+
+    rw_block_release(block);
+    return equal ? MEM_SUCCESS : MEM_INVALID;
+}
+
+// MEM_SUCCESS with the key's slot in `found`, MEM_INVALID if absent, or
+// MEM_FULL if a segment could not be brought back to compare keys. With
+// `insert_at`, also returns the first free slot on the key's probe path.
+static int index_find(rw_kv_t* kv, uint64_t hash, const void* key, size_t key_len,
+                      size_t* found, size_t* insert_at) {
+    size_t group_mask = kv->capacity / KV_GROUP - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+    uint8_t tag = hash_tag(hash);
+    bool have_free = false;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const uint8_t* ctrl = kv->ctrl + group * KV_GROUP;
+
+        for (uint32_t match = group_match(ctrl, tag); match; match &= match - 1) {
+            size_t slot = group * KV_GROUP + (size_t)__builtin_ctz(match);
+            if (kv->slots[slot].hash != hash) continue;
+
+            int rc = record_has_key(kv, &kv->slots[slot], key, key_len);
+            if (rc == MEM_SUCCESS) {
+                *found = slot;
+                return MEM_SUCCESS;
+            }
+            if (rc == MEM_FULL) return MEM_FULL;
+        }
+
+        uint32_t free_mask = group_free(ctrl);
+        if (insert_at && !have_free && free_mask) {
+            *insert_at = group * KV_GROUP + (size_t)__builtin_ctz(free_mask);
+            have_free = true;
+        }
+        // The key would have gone into this group's empty slot
+        if (group_match(ctrl, CTRL_EMPTY)) return MEM_INVALID;
+
+        group = (group + step) & group_mask;
+    }
+    return MEM_INVALID;
+}
+
+// The slot that points at a given record
+static bool index_locate(rw_kv_t* kv, uint64_t hash, uint32_t segment, uint32_t offset,
+                         size_t* found) {
+    size_t group_mask = kv->capacity / KV_GROUP - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const uint8_t* ctrl = kv->ctrl + group * KV_GROUP;
+
+        for (uint32_t match = group_match(ctrl, hash_tag(hash)); match; match &= match - 1) {
+            size_t slot = group * KV_GROUP + (size_t)__builtin_ctz(match);
+            if (kv->slots[slot].segment == segment && kv->slots[slot].offset == offset) {
+                *found = slot;
+                return true;
+            }
+        }
+        if (group_match(ctrl, CTRL_EMPTY)) return false;
+
+        group = (group + step) & group_mask;
+    }
+    return false;
+}
+
+static int index_resize(rw_kv_t* kv, size_t capacity) {
+    uint8_t* ctrl = rw_alloc_or_reclaim(capacity, false);
+    kv_slot_t* slots = rw_alloc_or_reclaim(capacity * sizeof(kv_slot_t), false);
+    if (!ctrl || !slots) {
+        rw_registry_lock();
+        rw_free_locked(ctrl, capacity);
+        rw_free_locked(slots, capacity * sizeof(kv_slot_t));
+        rw_registry_unlock();
+        return MEM_FULL;
+    }
+    memset(ctrl, CTRL_EMPTY, capacity);
+
+    // Full hashes are kept in the slots, so no key is read again
+    size_t group_mask = capacity / KV_GROUP - 1;
+    for (size_t i = 0; i < kv->capacity; i++) {
+        if (kv->ctrl[i] & 0x80) continue;
+
+        uint64_t hash = kv->slots[i].hash;
+        size_t group = (size_t)(hash >> 7) & group_mask;
+        for (size_t step = 1; ; step++) {
+            uint32_t free_mask = group_free(ctrl + group * KV_GROUP);
+            if (free_mask) {
+                size_t slot = group * KV_GROUP + (size_t)__builtin_ctz(free_mask);
+                ctrl[slot] = hash_tag(hash);
+                slots[slot] = kv->slots[i];
+                break;
+            }
+            group = (group + step) & group_mask;
+        }
+    }
+
+    if (kv->ctrl) {
+        rw_registry_lock();
+        rw_free_locked(kv->ctrl, kv->capacity);
+        rw_free_locked(kv->slots, kv->capacity * sizeof(kv_slot_t));
+        rw_registry_unlock();
+        kv->stats.index_resizes++;
+    }
+
+    kv->ctrl = ctrl;
+    kv->slots = slots;
+    kv->capacity = capacity;
+    kv->tombstones = 0;
+    kv->stats.index_slots = capacity;
+    kv->stats.index_bytes = capacity * (1 + sizeof(kv_slot_t));
+    return MEM_SUCCESS;
+}
+
+// Room for one more key at no more than 7/8 load, deleted slots included.
+// Mostly tombstones: rebuild at the same size; otherwise double.
+static int index_reserve(rw_kv_t* kv) {
+    if ((kv->count + kv->tombstones + 1) * 8 <= kv->capacity * 7) return MEM_SUCCESS;
+
+    size_t capacity = kv->capacity;
+    if ((kv->count + 1) * 16 > capacity * 7) capacity *= 2;
+    return index_resize(kv, capacity);
+}
+
+static int segment_add(rw_kv_t* kv, data_block_t* block, uint64_t sequence, uint32_t* index) {
+    size_t i = 0;
+    while (i < kv->segment_count && kv->segments[i].block) {
+        i++;
+    }
+
+    if (i == kv->segment_count) {
+        if (kv->segment_count == kv->segment_capacity) {
+            size_t capacity = kv->segment_capacity ? kv->segment_capacity * 2 : 16;
+            kv_segment_t* grown = realloc(kv->segments, capacity * sizeof(kv_segment_t));
+            if (!grown) return MEM_FULL;
+            kv->segments = grown;
+            kv->segment_capacity = capacity;
+        }
+        kv->segment_count++;
+    }
+
+    kv->segments[i].block = block;
+    kv->segments[i].sequence = sequence;
+    kv->segments[i].used = sizeof(kv_segment_header_t);
+    kv->segments[i].live_bytes = 0;
+    kv->stats.segments++;
+    *index = (uint32_t)i;
+    return MEM_SUCCESS;
+}
+
+static void segment_drop(rw_kv_t* kv, uint32_t index) {
+    kv_segment_t* segment = &kv->segments[index];
+    kv->stats.dead_bytes -= segment->used - sizeof(kv_segment_header_t) - segment->live_bytes;
+    kv->stats.live_bytes -= segment->live_bytes;
+    kv->stats.segments--;
+
+    rw_block_destroy(segment->block);
+    segment->block = NULL;
+}
+
+// Move the live records of a mostly dead segment to the active one and
+// drop it. Each record is marked dead here once its copy is in place, so
+// should the partition fill up halfway, every key is still live exactly
+// once and the rest of the segment is left for a later try.
+static void compact(rw_kv_t* kv, uint32_t index) {
+    data_block_t* block = kv->segments[index].block;
+    if (!rw_block_acquire(block)) return;
+
+    kv->compacting = true;
+    size_t offset = sizeof(kv_segment_header_t);
+    size_t used = kv->segments[index].used;
+    bool complete = true;
+
+    while (offset < used) {
+        const kv_record_t* record = (const kv_record_t*)(block->data + offset);
+        size_t size = record_size(record->key_len, record->value_len);
+
+        if (record->state == RECORD_LIVE) {
+            const uint8_t* key = (const uint8_t*)(record + 1);
+            uint64_t hash = key_hash(kv->seed, key, record->key_len);
+            size_t slot;
+            if (index_locate(kv, hash, index, (uint32_t)offset, &slot)) {
+                uint32_t segment, at;
+                if (append_record(kv, key, record->key_len, key + record->key_len,
+                                  record->value_len, &segment, &at) != MEM_SUCCESS) {
+                    complete = false;
+                    break;
+                }
+                kv->slots[slot].segment = segment;
+                kv->slots[slot].offset = at;
+
+                uint32_t dead = RECORD_DEAD;
+                rw_write_data_at(block, offset + offsetof(kv_record_t, state), &dead,
+                                 sizeof(dead));
+                kv->segments[index].live_bytes -= size;
+                kv->stats.live_bytes -= size;
+                kv->stats.dead_bytes += size;
+            }
+        }
+        offset += size;
+    }
+
+    rw_block_release(block);
+    kv->compacting = false;
+    kv->stats.compactions++;
+    if (complete) {
+        kv->compact_backoff = 0;
+        segment_drop(kv, index);
+    } else {
+        // Out of room: trying again on every delete would fail the same way
+        kv->compact_backoff = kv->compact_backoff ? kv->compact_backoff * 2 : 1;
+        if (kv->compact_backoff > KV_BACKOFF_MAX) kv->compact_backoff = KV_BACKOFF_MAX;
+        kv->compact_wait = kv->compact_backoff;
+    }
+}
+
+// Drop a segment nothing lives in any more, compact a mostly dead one
+static void segment_check(rw_kv_t* kv, uint32_t index) {
+    kv_segment_t* segment = &kv->segments[index];
+    if (index == kv->active || kv->compacting || !segment->block) return;
+
+    if (segment->live_bytes == 0) {
+        segment_drop(kv, index);
+    } else if (segment->live_bytes * 2 < segment->used - sizeof(kv_segment_header_t)) {
+        if (kv->compact_wait > 0) {
+            kv->compact_wait--;
+        } else {
+            compact(kv, index);
+        }
+    }
+}
+
+static int open_segment(rw_kv_t* kv, size_t record) {
+    size_t size = kv->segment_size;
+    if (record > size - sizeof(kv_segment_header_t)) {
+        size = record + sizeof(kv_segment_header_t);
+    }
+
+    data_block_t* block = rw_block_create(size);
+    if (!block) return MEM_FULL;
+
+    kv_segment_header_t header = { KV_SEGMENT_MAGIC, kv->store_id, 0, kv->next_sequence };
+    rw_iovec_t iov = { &header, sizeof(header) };
+    uint32_t index;
+    if (rw_writev(block, 0, &iov, 1) != sizeof(header) ||
+        segment_add(kv, block, kv->next_sequence, &index) != MEM_SUCCESS) {
+        rw_block_destroy(block);
+        return MEM_FULL;
+    }
+
+    kv->next_sequence++;
+    kv->active = index;
+    return MEM_SUCCESS;
+}
+
+static int append_record(rw_kv_t* kv, const void* key, size_t key_len,
+                         const void* value, size_t value_len,
+                         uint32_t* segment, uint32_t* offset) {
+    size_t size = record_size(key_len, value_len);
+
+    // Compacting the segment just filled may use up the next one as well
+    while (kv->active == KV_NONE ||
+           kv->segments[kv->active].used + size > kv->segments[kv->active].block->size) {
+        uint32_t previous = kv->active;
+        if (open_segment(kv, size) != MEM_SUCCESS) return MEM_FULL;
+        if (previous != KV_NONE) segment_check(kv, previous);
+    }
+
+    kv_segment_t* target = &kv->segments[kv->active];
+    kv_record_t header = { (uint32_t)key_len, (uint32_t)value_len, RECORD_LIVE };
+    rw_iovec_t iov[3] = {
+        { &header, sizeof(header) },
+        { (void*)key, key_len },
+        { (void*)value, value_len },
+    };
+    size_t length = sizeof(header) + key_len + value_len;
+    if (rw_writev(target->block, target->used, iov, value_len ? 3 : 2) != length) {
+        return MEM_FULL;
+    }
+
+    *segment = kv->active;
+    *offset = (uint32_t)target->used;
+    target->used += size;
+    target->live_bytes += size;
+    kv->stats.live_bytes += size;
+    return MEM_SUCCESS;
+}
+
+static void kill_record(rw_kv_t* kv, uint32_t index, uint32_t offset) {
+    data_block_t* block = kv->segments[index].block;
+    if (!rw_block_acquire(block)) return;
+    const kv_record_t* record = (const kv_record_t*)(block->data + offset);
+    size_t size = record_size(record->key_len, record->value_len);
+    rw_block_release(block);
+
+    uint32_t dead = RECORD_DEAD;
+    rw_write_data_at(block, offset + offsetof(kv_record_t, state), &dead, sizeof(dead));
+
+    kv->segments[index].live_bytes -= size;
+    kv->stats.live_bytes -= size;
+    kv->stats.dead_bytes += size;
+    segment_check(kv, index);
+}
+
+int rw_kv_put(rw_kv_t* kv, const void* key, size_t key_len, const void* value, size_t value_len) {
+    if (!kv || !key || key_len == 0 || key_len > RW_KV_MAX_KEY) return MEM_INVALID;
+    if ((!value && value_len > 0) || value_len > UINT32_MAX - RW_KV_MAX_KEY) return MEM_INVALID;
+
+    uint64_t hash = key_hash(kv->seed, key, key_len);
+
+    pthread_rwlock_wrlock(&kv->lock);
+    size_t slot = 0, insert_at = 0;
+    int rc = index_reserve(kv);
+    if (rc == MEM_SUCCESS) rc = index_find(kv, hash, key, key_len, &slot, &insert_at);
+    bool exists = rc == MEM_SUCCESS;
+
+    if (rc != MEM_FULL) {
+        uint32_t segment, offset;
+        rc = append_record(kv, key, key_len, value, value_len, &segment, &offset);
+        if (rc == MEM_SUCCESS && exists) {
+            uint32_t old_segment = kv->slots[slot].segment;
+            uint32_t old_offset = kv->slots[slot].offset;
+            kv->slots[slot].segment = segment;
+            kv->slots[slot].offset = offset;
+            kill_record(kv, old_segment, old_offset);
+        } else if (rc == MEM_SUCCESS) {
+            // Compaction only repoints slots, so insert_at is still free
+            if (kv->ctrl[insert_at] == CTRL_DELETED) kv->tombstones--;
+            kv->ctrl[insert_at] = hash_tag(hash);
+            kv->slots[insert_at] = (kv_slot_t){ hash, segment, offset };
+            kv->count++;
+            kv->stats.keys++;
+        }
+    }
+    pthread_rwlock_unlock(&kv->lock);
+
+    return rc;
+}
+
+int rw_kv_get(rw_kv_t* kv, const void* key, size_t key_len,
+              void* buffer, size_t buffer_size, size_t* value_len) {
+    if (!kv || !key || key_len == 0 || key_len > RW_KV_MAX_KEY) return MEM_INVALID;
+    if (!buffer && buffer_size > 0) return MEM_INVALID;
+
+    uint64_t hash = key_hash(kv->seed, key, key_len);
+
+    pthread_rwlock_rdlock(&kv->lock);
+    size_t slot;
+    int rc = index_find(kv, hash, key, key_len, &slot, NULL);
+    if (rc == MEM_SUCCESS) {
+        data_block_t* block = kv->segments[kv->slots[slot].segment].block;
+        if (rw_block_acquire(block)) {
+            const kv_record_t* record = (const kv_record_t*)(block->data + kv->slots[slot].offset);
+            size_t length = record->value_len;
+            size_t copy = length < buffer_size ? length : buffer_size;
+            if (copy > 0) {
+                memcpy(buffer, (const uint8_t*)(record + 1) + record->key_len, copy);
+            }
+            rw_block_release(block);
+            if (value_len) *value_len = length;
+        } else {
+            rc = MEM_FULL;
+        }
+    }
+    pthread_rwlock_unlock(&kv->lock);
+
+    return rc;
+}
+
+int rw_kv_delete(rw_kv_t* kv, const void* key, size_t key_len) {
+    if (!kv || !key || key_len == 0 || key_len > RW_KV_MAX_KEY) return MEM_INVALID;
+
+    uint64_t hash = key_hash(kv->seed, key, key_len);
+
+    pthread_rwlock_wrlock(&kv->lock);
+    size_t slot;
+    int rc = index_find(kv, hash, key, key_len, &slot, NULL);
+    if (rc == MEM_SUCCESS) {
+        // Probes never pass a group with an empty slot, so in such a
+        // group the slot can go back to empty rather than deleted
+        if (group_match(kv->ctrl + (slot & ~(size_t)(KV_GROUP - 1)), CTRL_EMPTY)) {
+            kv->ctrl[slot] = CTRL_EMPTY;
+        } else {
+            kv->ctrl[slot] = CTRL_DELETED;
+            kv->tombstones++;
+        }
+        kv->count--;
+        kv->stats.keys--;
+        kill_record(kv, kv->slots[slot].segment, kv->slots[slot].offset);
+    }
+    pthread_rwlock_unlock(&kv->lock);
+
+    return rc;
+}
+
+size_t rw_kv_scan(rw_kv_t* kv, const void* prefix, size_t prefix_len,
+                  rw_kv_visitor_t visitor, void* context) {
+    if (!kv || !visitor || (!prefix && prefix_len > 0)) return 0;
+
+    size_t visited = 0;
+    bool stop = false;
+
+    pthread_rwlock_rdlock(&kv->lock);
+    for (size_t i = 0; i < kv->segment_count && !stop; i++) {
+        data_block_t* block = kv->segments[i].block;
+        if (!block || !rw_block_acquire(block)) continue;
+
+        size_t offset = sizeof(kv_segment_header_t);
+        while (offset < kv->segments[i].used) {
+            const kv_record_t* record = (const kv_record_t*)(block->data + offset);
+            const uint8_t* key = (const uint8_t*)(record + 1);
+            offset += record_size(record->key_len, record->value_len);
+
+            if (record->state != RECORD_LIVE || record->key_len < prefix_len) continue;
+            if (prefix_len > 0 && memcmp(key, prefix, prefix_len) != 0) continue;
+
+            visited++;
+            if (!visitor(key, record->key_len, key + record->key_len, record->value_len, context)) {
+                stop = true;
+                break;
+            }
+        }
+        rw_block_release(block);
+    }
+    pthread_rwlock_unlock(&kv->lock);
+
+    return visited;
+}
+
+void rw_kv_get_stats(rw_kv_t* kv, rw_kv_stats_t* stats) {
+    if (!kv || !stats) return;
+
+    pthread_rwlock_rdlock(&kv->lock);
+    *stats = kv->stats;
+    pthread_rwlock_unlock(&kv->lock);
+}
+
+typedef struct {
+    data_block_t* block;
+    uint64_t sequence;
+} found_segment_t;
+
+typedef struct {
+    uint32_t store_id;
+    found_segment_t* found;
+    size_t count;
+    size_t capacity;
+} segment_search_t;
+
+static bool find_segment(data_block_t* block, void* context) {
+    segment_search_t* search = context;
+    kv_segment_header_t header;
+    rw_iovec_t iov = { &header, sizeof(header) };
+
+    if (block->size < sizeof(header) || rw_readv(block, 0, &iov, 1) != sizeof(header)) return true;
+    if (header.magic != KV_SEGMENT_MAGIC || header.store_id != search->store_id) return true;
+
+    if (search->count == search->capacity) {
+        size_t capacity = search->capacity ? search->capacity * 2 : 16;
+        found_segment_t* grown = realloc(search->found, capacity * sizeof(found_segment_t));
+        if (!grown) return true;
+        search->found = grown;
+        search->capacity = capacity;
+    }
+    search->found[search->count].block = block;
+    search->found[search->count].sequence = header.sequence;
+    search->count++;
+    return true;
+}
+
+static int compare_sequence(const void* a, const void* b) {
+    uint64_t x = ((const found_segment_t*)a)->sequence;
+    uint64_t y = ((const found_segment_t*)b)->sequence;
+    return (x > y) - (x < y);
+}
+
+// Index the live records of a segment. A key already indexed from an
+// older segment, left live by an interrupted update, loses to this one.
+static int load_segment(rw_kv_t* kv, uint32_t index) {
+    data_block_t* block = kv->segments[index].block;
+    if (!rw_block_acquire(block)) return MEM_FULL;
+
+    int rc = MEM_SUCCESS;
+    size_t offset = sizeof(kv_segment_header_t);
+    while (offset + sizeof(kv_record_t) <= block->size) {
+        const kv_record_t* record = (const kv_record_t*)(block->data + offset);
+        if (record->key_len == 0) break;
+
+        size_t size = record_size(record->key_len, record->value_len);
+        if (record->key_len > RW_KV_MAX_KEY || size > block->size - offset) break;
+
+        if (record->state != RECORD_LIVE) {
+            kv->stats.dead_bytes += size;
+            offset += size;
+            continue;
+        }
+
+        const uint8_t* key = (const uint8_t*)(record + 1);
+        uint64_t hash = key_hash(kv->seed, key, record->key_len);
+        size_t slot = 0, insert_at = 0;
+        rc = index_reserve(kv);
+        if (rc == MEM_SUCCESS) rc = index_find(kv, hash, key, record->key_len, &slot, &insert_at);
+
+        if (rc == MEM_SUCCESS) {
+            uint32_t old_segment = kv->slots[slot].segment;
+            uint32_t old_offset = kv->slots[slot].offset;
+            kv->slots[slot].segment = index;
+            kv->slots[slot].offset = (uint32_t)offset;
+            kill_record(kv, old_segment, old_offset);
+        } else if (rc == MEM_INVALID) {
+            if (kv->ctrl[insert_at] == CTRL_DELETED) kv->tombstones--;
+            kv->ctrl[insert_at] = hash_tag(hash);
+            kv->slots[insert_at] = (kv_slot_t){ hash, index, (uint32_t)offset };
+            kv->count++;
+            kv->stats.keys++;
+        } else {
+            break;
+        }
+        rc = MEM_SUCCESS;
+
+        kv->segments[index].live_bytes += size;
+        kv->stats.live_bytes += size;
+        offset += size;
+    }
+    kv->segments[index].used = offset;
+
+    rw_block_release(block);
+    return rc;
+}
+
+rw_kv_t* rw_kv_open(const rw_kv_config_t* config) {
+    if (!config) return NULL;
+
+    rw_kv_t* kv = calloc(1, sizeof(rw_kv_t));
+    if (!kv) return NULL;
+
+    kv->store_id = config->store_id;
+    kv->segment_size = config->segment_size ? config->segment_size : KV_DEFAULT_SEGMENT;
+    if (kv->segment_size < 4096) kv->segment_size = 4096;
+    kv->active = KV_NONE;
+    kv->next_sequence = 1;
+    pthread_rwlock_init(&kv->lock, NULL);
+
+    if (getrandom(&kv->seed, sizeof(kv->seed), 0) != sizeof(kv->seed)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        kv->seed = mix64((uint64_t)ts.tv_nsec ^ (uint64_t)(uintptr_t)kv);
+    }
+
+    size_t capacity = KV_MIN_SLOTS;
+    while (capacity / 8 * 7 < config->expected_keys) {
+        capacity *= 2;
+    }
+    if (index_resize(kv, capacity) != MEM_SUCCESS) {
+        rw_kv_close(kv);
+        return NULL;
+    }
+
+    // Pick up the store's segments, oldest first
+    segment_search_t search = { config->store_id, NULL, 0, 0 };
+    rw_for_each_block(find_segment, &search);
+    if (search.count) qsort(search.found, search.count, sizeof(found_segment_t), compare_sequence);
+
+    int rc = MEM_SUCCESS;
+    kv->compacting = true;
+    for (size_t i = 0; i < search.count && rc == MEM_SUCCESS; i++) {
+        uint32_t index;
+        rc = segment_add(kv, search.found[i].block, search.found[i].sequence, &index);
+        if (rc == MEM_SUCCESS) rc = load_segment(kv, index);
+        if (rc == MEM_SUCCESS) {
+            kv->active = index;
+            kv->next_sequence = search.found[i].sequence + 1;
+        }
+    }
+    kv->compacting = false;
+    free(search.found);
+
+    if (rc != MEM_SUCCESS) {
+        rw_kv_close(kv);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < kv->segment_count; i++) {
+        segment_check(kv, (uint32_t)i);
+    }
+    return kv;
+}
+
+void rw_kv_close(rw_kv_t* kv) {
+    if (!kv) return;
+
+    rw_registry_lock();
+    rw_free_locked(kv->ctrl, kv->capacity);
+    rw_free_locked(kv->slots, kv->capacity * sizeof(kv_slot_t));
+    rw_registry_unlock();
+
+    pthread_rwlock_destroy(&kv->lock);
+    free(kv->segments);
+    free(kv);
+}
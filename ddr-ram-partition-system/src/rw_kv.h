@@ -0,0 +1,66 @@
+#ifndef RW_KV_H
+#define RW_KV_H
+
+#include "rw_partition.h"
+
+// Key-value store inside the RW partition
+//
+// Records (binary key, binary value) are appended to segment blocks of the
+// partition, so they are checksummed, journaled, snapshotted and tiered
+// like any other block data. An open-addressing hash index, also in
+// partition memory, maps keys to records: a control byte per slot holds 7
+// bits of the key's hash, and lookups compare 16 control bytes at a time.
+//
+// Overwrites and deletions mark the old record dead. A segment left more
+// than half dead is compacted: its live records move to the segment being
+// filled and the block is deleted. Opening a store rebuilds the index from
+// the segments already in the partition, e.g. after journal recovery.
+//
+// A handle may be used from several threads: lookups and scans run
+// concurrently, updates one at a time. Open a store at most once at a time,
+// and close it before rw_init() resets the partition.
+
+#define RW_KV_MAX_KEY   65535
+
+typedef struct rw_kv rw_kv_t;
+
+typedef struct {
+    uint32_t store_id;              // Several stores can share the partition
+    size_t segment_size;            // 0: 1 MB; larger records get their own
+    size_t expected_keys;           // Index sized for this many up front
+} rw_kv_config_t;
+
+typedef struct {
+    uint64_t keys;
+    uint64_t segments;
+    uint64_t live_bytes;            // Reachable records
+    uint64_t dead_bytes;            // Overwritten or deleted, not yet compacted
+    uint64_t index_slots;
+    uint64_t index_bytes;
+    uint64_t index_resizes;
+    uint64_t compactions;
+} rw_kv_stats_t;
+
+// Return false to stop the scan. Pointers are valid during the call only;
+// the visitor must not modify the store.
+typedef bool (*rw_kv_visitor_t)(const void* key, size_t key_len,
+                                const void* value, size_t value_len, void* context);
+
+// NULL if the partition is not initialised or has no room for the index
+rw_kv_t* rw_kv_open(const rw_kv_config_t* config);
+// Frees the index; the records stay in the partition
+void rw_kv_close(rw_kv_t* kv);
+
+int rw_kv_put(rw_kv_t* kv, const void* key, size_t key_len, const void* value, size_t value_len);
+// Copies up to `buffer_size` bytes of the value and stores its full length
+// in `value_len`. MEM_INVALID if the key is not there.
+int rw_kv_get(rw_kv_t* kv, const void* key, size_t key_len,
+              void* buffer, size_t buffer_size, size_t* value_len);
+int rw_kv_delete(rw_kv_t* kv, const void* key, size_t key_len);
+// Visit the live records whose key starts with `prefix` (all of them for
+// an empty prefix), in no particular order; returns the number visited
+size_t rw_kv_scan(rw_kv_t* kv, const void* prefix, size_t prefix_len,
+                  rw_kv_visitor_t visitor, void* context);
+void rw_kv_get_stats(rw_kv_t* kv, rw_kv_stats_t* stats);
+
+#endif // RW_KV_H
@@ -0,0 +1,496 @@
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Merkle trees over the RW partition.
+//
+// Trees are complete binary trees stored as 1-based heaps: the root is
+// node 1, the children of node i are 2i and 2i + 1, and the leaves of a
+// tree `width` leaves wide (a power of two) are nodes width..2*width-1.
+// Leaves past the last chunk or block are 0, and so is every node with
+// two zero children, so padding costs nothing to hash.
+//
+// Writers set one bit per chunk they touch and then the tree's stale
+// flag; the updater clears the flag before collecting the bits, so a
+// write racing with an update is picked up by the next one. Chunks are
+// hashed under the block's sequence counter and rehashed if a write got
+// in between.
+
+#define MERKLE_BATCH 1024
+
+struct rw_merkle {
+    size_t chunks;
+    size_t width;
+    atomic_bool stale;
+    atomic_ulong* dirty;            // One bit per chunk, after the nodes
+    uint64_t nodes[];               // 2 * width; nodes[0] unused
+};
+
+static pthread_mutex_t merkle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rw_merkle_stats_t stats = {0};
+
+// Partition tree, leaves in registry order as of the last update
+static uint64_t* top = NULL;
+static uint32_t* top_ids = NULL;
+static size_t top_width = 0;
+static size_t top_leaves = 0;
+
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+// Multiply-mix over 16-byte words; one multiply per word keeps it close
+// to memory speed. Not collision resistant: a multiply by a chosen zero
+// operand wipes out the other, so these only catch accidental changes.
+static uint64_t hash_bytes(const uint8_t* data, size_t size) {
+    const uint64_t k0 = 0xA0761D6478BD642Full, k1 = 0xE7037ED1A0B428DBull;
+    uint64_t h = 0x8EBC6AF09C88C6E3ull ^ size;
+    size_t left = size;
+
+    while (left >= 16) {
+        uint64_t a, b;
+        memcpy(&a, data, 8);
+        memcpy(&b, data + 8, 8);
+        h = mum(a ^ k0 ^ h, b ^ k1);
+        data += 16;
+        left -= 16;
+    }
+    if (left > 0) {
+        uint8_t tail[16] = {0};
+        memcpy(tail, data, left);
+        uint64_t a, b;
+        memcpy(&a, tail, 8);
+        memcpy(&b, tail + 8, 8);
+        h = mum(a ^ k0 ^ h, b ^ k1);
+    }
+    return mum(h ^ k1, size ^ k0);
+}
+
+static inline uint64_t hash_node(uint64_t left, uint64_t right) {
+    if (left == 0 && right == 0) return 0;
+    return mum(left ^ 0x589965CC75374CC3ull, right ^ 0x1D8E4E27C47D124Full) ^ left;
+}
+
+static inline uint64_t hash_block_leaf(uint32_t id, size_t size, uint64_t root) {
+    return mum((uint64_t)id ^ 0xD6E8FEB86659FD93ull, (uint64_t)size ^ 0x9E3779B97F4A7C15ull) ^
+           mum(root ^ 0xA0761D6478BD642Full, 0xE7037ED1A0B428DBull);
+}
+
+static inline size_t round_up_pow2(size_t n) {
+    size_t width = 1;
+    while (width < n) {
+        width <<= 1;
+    }
+    return width;
+}
+
+static inline size_t merkle_bytes(size_t width) {
+    size_t words = (width + 63) / 64;
+    return sizeof(rw_merkle_t) + 2 * width * sizeof(uint64_t) + words * sizeof(atomic_ulong);
+}
+
+static inline size_t chunk_length(size_t block_size, size_t chunk) {
+    size_t offset = chunk * RW_MERKLE_CHUNK;
+    size_t left = block_size - offset;
+    return left < RW_MERKLE_CHUNK ? left : RW_MERKLE_CHUNK;
+}
+
+void rw_merkle_touch(rw_merkle_t* merkle, size_t offset, size_t size) {
+    if (size == 0) return;
+
+    size_t first = offset / RW_MERKLE_CHUNK;
+    size_t last = (offset + size - 1) / RW_MERKLE_CHUNK;
+    for (size_t word = first / 64; word <= last / 64; word++) {
+        size_t lo = word == first / 64 ? first % 64 : 0;
+        size_t hi = word == last / 64 ? last % 64 : 63;
+        unsigned long mask = (hi == 63 ? ~0ul : (1ul << (hi + 1)) - 1) & ~((1ul << lo) - 1);
+        // Repeated writes to the same chunks only read the word
+        if ((atomic_load_explicit(&merkle->dirty[word], memory_order_relaxed) & mask) != mask) {
+            atomic_fetch_or(&merkle->dirty[word], mask);
+        }
+    }
+    atomic_store(&merkle->stale, true);
+}
+
+void rw_merkle_free_locked(rw_merkle_t* merkle) {
+    if (merkle) rw_free_locked(merkle, merkle_bytes(merkle->width));
+}
+
+void rw_merkle_reset(void) {
+    // Block trees went with the partition
+    pthread_mutex_lock(&merkle_mutex);
+    free(top);
+    free(top_ids);
+    top = NULL;
+    top_ids = NULL;
+    top_width = 0;
+    top_leaves = 0;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&merkle_mutex);
+}
+
+// Tree for a block seen for the first time, every chunk dirty
+static rw_merkle_t* merkle_create(data_block_t* block) {
+    size_t chunks = block->size ? (block->size + RW_MERKLE_CHUNK - 1) / RW_MERKLE_CHUNK : 1;
+    size_t width = round_up_pow2(chunks);
+
+    rw_merkle_t* merkle = rw_alloc_or_reclaim(merkle_bytes(width), true);
+    if (!merkle) return NULL;
+    merkle->chunks = chunks;
+    merkle->width = width;
+    merkle->dirty = (atomic_ulong*)(merkle->nodes + 2 * width);
+    for (size_t c = 0; c < chunks; c++) {
+        merkle->dirty[c / 64] |= 1ul << (c % 64);
+    }
+    atomic_store(&merkle->stale, true);
+
+    // A writer that started before this is caught by the sequence check
+    rw_merkle_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&block->merkle, &expected, merkle)) {
+        rw_registry_lock();
+        rw_free_locked(merkle, merkle_bytes(width));
+        rw_registry_unlock();
+        return expected;
+    }
+    return merkle;
+}
+
+// Recompute the parents of `count` sorted nodes, level by level up to the
+// root; `nodes` is overwritten
+static size_t rehash_up(uint64_t* tree, size_t* nodes, size_t count) {
+    size_t hashed = 0;
+    while (count > 0 && nodes[0] > 1) {
+        size_t parents = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t parent = nodes[i] / 2;
+            if (parents > 0 && nodes[parents - 1] == parent) continue;
+            nodes[parents++] = parent;
+        }
+        for (size_t i = 0; i < parents; i++) {
+            size_t n = nodes[i];
+            tree[n] = hash_node(tree[2 * n], tree[2 * n + 1]);
+        }
+        hashed += parents;
+        count = parents;
+    }
+    return hashed;
+}
+
+static uint64_t hash_chunk(const data_block_t* block, size_t chunk) {
+    size_t offset = chunk * RW_MERKLE_CHUNK;
+    size_t length = chunk_length(block->size, chunk);
+    uint64_t hash;
+    uint32_t version;
+    do {
+        version = rw_block_read_stable(block);
+        hash = hash_bytes(block->data + offset, length);
+    } while (!rw_block_read_valid(block, version));
+    return hash;
+}
+
+// Rehash the chunks written since the last update. False if the block is
+// compressed or spilled: it stays stale until it is next read or written,
+// rather than being brought back (and warmed up) for the hash.
+static bool update_block(data_block_t* block, rw_merkle_t* merkle, size_t** scratch,
+                         size_t* scratch_size) {
+    if (!atomic_exchange(&merkle->stale, false)) return true;
+    if (!rw_block_try_acquire_raw(block)) {
+        atomic_store(&merkle->stale, true);
+        return false;
+    }
+
+    if (*scratch_size < merkle->chunks) {
+        size_t* grown = realloc(*scratch, merkle->chunks * sizeof(size_t));
+        if (!grown) {
+            rw_block_release(block);
+            atomic_store(&merkle->stale, true);
+            return false;
+        }
+        *scratch = grown;
+        *scratch_size = merkle->chunks;
+    }
+    size_t* nodes = *scratch;
+
+    size_t count = 0, bytes = 0;
+    size_t words = (merkle->chunks + 63) / 64;
+    for (size_t w = 0; w < words; w++) {
+        unsigned long bits = atomic_exchange(&merkle->dirty[w], 0);
+        while (bits) {
+            size_t chunk = w * 64 + (size_t)__builtin_ctzl(bits);
+            bits &= bits - 1;
+            merkle->nodes[merkle->width + chunk] = hash_chunk(block, chunk);
+            nodes[count++] = merkle->width + chunk;
+            bytes += chunk_length(block->size, chunk);
+        }
+    }
+    rw_block_release(block);
+
+    size_t hashed = rehash_up(merkle->nodes, nodes, count);
+
+    stats.chunks_hashed += count;
+    stats.bytes_hashed += bytes;
+    stats.nodes_hashed += hashed;
+    return true;
+}
+
+// Every live block, in registry order
+static data_block_t** copy_registry(size_t* count) {
+    size_t capacity = rw_registry_count() + MERKLE_BATCH;
+    for (;;) {
+        data_block_t** blocks = malloc(capacity * sizeof(data_block_t*));
+        if (!blocks) return NULL;
+        size_t n = rw_registry_snapshot(0, blocks, capacity);
+        if (n < capacity) {
+            *count = n;
+            return blocks;
+        }
+        free(blocks);
+        capacity *= 2;
+    }
+}
+
+// Caller holds merkle_mutex and a read section
+static uint64_t update_locked(void) {
+    size_t count = 0;
+    data_block_t** blocks = copy_registry(&count);
+    if (!blocks) return top ? top[1] : 0;
+
+    size_t width = round_up_pow2(count ? count : 1);
+    bool rebuild = width != top_width;
+    if (rebuild) {
+        uint64_t* grown = calloc(2 * width, sizeof(uint64_t));
+        uint32_t* ids = calloc(width, sizeof(uint32_t));
+        if (!grown || !ids) {
+            free(grown);
+            free(ids);
+            free(blocks);
+            return top ? top[1] : 0;
+        }
+        free(top);
+        free(top_ids);
+        top = grown;
+        top_ids = ids;
+        top_width = width;
+        top_leaves = 0;
+    }
+
+    size_t* changed = malloc(((count > top_leaves ? count : top_leaves) + 1) * sizeof(size_t));
+    size_t changes = 0;
+    size_t* scratch = NULL;
+    size_t scratch_size = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        data_block_t* block = blocks[i];
+        rw_merkle_t* merkle = atomic_load(&block->merkle);
+        if (!merkle) merkle = merkle_create(block);
+
+        uint64_t leaf = 0;
+        if (merkle) {
+            update_block(block, merkle, &scratch, &scratch_size);
+            leaf = hash_block_leaf(block->id, block->size, merkle->nodes[1]);
+        }
+        top_ids[i] = block->id;
+        if (top[width + i] != leaf || rebuild) {
+            top[width + i] = leaf;
+            if (changed) changed[changes++] = width + i;
+        }
+    }
+    // Blocks deleted since: their leaves go back to padding
+    for (size_t i = count; i < top_leaves; i++) {
+        top[width + i] = 0;
+        top_ids[i] = 0;
+        if (changed) changed[changes++] = width + i;
+    }
+    top_leaves = count;
+
+    if (changed) {
+        stats.nodes_hashed += rehash_up(top, changed, changes);
+    } else {
+        // No room to track changes; rehash the whole tree
+        for (size_t n = width - 1; n >= 1; n--) {
+            top[n] = hash_node(top[2 * n], top[2 * n + 1]);
+        }
+    }
+
+    stats.updates++;
+    stats.blocks = count;
+
+    free(changed);
+    free(scratch);
+    free(blocks);
+    return top[1];
+}
+
+uint64_t rw_merkle_update(void) {
+    pthread_mutex_lock(&merkle_mutex);
+    // Blocks of the copy deleted meanwhile stay allocated until it is done
+    uint64_t epoch = rw_epoch_enter();
+    uint64_t root = update_locked();
+    rw_epoch_exit(epoch);
+    pthread_mutex_unlock(&merkle_mutex);
+
+    return root;
+}
+
+size_t rw_merkle_verify(uint32_t* corrupted_ids, size_t max_ids) {
+    size_t found = 0;
+
+    pthread_mutex_lock(&merkle_mutex);
+    uint64_t epoch = rw_epoch_enter();
+    size_t count = 0;
+    data_block_t** blocks = copy_registry(&count);
+
+    for (size_t i = 0; blocks && i < count; i++) {
+        data_block_t* block = blocks[i];
+        rw_merkle_t* merkle = atomic_load(&block->merkle);
+        // Cold blocks are left cold, as by the scrubber
+        if (!merkle || !rw_block_try_acquire_raw(block)) continue;
+
+        size_t mismatches = 0;
+        for (size_t c = 0; c < merkle->chunks; c++) {
+            // Chunks written since the last update have no hash to check
+            unsigned long dirty = atomic_load(&merkle->dirty[c / 64]);
+            if (dirty & (1ul << (c % 64))) continue;
+
+            uint64_t hash = hash_chunk(block, c);
+            // A write may have landed while hashing
+            dirty = atomic_load(&merkle->dirty[c / 64]);
+            if (hash != merkle->nodes[merkle->width + c] && !(dirty & (1ul << (c % 64)))) {
+                mismatches++;
+            }
+        }
+        rw_block_release(block);
+
+        if (mismatches > 0) {
+            if (found < max_ids && corrupted_ids) corrupted_ids[found] = block->id;
+            found++;
+            stats.mismatches += mismatches;
+            LOG_WARN("Merkle verify: block %u has %zu changed chunk(s)", block->id, mismatches);
+        }
+    }
+
+    rw_epoch_exit(epoch);
+    free(blocks);
+    pthread_mutex_unlock(&merkle_mutex);
+
+    return found;
+}
+
+int rw_merkle_prove(data_block_t* block, size_t offset, size_t size, rw_merkle_proof_t* proof) {
+    if (!block || !proof || size == 0 || offset >= block->size) return MEM_INVALID;
+
+    pthread_mutex_lock(&merkle_mutex);
+    uint64_t epoch = rw_epoch_enter();
+    uint64_t root = update_locked();
+
+    // The leaf is at the block's registry slot unless it moved meanwhile
+    size_t leaf = block->registry_slot;
+    if (leaf >= top_leaves || top_ids[leaf] != block->id) {
+        for (leaf = 0; leaf < top_leaves && top_ids[leaf] != block->id; leaf++) {
+        }
+    }
+    rw_merkle_t* merkle = atomic_load(&block->merkle);
+    if (leaf == top_leaves || !merkle || atomic_load(&merkle->stale)) {
+        rw_epoch_exit(epoch);
+        pthread_mutex_unlock(&merkle_mutex);
+        return MEM_ERROR;
+    }
+
+    if (size > block->size - offset) size = block->size - offset;
+    size_t first = offset / RW_MERKLE_CHUNK;
+    size_t last = (offset + size - 1) / RW_MERKLE_CHUNK;
+
+    memset(proof, 0, sizeof(*proof));
+    proof->root = root;
+    proof->block_id = block->id;
+    proof->block_size = block->size;
+    proof->offset = first * RW_MERKLE_CHUNK;
+    proof->size = last * RW_MERKLE_CHUNK + chunk_length(block->size, last) - proof->offset;
+    proof->leaf = (uint32_t)leaf;
+
+    // Siblings just outside the range, left before right at each level
+    for (size_t lo = merkle->width + first, hi = merkle->width + last; lo > 1; lo /= 2, hi /= 2) {
+        if (lo & 1) proof->block_path[proof->block_path_length++] = merkle->nodes[lo - 1];
+        if (!(hi & 1)) proof->block_path[proof->block_path_length++] = merkle->nodes[hi + 1];
+    }
+    for (size_t n = top_width + leaf; n > 1; n /= 2) {
+        proof->top_path[proof->top_path_length++] = top[n ^ 1];
+    }
+
+    rw_epoch_exit(epoch);
+    pthread_mutex_unlock(&merkle_mutex);
+    return MEM_SUCCESS;
+}
+
+bool rw_merkle_check(const rw_merkle_proof_t* proof, const void* data) {
+    if (!proof || !data || proof->size == 0) return false;
+    if (proof->block_path_length > 2 * RW_MERKLE_MAX_DEPTH ||
+        proof->top_path_length > RW_MERKLE_MAX_DEPTH) {
+        return false;
+    }
+
+    size_t chunks = (proof->block_size + RW_MERKLE_CHUNK - 1) / RW_MERKLE_CHUNK;
+    size_t width = round_up_pow2(chunks ? chunks : 1);
+    size_t first = proof->offset / RW_MERKLE_CHUNK;
+    size_t count = (proof->size + RW_MERKLE_CHUNK - 1) / RW_MERKLE_CHUNK;
+    if (first + count > chunks) return false;
+
+    // Room for one extra node on each side of the range
+    uint64_t* level = malloc((count + 2) * sizeof(uint64_t));
+    if (!level) return false;
+
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = chunk_length(proof->block_size, first + i);
+        level[i] = hash_bytes(bytes + i * RW_MERKLE_CHUNK, length);
+    }
+
+    size_t lo = width + first, hi = width + first + count - 1;
+    size_t used = 0;
+    bool valid = true;
+    while (lo > 1) {
+        if (lo & 1) {
+            if (used == proof->block_path_length) {
+                valid = false;
+                break;
+            }
+            memmove(level + 1, level, count * sizeof(uint64_t));
+            level[0] = proof->block_path[used++];
+            lo--;
+            count++;
+        }
+        if (!(hi & 1)) {
+            if (used == proof->block_path_length) {
+                valid = false;
+                break;
+            }
+            level[count++] = proof->block_path[used++];
+            hi++;
+        }
+        for (size_t i = 0; i < count / 2; i++) {
+            level[i] = hash_node(level[2 * i], level[2 * i + 1]);
+        }
+        count /= 2;
+        lo /= 2;
+        hi /= 2;
+    }
+    uint64_t block_root = level[0];
+    free(level);
+    if (!valid || used != proof->block_path_length) return false;
+
+    uint64_t node = hash_block_leaf(proof->block_id, proof->block_size, block_root);
+    size_t position = proof->leaf;
+    for (uint32_t i = 0; i < proof->top_path_length; i++, position /= 2) {
+        node = (position & 1) ? hash_node(proof->top_path[i], node)
+                              : hash_node(node, proof->top_path[i]);
+    }
+    return node == proof->root;
+}
+
+rw_merkle_stats_t* get_rw_merkle_stats(void) {
+    return &stats;
+}
@@ -1,22 +1,125 @@
 #include "rw_partition.h"
+#include "rw_internal.h"
+#include "checksum.h"
+#include "config.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 
 static memory_partition_t* rw_partition = NULL;
-static rw_metrics_t metrics = {0};
 static uint32_t next_block_id = 1;
+static rw_checksum_type_t checksum_type = RW_CHECKSUM_CRC32C;
+
+// Metrics are counted per thread, so threads reading different blocks do
+// not fight over one cache line; get_rw_metrics() sums the shards
+#define METRIC_SHARDS 32
+
+typedef struct {
+    _Alignas(64) rw_metrics_t counts;
+} metrics_shard_t;
+
+static metrics_shard_t metric_shards[METRIC_SHARDS];
+static atomic_uint next_metric_shard;
+static _Thread_local unsigned my_metric_shard = METRIC_SHARDS;
+static rw_metrics_t metrics = {0};
+
+// Live block registry: dense array, each block remembers its slot
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static data_block_t** live_blocks = NULL;
+static size_t live_count = 0;
+static size_t live_capacity = 0;
+
+static bool registry_add_locked(data_block_t* block) {
+    if (!rw_index_insert_locked(block)) return false;
+    
+    if (live_count == live_capacity) {
+        size_t capacity = live_capacity ? live_capacity * 2 : 256;
+        data_block_t** grown = realloc(live_blocks, capacity * sizeof(data_block_t*));
+        if (!grown) {
+            rw_index_remove_locked(block->id);
+            return false;
+        }
+        live_blocks = grown;
+        live_capacity = capacity;
+    }
+    
+    block->registry_slot = (uint32_t)live_count;
+    live_blocks[live_count++] = block;
+    return true;
+}
+
+static bool registry_remove_locked(data_block_t* block) {
+    uint32_t slot = block->registry_slot;
+    if (slot == RW_SLOT_NONE || slot >= live_count || live_blocks[slot] != block) return false;
+    
+    data_block_t* last = live_blocks[--live_count];
+    live_blocks[slot] = last;
+    last->registry_slot = slot;
+    block->registry_slot = RW_SLOT_NONE;
+    
+    rw_index_remove_locked(block->id);
+    return true;
+}
+
+void rw_registry_lock(void) {
+    pthread_mutex_lock(&registry_mutex);
+}
+
+void rw_registry_unlock(void) {
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+size_t rw_registry_snapshot(size_t start, data_block_t** out, size_t max) {
+    size_t copied = 0;
+    
+    pthread_mutex_lock(&registry_mutex);
+    while (start + copied < live_count && copied < max) {
+        out[copied] = live_blocks[start + copied];
+        copied++;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    
+    return copied;
+}
+
+size_t rw_registry_count(void) {
+    pthread_mutex_lock(&registry_mutex);
+    size_t count = live_count;
+    pthread_mutex_unlock(&registry_mutex);
+    return count;
+}
+
+bool rw_block_is_live_locked(const data_block_t* block, uint32_t id) {
+    return block->registry_slot < live_count &&
+           live_blocks[block->registry_slot] == block &&
+           block->id == id;
+}
 
 void rw_init(memory_partition_t* partition) {
     if (!partition) return;
     
+    pthread_mutex_lock(&registry_mutex);
     rw_partition = partition;
-    
-    printf("Read/Write partition initialized\n");
+    live_count = 0;
+    rw_index_reset_locked();
+    rw_alloc_reset_locked(partition);
+    pthread_mutex_unlock(&registry_mutex);
+    rw_dedup_reset();
+    rw_snapshot_reset();
+    rw_tier_reset();
+    rw_heat_reset(partition);
+    rw_merkle_reset();
+    rw_epoch_reset();
+    
+    LOG_INFO("Read/Write partition initialized");
     
     // Initialize metrics
+    memset(metric_shards, 0, sizeof(metric_shards));
     memset(&metrics, 0, sizeof(rw_metrics_t));
 }
 
@@ -43,7 +146,7 @@ void rw_perform_operations(void) {
     printf("Data written and read: %s\n", read_buffer);
     
     // Verify checksum
-    uint32_t calculated_cs = calculate_checksum(block->data, block->size);
+    uint32_t calculated_cs = rw_block_checksum(block);
     printf("Checksum: stored=0x%08X, calculated=0x%08X\n", 
            block->checksum, calculated_cs);
     
@@ -62,126 +165,567 @@ void rw_benchmark(void) {
     
     printf("\n=== Read/Write Benchmark ===\n");
     
+    // A short pass for the demo; benchmarks/rw_bench.c sweeps up to 64 MB
     const size_t block_sizes[] = {64, 256, 1024, 4096, 16384};  // Bytes
-    const int iterations = 100;
-    
-    for (int i = 0; i < 5; i++) {
-        size_t block_size = block_sizes];
-        clock_t total_time = 0;
-        
-        printf("\nTesting block size: %zu bytes\n", block_size);
-        
-        // Write benchmark
-        clock_t write_start = clock();
-        for (int j = 0; j < iterations; j++) {
-            data_block_t* block = rw_create_data_block(block_size);
-            if (block) {
-                // Fill with pattern
-                for (size_t k = 0; k < block_size; k++) {
-                    block->data[k] = (uint8_t)((j + k) & 0xFF);
-                }
-                block->checksum = calculate_checksum(block->data, block_size);
-                
-                metrics.bytes_written += block_size;
-                metrics.total_writes++;
-                
-                rw_delete_data_block(block);
-            }
-        }
-        clock_t write_end = clock();
-        double write_time = (double)(write_end - write_start) / CLOCKS_PER_SEC;
-        
-        printf("  Write: %.2f MB/s\n", 
-               (iterations * block_size) / (write_time * 1024 * 1024));
-        
-        // Read benchmark
-        data_block_t* test_block = rw_create_data_block(block_size);
-        if (test_block) {
-            clock_t read_start = clock();
-            for (int j = 0; j < iterations; j++) {
-                char* buffer = malloc(block_size);
-                rw_read_data(test_block, buffer, block_size);
-                metrics.bytes_read += block_size;
-                metrics.total_reads++;
-                free(buffer);
-            }
-            clock_t read_end = clock();
-            double read_time = (double)(read_end - read_start) / CLOCKS_PER_SEC;
-            
-            printf("  Read:  %.2f MB/s\n", 
-                   (iterations * block_size) / (read_time * 1024 * 1024));
-            
-            rw_delete_data_block(test_block);
-        }
-    }
-    
+    bench_config_t config;
+    bench_default_config(&config);
+    config.warmup_ns = 10000000ull;
+    config.min_run_ns = 2000000ull;
+    config.runs = 10;
+    
+    bench_report_t report;
+    bench_report_begin(&report, stdout, BENCH_FORMAT_TEXT, "rw_partition");
+    rw_benchmark_sizes(block_sizes, sizeof(block_sizes) / sizeof(block_sizes[0]),
+                       &config, &report);
+    bench_report_end(&report);
+    
+    const rw_metrics_t* totals = get_rw_metrics();
     printf("\nTotal operations: %zu reads, %zu writes\n",
-           metrics.total_reads, metrics.total_writes);
+           totals->total_reads, totals->total_writes);
     printf("Total data: %.2f MB read, %.2f MB written\n",
-           metrics.bytes_read / (1024.0 * 1024.0),
-           metrics.bytes_written / (1024.0 * 1024.0));
+           totals->bytes_read / (1024.0 * 1024.0),
+           totals->bytes_written / (1024.0 * 1024.0));
+    if (totals->dedup_lookups) {
+        printf("Dedup: %.1f%% hit rate, %.2f MB saved\n",
+               100.0 * totals->dedup_hits / totals->dedup_lookups,
+               totals->dedup_bytes_saved / (1024.0 * 1024.0));
+    }
 }
 
-data_block_t* rw_create_data_block(size_t size) {
+// `id` 0 allocates the next free id. A journaled creation is logged before
+// the block is published, so no write to it can be logged ahead of it, and
+// the log is not rotated in between.
+static data_block_t* block_new(uint32_t id, size_t size, bool journal) {
     if (!rw_partition || size == 0) return NULL;
     
-    // Allocate block structure
-    data_block_t* block = (data_block_t*)partition_alloc(rw_partition, sizeof(data_block_t));
-    if (!block) return NULL;
+    // With dedup on, new blocks of a size share one zeroed buffer. Blocks
+    // recovered by the journal are filled in place and never share.
+    bool shareable = id == 0 && checksum_type == RW_CHECKSUM_CRC32C;
+    rw_chunk_t* zero = NULL;
+    if (shareable) {
+        zero = rw_dedup_share_zero(size, crc32c_zeros(size));
+    }
+    
+    // Allocate block structure and data; with tiering on this may spill
+    // cold blocks, so the registry lock is not held across it
+    data_block_t* block = (data_block_t*)rw_alloc_or_reclaim(sizeof(data_block_t), true);
+    if (!block) {
+        rw_dedup_put(zero, size);
+        return NULL;
+    }
     
-    // Allocate data
-    block->data = (uint8_t*)partition_alloc(rw_partition, size);
+    block->shared = zero;
+    block->data = zero ? zero->data : (uint8_t*)rw_alloc_or_reclaim(size, true);
     if (!block->data) {
-        // Free the block structure if data allocation fails
-        // Note: In real implementation, we'd need proper deallocation
+        pthread_mutex_lock(&registry_mutex);
+        rw_free_locked(block, sizeof(data_block_t));
+        pthread_mutex_unlock(&registry_mutex);
         return NULL;
     }
     
-    block->id = next_block_id++;
+    pthread_mutex_lock(&registry_mutex);
+    
+    if (id == 0) {
+        id = next_block_id++;
+    } else if (id >= next_block_id) {
+        next_block_id = id + 1;
+    }
+    block->id = id;
+    atomic_init(&block->version, 0);
+    atomic_init(&block->pins, 0);
+    atomic_init(&block->dirty, false);
+    block->file_offset = -1;
+    block->registry_slot = RW_SLOT_NONE;
+    atomic_init(&block->state, RW_BLOCK_RAW);
+    block->packed = NULL;
+    block->packed_size = 0;
+    block->skip_version = 0;
+    atomic_init(&block->last_access_ms, rw_coarse_ms());
+    block->created_epoch = rw_snapshot_current_epoch();
+    block->birth_epoch = block->created_epoch;
+    block->versions = NULL;
+    atomic_init(&block->access_count, 0);
+    block->spill_offset = -1;
+    block->spill_length = 0;
+    block->spill_version = 0;
+    block->spill_packed = false;
+    pthread_mutex_unlock(&registry_mutex);
+    
     block->size = size;
-    block->checksum = 0;
+    block->checksum_type = checksum_type;
     block->timestamp = time(NULL);
     
-    printf("Created data block %u, size: %zu bytes\n", block->id, size);
+    // Data starts zeroed; CRC32C of zeros needs no pass over the data
+    if (checksum_type == RW_CHECKSUM_CRC32C) {
+        block->checksum = crc32c_zeros(size);
+    } else {
+        block->checksum = calculate_checksum(block->data, size);
+    }
     
+    if (shareable && !zero) {
+        rw_dedup_register_zero(block);
+    }
+    
+    uint64_t lsn = journal ? rw_journal_log_create(block->id, size) : 0;
+    
+    // Publish only once the block is fully initialised
+    pthread_mutex_lock(&registry_mutex);
+    bool registered = registry_add_locked(block);
+    pthread_mutex_unlock(&registry_mutex);
+    
+    // Recovery must not bring back a block that never existed
+    if (!registered && lsn) lsn = rw_journal_log_delete(block->id);
+    if (journal) rw_journal_create_done();
+    rw_journal_commit(lsn);
+    
+    if (!registered) {
+        // Storage shared meanwhile stays with the other users
+        rw_dedup_put(block->shared, size);
+        pthread_mutex_lock(&registry_mutex);
+        if (!block->shared) rw_free_locked(block->data, size);
+        rw_free_locked(block, sizeof(data_block_t));
+        pthread_mutex_unlock(&registry_mutex);
+        return NULL;
+    }
     return block;
 }
 
+data_block_t* rw_block_create(size_t size) {
+    return block_new(0, size, rw_journal_active());
+}
+
+data_block_t* rw_block_restore(uint32_t id, size_t size) {
+    if (id == 0 || rw_get_block(id)) return NULL;
+    return block_new(id, size, false);
+}
+
+data_block_t* rw_create_data_block(size_t size) {
+    data_block_t* block = rw_block_create(size);
+    if (!block) return NULL;
+    
+    LOG_DEBUG("Created data block %u, size: %zu bytes", block->id, size);
+    
+    return block;
+}
+
+rw_metrics_t* rw_metrics_shard(void) {
+    if (my_metric_shard == METRIC_SHARDS) {
+        my_metric_shard = atomic_fetch_add(&next_metric_shard, 1) % METRIC_SHARDS;
+    }
+    return &metric_shards[my_metric_shard].counts;
+}
+
+// Shards are shared once there are more threads than shards
+static inline void account_io(size_t reads, size_t bytes_read,
+                              size_t writes, size_t bytes_written) {
+    rw_metrics_t* shard = rw_metrics_shard();
+    if (reads) {
+        __atomic_fetch_add(&shard->total_reads, reads, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard->bytes_read, bytes_read, __ATOMIC_RELAXED);
+    }
+    if (writes) {
+        __atomic_fetch_add(&shard->total_writes, writes, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard->bytes_written, bytes_written, __ATOMIC_RELAXED);
+    }
+}
+
+// Writes run inside a snapshot epoch, and contents a snapshot still sees
+// are preserved before the first byte changes
+static bool block_write_open(data_block_t* block, uint64_t* epoch) {
+    *epoch = rw_snapshot_enter();
+    rw_block_write_begin(block);
+    if (rw_snapshot_preserve(block, *epoch)) return true;
+    
+    rw_block_write_end(block);
+    rw_snapshot_exit(*epoch);
+    return false;
+}
+
+static void block_write_close(data_block_t* block, uint64_t epoch) {
+    block->birth_epoch = epoch;
+    rw_block_write_end(block);
+    rw_snapshot_exit(epoch);
+}
+
+// Copy into a block between block_write_open/close. CRC32C is patched
+// from the bytes being replaced; the legacy checksum has no incremental
+// form and is recomputed once by block_seal().
+static size_t block_store(data_block_t* block, size_t offset, const void* data, size_t size) {
+    if (offset >= block->size || !data) return 0;
+    if (block->shared && !rw_dedup_unshare(block)) return 0;
+    
+    size_t copy_size = (size > block->size - offset) ? block->size - offset : size;
+    uint8_t* dest = block->data + offset;
+    
+    if (block->checksum_type == RW_CHECKSUM_CRC32C) {
+        block->checksum = crc32c_patch(block->checksum, block->size, offset,
+                                       dest, data, copy_size);
+    }
+    memcpy(dest, data, copy_size);
+    
+    rw_merkle_t* merkle = atomic_load(&block->merkle);
+    if (merkle) rw_merkle_touch(merkle, offset, copy_size);
+    
+    return copy_size;
+}
+
+static void block_seal(data_block_t* block, time_t now) {
+    if (block->checksum_type != RW_CHECKSUM_CRC32C) {
+        block->checksum = calculate_checksum(block->data, block->size);
+    }
+    block->timestamp = now;
+    atomic_store_explicit(&block->dirty, true, memory_order_relaxed);
+}
+
+// Log a write from inside the block's write section; 0 when not journaling
+static inline uint64_t journal_write(const data_block_t* block, size_t offset,
+                                     const rw_iovec_t* iov, int iovcnt) {
+    return rw_journal_active() ? rw_journal_log_write(block->id, offset, iov, iovcnt) : 0;
+}
+
+static size_t block_load(const data_block_t* block, const uint8_t* data, size_t offset,
+                         void* buffer, size_t size) {
+    if (offset >= block->size || !buffer) return 0;
+    
+    size_t copy_size = (size > block->size - offset) ? block->size - offset : size;
+    memcpy(buffer, data + offset, copy_size);
+    
+    return copy_size;
+}
+
+// Readers take no lock: copy, and copy again if a write overlapped. The
+// data pointer may change under us (dedup unshare), but only inside a
+// write, which the version check catches.
+static size_t block_read(const data_block_t* block, size_t offset,
+                         const rw_iovec_t* iov, int iovcnt) {
+    size_t read;
+    uint32_t version;
+    
+    do {
+        version = rw_block_read_stable(block);
+        read = 0;
+        for (int i = 0; i < iovcnt && offset + read < block->size; i++) {
+            read += block_load(block, block->data, offset + read, iov[i].base, iov[i].len);
+        }
+    } while (!rw_block_read_valid(block, version));
+    
+    return read;
+}
+
+// Read a raw block without pinning it, so a hot block's header sees no
+// writes but the sampled access stats. Buffers are only taken away inside
+// a write, so a copy from one freed meanwhile fails validation. False when
+// the block is not raw or a write is in progress: pin and read instead.
+static bool block_read_unpinned(data_block_t* block, size_t offset,
+                                const rw_iovec_t* iov, int iovcnt, size_t* read) {
+    for (;;) {
+        uint32_t version = rw_block_read_begin(block);
+        if ((version & 1) || atomic_load(&block->state) != RW_BLOCK_RAW) return false;
+        
+        const uint8_t* data = __atomic_load_n(&block->data, __ATOMIC_RELAXED);
+        if (!data) return false;
+        
+        size_t n = 0;
+        for (int i = 0; i < iovcnt && offset + n < block->size; i++) {
+            n += block_load(block, data, offset + n, iov[i].base, iov[i].len);
+        }
+        if (rw_block_read_valid(block, version)) {
+            rw_block_touch(block);
+            *read = n;
+            return true;
+        }
+    }
+}
+
 void rw_write_data(data_block_t* block, const void* data, size_t size) {
-    if (!block || !data || size == 0) return;
+    rw_write_data_at(block, 0, data, size);
+    if (block && rw_get_dedup()) rw_dedup_block(block);
+}
+
+void rw_write_data_at(data_block_t* block, size_t offset, const void* data, size_t size) {
+    if (!block || !data || size == 0 || offset >= block->size) return;
     
-    size_t copy_size = (size > block->size) ? block->size : size;
-    memcpy(block->data, data, copy_size);
+    rw_iovec_t iov = { (void*)data, size };
     
-    // Calculate checksum
-    block->checksum = calculate_checksum(block->data, copy_size);
-    block->timestamp = time(NULL);
+    uint64_t epoch;
+    if (!rw_block_acquire(block)) return;
+    if (!block_write_open(block, &epoch)) {
+        rw_block_release(block);
+        return;
+    }
+    uint64_t lsn = journal_write(block, offset, &iov, 1);
+    size_t copy_size = block_store(block, offset, data, size);
+    block_seal(block, time(NULL));
+    block_write_close(block, epoch);
+    rw_block_release(block);
+    rw_journal_commit(lsn);
     
-    metrics.bytes_written += copy_size;
-    metrics.total_writes++;
+    account_io(0, 0, 1, copy_size);
     
-    printf("Wrote %zu bytes to block %u\n", copy_size, block->id);
+    LOG_DEBUG("Wrote %zu bytes to block %u", copy_size, block->id);
 }
 
 void rw_read_data(const data_block_t* block, void* buffer, size_t size) {
     if (!block || !buffer || size == 0) return;
     
-    size_t copy_size = (size > block->size) ? block->size : size;
-    memcpy(buffer, block->data, copy_size);
+    rw_iovec_t iov = { buffer, size };
+    
+    data_block_t* target = (data_block_t*)block;
+    size_t copy_size;
+    if (!block_read_unpinned(target, 0, &iov, 1, &copy_size)) {
+        if (!rw_block_acquire(target)) return;
+        copy_size = block_read(block, 0, &iov, 1);
+        rw_block_release(target);
+    }
+    
+    account_io(1, copy_size, 0, 0);
+    
+    LOG_DEBUG("Read %zu bytes from block %u", copy_size, block->id);
+}
+
+size_t rw_writev(data_block_t* block, size_t offset, const rw_iovec_t* iov, int iovcnt) {
+    if (!block || !iov || iovcnt <= 0) return 0;
+    
+    size_t written = 0;
+    
+    uint64_t epoch;
+    if (!rw_block_acquire(block)) return 0;
+    if (!block_write_open(block, &epoch)) {
+        rw_block_release(block);
+        return 0;
+    }
+    uint64_t lsn = journal_write(block, offset, iov, iovcnt);
+    for (int i = 0; i < iovcnt && offset + written < block->size; i++) {
+        written += block_store(block, offset + written, iov[i].base, iov[i].len);
+    }
+    block_seal(block, time(NULL));
+    block_write_close(block, epoch);
+    rw_block_release(block);
+    rw_journal_commit(lsn);
+    
+    account_io(0, 0, 1, written);
+    
+    LOG_DEBUG("Wrote %zu bytes (%d segments) to block %u", written, iovcnt, block->id);
+    return written;
+}
+
+size_t rw_readv(const data_block_t* block, size_t offset, const rw_iovec_t* iov, int iovcnt) {
+    if (!block || !iov || iovcnt <= 0) return 0;
+    
+    data_block_t* target = (data_block_t*)block;
+    size_t read;
+    if (!block_read_unpinned(target, offset, iov, iovcnt, &read)) {
+        if (!rw_block_acquire(target)) return 0;
+        read = block_read(block, offset, iov, iovcnt);
+        rw_block_release(target);
+    }
+    
+    account_io(1, read, 0, 0);
+    
+    LOG_DEBUG("Read %zu bytes (%d segments) from block %u", read, iovcnt, block->id);
+    return read;
+}
+
+// Warm the caches for an upcoming operation: the block header, the first
+// lines of the block range and of the caller's buffer.
+static inline void prefetch_op(const rw_op_t* op) {
+    if (!op->block || !op->block->data || op->offset >= op->block->size) return;
+    
+    const uint8_t* data = op->block->data + op->offset;
+    const uint8_t* buffer = (const uint8_t*)op->buffer;
+    size_t span = op->size < RW_BATCH_PREFETCH_BYTES ? op->size : RW_BATCH_PREFETCH_BYTES;
+    bool is_write = op->type == RW_OP_WRITE;
+    
+    for (size_t off = 0; off < span; off += 64) {
+        if (is_write) {
+            __builtin_prefetch(data + off, 1);
+            __builtin_prefetch(buffer + off, 0);
+        } else {
+            __builtin_prefetch(data + off, 0);
+            __builtin_prefetch(buffer + off, 1);
+        }
+    }
+}
+
+size_t rw_submit_batch(rw_op_t* ops, size_t count) {
+    if (!ops || count == 0) return 0;
+    
+    size_t reads = 0, writes = 0;
+    size_t bytes_read = 0, bytes_written = 0;
+    size_t completed = 0;
+    time_t now = time(NULL);
+    bool journaling = rw_journal_active();
+    uint64_t lsn = 0;
+    
+    if (ops[0].block) __builtin_prefetch(ops[0].block);
+    if (count > 1 && ops[1].block) __builtin_prefetch(ops[1].block);
+    
+    for (size_t i = 0; i < count; i++) {
+        rw_op_t* op = &ops[i];
+        
+        // Header two ahead, data one ahead (its pointer lives in the header)
+        if (i + 2 < count && ops[i + 2].block) __builtin_prefetch(ops[i + 2].block);
+        if (i + 1 < count) prefetch_op(&ops[i + 1]);
+        
+        op->result = 0;
+        if (!op->block || !op->buffer || op->size == 0) continue;
+        
+        if (op->type != RW_OP_WRITE) {
+            rw_iovec_t iov = { op->buffer, op->size };
+            if (block_read_unpinned(op->block, op->offset, &iov, 1, &op->result)) {
+                reads++;
+                bytes_read += op->result;
+                if (op->result > 0) completed++;
+                continue;
+            }
+        }
+        if (!rw_block_acquire(op->block)) continue;
+        
+        if (op->type == RW_OP_WRITE) {
+            uint64_t epoch;
+            if (!block_write_open(op->block, &epoch)) {
+                rw_block_release(op->block);
+                continue;
+            }
+            if (journaling) {
+                rw_iovec_t iov = { op->buffer, op->size };
+                lsn = rw_journal_log_write(op->block->id, op->offset, &iov, 1);
+            }
+            op->result = block_store(op->block, op->offset, op->buffer, op->size);
+            block_seal(op->block, now);
+            block_write_close(op->block, epoch);
+            writes++;
+            bytes_written += op->result;
+        } else {
+            rw_iovec_t iov = { op->buffer, op->size };
+            op->result = block_read(op->block, op->offset, &iov, 1);
+            reads++;
+            bytes_read += op->result;
+        }
+        rw_block_release(op->block);
+        
+        if (op->result > 0) completed++;
+    }
+    
+    // One commit covers every write of the batch
+    rw_journal_commit(lsn);
+    account_io(reads, bytes_read, writes, bytes_written);
     
-    metrics.bytes_read += copy_size;
-    metrics.total_reads++;
+    return completed;
+}
+
+void rw_block_destroy(data_block_t* block) {
+    if (!block) return;
+    
+    pthread_mutex_lock(&registry_mutex);
+    bool removed = registry_remove_locked(block);
+    pthread_mutex_unlock(&registry_mutex);
+    
+    if (!removed) return;
+    
+    // Storage nobody else shares stays with the block. Shared storage keeps
+    // its reference until the block is freed, and so does a spill slot:
+    // readers and snapshots of the deleted block may still look at them.
+    rw_dedup_detach(block);
+    rw_snapshot_bury(block);
+    if (rw_journal_active()) {
+        rw_journal_commit(rw_journal_log_delete(block->id));
+    }
     
-    printf("Read %zu bytes from block %u\n", copy_size, block->id);
+    // Readers may still be looking at it; freed once they are done
+    rw_epoch_retire(block);
+}
+
+void rw_block_free(data_block_t* block) {
+    // Undo whatever a background pass did to it after it was deleted
+    rw_tier_drop(block);
+    rw_compress_drop(block);
+    // Shared storage goes with its last user
+    rw_dedup_put(block->shared, block->size);
+    
+    pthread_mutex_lock(&registry_mutex);
+    if (block->data && !block->shared) {
+        rw_free_locked(block->data, block->size);
+    }
+    rw_merkle_free_locked(atomic_load(&block->merkle));
+    rw_free_locked(block, sizeof(data_block_t));
+    pthread_mutex_unlock(&registry_mutex);
 }
 
 void rw_delete_data_block(data_block_t* block) {
     if (!block) return;
     
-    printf("Deleted data block %u\n", block->id);
+    uint32_t id = block->id;
+    rw_block_destroy(block);
     
-    // Note: In real implementation, we'd actually free the memory
-    // For simulation, we just mark it as deleted
+    LOG_DEBUG("Deleted data block %u", id);
+}
+
+int rw_borrow(data_block_t* block, size_t offset, size_t size, rw_view_t* view) {
+    if (!block || !view) return MEM_INVALID;
+    if (offset >= block->size) return MEM_INVALID;
+    
+    // The pin is held until rw_release()
+    if (!rw_block_acquire(block)) return MEM_FULL;
+    
+    // Hand out a view of a settled block, never of a half-written one
+    uint32_t version = rw_block_read_stable(block);
+    
+    view->block = block;
+    view->data = block->data + offset;
+    view->size = (size > block->size - offset) ? block->size - offset : size;
+    view->version = version;
+    
+    account_io(1, view->size, 0, 0);
+    
+    return MEM_SUCCESS;
+}
+
+void rw_release(rw_view_t* view) {
+    if (!view || !view->block) return;
+    
+    rw_block_release(view->block);
+    view->block = NULL;
+    view->data = NULL;
+    view->size = 0;
+}
+
+bool rw_view_valid(const rw_view_t* view) {
+    return view && view->block &&
+           rw_block_read_valid(view->block, view->version);
+}
+
+data_block_t* rw_get_block(uint32_t id) {
+    pthread_mutex_lock(&registry_mutex);
+    data_block_t* block = rw_index_lookup_locked(id);
+    pthread_mutex_unlock(&registry_mutex);
+    
+    return block;
+}
+
+// Visits blocks in registry order, a batch at a time, without holding the
+// lock during callbacks. Blocks created or deleted meanwhile may be missed;
+// deleted ones are not freed before the walk ends.
+size_t rw_for_each_block(rw_block_visitor_t visitor, void* context) {
+    if (!visitor) return 0;
+    
+    data_block_t* batch[64];
+    size_t visited = 0;
+    size_t n;
+    uint64_t epoch = rw_epoch_enter();
+    
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, 64)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            visited++;
+            if (!visitor(batch[i], context)) {
+                rw_epoch_exit(epoch);
+                return visited;
+            }
+        }
+    }
+    
+    rw_epoch_exit(epoch);
+    return visited;
 }
 
 uint32_t calculate_checksum(const void* data, size_t size) {
@@ -198,20 +742,80 @@ uint32_t calculate_checksum(const void* data, size_t size) {
     return checksum;
 }
 
+uint32_t rw_block_checksum(const data_block_t* block) {
+    if (!block) return 0;
+    
+    // A maintenance read: scrubbing must not keep blocks warm
+    data_block_t* target = (data_block_t*)block;
+    if (!rw_block_acquire_quiet(target)) return 0;
+    
+    // Of one version of the data, like a read
+    uint32_t checksum, version;
+    do {
+        version = rw_block_read_stable(block);
+        if (block->checksum_type == RW_CHECKSUM_CRC32C) {
+            checksum = crc32c(block->data, block->size);
+        } else {
+            checksum = calculate_checksum(block->data, block->size);
+        }
+    } while (!rw_block_read_valid(block, version));
+    
+    rw_block_release(target);
+    return checksum;
+}
+
+void rw_set_checksum_type(rw_checksum_type_t type) {
+    // Existing blocks keep the algorithm they were created with
+    checksum_type = type;
+}
+
+rw_checksum_type_t rw_get_checksum_type(void) {
+    return checksum_type;
+}
+
 void rw_defragment(void) {
     if (!rw_partition) return;
     
-    printf("Defragmenting read/write partition...\n");
-    printf("Fragmentation simulation complete\n");
+    LOG_INFO("Defragmenting read/write partition...");
+    LOG_INFO("Fragmentation simulation complete");
 }
 
 void rw_verify_integrity(void) {
     if (!rw_partition) return;
     
     printf("Verifying partition integrity...\n");
-    printf("Integrity check passed\n");
+    
+    uint32_t corrupted[RW_SCRUB_MAX_REPORTED];
+    size_t blocks = rw_registry_count();
+    size_t found = rw_scrub(0, corrupted, RW_SCRUB_MAX_REPORTED);
+    
+    if (found == 0) {
+        printf("Integrity check passed (%zu blocks)\n", blocks);
+        return;
+    }
+    
+    printf("Integrity check FAILED: %zu corrupted block(s):", found);
+    for (size_t i = 0; i < found && i < RW_SCRUB_MAX_REPORTED; i++) {
+        printf(" %u", corrupted[i]);
+    }
+    printf("\n");
 }
 
 rw_metrics_t* get_rw_metrics(void) {
+    rw_metrics_t sum = {0};
+    
+    for (int i = 0; i < METRIC_SHARDS; i++) {
+        rw_metrics_t* shard = &metric_shards[i].counts;
+        sum.total_reads += __atomic_load_n(&shard->total_reads, __ATOMIC_RELAXED);
+        sum.total_writes += __atomic_load_n(&shard->total_writes, __ATOMIC_RELAXED);
+        sum.bytes_read += __atomic_load_n(&shard->bytes_read, __ATOMIC_RELAXED);
+        sum.bytes_written += __atomic_load_n(&shard->bytes_written, __ATOMIC_RELAXED);
+        sum.dedup_lookups += __atomic_load_n(&shard->dedup_lookups, __ATOMIC_RELAXED);
+        sum.dedup_hits += __atomic_load_n(&shard->dedup_hits, __ATOMIC_RELAXED);
+        // Shards may go below zero on their own; the sum does not
+        sum.dedup_bytes_saved += __atomic_load_n(&shard->dedup_bytes_saved, __ATOMIC_RELAXED);
+    }
+    
+    metrics = sum;
     return &metrics;
 }
@@ -2,29 +2,143 @@
 #define RW_PARTITION_H
 
 #include "ddr_memory.h"
+#include "bench.h"
+#include <time.h>
+#include <stdatomic.h>
+
+// Checksum algorithms for data blocks
+typedef enum {
+    RW_CHECKSUM_LEGACY,     // Rotate-left-5/XOR, see calculate_checksum()
+    RW_CHECKSUM_CRC32C      // CRC32C, hardware accelerated, incremental
+} rw_checksum_type_t;
+
+typedef struct rw_chunk rw_chunk_t;    // Shared storage, see rw_set_dedup()
+typedef struct rw_version rw_version_t; // Contents kept for snapshots
+typedef struct rw_merkle rw_merkle_t;   // Chunk hash tree, see rw_merkle_update()
 
 // Data structure for read/write operations
 typedef struct {
     uint32_t id;
     uint8_t* data;
     size_t size;
-    uint32_t checksum;
+    uint32_t checksum;              // Covers all `size` bytes of data
+    rw_checksum_type_t checksum_type;
     time_t timestamp;
+    _Atomic uint32_t version;       // Odd while a write is in progress
+    _Atomic uint32_t pins;          // Outstanding views; pinned blocks stay put
+    uint32_t registry_slot;         // Position in the live block registry
+    atomic_bool dirty;              // Written since the last checkpoint
+    int64_t file_offset;            // Slot in the journal data file, -1 if none
+    // Transparent compression; `data` is NULL while compressed
+    _Atomic uint32_t state;         // RW_BLOCK_RAW, RW_BLOCK_COMPRESSED, ...
+    uint8_t* packed;                // Compressed contents
+    uint32_t packed_size;
+    uint32_t skip_version;          // Found incompressible at this version + 1
+    _Atomic uint64_t last_access_ms;
+    rw_chunk_t* shared;             // Storage shared with identical blocks
+    uint64_t created_epoch;         // Snapshot epochs, see rw_snapshot_create()
+    uint64_t birth_epoch;           // Epoch the current contents were written in
+    rw_version_t* versions;         // Older contents still seen by snapshots
+    // Tiering; a spilled block keeps only this header in memory
+    _Atomic uint32_t access_count;  // Sampled; halved by tiering and placement passes
+    int64_t spill_offset;           // Slot in the spill file, -1 if none
+    uint32_t spill_length;
+    uint32_t spill_version;         // Block version the slot holds
+    bool spill_packed;              // Slot holds the compressed form
+    rw_merkle_t* _Atomic merkle;    // NULL until the next rw_merkle_update()
 } data_block_t;
 
 // Read/Write operations
 void rw_init(memory_partition_t* partition);
 void rw_perform_operations(void);
 void rw_benchmark(void);
+// Time write, read, borrow and checksum of one block of each size on the
+// benchmark harness (rw_bench.c); returns the number of results reported,
+// RW_BENCH_CASES per size unless a block could not be created
+#define RW_BENCH_CASES 4
+size_t rw_benchmark_sizes(const size_t* sizes, size_t count, const bench_config_t* config,
+                          bench_report_t* report);
 
 // Data management
 data_block_t* rw_create_data_block(size_t size);
 void rw_write_data(data_block_t* block, const void* data, size_t size);
+void rw_write_data_at(data_block_t* block, size_t offset, const void* data, size_t size);
 void rw_read_data(const data_block_t* block, void* buffer, size_t size);
 void rw_delete_data_block(data_block_t* block);
 
+// Scatter-gather and batched I/O
+//
+// Vectored calls move several buffers to/from consecutive block bytes in
+// one call. A batch runs many block operations back to back with a single
+// metrics update, no per-operation logging, and prefetching of the next
+// operation's block while the current one is copied.
+#define RW_BATCH_PREFETCH_BYTES 256
+
+typedef struct {
+    void* base;
+    size_t len;
+} rw_iovec_t;
+
+typedef enum {
+    RW_OP_READ,
+    RW_OP_WRITE
+} rw_op_type_t;
+
+typedef struct {
+    rw_op_type_t type;
+    data_block_t* block;
+    size_t offset;                  // Byte offset within the block
+    void* buffer;                   // Source for writes, destination for reads
+    size_t size;
+    size_t result;                  // Bytes transferred, set on completion
+} rw_op_t;
+
+size_t rw_writev(data_block_t* block, size_t offset, const rw_iovec_t* iov, int iovcnt);
+size_t rw_readv(const data_block_t* block, size_t offset, const rw_iovec_t* iov, int iovcnt);
+size_t rw_submit_batch(rw_op_t* ops, size_t count);
+
+// Zero-copy reads
+//
+// A view points straight into block->data. While any view is held the
+// block is pinned: compaction and eviction leave its data where it is.
+// Writes are still allowed; rw_view_valid() tells whether one happened
+// since the view was taken.
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    uint32_t version;               // Block version the view was taken at
+    data_block_t* block;
+} rw_view_t;
+
+int rw_borrow(data_block_t* block, size_t offset, size_t size, rw_view_t* view);
+void rw_release(rw_view_t* view);
+bool rw_view_valid(const rw_view_t* view);
+
+// Block lookup and iteration
+typedef bool (*rw_block_visitor_t)(data_block_t* block, void* context);
+
+data_block_t* rw_get_block(uint32_t id);
+size_t rw_for_each_block(rw_block_visitor_t visitor, void* context);
+
+// Concurrent readers
+//
+// Reads take no lock: they copy the data and copy again if a write
+// overlapped, so any number of threads can read a block while others
+// write it. Writers to the same block take turns. Deleted blocks are
+// freed once every read section that might have found them has ended:
+// threads that look blocks up with rw_get_block() while others delete
+// them do so between rw_epoch_enter() and rw_epoch_exit().
+// rw_for_each_block() keeps a section open around its callbacks.
+uint64_t rw_epoch_enter(void);
+void rw_epoch_exit(uint64_t epoch);
+// Free deleted blocks that have become safe; returns how many
+size_t rw_epoch_collect(void);
+
 // Utility functions
 uint32_t calculate_checksum(const void* data, size_t size);
+uint32_t rw_block_checksum(const data_block_t* block);
+void rw_set_checksum_type(rw_checksum_type_t type);
+rw_checksum_type_t rw_get_checksum_type(void);
 void rw_defragment(void);
 void rw_verify_integrity(void);
 
@@ -36,8 +150,249 @@ typedef struct {
     size_t bytes_written;
     double read_latency;
     double write_latency;
+    size_t dedup_lookups;
+    size_t dedup_hits;
+    size_t dedup_bytes_saved;       // Not stored thanks to sharing, right now
 } rw_metrics_t;
 
+// Counters are kept per thread and summed here; the result is overwritten
+// by the next call
 rw_metrics_t* get_rw_metrics(void);
 
+// Content deduplication
+//
+// When enabled, new blocks share one zeroed buffer per size and
+// rw_write_data() looks for a block with the same contents: the block
+// checksum finds candidates, a keyed 128-bit hash confirms them. Matching
+// blocks share storage by reference count, and the first write to a
+// shared block gives it a private copy. Off by default.
+void rw_set_dedup(bool enabled);
+bool rw_get_dedup(void);
+bool rw_block_is_shared(const data_block_t* block);
+
+// Integrity scrubbing
+//
+// A scrub pass walks every live block, recomputes its checksum on a pool of
+// worker threads and reports blocks whose data no longer matches. Blocks
+// being written during the check are skipped, not reported.
+#define RW_SCRUB_MAX_REPORTED 64
+
+typedef struct {
+    uint32_t threads;               // Worker threads per pass
+    size_t bandwidth_limit;         // Bytes/sec over all workers, 0 = no cap
+    uint32_t pass_interval_ms;      // Pause between background passes
+} rw_scrub_config_t;
+
+typedef struct {
+    uint64_t passes;
+    uint64_t blocks_checked;
+    uint64_t bytes_checked;
+    uint64_t blocks_busy;           // Skipped because a write was in progress
+    uint64_t corruptions;
+    uint32_t corrupted_ids[RW_SCRUB_MAX_REPORTED];  // First ids found, no repeats
+    uint32_t corrupted_count;
+} rw_scrub_stats_t;
+
+// Synchronous parallel pass. Stores up to `max_ids` corrupted block ids and
+// returns how many corrupted blocks were found.
+size_t rw_scrub(uint32_t threads, uint32_t* corrupted_ids, size_t max_ids);
+
+// Continuous background scrubbing at low priority
+int rw_scrub_start(const rw_scrub_config_t* config);
+void rw_scrub_stop(void);
+// A copy; the counters keep moving while a scrub runs
+rw_scrub_stats_t get_rw_scrub_stats(void);
+
+// Transparent compression of cold blocks
+//
+// A pass compresses blocks that have not been accessed for `cold_after_ms`
+// into compact buffers inside the partition and releases their raw memory
+// for reuse. The next read, write or borrow decompresses the block again.
+// Blocks that would not shrink by `min_savings_percent` stay raw and are
+// not retried until they are written.
+#define RW_COMPRESS_RATIO_BUCKETS 5     // <1.5x, <2x, <4x, <8x, >=8x
+
+typedef struct {
+    uint32_t cold_after_ms;
+    uint32_t scan_interval_ms;          // Pause between background passes
+    size_t min_block_size;
+    uint32_t min_savings_percent;
+} rw_compress_config_t;
+
+typedef struct {
+    uint64_t compressions;
+    uint64_t decompressions;
+    uint64_t incompressible;            // Attempts rejected by the savings policy
+    uint64_t blocks_compressed;         // Currently compressed
+    uint64_t raw_bytes;                 // Uncompressed size of those blocks
+    uint64_t packed_bytes;              // Partition bytes they occupy now
+    uint64_t ratio_histogram[RW_COMPRESS_RATIO_BUCKETS];
+} rw_compress_stats_t;
+
+// Synchronous pass; returns the number of blocks compressed
+size_t rw_compress_pass(const rw_compress_config_t* config);
+int rw_compress_start(const rw_compress_config_t* config);
+void rw_compress_stop(void);
+bool rw_block_is_compressed(const data_block_t* block);
+double rw_block_compression_ratio(const data_block_t* block);
+rw_compress_stats_t* get_rw_compress_stats(void);
+void print_rw_compress_stats(void);
+
+// Point-in-time snapshots
+//
+// rw_snapshot_create() ends the current write epoch and returns its id.
+// Reads against the id see the partition as it was then while writers
+// carry on: the first write to a block after a snapshot keeps a copy of
+// the old contents, collected once every snapshot that sees it has been
+// released. Creation waits only for writes already in progress. Ids start
+// at 1; 0 means failure.
+typedef uint64_t rw_snapshot_t;
+
+typedef struct {
+    uint64_t snapshots_created;
+    uint64_t snapshots_active;
+    uint64_t versions;              // Old block contents kept for snapshots
+    uint64_t version_bytes;
+    uint64_t versions_collected;
+} rw_snapshot_stats_t;
+
+rw_snapshot_t rw_snapshot_create(void);
+int rw_snapshot_retain(rw_snapshot_t snapshot);
+void rw_snapshot_release(rw_snapshot_t snapshot);
+// The caller must hold the snapshot
+size_t rw_read_snapshot(data_block_t* block, rw_snapshot_t snapshot,
+                        size_t offset, void* buffer, size_t size);
+// Blocks as of the snapshot, including ones deleted since
+size_t rw_snapshot_for_each(rw_snapshot_t snapshot, rw_block_visitor_t visitor, void* context);
+rw_snapshot_stats_t* get_rw_snapshot_stats(void);
+
+// Spill-to-disk tiering
+//
+// With tiering on, the partition acts as a cache over a spill file. When
+// an allocation finds the partition full, cold blocks (long idle, rarely
+// used) are written out, leaving their headers behind, and the next access
+// reads them back in. A background thread keeps usage between the
+// watermarks, spilling cold blocks and bringing back ones that were busy
+// when pushed out once there is room again.
+typedef struct {
+    const char* spill_path;
+    uint32_t high_watermark_percent;    // Spill above this usage...
+    uint32_t low_watermark_percent;     // ...down to this one
+    uint32_t scan_interval_ms;
+    uint32_t promote_min_accesses;      // Recent accesses to earn a way back
+} rw_tier_config_t;
+
+typedef struct {
+    uint64_t evictions;
+    uint64_t clean_evictions;           // Slot was up to date, nothing written
+    uint64_t faults;
+    uint64_t promotions;                // Brought back in the background
+    uint64_t blocks_spilled;            // Currently
+    uint64_t bytes_spilled;
+    uint64_t spill_file_bytes;
+} rw_tier_stats_t;
+
+int rw_tier_start(const rw_tier_config_t* config);
+// Brings every block back; MEM_FULL if they do not fit, in which case the
+// spill file stays in use. Deleted blocks that snapshots still see keep
+// their slots until the snapshots are released.
+int rw_tier_stop(void);
+// One synchronous watermark pass; returns the number of blocks moved
+size_t rw_tier_balance(void);
+bool rw_block_is_spilled(const data_block_t* block);
+rw_tier_stats_t* get_rw_tier_stats(void);
+
+// Access heatmap and hot/cold placement
+//
+// rw_heatmap() sums the blocks' access counts over equal slices of the
+// partition address space, showing where the hot data lives.
+//
+// A placement pass ranks blocks by recent accesses per byte and moves the
+// hottest ones, as many as fit, into a hot region of the partition, and
+// the ones that cooled down back out. The region is reserved by the first
+// pass; from 2 MB up it is aligned to and advised for transparent huge
+// pages. Other allocations never come from it, so hot data shares TLB
+// entries and cache lines only with other hot data.
+typedef struct {
+    size_t hot_bytes;                   // Region size, fixed by the first pass
+    uint32_t hot_min_accesses;          // Recent (sampled) accesses to qualify
+    uint32_t scan_interval_ms;          // Pause between background passes
+} rw_heat_config_t;
+
+typedef struct {
+    uint64_t passes;
+    uint64_t promotions;                // Moved into the hot region
+    uint64_t demotions;                 // Moved out after cooling down
+    uint64_t hot_blocks;                // In the region after the last pass
+    uint64_t hot_bytes_used;
+    uint64_t hot_bytes;                 // Region size, 0 until reserved
+    bool huge_pages;                    // Advised for transparent huge pages
+} rw_heat_stats_t;
+
+// Fill `heat[regions]`; returns the bytes per slice, 0 if not initialised
+size_t rw_heatmap(uint64_t* heat, size_t regions);
+void print_rw_heatmap(size_t regions);
+// Synchronous pass; returns the number of blocks moved
+size_t rw_heat_pass(const rw_heat_config_t* config);
+int rw_heat_start(const rw_heat_config_t* config);
+void rw_heat_stop(void);
+bool rw_block_is_hot(const data_block_t* block);
+rw_heat_stats_t* get_rw_heat_stats(void);
+
+// Merkle tree integrity
+//
+// Every block is split into RW_MERKLE_CHUNK-byte chunks under a binary hash
+// tree, and the block roots (with id and size) form the leaves of a tree
+// over the partition. Writes only mark the chunks they touch;
+// rw_merkle_update() rehashes those chunks and the nodes above them, so
+// keeping the root current costs in proportion to what was written, not
+// to the partition size. The first update after a block is created hashes
+// it in full. Compressed and spilled blocks are neither hashed nor
+// verified; one written before it went cold cannot be proven until its
+// data is back.
+//
+// The tree only detects accidental corruption. Hashes are 64-bit unkeyed
+// multiply-mixes with fixed constants, picked for speed: anyone can build
+// data and a path that hash up to a given root, so a passing
+// rw_merkle_check() proves nothing against someone who means to forge it.
+// A "proof" holds the O(log n) sibling hashes linking a chunk-aligned range
+// of one block to the root, so a copy of the range can be checked for
+// bit rot against the root without rehashing the whole block.
+#define RW_MERKLE_CHUNK     4096
+#define RW_MERKLE_MAX_DEPTH 48
+
+typedef struct {
+    uint64_t root;
+    uint32_t block_id;
+    size_t block_size;
+    size_t offset;                  // Range covered, widened to whole chunks
+    size_t size;
+    uint32_t leaf;                  // Block's position among the leaves
+    uint32_t block_path_length;
+    uint32_t top_path_length;
+    uint64_t block_path[2 * RW_MERKLE_MAX_DEPTH];  // Range boundary siblings
+    uint64_t top_path[RW_MERKLE_MAX_DEPTH];
+} rw_merkle_proof_t;
+
+typedef struct {
+    uint64_t updates;
+    uint64_t blocks;                // Leaves after the last update
+    uint64_t chunks_hashed;
+    uint64_t bytes_hashed;
+    uint64_t nodes_hashed;
+    uint64_t mismatches;            // Chunks rw_merkle_verify() found changed
+} rw_merkle_stats_t;
+
+// Bring the tree up to date and return the root
+uint64_t rw_merkle_update(void);
+// Rehash every chunk the tree has a hash for and compare: stores up to
+// `max_ids` ids of blocks whose data changed outside the write paths and
+// returns how many were found
+size_t rw_merkle_verify(uint32_t* corrupted_ids, size_t max_ids);
+// Update, then prove bytes [offset, offset + size) of the block
+int rw_merkle_prove(data_block_t* block, size_t offset, size_t size, rw_merkle_proof_t* proof);
+// True if `data` (proof->size bytes) hashes up to proof->root
+bool rw_merkle_check(const rw_merkle_proof_t* proof, const void* data);
+rw_merkle_stats_t* get_rw_merkle_stats(void);
+
 #endif // RW_PARTITION_H
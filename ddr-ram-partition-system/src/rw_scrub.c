@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SCRUB_BATCH          64     // Blocks claimed per registry visit
+#define SCRUB_BUSY_RETRIES   3
+#define SCRUB_MAX_THREADS    4      // Default cap when threads == 0
+
+typedef enum {
+    SCRUB_OK,
+    SCRUB_BUSY,
+    SCRUB_CORRUPT
+} scrub_result_t;
+
+typedef struct {
+    atomic_size_t cursor;           // Next registry position to claim
+    atomic_bool* stop;              // Optional, background scrubbing only
+    uint32_t* corrupted_ids;
+    size_t max_ids;
+    atomic_size_t found;
+    // Bandwidth cap shared by all workers of the pass
+    size_t bandwidth_limit;
+    pthread_mutex_t throttle_mutex;
+    uint64_t throttle_next_ns;
+} scrub_pass_t;
+
+static rw_scrub_stats_t scrub_stats = {0};
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Background scrubber
+static pthread_t scrub_thread;
+static bool scrub_running = false;
+static atomic_bool scrub_stop_flag;
+static pthread_mutex_t scrub_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scrub_wait_cond = PTHREAD_COND_INITIALIZER;
+static rw_scrub_config_t scrub_config;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    nanosleep(&ts, NULL);
+}
+
+// Reserve `bytes` of the bandwidth budget, sleeping until they are due
+static void scrub_throttle(scrub_pass_t* pass, size_t bytes) {
+    if (pass->bandwidth_limit == 0) return;
+
+    uint64_t now = now_ns();
+    uint64_t cost = (uint64_t)((double)bytes * 1e9 / pass->bandwidth_limit);
+
+    pthread_mutex_lock(&pass->throttle_mutex);
+    if (pass->throttle_next_ns < now) pass->throttle_next_ns = now;
+    uint64_t start = pass->throttle_next_ns;
+    pass->throttle_next_ns += cost;
+    pthread_mutex_unlock(&pass->throttle_mutex);
+
+    if (start > now) {
+        sleep_ns(start - now);
+    }
+}
+
+static scrub_result_t scrub_raw_block(data_block_t* block, uint32_t id) {
+    for (int attempt = 0; attempt < SCRUB_BUSY_RETRIES; attempt++) {
+        uint32_t version = rw_block_read_begin(block);
+        if (version & 1) {
+            sched_yield();
+            continue;
+        }
+
+        uint32_t stored = block->checksum;
+        uint32_t actual = rw_block_checksum(block);
+        if (!rw_block_read_valid(block, version)) continue;
+        if (stored == actual) return SCRUB_OK;
+
+        // Only report blocks that were not deleted while we looked at them
+        rw_registry_lock();
+        bool live = rw_block_is_live_locked(block, id);
+        rw_registry_unlock();
+        return live ? SCRUB_CORRUPT : SCRUB_OK;
+    }
+    return SCRUB_BUSY;
+}
+
+static scrub_result_t scrub_block(data_block_t* block, uint32_t id) {
+    // Compressed blocks are left cold; they are checked when next unpacked
+    if (!rw_block_try_acquire_raw(block)) return SCRUB_OK;
+    scrub_result_t result = scrub_raw_block(block, id);
+    rw_block_release(block);
+    return result;
+}
+
+static void record_corruption(uint32_t id) {
+    pthread_mutex_lock(&stats_mutex);
+    scrub_stats.corruptions++;
+
+    bool known = false;
+    for (uint32_t i = 0; i < scrub_stats.corrupted_count; i++) {
+        if (scrub_stats.corrupted_ids[i] == id) {
+            known = true;
+            break;
+        }
+    }
+    if (!known && scrub_stats.corrupted_count < RW_SCRUB_MAX_REPORTED) {
+        scrub_stats.corrupted_ids[scrub_stats.corrupted_count++] = id;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static void* scrub_worker(void* arg) {
+    scrub_pass_t* pass = arg;
+    data_block_t* batch[SCRUB_BATCH];
+    uint64_t checked = 0, bytes = 0, busy = 0;
+
+    for (;;) {
+        if (pass->stop && atomic_load(pass->stop)) break;
+
+        size_t start = atomic_fetch_add(&pass->cursor, SCRUB_BATCH);
+        // Blocks of the batch deleted meanwhile stay allocated until it is done
+        uint64_t epoch = rw_epoch_enter();
+        size_t n = rw_registry_snapshot(start, batch, SCRUB_BATCH);
+        if (n == 0) {
+            rw_epoch_exit(epoch);
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            data_block_t* block = batch[i];
+            uint32_t id = block->id;
+
+            scrub_throttle(pass, block->size);
+
+            switch (scrub_block(block, id)) {
+                case SCRUB_OK:
+                    break;
+                case SCRUB_BUSY:
+                    busy++;
+                    break;
+                case SCRUB_CORRUPT: {
+                    size_t slot = atomic_fetch_add(&pass->found, 1);
+                    if (slot < pass->max_ids) {
+                        pass->corrupted_ids[slot] = id;
+                    }
+                    record_corruption(id);
+                    break;
+                }
+            }
+            checked++;
+            bytes += block->size;
+        }
+        rw_epoch_exit(epoch);
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    scrub_stats.blocks_checked += checked;
+    scrub_stats.bytes_checked += bytes;
+    scrub_stats.blocks_busy += busy;
+    pthread_mutex_unlock(&stats_mutex);
+
+    return NULL;
+}
+
+static uint32_t default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    return cpus > SCRUB_MAX_THREADS ? SCRUB_MAX_THREADS : (uint32_t)cpus;
+}
+
+// One pass over the registry; the calling thread is one of the workers.
+// Blocks appended or moved by deletions during the pass may be skipped or
+// checked twice; the next pass picks them up.
+static size_t scrub_run_pass(scrub_pass_t* pass, uint32_t threads) {
+    if (threads == 0) threads = default_threads();
+
+    atomic_store(&pass->cursor, 0);
+    atomic_store(&pass->found, 0);
+
+    pthread_t* helpers = calloc(threads, sizeof(pthread_t));
+    uint32_t started = 0;
+    if (helpers) {
+        for (uint32_t i = 1; i < threads; i++) {
+            if (pthread_create(&helpers[started], NULL, scrub_worker, pass) != 0) break;
+            started++;
+        }
+    }
+
+    scrub_worker(pass);
+
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+    free(helpers);
+
+    pthread_mutex_lock(&stats_mutex);
+    scrub_stats.passes++;
+    pthread_mutex_unlock(&stats_mutex);
+
+    return atomic_load(&pass->found);
+}
+
+size_t rw_scrub(uint32_t threads, uint32_t* corrupted_ids, size_t max_ids) {
+    scrub_pass_t pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.corrupted_ids = corrupted_ids;
+    pass.max_ids = corrupted_ids ? max_ids : 0;
+    pthread_mutex_init(&pass.throttle_mutex, NULL);
+
+    size_t found = scrub_run_pass(&pass, threads);
+
+    pthread_mutex_destroy(&pass.throttle_mutex);
+    return found;
+}
+
+static void* scrub_background(void* arg) {
+    (void)arg;
+
+#ifdef SCHED_IDLE
+    // Only use otherwise idle CPU time; pass workers inherit the policy
+    struct sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    scrub_pass_t pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.stop = &scrub_stop_flag;
+    pass.bandwidth_limit = scrub_config.bandwidth_limit;
+    pthread_mutex_init(&pass.throttle_mutex, NULL);
+
+    while (!atomic_load(&scrub_stop_flag)) {
+        uint32_t found[RW_SCRUB_MAX_REPORTED];
+        pass.corrupted_ids = found;
+        pass.max_ids = RW_SCRUB_MAX_REPORTED;
+
+        size_t corrupted = scrub_run_pass(&pass, scrub_config.threads);
+        for (size_t i = 0; i < corrupted && i < RW_SCRUB_MAX_REPORTED; i++) {
+            LOG_ERROR("Scrubber: block %u failed checksum verification", found[i]);
+        }
+
+        // Sleep between passes, waking early on stop
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)scrub_config.pass_interval_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+
+        pthread_mutex_lock(&scrub_wait_mutex);
+        while (!atomic_load(&scrub_stop_flag)) {
+            if (pthread_cond_timedwait(&scrub_wait_cond, &scrub_wait_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&scrub_wait_mutex);
+    }
+
+    pthread_mutex_destroy(&pass.throttle_mutex);
+    return NULL;
+}
+
+int rw_scrub_start(const rw_scrub_config_t* config) {
+    if (!config) return MEM_INVALID;
+    if (scrub_running) return MEM_ERROR;
+
+    scrub_config = *config;
+    atomic_store(&scrub_stop_flag, false);
+
+    if (pthread_create(&scrub_thread, NULL, scrub_background, NULL) != 0) {
+        return MEM_ERROR;
+    }
+
+    scrub_running = true;
+    LOG_INFO("Background scrubber started (%u threads, %zu KB/s cap)",
+           config->threads ? config->threads : default_threads(),
+           config->bandwidth_limit / 1024);
+    return MEM_SUCCESS;
+}
+
+void rw_scrub_stop(void) {
+    if (!scrub_running) return;
+
+    pthread_mutex_lock(&scrub_wait_mutex);
+    atomic_store(&scrub_stop_flag, true);
+    pthread_cond_broadcast(&scrub_wait_cond);
+    pthread_mutex_unlock(&scrub_wait_mutex);
+
+    pthread_join(scrub_thread, NULL);
+    scrub_running = false;
+}
+
+rw_scrub_stats_t get_rw_scrub_stats(void) {
+    pthread_mutex_lock(&stats_mutex);
+    rw_scrub_stats_t copy = scrub_stats;
+    pthread_mutex_unlock(&stats_mutex);
+    return copy;
+}
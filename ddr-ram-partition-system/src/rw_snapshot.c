@@ -0,0 +1,403 @@
+#include "rw_internal.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+// Point-in-time snapshots.
+//
+// Time is divided into epochs. Taking a snapshot ends the current epoch:
+// the snapshot id is the epoch that ended, and it sees every write made in
+// it or before. Each block remembers the epoch its contents were written
+// in; a write that would overwrite contents a live snapshot still sees
+// first copies them onto the block's version chain.
+//
+// Writers register in the epoch they run in, on a sharded counter. Taking
+// a snapshot bumps the epoch and waits for the writers of the old one to
+// drain, so a snapshot never sees half of a write.
+
+#define WRITER_SHARDS 32
+
+typedef struct {
+    _Alignas(64) atomic_ulong writers[2];       // By epoch parity
+} writer_shard_t;
+
+typedef struct {
+    rw_snapshot_t id;
+    uint32_t refs;
+} active_snapshot_t;
+
+typedef struct {
+    data_block_t* block;
+    uint64_t deleted_epoch;
+} grave_t;
+
+static writer_shard_t shards[WRITER_SHARDS];
+static atomic_uint next_shard;
+static _Thread_local unsigned my_shard = WRITER_SHARDS;
+
+static _Atomic uint64_t current_epoch = 1;
+static _Atomic uint64_t latest_snapshot = 0;    // Newest live snapshot, 0 if none
+static pthread_mutex_t create_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Live snapshots (ascending ids), blocks with versions and deleted blocks
+// that snapshots still see
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static active_snapshot_t* active = NULL;
+static size_t active_count = 0, active_capacity = 0;
+static data_block_t** versioned = NULL;
+static size_t versioned_count = 0, versioned_capacity = 0;
+static grave_t* graves = NULL;
+static size_t grave_count = 0, grave_capacity = 0;
+
+static rw_snapshot_stats_t stats = {0};
+
+static bool reserve(void** array, size_t* capacity, size_t count, size_t element) {
+    if (count < *capacity) return true;
+
+    size_t grown_capacity = *capacity ? *capacity * 2 : 16;
+    void* grown = realloc(*array, grown_capacity * element);
+    if (!grown) return false;
+    *array = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+// Any live snapshot in [from, to)? Snapshot mutex held.
+static bool needed_locked(uint64_t from, uint64_t to) {
+    for (size_t i = 0; i < active_count; i++) {
+        if (active[i].id >= from && active[i].id < to) return true;
+    }
+    return false;
+}
+
+uint64_t rw_snapshot_current_epoch(void) {
+    return atomic_load(&current_epoch);
+}
+
+uint64_t rw_snapshot_enter(void) {
+    if (my_shard == WRITER_SHARDS) {
+        my_shard = atomic_fetch_add(&next_shard, 1) % WRITER_SHARDS;
+    }
+    writer_shard_t* shard = &shards[my_shard];
+
+    for (;;) {
+        uint64_t epoch = atomic_load(&current_epoch);
+        atomic_fetch_add(&shard->writers[epoch & 1], 1);
+        // Registered before the bump, or we see the new epoch and retry
+        if (atomic_load(&current_epoch) == epoch) return epoch;
+        atomic_fetch_sub(&shard->writers[epoch & 1], 1);
+    }
+}
+
+void rw_snapshot_exit(uint64_t epoch) {
+    atomic_fetch_sub_explicit(&shards[my_shard].writers[epoch & 1], 1, memory_order_release);
+}
+
+bool rw_snapshot_preserve(data_block_t* block, uint64_t epoch) {
+    // The contents are only needed by a snapshot taken since they were
+    // written. In the short window of a snapshot being created this may
+    // keep a version nobody needs; the next collection drops it.
+    uint64_t latest = atomic_load(&latest_snapshot);
+    if (latest < block->birth_epoch || block->birth_epoch >= epoch) return true;
+
+    rw_version_t* version = malloc(sizeof(rw_version_t));
+    if (!version) return false;
+
+    version->data = rw_alloc_or_reclaim(block->size, false);
+    if (!version->data) {
+        free(version);
+        return false;
+    }
+
+    memcpy(version->data, block->data, block->size);
+    version->size = block->size;
+    version->birth_epoch = block->birth_epoch;
+    version->end_epoch = epoch;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    if (!block->versions) {
+        if (!reserve((void**)&versioned, &versioned_capacity, versioned_count,
+                     sizeof(data_block_t*))) {
+            pthread_mutex_unlock(&snapshot_mutex);
+            rw_registry_lock();
+            rw_free_locked(version->data, block->size);
+            rw_registry_unlock();
+            free(version);
+            return false;
+        }
+        versioned[versioned_count++] = block;
+    }
+    version->next = block->versions;
+    block->versions = version;
+    stats.versions++;
+    stats.version_bytes += block->size;
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    return true;
+}
+
+void rw_snapshot_bury(data_block_t* block) {
+    // Deleted blocks stay readable through snapshots that saw them
+    if (atomic_load(&latest_snapshot) < block->created_epoch) return;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    if (reserve((void**)&graves, &grave_capacity, grave_count, sizeof(grave_t))) {
+        graves[grave_count].block = block;
+        graves[grave_count].deleted_epoch = atomic_load(&current_epoch);
+        grave_count++;
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+}
+
+bool rw_snapshot_holds(data_block_t* block) {
+    pthread_mutex_lock(&snapshot_mutex);
+    bool held = block->versions != NULL;
+    for (size_t i = 0; !held && i < grave_count; i++) {
+        held = graves[i].block == block;
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+    return held;
+}
+
+void rw_snapshot_reset(void) {
+    pthread_mutex_lock(&create_mutex);
+    pthread_mutex_lock(&snapshot_mutex);
+    // Version buffers go with the partition; only host memory is freed here
+    for (size_t i = 0; i < versioned_count; i++) {
+        rw_version_t* version = versioned[i]->versions;
+        while (version) {
+            rw_version_t* next = version->next;
+            free(version);
+            version = next;
+        }
+    }
+    versioned_count = 0;
+    active_count = 0;
+    grave_count = 0;
+    atomic_store(&latest_snapshot, 0);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&snapshot_mutex);
+    pthread_mutex_unlock(&create_mutex);
+}
+
+rw_snapshot_t rw_snapshot_create(void) {
+    pthread_mutex_lock(&create_mutex);
+
+    uint64_t epoch = atomic_load(&current_epoch);
+
+    pthread_mutex_lock(&snapshot_mutex);
+    if (!reserve((void**)&active, &active_capacity, active_count, sizeof(active_snapshot_t))) {
+        pthread_mutex_unlock(&snapshot_mutex);
+        pthread_mutex_unlock(&create_mutex);
+        return 0;
+    }
+    active[active_count].id = epoch;
+    active[active_count].refs = 1;
+    active_count++;
+    stats.snapshots_active++;
+    stats.snapshots_created++;
+    // Writers of the next epoch must already see this snapshot
+    atomic_store(&latest_snapshot, epoch);
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    atomic_store(&current_epoch, epoch + 1);
+
+    // Let writes of the ended epoch finish
+    for (;;) {
+        uint64_t pending = 0;
+        for (int i = 0; i < WRITER_SHARDS; i++) {
+            pending += atomic_load(&shards[i].writers[epoch & 1]);
+        }
+        if (pending == 0) break;
+        sched_yield();
+    }
+
+    pthread_mutex_unlock(&create_mutex);
+    return epoch;
+}
+
+int rw_snapshot_retain(rw_snapshot_t snapshot) {
+    int rc = MEM_INVALID;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    for (size_t i = 0; i < active_count; i++) {
+        if (active[i].id == snapshot) {
+            active[i].refs++;
+            rc = MEM_SUCCESS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    return rc;
+}
+
+// Drop versions and graves no live snapshot sees. Snapshot mutex held;
+// freed buffers are collected in `garbage` and returned to the allocator
+// by the caller, outside the lock.
+static size_t collect_locked(rw_version_t** garbage) {
+    size_t collected = 0;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < versioned_count; i++) {
+        data_block_t* block = versioned[i];
+        rw_version_t** link = &block->versions;
+        while (*link) {
+            rw_version_t* version = *link;
+            if (needed_locked(version->birth_epoch, version->end_epoch)) {
+                link = &version->next;
+                continue;
+            }
+            *link = version->next;
+            version->next = *garbage;
+            *garbage = version;
+            stats.versions--;
+            stats.version_bytes -= block->size;
+            collected++;
+        }
+        if (block->versions) versioned[kept++] = block;
+    }
+    versioned_count = kept;
+
+    kept = 0;
+    for (size_t i = 0; i < grave_count; i++) {
+        if (needed_locked(graves[i].block->created_epoch, graves[i].deleted_epoch)) {
+            graves[kept++] = graves[i];
+        }
+    }
+    grave_count = kept;
+
+    stats.versions_collected += collected;
+    return collected;
+}
+
+void rw_snapshot_release(rw_snapshot_t snapshot) {
+    rw_version_t* garbage = NULL;
+    bool removed = false;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    for (size_t i = 0; i < active_count; i++) {
+        if (active[i].id != snapshot) continue;
+
+        if (--active[i].refs == 0) {
+            memmove(&active[i], &active[i + 1], (active_count - i - 1) * sizeof(active_snapshot_t));
+            active_count--;
+            stats.snapshots_active--;
+            removed = true;
+        }
+        break;
+    }
+    if (removed) {
+        atomic_store(&latest_snapshot, active_count ? active[active_count - 1].id : 0);
+        collect_locked(&garbage);
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    if (!garbage) return;
+
+    rw_registry_lock();
+    for (rw_version_t* version = garbage; version; version = version->next) {
+        rw_free_locked(version->data, version->size);
+    }
+    rw_registry_unlock();
+
+    while (garbage) {
+        rw_version_t* next = garbage->next;
+        free(garbage);
+        garbage = next;
+    }
+}
+
+size_t rw_read_snapshot(data_block_t* block, rw_snapshot_t snapshot,
+                        size_t offset, void* buffer, size_t size) {
+    if (!block || !buffer || snapshot == 0) return 0;
+    if (block->created_epoch > snapshot || offset >= block->size) return 0;
+
+    size_t copy_size = (size > block->size - offset) ? block->size - offset : size;
+
+    if (!rw_block_acquire(block)) return 0;
+
+    for (;;) {
+        uint32_t seq = rw_block_read_begin(block);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        if (block->birth_epoch <= snapshot) {
+            memcpy(buffer, block->data + offset, copy_size);
+            if (rw_block_read_valid(block, seq)) break;
+            continue;
+        }
+
+        // Overwritten since; the newest version born by then is the one.
+        // The caller holds the snapshot, so that version stays put.
+        const uint8_t* data = NULL;
+        pthread_mutex_lock(&snapshot_mutex);
+        for (rw_version_t* version = block->versions; version; version = version->next) {
+            if (version->birth_epoch <= snapshot) {
+                data = version->data;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&snapshot_mutex);
+
+        if (data) {
+            memcpy(buffer, data + offset, copy_size);
+        } else {
+            copy_size = 0;
+        }
+        break;
+    }
+
+    rw_block_release(block);
+    return copy_size;
+}
+
+size_t rw_snapshot_for_each(rw_snapshot_t snapshot, rw_block_visitor_t visitor, void* context) {
+    if (!visitor || snapshot == 0) return 0;
+
+    data_block_t* batch[64];
+    size_t visited = 0;
+    size_t n;
+    uint64_t epoch = rw_epoch_enter();
+
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, 64)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i]->created_epoch > snapshot) continue;
+            visited++;
+            if (!visitor(batch[i], context)) {
+                rw_epoch_exit(epoch);
+                return visited;
+            }
+        }
+    }
+    rw_epoch_exit(epoch);
+
+    // Blocks deleted after the snapshot was taken; the caller holds the
+    // snapshot, so none of these graves is collected meanwhile
+    pthread_mutex_lock(&snapshot_mutex);
+    data_block_t** buried = malloc((grave_count ? grave_count : 1) * sizeof(data_block_t*));
+    size_t buried_count = 0;
+    for (size_t i = 0; buried && i < grave_count; i++) {
+        if (graves[i].block->created_epoch <= snapshot && graves[i].deleted_epoch > snapshot) {
+            buried[buried_count++] = graves[i].block;
+        }
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    for (size_t i = 0; i < buried_count; i++) {
+        visited++;
+        if (!visitor(buried[i], context)) break;
+    }
+    free(buried);
+
+    return visited;
+}
+
+rw_snapshot_stats_t* get_rw_snapshot_stats(void) {
+    return &stats;
+}
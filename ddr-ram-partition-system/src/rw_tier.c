@@ -0,0 +1,522 @@
+#define _GNU_SOURCE
+#include "rw_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define TIER_BATCH 64           // Blocks sampled per victim choice
+
+// Spill-to-disk tiering.
+//
+// Eviction claims a block through its state, like compression: it has to
+// be unpinned, raw or compressed, and not sharing its storage. Its current
+// form is written to a slot of the spill file and its memory goes back to
+// the RW allocator. Slots are kept after the block is read back, so a
+// block evicted again unchanged costs no write.
+//
+// Victims are sampled: a hand moves over the registry a batch at a time
+// and the coldest eligible block of the batch goes, coldness being idle
+// time divided by recent accesses.
+
+typedef struct {
+    int64_t* offsets;
+    size_t count;
+    size_t capacity;
+} slot_list_t;
+
+static int spill_fd = -1;
+static atomic_bool tier_active = false;
+static rw_tier_config_t tier_config;
+static rw_tier_stats_t stats = {0};
+
+// Spill file space, by allocator size class
+static pthread_mutex_t tier_mutex = PTHREAD_MUTEX_INITIALIZER;
+static slot_list_t free_slots[RW_ALLOC_CLASSES];
+static int64_t file_end = 0;
+static atomic_size_t hand = 0;
+
+// Background thread
+static pthread_t tier_thread;
+static bool tier_running = false;
+static atomic_bool tier_stop_flag;
+static pthread_mutex_t tier_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tier_wait_cond = PTHREAD_COND_INITIALIZER;
+
+static int pwrite_all(int fd, const void* data, size_t size, int64_t offset) {
+    const uint8_t* p = data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return MEM_ERROR;
+        p += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return MEM_SUCCESS;
+}
+
+static int pread_all(int fd, void* data, size_t size, int64_t offset) {
+    uint8_t* p = data;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return MEM_ERROR;
+        p += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return MEM_SUCCESS;
+}
+
+static int64_t slot_alloc(size_t length) {
+    size_t class_size;
+    unsigned index = rw_alloc_class(length, &class_size);
+    slot_list_t* list = &free_slots[index];
+
+    pthread_mutex_lock(&tier_mutex);
+    int64_t offset;
+    if (list->count > 0) {
+        offset = list->offsets[--list->count];
+    } else {
+        offset = file_end;
+        file_end += (int64_t)class_size;
+        stats.spill_file_bytes = (uint64_t)file_end;
+    }
+    pthread_mutex_unlock(&tier_mutex);
+
+    return offset;
+}
+
+static void slot_free(int64_t offset, size_t length) {
+    size_t class_size;
+    slot_list_t* list = &free_slots[rw_alloc_class(length, &class_size)];
+
+    pthread_mutex_lock(&tier_mutex);
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        int64_t* grown = realloc(list->offsets, capacity * sizeof(int64_t));
+        if (!grown) {
+            // The slot is lost, not reused
+            pthread_mutex_unlock(&tier_mutex);
+            return;
+        }
+        list->offsets = grown;
+        list->capacity = capacity;
+    }
+    list->offsets[list->count++] = offset;
+    pthread_mutex_unlock(&tier_mutex);
+}
+
+static inline size_t stored_size(const data_block_t* block, uint32_t state) {
+    return state == RW_BLOCK_COMPRESSED ? block->packed_size : block->size;
+}
+
+static inline bool evictable(const data_block_t* block, uint32_t state) {
+    if (state != RW_BLOCK_RAW && state != RW_BLOCK_COMPRESSED) return false;
+    if (atomic_load(&block->pins) != 0) return false;
+    // The next checkpoint would only read it back in
+    if (rw_journal_active() && atomic_load(&block->dirty)) return false;
+    return true;
+}
+
+static double coldness(const data_block_t* block, uint64_t now) {
+    uint64_t last = atomic_load_explicit(&block->last_access_ms, memory_order_relaxed);
+    uint64_t idle = now > last ? now - last : 0;
+    uint32_t accesses = atomic_load_explicit(&block->access_count, memory_order_relaxed);
+    return (double)(idle + 1) / (double)(accesses + 1);
+}
+
+static bool evict(data_block_t* block) {
+    uint32_t state = atomic_load(&block->state);
+    if (!evictable(block, state)) return false;
+    if (!atomic_compare_exchange_strong(&block->state, &state, RW_BLOCK_EVICTING)) return false;
+    if (atomic_load(&block->pins) != 0 || !rw_dedup_detach(block)) {
+        atomic_store(&block->state, state);
+        return false;
+    }
+
+    bool packed = state == RW_BLOCK_COMPRESSED;
+    uint8_t* buffer = packed ? block->packed : block->data;
+    size_t length = stored_size(block, state);
+    uint32_t version = rw_block_read_begin(block);
+
+    bool clean = block->spill_offset >= 0 && block->spill_version == version &&
+                 block->spill_packed == packed && block->spill_length == length;
+    if (!clean) {
+        size_t slot_class, new_class;
+        if (block->spill_offset >= 0) {
+            rw_alloc_class(block->spill_length, &slot_class);
+            rw_alloc_class(length, &new_class);
+            if (slot_class != new_class) {
+                slot_free(block->spill_offset, block->spill_length);
+                block->spill_offset = -1;
+            }
+        }
+        int64_t offset = block->spill_offset >= 0 ? block->spill_offset : slot_alloc(length);
+        if (pwrite_all(spill_fd, buffer, length, offset) != MEM_SUCCESS) {
+            if (block->spill_offset < 0) slot_free(offset, length);
+            atomic_store(&block->state, state);
+            return false;
+        }
+        block->spill_offset = offset;
+        block->spill_length = (uint32_t)length;
+        block->spill_packed = packed;
+    }
+
+    if (packed) {
+        block->packed = NULL;
+        block->packed_size = 0;
+    } else {
+        rw_block_write_begin(block);
+        block->data = NULL;
+        rw_block_write_end(block);
+    }
+    // Past the bump above: the slot stays clean until the next real write
+    block->spill_version = rw_block_read_begin(block);
+
+    rw_registry_lock();
+    rw_free_locked(buffer, length);
+    rw_registry_unlock();
+
+    pthread_mutex_lock(&tier_mutex);
+    stats.evictions++;
+    if (clean) stats.clean_evictions++;
+    stats.blocks_spilled++;
+    stats.bytes_spilled += length;
+    pthread_mutex_unlock(&tier_mutex);
+
+    atomic_store(&block->state, RW_BLOCK_SPILLED);
+    return true;
+}
+
+// Read a block back in; the caller moved it to RW_BLOCK_FAULTING
+static uint32_t fault_in(data_block_t* block) {
+    size_t length = block->spill_length;
+    uint8_t* buffer = rw_alloc_or_reclaim(length, false);
+    if (!buffer) return RW_BLOCK_SPILLED;
+
+    if (pread_all(spill_fd, buffer, length, block->spill_offset) != MEM_SUCCESS) {
+        rw_registry_lock();
+        rw_free_locked(buffer, length);
+        rw_registry_unlock();
+        return RW_BLOCK_SPILLED;
+    }
+
+    pthread_mutex_lock(&tier_mutex);
+    stats.blocks_spilled--;
+    stats.bytes_spilled -= length;
+    pthread_mutex_unlock(&tier_mutex);
+
+    if (block->spill_packed) {
+        block->packed = buffer;
+        block->packed_size = (uint32_t)length;
+        return RW_BLOCK_COMPRESSED;
+    }
+    block->data = buffer;
+    return RW_BLOCK_RAW;
+}
+
+uint32_t rw_tier_fault(data_block_t* block) {
+    uint32_t state = fault_in(block);
+    if (state != RW_BLOCK_SPILLED) {
+        pthread_mutex_lock(&tier_mutex);
+        stats.faults++;
+        pthread_mutex_unlock(&tier_mutex);
+    }
+    return state;
+}
+
+// Wait out a move in progress, then hold the block still; returns the
+// state to put back
+static uint32_t claim(data_block_t* block) {
+    for (;;) {
+        uint32_t state = atomic_load(&block->state);
+        if (state == RW_BLOCK_RAW || state == RW_BLOCK_COMPRESSED || state == RW_BLOCK_SPILLED) {
+            if (atomic_compare_exchange_strong(&block->state, &state, RW_BLOCK_FAULTING)) {
+                return state;
+            }
+            continue;
+        }
+        sched_yield();
+    }
+}
+
+static void forget_slot(data_block_t* block, uint32_t state) {
+    if (block->spill_offset < 0) return;
+
+    pthread_mutex_lock(&tier_mutex);
+    if (state == RW_BLOCK_SPILLED) {
+        stats.blocks_spilled--;
+        stats.bytes_spilled -= block->spill_length;
+    }
+    pthread_mutex_unlock(&tier_mutex);
+
+    slot_free(block->spill_offset, block->spill_length);
+    block->spill_offset = -1;
+}
+
+void rw_tier_drop(data_block_t* block) {
+    uint32_t state = claim(block);
+    forget_slot(block, state);
+    atomic_store(&block->state, state);
+}
+
+static bool promote(data_block_t* block) {
+    uint32_t expected = RW_BLOCK_SPILLED;
+    if (!atomic_compare_exchange_strong(&block->state, &expected, RW_BLOCK_FAULTING)) return false;
+
+    uint32_t state = fault_in(block);
+    atomic_store(&block->state, state);
+    if (state == RW_BLOCK_SPILLED) return false;
+
+    pthread_mutex_lock(&tier_mutex);
+    stats.promotions++;
+    pthread_mutex_unlock(&tier_mutex);
+    return true;
+}
+
+// Evict the coldest eligible block of the next batch whose storage is at
+// least `min_size` bytes. Returns false once the registry is exhausted.
+static bool evict_one(size_t min_size, size_t* scanned, bool* evicted) {
+    data_block_t* batch[TIER_BATCH];
+    uint64_t epoch = rw_epoch_enter();
+    size_t start = atomic_fetch_add(&hand, TIER_BATCH);
+    size_t n = rw_registry_snapshot(start, batch, TIER_BATCH);
+    if (n == 0) {
+        atomic_store(&hand, 0);
+        n = rw_registry_snapshot(0, batch, TIER_BATCH);
+        if (n == 0) {
+            rw_epoch_exit(epoch);
+            return false;
+        }
+    }
+    *scanned += n;
+
+    uint64_t now = rw_coarse_ms();
+    data_block_t* victim = NULL;
+    double coldest = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t state = atomic_load(&batch[i]->state);
+        if (!evictable(batch[i], state)) continue;
+        if (rw_alloc_size(stored_size(batch[i], state)) < min_size) continue;
+
+        double score = coldness(batch[i], now);
+        if (!victim || score > coldest) {
+            victim = batch[i];
+            coldest = score;
+        }
+    }
+
+    *evicted = victim && evict(victim);
+    rw_epoch_exit(epoch);
+    return true;
+}
+
+void* rw_alloc_or_reclaim(size_t size, bool zero) {
+    rw_registry_lock();
+    void* ptr = rw_alloc_locked(size, zero);
+    rw_registry_unlock();
+    if (ptr || !atomic_load(&tier_active)) return ptr;
+
+    // A freed chunk of this class or larger will do
+    size_t need = rw_alloc_size(size);
+    size_t total = rw_registry_count();
+    size_t scanned = 0;
+    while (scanned <= total) {
+        bool evicted = false;
+        if (!evict_one(need, &scanned, &evicted)) break;
+        if (!evicted) continue;
+
+        rw_registry_lock();
+        ptr = rw_alloc_locked(size, zero);
+        rw_registry_unlock();
+        if (ptr) return ptr;
+    }
+    return NULL;
+}
+
+static size_t balance(void) {
+    size_t capacity;
+    rw_registry_lock();
+    size_t live = rw_alloc_live_bytes_locked(&capacity);
+    rw_registry_unlock();
+    size_t total = rw_registry_count();
+    if (capacity == 0) return 0;
+
+    size_t high = capacity / 100 * tier_config.high_watermark_percent;
+    size_t low = capacity / 100 * tier_config.low_watermark_percent;
+    size_t moved = 0;
+
+    if (live > high) {
+        size_t scanned = 0;
+        while (scanned <= total && !atomic_load(&tier_stop_flag)) {
+            bool evicted = false;
+            if (!evict_one(0, &scanned, &evicted)) break;
+            if (!evicted) continue;
+            moved++;
+
+            rw_registry_lock();
+            live = rw_alloc_live_bytes_locked(&capacity);
+            rw_registry_unlock();
+            if (live <= low) break;
+        }
+    }
+
+    // Age access counts; bring back blocks that were busy when spilled
+    // while there is room below the low watermark
+    data_block_t* batch[TIER_BATCH];
+    uint64_t epoch = rw_epoch_enter();
+    size_t n;
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, TIER_BATCH)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            data_block_t* block = batch[i];
+            uint32_t accesses = atomic_load_explicit(&block->access_count, memory_order_relaxed);
+
+            if (atomic_load(&block->state) != RW_BLOCK_SPILLED) {
+                atomic_store_explicit(&block->access_count, accesses / 2, memory_order_relaxed);
+                continue;
+            }
+            if (accesses < tier_config.promote_min_accesses || live + block->spill_length > low) {
+                continue;
+            }
+            if (promote(block)) {
+                live += rw_alloc_size(block->spill_length);
+                moved++;
+            }
+        }
+    }
+    rw_epoch_exit(epoch);
+
+    return moved;
+}
+
+size_t rw_tier_balance(void) {
+    if (!atomic_load(&tier_active)) return 0;
+    return balance();
+}
+
+static void* tier_background(void* arg) {
+    (void)arg;
+
+    while (!atomic_load(&tier_stop_flag)) {
+        balance();
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = deadline.tv_nsec + (uint64_t)tier_config.scan_interval_ms * 1000000ull;
+        deadline.tv_sec += ns / 1000000000ull;
+        deadline.tv_nsec = ns % 1000000000ull;
+
+        pthread_mutex_lock(&tier_wait_mutex);
+        while (!atomic_load(&tier_stop_flag)) {
+            if (pthread_cond_timedwait(&tier_wait_cond, &tier_wait_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&tier_wait_mutex);
+    }
+
+    return NULL;
+}
+
+void rw_tier_reset(void) {
+    pthread_mutex_lock(&tier_mutex);
+    for (unsigned i = 0; i < RW_ALLOC_CLASSES; i++) {
+        free_slots[i].count = 0;
+    }
+    file_end = 0;
+    stats.blocks_spilled = 0;
+    stats.bytes_spilled = 0;
+    pthread_mutex_unlock(&tier_mutex);
+    atomic_store(&hand, 0);
+}
+
+int rw_tier_start(const rw_tier_config_t* config) {
+    if (!config || !config->spill_path) return MEM_INVALID;
+    if (config->low_watermark_percent > config->high_watermark_percent ||
+        config->high_watermark_percent > 100) {
+        return MEM_INVALID;
+    }
+    if (spill_fd >= 0) return MEM_ERROR;
+
+    // Spilled data is a cache; nothing survives a restart, so the file is
+    // unlinked straight away and goes with the descriptor
+    spill_fd = open(config->spill_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (spill_fd < 0) return MEM_ERROR;
+    unlink(config->spill_path);
+
+    tier_config = *config;
+    tier_config.spill_path = NULL;
+    rw_tier_reset();
+    atomic_store(&tier_active, true);
+    atomic_store(&tier_stop_flag, false);
+
+    if (tier_config.scan_interval_ms > 0) {
+        if (pthread_create(&tier_thread, NULL, tier_background, NULL) != 0) {
+            atomic_store(&tier_active, false);
+            close(spill_fd);
+            spill_fd = -1;
+            return MEM_ERROR;
+        }
+        tier_running = true;
+    }
+
+    LOG_INFO("Spill tiering started (watermarks %u%%/%u%%)",
+           config->low_watermark_percent, config->high_watermark_percent);
+    return MEM_SUCCESS;
+}
+
+int rw_tier_stop(void) {
+    if (spill_fd < 0) return MEM_SUCCESS;
+
+    if (tier_running) {
+        pthread_mutex_lock(&tier_wait_mutex);
+        atomic_store(&tier_stop_flag, true);
+        pthread_cond_broadcast(&tier_wait_cond);
+        pthread_mutex_unlock(&tier_wait_mutex);
+
+        pthread_join(tier_thread, NULL);
+        tier_running = false;
+    }
+    atomic_store(&tier_active, false);
+
+    data_block_t* batch[TIER_BATCH];
+    uint64_t epoch = rw_epoch_enter();
+    size_t n;
+    for (size_t start = 0; (n = rw_registry_snapshot(start, batch, TIER_BATCH)) > 0; start += n) {
+        for (size_t i = 0; i < n; i++) {
+            if (atomic_load(&batch[i]->state) == RW_BLOCK_SPILLED) promote(batch[i]);
+
+            // Slots do not outlive the file
+            uint32_t state = claim(batch[i]);
+            if (state != RW_BLOCK_SPILLED) forget_slot(batch[i], state);
+            atomic_store(&batch[i]->state, state);
+        }
+    }
+    rw_epoch_exit(epoch);
+
+    pthread_mutex_lock(&tier_mutex);
+    uint64_t remaining = stats.blocks_spilled;
+    pthread_mutex_unlock(&tier_mutex);
+    if (remaining > 0) return MEM_FULL;
+
+    close(spill_fd);
+    spill_fd = -1;
+    return MEM_SUCCESS;
+}
+
+bool rw_block_is_spilled(const data_block_t* block) {
+    return block && atomic_load(&block->state) == RW_BLOCK_SPILLED;
+}
+
+rw_tier_stats_t* get_rw_tier_stats(void) {
+    return &stats;
+}
@@ -1,156 +1,366 @@
-#include "userspace_app.h"
+#include "userspace_internal.h"
+#include "config.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
-
-#define MAX_USER_APPS 20
+#include <pthread.h>
 
 static memory_partition_t* userspace_partition = NULL;
-static user_app_t* apps[MAX_USER_APPS] = {0};
+// App table, grown as needed; stopped apps leave a NULL slot
+static user_app_t** apps = NULL;
+static uint32_t app_slots = 0;
+static uint32_t app_capacity = 0;
+static uint32_t free_hint = 0;     // No free slot below this one
 static userspace_stats_t stats = {0};
 static uint32_t next_app_id = 1000;
+// Guards the app table and the statistics against SMP workers stopping
+// apps that exit
+static pthread_mutex_t app_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void userspace_init(memory_partition_t* partition) {
     if (!partition) return;
     
     userspace_partition = partition;
     
+    // Forget the apps of an earlier run
+    userspace_sched_reset();
+    userspace_arena_reset(partition);
+    userspace_gc_reset();
+    if (userspace_events_reset(partition) != MEM_SUCCESS) {
+        LOG_WARN("No room for event mailboxes in the user space partition");
+    }
+    free(apps);
+    apps = NULL;
+    app_slots = 0;
+    app_capacity = 0;
+    free_hint = 0;
+    next_app_id = 1000;
+    
     // Initialize stats
     memset(&stats, 0, sizeof(userspace_stats_t));
     
-    printf("User space partition initialized\n");
+    LOG_INFO("User space partition initialized");
     
     // Start some default apps
     userspace_start_app("System Monitor", APP_TYPE_SYSTEM, 2 * 1024 * 1024);
     userspace_start_app("File Manager", APP_TYPE_UTILITY, 5 * 1024 * 1024);
 }
 
-void userspace_start_app(const char* name, app_type_t type, size_t memory_req) {
-    if (!userspace_partition || !name) return;
+// Index of a free slot in the app table, growing it if there is none
+static int64_t find_free_slot(void) {
+    for (; free_hint < app_slots; free_hint++) {
+        if (apps[free_hint] == NULL) return free_hint;
+    }
     
-    // Find free slot
-    int free_slot = -1;
-    for (int i = 0; i < MAX_USER_APPS; i++) {
-        if (apps[i] == NULL) {
-            free_slot = i;
-            break;
-        }
+    if (app_slots == app_capacity) {
+        uint32_t capacity = app_capacity ? app_capacity * 2 : 32;
+        user_app_t** grown = realloc(apps, capacity * sizeof(user_app_t*));
+        if (!grown) return -1;
+        apps = grown;
+        app_capacity = capacity;
     }
+    apps[app_slots] = NULL;
+    return app_slots++;
+}
+
+user_app_t* userspace_start_app(const char* name, app_type_t type, size_t memory_req) {
+    if (!userspace_partition || !name) return NULL;
     
+    pthread_mutex_lock(&app_mutex);
+    
+    // Find free slot
+    int64_t free_slot = find_free_slot();
     if (free_slot == -1) {
-        printf("Cannot start app '%s': Maximum apps reached\n", name);
-        return;
+        pthread_mutex_unlock(&app_mutex);
+        LOG_WARN("Cannot start app '%s': Out of memory for the app table", name);
+        return NULL;
     }
     
-    // Check available memory
-    if (memory_req > userspace_partition->size - userspace_partition->used) {
-        printf("Cannot start app '%s': Insufficient memory\n", name);
-        return;
+    // The app's arena, with room for the app itself and its memory; apps
+    // may run without any
+    user_arena_t arena = {0};
+    size_t header = (sizeof(user_app_t) + 15) & ~(size_t)15;
+    if (memory_req > SIZE_MAX - header ||
+        userspace_arena_reserve(&arena, header + memory_req) != MEM_SUCCESS) {
+        pthread_mutex_unlock(&app_mutex);
+        LOG_WARN("Cannot start app '%s': Insufficient memory", name);
+        return NULL;
     }
-    
-    // Allocate app structure
-    user_app_t* app = (user_app_t*)partition_alloc(userspace_partition, sizeof(user_app_t));
-    if (!app) return;
-    
-    // Allocate app memory
-    app->memory_region = partition_alloc(userspace_partition, memory_req);
-    if (!app->memory_region) {
-        // Handle allocation failure
-        return;
+    user_app_t* app = userspace_arena_alloc(&arena, sizeof(user_app_t));
+    if (memory_req > 0) {
+        app->memory_region = userspace_arena_alloc(&arena, memory_req);
     }
+    app->arena = arena;
     
     // Initialize app
     app->app_id = next_app_id++;
     strncpy(app->name, name, sizeof(app->name) - 1);
     app->type = type;
     app->memory_size = memory_req;
-    app->priority = 5;  // Default priority
+    app->priority = USERSPACE_PRIORITY_DEFAULT;
     app->is_running = true;
     app->start_time = time(NULL);
+    app->run = userspace_app_idle_run;
+    app->weight = userspace_sched_weight(app->priority);
+    app->slot = (uint32_t)free_slot;
     
     apps[free_slot] = app;
     
     // Update statistics
     stats.total_apps++;
     stats.running_apps++;
-    stats.total_memory_used += memory_req;
+    stats.total_memory_used += app->arena.used;
     if (stats.total_memory_used > stats.peak_memory_used) {
         stats.peak_memory_used = stats.total_memory_used;
     }
+    pthread_mutex_unlock(&app_mutex);
     
-    printf("Started app '%s' (ID: %u, Type: %d, Memory: %zu MB)\n",
+    LOG_INFO("Started app '%s' (ID: %u, Type: %d, Memory: %zu MB)",
            name, app->app_id, type, memory_req / (1024 * 1024));
     
     // Initialize app memory with some data
-    switch (type) {
-        case APP_TYPE_GUI:
-            memset(app->memory_region, 0xAA, memory_req);
-            break;
-        case APP_TYPE_UTILITY:
-            memset(app->memory_region, 0xBB, memory_req);
-            break;
-        case APP_TYPE_SERVICE:
-            memset(app->memory_region, 0xCC, memory_req);
-            break;
-        default:
-            memset(app->memory_region, 0x00, memory_req);
+    if (app->memory_region) {
+        switch (type) {
+            case APP_TYPE_GUI:
+                memset(app->memory_region, 0xAA, memory_req);
+                break;
+            case APP_TYPE_UTILITY:
+                memset(app->memory_region, 0xBB, memory_req);
+                break;
+            case APP_TYPE_SERVICE:
+                memset(app->memory_region, 0xCC, memory_req);
+                break;
+            default:
+                memset(app->memory_region, 0x00, memory_req);
+        }
     }
+    
+    userspace_sched_add(app);
+    return app;
+}
+
+// Caller holds app_mutex
+static void release_app(user_app_t* app) {
+    userspace_events_close(app);
+    userspace_gc_release(app);
+    userspace_arena_release(&app->arena);
+}
+
+// Caller holds app_mutex. False if the app is in a turn on a worker,
+// which releases its arena when the turn ends.
+static bool stop_app(user_app_t* app) {
+    // Update statistics
+    stats.running_apps--;
+    stats.total_memory_used -= app->arena.used;
+    
+    apps[app->slot] = NULL;
+    if (app->slot < free_hint) free_hint = app->slot;
+    
+    // This clears is_running
+    return userspace_sched_remove(app);
 }
 
 void userspace_stop_app(uint32_t app_id) {
-    for (int i = 0; i < MAX_USER_APPS; i++) {
+    pthread_mutex_lock(&app_mutex);
+    for (uint32_t i = 0; i < app_slots; i++) {
         if (apps[i] && apps[i]->app_id == app_id) {
-            printf("Stopping app '%s' (ID: %u)\n", apps[i]->name, app_id);
-            
-            // Update statistics
-            stats.running_apps--;
-            stats.total_memory_used -= apps[i]->memory_size;
-            
-            // Free app memory (in real system)
-            apps[i]->is_running = false;
-            
-            // Note: In real implementation, we'd free the memory
-            // For simulation, we just mark it as stopped
-            
-            apps[i] = NULL;
+            LOG_INFO("Stopping app '%s' (ID: %u)", apps[i]->name, app_id);
+            user_app_t* app = apps[i];
+            if (stop_app(app)) release_app(app);
+            pthread_mutex_unlock(&app_mutex);
             return;
         }
     }
+    pthread_mutex_unlock(&app_mutex);
     
-    printf("App with ID %u not found\n", app_id);
+    LOG_WARN("App with ID %u not found", app_id);
+}
+
+void userspace_app_exit(user_app_t* app) {
+    pthread_mutex_lock(&app_mutex);
+    // Unless stopped since it returned APP_RUN_EXIT; either way it is
+    // still in its turn, so nobody released it
+    if (apps[app->slot] == app) {
+        LOG_DEBUG("App '%s' (ID: %u) exited", app->name, app->app_id);
+        stop_app(app);
+    }
+    release_app(app);
+    pthread_mutex_unlock(&app_mutex);
+}
+
+void userspace_app_release(user_app_t* app) {
+    pthread_mutex_lock(&app_mutex);
+    release_app(app);
+    pthread_mutex_unlock(&app_mutex);
+}
+
+void userspace_set_app_priority(user_app_t* app, uint32_t priority) {
+    if (!app) return;
+    
+    if (priority > USERSPACE_PRIORITY_MAX) priority = USERSPACE_PRIORITY_MAX;
+    app->priority = priority;
+    userspace_sched_reweight(app, userspace_sched_weight(priority));
+}
+
+// Read a page of the app's memory, a cache line at a time
+app_run_result_t userspace_app_idle_run(user_app_t* app, void* context) {
+    (void)context;
+    
+    volatile const uint8_t* memory = app->memory_region;
+    size_t size = app->memory_size < 4096 ? app->memory_size : 4096;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) {
+        sum += memory[i];
+    }
+    (void)sum;
+    
+    return APP_RUN_YIELD;
+}
+
+static void print_gc_histogram(const char* label, const uint64_t* histogram) {
+    printf("  %s:", label);
+    for (uint32_t i = 0; i < USERSPACE_GC_PAUSE_BUCKETS; i++) {
+        if (histogram[i] == 0) continue;
+        if (i == USERSPACE_GC_PAUSE_BUCKETS - 1) {
+            printf(" >=%uus: %llu", 1u << (i - 1), (unsigned long long)histogram[i]);
+        } else {
+            printf(" <%uus: %llu", 1u << i, (unsigned long long)histogram[i]);
+        }
+    }
+    printf("\n");
 }
 
 void userspace_list_apps(void) {
     printf("\n=== User Space Applications ===\n");
     
+    pthread_mutex_lock(&app_mutex);
     bool found = false;
-    for (int i = 0; i < MAX_USER_APPS; i++) {
+    for (uint32_t i = 0; i < app_slots; i++) {
         if (apps[i]) {
             found = true;
-            printf("ID: %u, Name: %s, Type: %d, Memory: %zu MB, Running: %s\n",
+            printf("ID: %u, Name: %s, Type: %d, Memory: %zu MB (%.1f KB used, %.1f KB peak), "
+                   "Running: %s, Priority: %u, CPU: %.3f ms in %llu slices\n",
                    apps[i]->app_id,
                    apps[i]->name,
                    apps[i]->type,
                    apps[i]->memory_size / (1024 * 1024),
-                   apps[i]->is_running ? "Yes" : "No");
+                   apps[i]->arena.used / 1024.0,
+                   apps[i]->arena.peak / 1024.0,
+                   apps[i]->is_running ? "Yes" : "No",
+                   apps[i]->priority,
+                   apps[i]->runtime_ns / 1e6,
+                   (unsigned long long)apps[i]->slices);
         }
     }
     
     if (!found) {
         printf("No applications running\n");
     }
+    userspace_sched_collect(&stats);
+    userspace_arena_collect(&stats);
+    userspace_gc_collect(&stats);
+    userspace_events_collect(&stats);
+    pthread_mutex_unlock(&app_mutex);
     
     printf("\nStatistics:\n");
     printf("  Total Apps: %u\n", stats.total_apps);
     printf("  Running Apps: %u\n", stats.running_apps);
     printf("  Memory Used: %.2f MB\n", stats.total_memory_used / (1024.0 * 1024.0));
     printf("  Peak Memory: %.2f MB\n", stats.peak_memory_used / (1024.0 * 1024.0));
+    printf("  App Arenas: %.2f MB held, %.2f MB free for reuse\n",
+           stats.arena_memory / (1024.0 * 1024.0),
+           stats.free_arena_memory / (1024.0 * 1024.0));
+    printf("  Garbage Collection: %llu objects live, %llu freed (%.2f MB) in %llu steps, "
+           "longest pause %.1f us, longest app stall %.1f us\n",
+           (unsigned long long)stats.gc.live_objects,
+           (unsigned long long)stats.gc.objects_freed,
+           stats.gc.bytes_freed / (1024.0 * 1024.0),
+           (unsigned long long)stats.gc.steps,
+           stats.gc.max_pause_ns / 1000.0,
+           stats.gc.max_stall_ns / 1000.0);
+    if (stats.gc.steps > 0) {
+        print_gc_histogram("GC Pauses", stats.gc.pause_histogram);
+    }
+    if (stats.gc.collections > 0) {
+        print_gc_histogram("GC App Stalls", stats.gc.stall_histogram);
+    }
+    printf("  Events: %llu posted, %llu received, %llu rejected, %llu dropped as stale; "
+           "%u mailboxes open, %u payload blocks free\n",
+           (unsigned long long)stats.events.posted,
+           (unsigned long long)stats.events.received,
+           (unsigned long long)stats.events.rejected,
+           (unsigned long long)stats.events.stale,
+           stats.events.mailboxes,
+           stats.events.free_payloads);
+    printf("  App Switches: %llu in %llu scheduler ticks\n",
+           (unsigned long long)stats.app_switches,
+           (unsigned long long)stats.scheduler_ticks);
+    for (uint32_t i = 0; i < USERSPACE_MAX_CPUS; i++) {
+        // Queues that ran anything, now or in an earlier SMP run
+        if (stats.cpu[i].slices == 0) continue;
+        printf("  CPU %u: %.1f%% busy, %llu slices, %llu migrations in (%llu stolen)\n", i,
+               stats.cpu[i].utilization * 100.0,
+               (unsigned long long)stats.cpu[i].slices,
+               (unsigned long long)stats.cpu[i].migrations,
+               (unsigned long long)stats.cpu[i].steals);
+    }
+}
+
+void* userspace_app_alloc(user_app_t* app, size_t size) {
+    if (!app || size == 0) return NULL;
+    
+    pthread_mutex_lock(&app_mutex);
+    void* ptr = userspace_arena_alloc(&app->arena, size);
+    if (ptr) {
+        stats.total_memory_used += size;
+        if (stats.total_memory_used > stats.peak_memory_used) {
+            stats.peak_memory_used = stats.total_memory_used;
+        }
+    } else {
+        LOG_DEBUG("App '%s' (ID: %u) could not allocate %zu bytes (%zu used, quota %zu)",
+                  app->name, app->app_id, size, app->arena.used, app->arena.quota);
+    }
+    pthread_mutex_unlock(&app_mutex);
+    
+    return ptr;
+}
+
+void userspace_app_unalloc(user_app_t* app, void* ptr, size_t size) {
+    pthread_mutex_lock(&app_mutex);
+    if (userspace_arena_unalloc(&app->arena, ptr, size)) {
+        stats.total_memory_used -= size;
+    }
+    pthread_mutex_unlock(&app_mutex);
+}
+
+void userspace_set_app_quota(user_app_t* app, size_t bytes) {
+    if (!app) return;
+    
+    pthread_mutex_lock(&app_mutex);
+    app->arena.quota = bytes;
+    pthread_mutex_unlock(&app_mutex);
 }
 
 void* userspace_alloc(size_t size) {
     if (!userspace_partition || size == 0) return NULL;
     
+    user_app_t* app = userspace_current_app();
+    if (app) {
+        pthread_mutex_lock(&app_mutex);
+        size_t used = app->arena.used;
+        void* ptr = userspace_gc_alloc(app, size);
+        stats.total_memory_used += app->arena.used - used;
+        if (stats.total_memory_used > stats.peak_memory_used) {
+            stats.peak_memory_used = stats.total_memory_used;
+        }
+        pthread_mutex_unlock(&app_mutex);
+        return ptr;
+    }
+    
+    pthread_mutex_lock(&app_mutex);
     void* ptr = partition_alloc(userspace_partition, size);
     if (ptr) {
         stats.total_memory_used += size;
@@ -158,56 +368,53 @@ void* userspace_alloc(size_t size) {
             stats.peak_memory_used = stats.total_memory_used;
         }
     }
+    pthread_mutex_unlock(&app_mutex);
     
     return ptr;
 }
 
 void userspace_free(void* ptr) {
-    // Note: In real implementation, we'd free the memory
-    // For simulation, we just log it
-    printf("User space free operation simulated\n");
+    user_app_t* app = userspace_current_app();
+    if (!app || !ptr) return;
+    
+    pthread_mutex_lock(&app_mutex);
+    stats.total_memory_used -= userspace_gc_free(app, ptr);
+    pthread_mutex_unlock(&app_mutex);
 }
 
-void userspace_garbage_collect(void) {
-    printf("Running garbage collection...\n");
-    
-    // Simulate garbage collection
-    static int gc_counter = 0;
-    gc_counter++;
-    
-    if (gc_counter % 10 == 0) {
-        printf("Garbage collection completed. Reclaimed simulated memory.\n");
-    }
+int userspace_gc_add_root(user_app_t* app, const void* start, size_t size) {
+    pthread_mutex_lock(&app_mutex);
+    int rc = userspace_gc_root(app, start, size);
+    pthread_mutex_unlock(&app_mutex);
+    return rc;
 }
 
-void userspace_run_scheduler(void) {
-    static int scheduler_ticks = 0;
-    scheduler_ticks++;
+void userspace_gc_set_step_budget(uint64_t ns) {
+    pthread_mutex_lock(&app_mutex);
+    userspace_gc_budget(ns);
+    pthread_mutex_unlock(&app_mutex);
+}
+
+void userspace_garbage_collect(void) {
+    if (!userspace_partition) return;
     
-    if (scheduler_ticks % 100 == 0) {
-        printf("User space scheduler: Running app context switch\n");
-        stats.app_switches++;
+    pthread_mutex_lock(&app_mutex);
+    size_t freed = userspace_gc_step(apps, app_slots);
+    stats.total_memory_used -= freed;
+    pthread_mutex_unlock(&app_mutex);
+    
+    if (freed > 0) {
+        LOG_DEBUG("Garbage collection step reclaimed %zu bytes", freed);
     }
 }
 
-void userspace_handle_events(void) {
-    static int event_counter = 0;
-    event_counter++;
+userspace_mailbox_t userspace_open_mailbox(user_app_t* app) {
+    if (!app) return 0;
     
-    if (event_counter % 50 == 0) {
-        printf("User space: Processing events...\n");
-        
-        // Simulate random app starts/stops
-        if (rand() % 100 > 70 && stats.running_apps < MAX_USER_APPS) {
-            const char* app_names[] = {
-                "Web Browser", "Text Editor", "Media Player", 
-                "Calculator", "Terminal", "Settings"
-            };
-            int idx = rand() % 6;
-            userspace_start_app(app_names[idx], APP_TYPE_UTILITY, 
-                               (rand() % 10 + 1) * 1024 * 1024);
-        }
-    }
+    pthread_mutex_lock(&app_mutex);
+    userspace_mailbox_t mailbox = userspace_events_open(app);
+    pthread_mutex_unlock(&app_mutex);
+    return mailbox;
 }
 
 void userspace_update_apps(void) {
@@ -215,20 +422,28 @@ void userspace_update_apps(void) {
     update_counter++;
     
     if (update_counter % 200 == 0) {
-        printf("Updating user applications...\n");
+        LOG_DEBUG("Updating user applications...");
         
         // Simulate app updates
-        for (int i = 0; i < MAX_USER_APPS; i++) {
+        pthread_mutex_lock(&app_mutex);
+        for (uint32_t i = 0; i < app_slots; i++) {
             if (apps[i] && apps[i]->is_running) {
                 // Simulate app activity
                 if (rand() % 100 > 90) {
-                    printf("  App '%s' is active\n", apps[i]->name);
+                    LOG_DEBUG("  App '%s' is active", apps[i]->name);
                 }
             }
         }
+        pthread_mutex_unlock(&app_mutex);
     }
 }
 
 userspace_stats_t* get_userspace_stats(void) {
+    pthread_mutex_lock(&app_mutex);
+    userspace_sched_collect(&stats);
+    userspace_arena_collect(&stats);
+    userspace_gc_collect(&stats);
+    userspace_events_collect(&stats);
+    pthread_mutex_unlock(&app_mutex);
     return &stats;
 }
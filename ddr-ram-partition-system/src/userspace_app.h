@@ -2,6 +2,7 @@
 #define USERSPACE_APP_H
 
 #include "ddr_memory.h"
+#include <stdatomic.h>
 
 // User application types
 typedef enum {
@@ -12,8 +13,54 @@ typedef enum {
     APP_TYPE_SYSTEM
 } app_type_t;
 
-// User application structure
+typedef struct user_app user_app_t;
+
+// What an app's run function did with its turn
+typedef enum {
+    APP_RUN_CONTINUE,   // Has more work; called again while its slice lasts
+    APP_RUN_YIELD,      // Gives up the rest of its slice
+    APP_RUN_EXIT        // Finished; the app is stopped
+} app_run_result_t;
+
+typedef app_run_result_t (*user_app_run_fn)(user_app_t* app, void* context);
+// Body of a coroutine app; runs until it returns, giving up the CPU with
+// userspace_yield()
+typedef void (*user_app_main_fn)(user_app_t* app, void* context);
+
+// Higher priorities get a larger share of the CPU: each level is worth
+// about 25% more than the one below
+#define USERSPACE_PRIORITY_MIN     0
+#define USERSPACE_PRIORITY_DEFAULT 5
+#define USERSPACE_PRIORITY_MAX     9
+
+// Run queues, one per worker in SMP mode; affinity masks have a bit each
+#define USERSPACE_MAX_CPUS 64
+
+// Default coroutine app stack
+#define USERSPACE_STACK_SIZE (64 * 1024)
+
+// An app's memory: chunks of the partition, released together when the
+// app stops
+typedef struct user_arena_chunk user_arena_chunk_t;
+
 typedef struct {
+    user_arena_chunk_t* chunks;
+    user_arena_chunk_t* last;
+    size_t reserved;                // Bytes of chunks held
+    size_t used;                    // Bytes allocated, the app header included
+    size_t peak;
+    size_t quota;                   // Limit on `used`; 0 for none
+} user_arena_t;
+
+// Objects the app got from userspace_alloc(), for the garbage collector
+typedef struct user_gc_heap user_gc_heap_t;
+
+// Handle of an event mailbox: a slot number and the generation of the slot
+// it was issued for, so handles of closed mailboxes are turned away
+typedef uint64_t userspace_mailbox_t;
+
+// User application structure
+struct user_app {
     uint32_t app_id;
     char name[64];
     app_type_t type;
@@ -22,31 +69,205 @@ typedef struct {
     uint32_t priority;
     bool is_running;
     time_t start_time;
-} user_app_t;
+    
+    // Scheduling
+    user_app_run_fn run;
+    void* context;
+    uint32_t weight;                // From priority
+    uint64_t vruntime;              // Run time in ns, scaled by 1024 / weight
+    uint64_t runtime_ns;
+    uint64_t slices;
+    uint64_t affinity;              // Run queues the app may use; 0 for any
+    atomic_int cpu;                 // Run queue it is on, or ran on last
+    uint32_t migrations;
+    size_t stack_size;              // Coroutine apps only
+    uint32_t slot;                  // Position in the app table
+    bool queued;
+    bool on_cpu;                    // In a turn; its arena outlives a stop until the turn ends
+    user_app_t* child;              // Run queue (pairing heap) links
+    user_app_t* next;
+    user_app_t* prev;
+
+    user_arena_t arena;
+    user_gc_heap_t* gc;             // NULL until the app's first userspace_alloc()
+    userspace_mailbox_t mailbox;    // 0 until userspace_open_mailbox()
+};
 
 // User space management
 void userspace_init(memory_partition_t* partition);
-void userspace_start_app(const char* name, app_type_t type, size_t memory_req);
+// Returns the app, or NULL if it could not be started. Apps without a run
+// function touch their memory when scheduled. The app, its memory and
+// everything it allocated live in its arena.
+user_app_t* userspace_start_app(const char* name, app_type_t type, size_t memory_req);
+// Releases the app's arena; pointers to the app are invalid afterwards
 void userspace_stop_app(uint32_t app_id);
 void userspace_list_apps(void);
+void userspace_set_app_entry(user_app_t* app, user_app_run_fn run, void* context);
+void userspace_set_app_priority(user_app_t* app, uint32_t priority);
+// Restrict an app to the run queues whose bits are set in `cpus`
+void userspace_set_app_affinity(user_app_t* app, uint64_t cpus);
+// Run `main` as a coroutine on a stack of `stack_size` bytes (0 for
+// USERSPACE_STACK_SIZE) allocated from the partition. Each turn resumes it
+// until it yields; the app stops when `main` returns.
+int userspace_set_app_coroutine(user_app_t* app, user_app_main_fn main, void* context,
+                                size_t stack_size);
+// From a coroutine app: give up the CPU until the app's next turn
+void userspace_yield(void);
 
 // Memory management for user apps
+// Zeroed memory from the app's arena; NULL once it would take the app
+// over its quota
+void* userspace_app_alloc(user_app_t* app, size_t size);
+// Cap the bytes the app may hold in its arena; 0 lifts the cap
+void userspace_set_app_quota(user_app_t* app, size_t bytes);
+// The app whose turn this thread is running, or NULL
+user_app_t* userspace_current_app(void);
+// From the current app's arena, garbage collected: freed once no root of
+// the app points at it any more. Outside an app's turn the memory belongs
+// to no app and is never released.
 void* userspace_alloc(size_t size);
+// Free memory the current app got from userspace_alloc() at once; other
+// memory goes back when its app stops
 void userspace_free(void* ptr);
+
+// Garbage collection, one app at a time. An app's roots are its memory
+// region, its context pointer, a coroutine app's stack and the ranges
+// added here; words in them that point at the start of one of its
+// userspace_alloc() objects keep the object alive, and so on from there.
+// The app sits out its turns while being collected.
+int userspace_gc_add_root(user_app_t* app, const void* start, size_t size);
+// One step of collection, of at most the step budget (0 for 100 us)
 void userspace_garbage_collect(void);
+void userspace_gc_set_step_budget(uint64_t ns);
 
 // Application services
+// One scheduling decision: runs the app with the least weighted run time
+// for up to its slice, a share of a 6 ms period proportional to its weight
+// (at least 0.75 ms). Picking is O(log n) in the runnable apps. Does
+// nothing while SMP workers are running.
 void userspace_run_scheduler(void);
+
+// SMP mode: worker threads, each running the apps on its own run queue.
+// Idle workers steal apps from the busiest queue, and worker 0
+// periodically evens out queue lengths. Apps return to the calling
+// thread's queue when the workers stop.
+typedef struct {
+    uint32_t workers;               // 0 for one per online CPU
+    bool pin;                       // Pin worker i to CPU i
+    uint32_t balance_interval_ms;   // 0 for 10 ms
+} userspace_smp_config_t;
+
+int userspace_smp_start(const userspace_smp_config_t* config);
+void userspace_smp_stop(void);
+
+// Events
+//
+// Mailboxes are bounded lock-free queues that any number of threads may
+// post to and receive from. Payloads are copied into blocks of the User
+// Space partition, which a receiver hands back with
+// userspace_release_events() once it is done with them. userspace_init()
+// waits for posts and receives under way; handles from before it are
+// turned away after it.
+#define USERSPACE_EVENT_PAYLOAD_MAX 256
+#define USERSPACE_EVENT_TYPES       64
+#define USERSPACE_MAILBOX_CAPACITY  256     // Events per app mailbox
+// Drained by userspace_handle_events()
+#define USERSPACE_SYSTEM_MAILBOX    ((userspace_mailbox_t)1 << 32)
+
+typedef enum {
+    USERSPACE_EVENT_START_APP,      // Payload: app name; data: memory bytes
+    USERSPACE_EVENT_STOP_APP,       // Data: app ID
+    USERSPACE_EVENT_FRAME,          // A game frame was rendered; data: frame number
+    USERSPACE_EVENT_IO_COMPLETE,    // Payload: rw_async_cqe_t
+    USERSPACE_EVENT_USER = 16       // First type free for applications
+} userspace_event_type_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;                  // Payload bytes
+    uint64_t data;
+    uint64_t posted_ns;             // CLOCK_MONOTONIC time of posting
+    void* payload;                  // NULL if none
+} userspace_event_t;
+
+typedef void (*userspace_event_fn)(const userspace_event_t* event, void* context);
+
+// The app's mailbox, opened on first use; closed when the app stops.
+// Returns 0 if no mailbox could be set up.
+userspace_mailbox_t userspace_open_mailbox(user_app_t* app);
+// From any thread. MEM_INVALID for a closed mailbox, an unknown type or a
+// payload over USERSPACE_EVENT_PAYLOAD_MAX; MEM_FULL if the mailbox or the
+// payload blocks ran out.
+int userspace_post_event(userspace_mailbox_t mailbox, uint32_t type, uint64_t data,
+                         const void* payload, size_t size);
+// Post `count` events with one claim on the mailbox; returns how many were
+// posted, in order. posted_ns is filled in.
+uint32_t userspace_post_events(userspace_mailbox_t mailbox, const userspace_event_t* events,
+                               uint32_t count);
+// Take up to `max` events, oldest first, in one claim
+uint32_t userspace_receive_events(userspace_mailbox_t mailbox, userspace_event_t* events,
+                                  uint32_t max);
+// Give back the payload blocks of received events
+void userspace_release_events(const userspace_event_t* events, uint32_t count);
+// Handler userspace_handle_events() calls for events of `type`; NULL for
+// none. Start and stop requests have handlers from userspace_init().
+void userspace_set_event_handler(uint32_t type, userspace_event_fn handler, void* context);
+// Dispatch the events waiting in the system mailbox, a bounded number per call
 void userspace_handle_events(void);
 void userspace_update_apps(void);
 
 // Statistics
+typedef struct {
+    uint64_t slices;
+    uint64_t busy_ns;               // In app run functions
+    uint64_t idle_ns;               // Waiting for an app to run
+    double utilization;             // busy / (busy + idle)
+    uint64_t steals;                // Apps pulled from other queues when idle
+    uint64_t migrations;            // Apps moved onto this queue
+    uint32_t runnable_apps;
+} userspace_cpu_stats_t;
+
+// Pause and stall histograms: bucket 0 counts times under 1 us, bucket i
+// times of [2^(i-1), 2^i) us, and the last one everything longer
+#define USERSPACE_GC_PAUSE_BUCKETS 16
+
+typedef struct {
+    uint64_t cycles;                // Passes over every app
+    uint64_t collections;           // Apps collected
+    uint64_t steps;
+    uint64_t objects_freed;
+    uint64_t bytes_freed;           // Headers included
+    uint64_t live_objects;
+    uint64_t max_pause_ns;          // One step, on the collecting thread
+    uint64_t pause_histogram[USERSPACE_GC_PAUSE_BUCKETS];
+    uint64_t max_stall_ns;          // An app parked, from its first step to its last
+    uint64_t stall_histogram[USERSPACE_GC_PAUSE_BUCKETS];
+} userspace_gc_stats_t;
+
+typedef struct {
+    uint64_t posted;
+    uint64_t received;
+    uint64_t rejected;              // Mailbox or payload blocks full
+    uint64_t stale;                 // Posted to a mailbox closed meanwhile, dropped
+    uint32_t mailboxes;             // Open, the system mailbox included
+    uint32_t free_payloads;
+} userspace_event_stats_t;
+
 typedef struct {
     uint32_t total_apps;
     uint32_t running_apps;
     size_t total_memory_used;
     size_t peak_memory_used;
-    uint32_t app_switches;
+    size_t arena_memory;            // Partition bytes held by app arenas
+    size_t free_arena_memory;       // Released by stopped apps, for reuse
+    uint64_t app_switches;          // Turns given to a different app than the last
+    uint64_t scheduler_ticks;
+    uint32_t runnable_apps;
+    uint64_t migrations;            // Apps moved between run queues
+    uint32_t cpus;                  // Run queues in use
+    userspace_cpu_stats_t cpu[USERSPACE_MAX_CPUS];
+    userspace_gc_stats_t gc;
+    userspace_event_stats_t events;
 } userspace_stats_t;
 
 userspace_stats_t* get_userspace_stats(void);
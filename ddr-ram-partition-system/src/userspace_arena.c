@@ -0,0 +1,227 @@
+#include "userspace_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdint.h>
+#include <string.h>
+
+// Per-app arenas.
+//
+// An arena is a list of chunks carved from the User Space partition.
+// Allocations bump through the newest chunk; large ones get a chunk of
+// their own. Nothing is freed piecemeal: a stopped app's whole chunk list
+// is spliced onto a released list in O(1), and chunks are sorted from
+// there into free lists by size class only when an allocation needs one.
+//
+// Chunk sizes are classes a quarter of a power of two apart (1 KB, 1.25 KB,
+// 1.5 KB, 1.75 KB, 2 KB, 2.5 KB, ...), so a chunk wastes at most a fifth
+// of itself and comes back to the same free list every time. Chunks start
+// at multiples of 256 bytes, so the slack is spent on colouring: the first
+// allocation in a chunk starts a varying number of cache lines in, or
+// every app's header would compete for the same few cache sets.
+//
+// Callers serialize access (userspace_app.c holds app_mutex).
+
+#define ARENA_MIN_CHUNK   1024
+#define ARENA_MIN_SHIFT   10
+#define ARENA_MAX_SHIFT   47
+#define ARENA_CLASSES     (4 * (ARENA_MAX_SHIFT - ARENA_MIN_SHIFT) + 1)
+#define ARENA_CHUNK_SIZE  (16 * 1024)   // For small allocations
+#define ARENA_ALIGN       16
+#define ARENA_COLORS      16
+#define CACHE_LINE        64
+
+struct user_arena_chunk {
+    user_arena_chunk_t* next;
+    size_t size;                    // Whole chunk, header included
+    size_t used;                    // Header included
+    size_t first;                   // Offset of the first allocation
+};
+
+#define CHUNK_HEADER ((sizeof(user_arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static memory_partition_t* arena_partition = NULL;
+static user_arena_chunk_t* free_chunks[ARENA_CLASSES];
+static user_arena_chunk_t* released = NULL;  // Unsorted chunks of stopped apps
+static size_t held_bytes = 0;
+static size_t free_bytes = 0;
+static uint32_t next_color = 0;
+
+void userspace_arena_reset(memory_partition_t* partition) {
+    arena_partition = partition;
+    memset(free_chunks, 0, sizeof(free_chunks));
+    released = NULL;
+    next_color = 0;
+    held_bytes = 0;
+    free_bytes = 0;
+}
+
+// Class of the smallest chunk holding `size` bytes, or -1 if none does
+static int size_class(size_t size, size_t* class_size) {
+    if (size <= ARENA_MIN_CHUNK) {
+        *class_size = ARENA_MIN_CHUNK;
+        return 0;
+    }
+
+    int shift = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    if (shift >= ARENA_MAX_SHIFT) return -1;
+    size_t step = (size_t)1 << (shift - 2);
+    size_t quarters = (size - 1 - ((size_t)1 << shift)) / step + 1;
+    *class_size = ((size_t)1 << shift) + quarters * step;
+    return 4 * (shift - ARENA_MIN_SHIFT) + (int)quarters;
+}
+
+// A free chunk of class `c`, sorting released chunks until one turns up
+static user_arena_chunk_t* take_free(int c) {
+    user_arena_chunk_t* chunk = free_chunks[c];
+    if (chunk) {
+        free_chunks[c] = chunk->next;
+        return chunk;
+    }
+
+    while (released) {
+        chunk = released;
+        released = chunk->next;
+        size_t class_size;
+        int chunk_class = size_class(chunk->size, &class_size);
+        if (chunk_class == c) return chunk;
+        chunk->next = free_chunks[chunk_class];
+        free_chunks[chunk_class] = chunk;
+    }
+    return NULL;
+}
+
+// Partition allocations are not aligned, so chunks carry their own padding
+static user_arena_chunk_t* carve(size_t size) {
+    uintptr_t at = (uintptr_t)(arena_partition->base_address + arena_partition->used);
+    size_t pad = (ARENA_ALIGN - (at & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+    size_t left = arena_partition->size - arena_partition->used;
+    if (pad > left || size > left - pad) return NULL;
+
+    char* memory = partition_alloc(arena_partition, pad + size);
+    if (!memory) return NULL;
+    user_arena_chunk_t* chunk = (user_arena_chunk_t*)(memory + pad);
+    chunk->size = size;
+    return chunk;
+}
+
+static user_arena_chunk_t* get_chunk(size_t size) {
+    if (!arena_partition || size > SIZE_MAX - CHUNK_HEADER) return NULL;
+
+    size_t class_size;
+    int c = size_class(CHUNK_HEADER + size, &class_size);
+    if (c < 0) return NULL;
+
+    user_arena_chunk_t* chunk = take_free(c);
+    bool recycled = chunk != NULL;
+    if (!chunk) chunk = carve(class_size);
+    // Out of partition: a larger free chunk will do, whole
+    for (int i = c + 1; !chunk && i < ARENA_CLASSES; i++) {
+        chunk = take_free(i);
+        recycled = chunk != NULL;
+    }
+    if (!chunk) return NULL;
+
+    if (recycled) free_bytes -= chunk->size;
+    held_bytes += chunk->size;
+    size_t colors = (chunk->size - CHUNK_HEADER - size) / CACHE_LINE + 1;
+    if (colors > ARENA_COLORS) colors = ARENA_COLORS;
+    chunk->next = NULL;
+    chunk->used = CHUNK_HEADER + (next_color++ % colors) * CACHE_LINE;
+    chunk->first = chunk->used;
+    return chunk;
+}
+
+int userspace_arena_reserve(user_arena_t* arena, size_t size) {
+    if (!arena || arena->chunks) return MEM_INVALID;
+
+    user_arena_chunk_t* chunk = get_chunk(size);
+    if (!chunk) return MEM_FULL;
+    arena->chunks = arena->last = chunk;
+    arena->reserved = chunk->size;
+    return MEM_SUCCESS;
+}
+
+void* userspace_arena_alloc(user_arena_t* arena, size_t size) {
+    if (!arena || size == 0 || size > SIZE_MAX - ARENA_ALIGN) return NULL;
+    if (arena->quota && (size > arena->quota || arena->used > arena->quota - size)) return NULL;
+
+    size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    user_arena_chunk_t* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < need) {
+        // Large allocations go at the tail so the small ones keep bumping
+        // through the head
+        bool own_chunk = need > ARENA_CHUNK_SIZE / 4;
+        chunk = get_chunk(own_chunk ? need : ARENA_CHUNK_SIZE - CHUNK_HEADER);
+        if (!chunk) return NULL;
+
+        if (!arena->chunks) {
+            arena->chunks = arena->last = chunk;
+        } else if (own_chunk) {
+            arena->last->next = chunk;
+            arena->last = chunk;
+        } else {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+        arena->reserved += chunk->size;
+    }
+
+    void* ptr = (char*)chunk + chunk->used;
+    chunk->used += need;
+    memset(ptr, 0, size);
+
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return ptr;
+}
+
+bool userspace_arena_unalloc(user_arena_t* arena, void* ptr, size_t size) {
+    if (!arena || !ptr || size == 0) return false;
+
+    size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    user_arena_chunk_t* prev = NULL;
+    user_arena_chunk_t* chunk = arena->chunks;
+    while (chunk && !((char*)ptr > (char*)chunk && (char*)ptr < (char*)chunk + chunk->size)) {
+        prev = chunk;
+        chunk = chunk->next;
+    }
+    if (!chunk || (char*)ptr + need != (char*)chunk + chunk->used) return false;
+
+    chunk->used -= need;
+    arena->used -= size;
+
+    // An emptied chunk goes back to its free list; the first one holds the app
+    if (prev && chunk->used == chunk->first) {
+        prev->next = chunk->next;
+        if (arena->last == chunk) arena->last = prev;
+        arena->reserved -= chunk->size;
+        held_bytes -= chunk->size;
+        free_bytes += chunk->size;
+        size_t class_size;
+        int c = size_class(chunk->size, &class_size);
+        chunk->next = free_chunks[c];
+        free_chunks[c] = chunk;
+    }
+    return true;
+}
+
+void userspace_arena_release(user_arena_t* arena) {
+    if (!arena || !arena->chunks) return;
+
+    // The arena may live in one of its own chunks
+    user_arena_chunk_t* first = arena->chunks;
+    user_arena_chunk_t* last = arena->last;
+    size_t reserved = arena->reserved;
+    arena->chunks = arena->last = NULL;
+    arena->reserved = 0;
+
+    last->next = released;
+    released = first;
+    held_bytes -= reserved;
+    free_bytes += reserved;
+}
+
+void userspace_arena_collect(userspace_stats_t* stats) {
+    stats->arena_memory = held_bytes;
+    stats->free_arena_memory = free_bytes;
+}
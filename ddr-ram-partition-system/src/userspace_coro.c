@@ -0,0 +1,249 @@
+#include "userspace_coro.h"
+#include "userspace_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+// ThreadSanitizer has to be told about stack switches
+#if defined(__SANITIZE_THREAD__)
+#define CORO_TSAN 1
+void* __tsan_get_current_fiber(void);
+void* __tsan_create_fiber(unsigned flags);
+void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+#endif
+
+#define CORO_MIN_STACK 1024
+#define STACK_CANARY   0x5AFE57AC4B0770Full
+
+struct userspace_coro {
+#if defined(__x86_64__)
+    void* sp;                       // Saved stack pointer while suspended
+    void* caller_sp;                // Where the last resume() left off
+#else
+    ucontext_t context;
+    ucontext_t caller;
+#endif
+    userspace_coro_fn entry;
+    void* arg;
+    uint64_t* stack_bottom;         // Canary word
+    void* stack_top;
+    bool finished;
+#ifdef CORO_TSAN
+    void* tsan_fiber;
+    void* tsan_caller;
+#endif
+} __attribute__((aligned(16)));
+
+static _Thread_local userspace_coro_t* current = NULL;
+
+#if defined(__x86_64__)
+// Push the callee-saved registers, switch stacks, pop the other side's.
+// A new coroutine's stack is laid out so the first switch "returns" into
+// coro_start.
+void userspace_coro_swap(void** save_sp, void* load_sp);
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl userspace_coro_swap\n"
+    ".hidden userspace_coro_swap\n"
+    ".type userspace_coro_swap, @function\n"
+    "userspace_coro_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size userspace_coro_swap, .-userspace_coro_swap\n"
+);
+#endif
+
+// First code run on a coroutine's stack
+static void coro_start(void) {
+    userspace_coro_t* coro = current;
+    coro->entry(coro->arg);
+    coro->finished = true;
+
+#ifdef CORO_TSAN
+    __tsan_switch_to_fiber(coro->tsan_caller, 0);
+#endif
+#if defined(__x86_64__)
+    userspace_coro_swap(&coro->sp, coro->caller_sp);
+#else
+    swapcontext(&coro->context, &coro->caller);
+#endif
+    // Never resumed once finished
+    __builtin_unreachable();
+}
+
+size_t userspace_coro_overhead(void) {
+    return sizeof(userspace_coro_t) + sizeof(uint64_t);
+}
+
+userspace_coro_t* userspace_coro_init(void* memory, size_t size, userspace_coro_fn entry,
+                                      void* arg) {
+    uintptr_t start = ((uintptr_t)memory + 15) & ~(uintptr_t)15;
+    uintptr_t top = ((uintptr_t)memory + size) & ~(uintptr_t)15;
+    if (!memory || !entry || top < start + sizeof(userspace_coro_t) + CORO_MIN_STACK) {
+        return NULL;
+    }
+
+    userspace_coro_t* coro = (userspace_coro_t*)start;
+    memset(coro, 0, sizeof(*coro));
+    coro->entry = entry;
+    coro->arg = arg;
+    coro->stack_bottom = (uint64_t*)(start + sizeof(userspace_coro_t));
+    coro->stack_top = (void*)top;
+    *coro->stack_bottom = STACK_CANARY;
+#ifdef CORO_TSAN
+    coro->tsan_fiber = __tsan_create_fiber(0);
+#endif
+
+#if defined(__x86_64__)
+    // From the top: a null return address for coro_start, coro_start
+    // itself for the switch's ret, and six zeroed registers to pop. rsp is
+    // 8 past a 16-byte boundary on entry to coro_start, as after a call.
+    uint64_t* sp = (uint64_t*)top;
+    *--sp = 0;
+    *--sp = (uint64_t)(uintptr_t)coro_start;
+    for (int i = 0; i < 6; i++) {
+        *--sp = 0;
+    }
+    coro->sp = sp;
+#else
+    getcontext(&coro->context);
+    coro->context.uc_stack.ss_sp = coro->stack_bottom + 1;
+    coro->context.uc_stack.ss_size = top - (uintptr_t)(coro->stack_bottom + 1);
+    coro->context.uc_link = NULL;
+    makecontext(&coro->context, coro_start, 0);
+#endif
+    return coro;
+}
+
+bool userspace_coro_resume(userspace_coro_t* coro) {
+    if (!coro || coro->finished || current) return false;
+
+    current = coro;
+#ifdef CORO_TSAN
+    coro->tsan_caller = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(coro->tsan_fiber, 0);
+#endif
+#if defined(__x86_64__)
+    userspace_coro_swap(&coro->caller_sp, coro->sp);
+#else
+    swapcontext(&coro->caller, &coro->context);
+#endif
+    current = NULL;
+
+    return !coro->finished;
+}
+
+void userspace_coro_yield(void) {
+    userspace_coro_t* coro = current;
+    if (!coro) return;
+
+#ifdef CORO_TSAN
+    __tsan_switch_to_fiber(coro->tsan_caller, 0);
+#endif
+#if defined(__x86_64__)
+    userspace_coro_swap(&coro->sp, coro->caller_sp);
+#else
+    swapcontext(&coro->context, &coro->caller);
+#endif
+}
+
+userspace_coro_t* userspace_coro_current(void) {
+    return current;
+}
+
+bool userspace_coro_stack_ok(const userspace_coro_t* coro) {
+    return *coro->stack_bottom == STACK_CANARY;
+}
+
+// Coroutine apps. The app's run function resumes its coroutine, and what
+// the coroutine asked for when it yielded becomes the run function's
+// result.
+
+typedef struct {
+    userspace_coro_t* coro;
+    user_app_main_fn main;
+    void* context;
+    user_app_t* app;
+} app_coro_t;
+
+static void app_coro_entry(void* arg) {
+    app_coro_t* ac = arg;
+    ac->main(ac->app, ac->context);
+}
+
+static app_run_result_t app_coro_run(user_app_t* app, void* context) {
+    app_coro_t* ac = context;
+    bool alive = userspace_coro_resume(ac->coro);
+
+    if (!userspace_coro_stack_ok(ac->coro)) {
+        LOG_ERROR("App '%s' (ID: %u) overflowed its %zu-byte stack", app->name, app->app_id,
+                  app->stack_size);
+        return APP_RUN_EXIT;
+    }
+    return alive ? APP_RUN_YIELD : APP_RUN_EXIT;
+}
+
+int userspace_set_app_coroutine(user_app_t* app, user_app_main_fn main, void* context,
+                                size_t stack_size) {
+    if (!app || !main) return MEM_INVALID;
+    if (stack_size == 0) stack_size = USERSPACE_STACK_SIZE;
+
+    // Leave room to align both the header and the coroutine to 16 bytes
+    size_t size = 16 + sizeof(app_coro_t) + 16 + userspace_coro_overhead() + stack_size;
+    char* block = userspace_app_alloc(app, size);
+    if (!block) return MEM_FULL;
+
+    app_coro_t* ac = (app_coro_t*)(((uintptr_t)block + 15) & ~(uintptr_t)15);
+    ac->main = main;
+    ac->context = context;
+    ac->app = app;
+    ac->coro = userspace_coro_init(ac + 1, (size_t)(block + size - (char*)(ac + 1)),
+                                   app_coro_entry, ac);
+    if (!ac->coro) {
+        userspace_app_unalloc(app, block, size);
+        return MEM_INVALID;
+    }
+
+    app->stack_size = stack_size;
+    userspace_set_app_entry(app, app_coro_run, ac);
+    return MEM_SUCCESS;
+}
+
+int userspace_coro_app_roots(const user_app_t* app, user_root_range_t* ranges, int max) {
+    if (app->run != app_coro_run || max < 2) return 0;
+
+    const app_coro_t* ac = app->context;
+    const userspace_coro_t* coro = ac->coro;
+    ranges[0] = (user_root_range_t){ ac, ac + 1 };
+    if (coro->finished) return 1;
+#if defined(__x86_64__)
+    // Saved registers included
+    ranges[1] = (user_root_range_t){ coro->sp, coro->stack_top };
+#else
+    ranges[1] = (user_root_range_t){ coro->stack_bottom + 1, coro->stack_top };
+#endif
+    return 2;
+}
+
+void userspace_yield(void) {
+    userspace_coro_yield();
+}
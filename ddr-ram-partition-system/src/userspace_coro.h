@@ -0,0 +1,37 @@
+#ifndef USERSPACE_CORO_H
+#define USERSPACE_CORO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Stackful coroutines
+//
+// A coroutine runs `entry` on a stack in memory the caller provides.
+// userspace_coro_resume() runs it until it calls userspace_coro_yield() or
+// returns; the next resume continues after the yield. On x86-64 a switch
+// saves and restores the callee-saved registers and the stack pointer and
+// nothing else; elsewhere it falls back to ucontext, which also saves the
+// signal mask with a system call.
+//
+// A suspended coroutine may be resumed from any thread, by one thread at
+// a time. Coroutines do not nest, and code running in one must not change
+// the floating-point control state, which is not switched.
+typedef struct userspace_coro userspace_coro_t;
+typedef void (*userspace_coro_fn)(void* arg);
+
+// Bytes a coroutine needs besides its stack
+size_t userspace_coro_overhead(void);
+// Lay out a coroutine in `size` bytes at `memory`; the stack gets what is
+// left after userspace_coro_overhead(). NULL if that is under 1 KB.
+userspace_coro_t* userspace_coro_init(void* memory, size_t size, userspace_coro_fn entry,
+                                      void* arg);
+// False once the entry function has returned
+bool userspace_coro_resume(userspace_coro_t* coro);
+// Back to the resume() that ran this coroutine
+void userspace_coro_yield(void);
+// The coroutine running on this thread, or NULL
+userspace_coro_t* userspace_coro_current(void);
+// False if the coroutine ran past the bottom of its stack
+bool userspace_coro_stack_ok(const userspace_coro_t* coro);
+
+#endif // USERSPACE_CORO_H
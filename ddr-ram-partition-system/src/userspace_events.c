@@ -0,0 +1,543 @@
+#include "userspace_internal.h"
+#include "config.h"
+#include "log.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+// Event mailboxes.
+//
+// A mailbox is a bounded multi-producer/multi-consumer ring (Vyukov). Each
+// cell starts with a sequence number: the cell is free for the producer of
+// position p when it reads p and holds that producer's event when it reads
+// p + 1, after which the consumer sets it to p + capacity for the next
+// lap. Producers and consumers claim positions with a CAS on their own
+// counter, several at once for a batch, so neither side takes a lock and
+// a slow thread holds up only the cells it claimed.
+//
+// Mailbox rings are carved from the User Space partition and never freed:
+// a producer on another thread may still hold the handle of an app that
+// has stopped. Closing a mailbox bumps its generation instead, and the
+// slot is reused for the next app that opens one. Events carry the
+// generation they were posted for; receivers drop those of an earlier
+// one.
+//
+// Payloads are copied into fixed-size blocks of the partition, handed out
+// and taken back through another ring of the same kind.
+//
+// A reset (userspace_init() on the partition) does free the mailboxes.
+// Posts, receives and releases count themselves in, on a per-thread shard,
+// and the reset first turns new ones away, then waits for those under way
+// to finish. Mailboxes opened afterwards start past every generation
+// handed out before, so handles kept across the reset stay turned away,
+// and payloads of events posted before it are not taken back.
+
+#define EVENT_MAX_MAILBOXES   16384
+#define EVENT_SYSTEM_CAPACITY 1024
+#define EVENT_PAYLOAD_BLOCKS  1024
+#define EVENT_BATCH           64        // Events per claim
+#define EVENT_DISPATCH_MAX    256       // Events per userspace_handle_events()
+#define EVENT_CALLER_SHARDS   32
+#define CACHE_LINE            64
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE) char* cells;
+    size_t mask;
+    size_t cell_size;               // Sequence number, then the item
+} event_ring_t;
+
+typedef struct {
+    event_ring_t ring;
+    atomic_uint generation;         // Bumped when the mailbox closes
+    uint32_t next_free;             // Closed mailboxes, for reuse; 0 ends the list
+} mailbox_t;
+
+typedef struct {
+    uint32_t generation;
+    userspace_event_t event;
+} mail_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_uint calls;  // Under way on this shard
+} caller_shard_t;
+
+static memory_partition_t* event_partition = NULL;
+// Entries below mailbox_count are set before it is raised and stay put
+// until the next reset
+static mailbox_t* mailboxes[EVENT_MAX_MAILBOXES];
+static atomic_uint mailbox_count;
+static uint32_t free_mailboxes = 0;
+static uint32_t open_mailboxes = 0;
+static event_ring_t payload_pool;
+static atomic_uint payload_blocks;     // 0 while the pool is not set up
+static atomic_ullong rejected;
+static atomic_ullong stale;
+static uint32_t first_generation = 1;   // Of app mailboxes since the last reset
+static uint64_t reset_ns = 0;
+static caller_shard_t callers[EVENT_CALLER_SHARDS];
+static atomic_uint next_caller_shard;
+static _Thread_local unsigned caller_shard = EVENT_CALLER_SHARDS;
+static userspace_event_fn handlers[USERSPACE_EVENT_TYPES];
+static void* handler_contexts[USERSPACE_EVENT_TYPES];
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --- Rings -----------------------------------------------------------------
+
+static inline size_t cell_size(size_t item_size) {
+    return sizeof(atomic_size_t) + ((item_size + 7) & ~(size_t)7);
+}
+
+static inline atomic_size_t* ring_cell(const event_ring_t* ring, size_t pos) {
+    return (atomic_size_t*)(ring->cells + (pos & ring->mask) * ring->cell_size);
+}
+
+// `capacity` is a power of two
+static void ring_init(event_ring_t* ring, char* cells, size_t capacity, size_t item_size) {
+    ring->cells = cells;
+    ring->mask = capacity - 1;
+    ring->cell_size = cell_size(item_size);
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(ring_cell(ring, i), i);
+    }
+    atomic_init(&ring->enqueue_pos, 0);
+    atomic_init(&ring->dequeue_pos, 0);
+}
+
+// Claim up to `count` consecutive positions from `counter` whose cells
+// read `position + ready`: 0 for producers, 1 for consumers. Returns the
+// number claimed; 0 if the ring is full (or empty).
+static inline uint32_t ring_claim(event_ring_t* ring, atomic_size_t* counter, size_t ready,
+                                  uint32_t count, size_t* start) {
+    if (count == 0) return 0;
+
+    size_t pos = atomic_load_explicit(counter, memory_order_relaxed);
+    for (;;) {
+        uint32_t n = 0;
+        while (n < count &&
+               atomic_load_explicit(ring_cell(ring, pos + n), memory_order_acquire) ==
+                   pos + n + ready) {
+            n++;
+        }
+
+        if (n > 0) {
+            if (atomic_compare_exchange_weak_explicit(counter, &pos, pos + n,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *start = pos;
+                return n;
+            }
+            continue;
+        }
+
+        // A lap behind: full or empty. Ahead: someone else claimed `pos`.
+        size_t seq = atomic_load_explicit(ring_cell(ring, pos), memory_order_acquire);
+        if ((intptr_t)(seq - (pos + ready)) < 0) return 0;
+        pos = atomic_load_explicit(counter, memory_order_relaxed);
+    }
+}
+
+static uint32_t ring_push(event_ring_t* ring, const void* items, uint32_t count,
+                          size_t item_size) {
+    size_t pos;
+    uint32_t n = ring_claim(ring, &ring->enqueue_pos, 0, count, &pos);
+    for (uint32_t i = 0; i < n; i++) {
+        atomic_size_t* cell = ring_cell(ring, pos + i);
+        memcpy(cell + 1, (const char*)items + i * item_size, item_size);
+        atomic_store_explicit(cell, pos + i + 1, memory_order_release);
+    }
+    return n;
+}
+
+static uint32_t ring_pop(event_ring_t* ring, void* items, uint32_t max, size_t item_size) {
+    size_t pos;
+    uint32_t n = ring_claim(ring, &ring->dequeue_pos, 1, max, &pos);
+    for (uint32_t i = 0; i < n; i++) {
+        atomic_size_t* cell = ring_cell(ring, pos + i);
+        memcpy((char*)items + i * item_size, cell + 1, item_size);
+        atomic_store_explicit(cell, pos + i + ring->mask + 1, memory_order_release);
+    }
+    return n;
+}
+
+// Partition allocations are not aligned
+static char* carve(size_t size) {
+    char* memory = partition_alloc(event_partition, size + CACHE_LINE - 1);
+    if (!memory) return NULL;
+    return (char*)(((uintptr_t)memory + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+}
+
+// --- Callers ---------------------------------------------------------------
+
+static atomic_uint* caller_enter(void) {
+    if (caller_shard == EVENT_CALLER_SHARDS) {
+        caller_shard = atomic_fetch_add(&next_caller_shard, 1) % EVENT_CALLER_SHARDS;
+    }
+    atomic_uint* calls = &callers[caller_shard].calls;
+    atomic_fetch_add(calls, 1);
+    return calls;
+}
+
+static void caller_leave(atomic_uint* calls) {
+    atomic_fetch_sub_explicit(calls, 1, memory_order_release);
+}
+
+// Wait until no call that may have found a mailbox is under way; new ones
+// are already turned away
+static void callers_drain(void) {
+    for (int i = 0; i < EVENT_CALLER_SHARDS; i++) {
+        while (atomic_load(&callers[i].calls) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+// --- Payloads --------------------------------------------------------------
+
+static uint32_t payload_get(void** blocks, uint32_t count) {
+    if (atomic_load_explicit(&payload_blocks, memory_order_acquire) == 0) return 0;
+    return ring_pop(&payload_pool, blocks, count, sizeof(void*));
+}
+
+// The pool has a cell for every block, so a push only finds it full while
+// a pop that made room has yet to hand its cell back; wait for that
+static void payload_put(void* const* blocks, uint32_t count) {
+    while (count > 0) {
+        uint32_t n = ring_push(&payload_pool, blocks, count, sizeof(void*));
+        if (n == 0) sched_yield();
+        blocks += n;
+        count -= n;
+    }
+}
+
+// --- Mailboxes -------------------------------------------------------------
+
+// Slot of a new mailbox, or -1
+static int64_t new_mailbox(size_t capacity) {
+    uint32_t slot = atomic_load_explicit(&mailbox_count, memory_order_relaxed);
+    if (slot >= EVENT_MAX_MAILBOXES) return -1;
+
+    mailbox_t* box = aligned_alloc(CACHE_LINE, sizeof(mailbox_t));
+    if (!box) return -1;
+    char* cells = carve(capacity * cell_size(sizeof(mail_t)));
+    if (!cells) {
+        free(box);
+        return -1;
+    }
+
+    // The system mailbox keeps its well-known handle
+    ring_init(&box->ring, cells, capacity, sizeof(mail_t));
+    atomic_init(&box->generation, slot == 0 ? 1 : first_generation);
+    box->next_free = 0;
+    mailboxes[slot] = box;
+    atomic_store_explicit(&mailbox_count, slot + 1, memory_order_release);
+    return slot;
+}
+
+static mailbox_t* lookup(userspace_mailbox_t handle, uint32_t* generation) {
+    uint32_t slot = (uint32_t)handle;
+    if (slot >= atomic_load_explicit(&mailbox_count, memory_order_acquire)) return NULL;
+
+    mailbox_t* box = mailboxes[slot];
+    *generation = (uint32_t)(handle >> 32);
+    if (atomic_load_explicit(&box->generation, memory_order_acquire) != *generation) return NULL;
+    return box;
+}
+
+static void drop(const mail_t* mail, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (mail[i].event.payload) payload_put(&mail[i].event.payload, 1);
+    }
+    atomic_fetch_add_explicit(&stale, count, memory_order_relaxed);
+}
+
+static void start_app_event(const userspace_event_t* event, void* context) {
+    (void)context;
+    char name[64];
+    size_t length = event->size < sizeof(name) ? event->size : sizeof(name) - 1;
+    if (event->payload) memcpy(name, event->payload, length);
+    name[event->payload ? length : 0] = '\0';
+    userspace_start_app(name, APP_TYPE_UTILITY, (size_t)event->data);
+}
+
+static void stop_app_event(const userspace_event_t* event, void* context) {
+    (void)context;
+    userspace_stop_app((uint32_t)event->data);
+}
+
+int userspace_events_reset(memory_partition_t* partition) {
+    uint32_t count = atomic_exchange(&mailbox_count, 0);
+    atomic_store(&payload_blocks, 0);
+    callers_drain();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t generation = atomic_load_explicit(&mailboxes[i]->generation,
+                                                   memory_order_relaxed);
+        if (generation >= first_generation) first_generation = generation + 1;
+        free(mailboxes[i]);
+    }
+    reset_ns = now_ns();
+    free_mailboxes = 0;
+    open_mailboxes = 0;
+    atomic_store(&rejected, 0);
+    atomic_store(&stale, 0);
+    memset(handlers, 0, sizeof(handlers));
+    memset(handler_contexts, 0, sizeof(handler_contexts));
+    handlers[USERSPACE_EVENT_START_APP] = start_app_event;
+    handlers[USERSPACE_EVENT_STOP_APP] = stop_app_event;
+    event_partition = partition;
+
+    // Slot 0, generation 1: USERSPACE_SYSTEM_MAILBOX
+    if (new_mailbox(EVENT_SYSTEM_CAPACITY) != 0) return MEM_FULL;
+    open_mailboxes = 1;
+
+    char* cells = carve(EVENT_PAYLOAD_BLOCKS * cell_size(sizeof(void*)));
+    char* blocks = carve((size_t)EVENT_PAYLOAD_BLOCKS * USERSPACE_EVENT_PAYLOAD_MAX);
+    if (!cells || !blocks) return MEM_FULL;
+    ring_init(&payload_pool, cells, EVENT_PAYLOAD_BLOCKS, sizeof(void*));
+    atomic_store_explicit(&payload_blocks, EVENT_PAYLOAD_BLOCKS, memory_order_release);
+    for (uint32_t i = 0; i < EVENT_PAYLOAD_BLOCKS; i++) {
+        void* block = blocks + (size_t)i * USERSPACE_EVENT_PAYLOAD_MAX;
+        payload_put(&block, 1);
+    }
+    return MEM_SUCCESS;
+}
+
+userspace_mailbox_t userspace_events_open(user_app_t* app) {
+    if (app->mailbox) return app->mailbox;
+
+    int64_t slot = free_mailboxes;
+    if (slot) {
+        free_mailboxes = mailboxes[slot]->next_free;
+    } else {
+        slot = new_mailbox(USERSPACE_MAILBOX_CAPACITY);
+        if (slot < 0) return 0;
+    }
+
+    uint32_t generation = atomic_load_explicit(&mailboxes[slot]->generation,
+                                               memory_order_relaxed);
+    app->mailbox = (userspace_mailbox_t)generation << 32 | (uint32_t)slot;
+    open_mailboxes++;
+    return app->mailbox;
+}
+
+void userspace_events_close(user_app_t* app) {
+    if (!app->mailbox) return;
+
+    uint32_t slot = (uint32_t)app->mailbox;
+    mailbox_t* box = mailboxes[slot];
+    atomic_fetch_add_explicit(&box->generation, 1, memory_order_release);
+    app->mailbox = 0;
+
+    // What the app left unread
+    mail_t batch[EVENT_BATCH];
+    uint32_t n;
+    while ((n = ring_pop(&box->ring, batch, EVENT_BATCH, sizeof(mail_t))) > 0) {
+        drop(batch, n);
+    }
+
+    box->next_free = free_mailboxes;
+    free_mailboxes = slot;
+    open_mailboxes--;
+}
+
+void userspace_events_collect(userspace_stats_t* stats) {
+    uint64_t posted = 0;
+    uint64_t taken = 0;
+    uint32_t count = atomic_load_explicit(&mailbox_count, memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+        posted += atomic_load_explicit(&mailboxes[i]->ring.enqueue_pos, memory_order_relaxed);
+        taken += atomic_load_explicit(&mailboxes[i]->ring.dequeue_pos, memory_order_relaxed);
+    }
+
+    uint64_t dropped = atomic_load_explicit(&stale, memory_order_relaxed);
+    stats->events.posted = posted;
+    stats->events.received = taken - dropped;
+    stats->events.rejected = atomic_load_explicit(&rejected, memory_order_relaxed);
+    stats->events.stale = dropped;
+    stats->events.mailboxes = open_mailboxes;
+    stats->events.free_payloads = atomic_load(&payload_blocks) == 0 ? 0 : (uint32_t)(
+        atomic_load_explicit(&payload_pool.enqueue_pos, memory_order_relaxed) -
+        atomic_load_explicit(&payload_pool.dequeue_pos, memory_order_relaxed));
+}
+
+// --- Public API ------------------------------------------------------------
+
+// Posts events up to the first that cannot go, with `*result` saying why
+static uint32_t post(mailbox_t* box, uint32_t generation, const userspace_event_t* events,
+                     uint32_t count, int* result) {
+    uint64_t now = now_ns();
+    uint32_t posted = 0;
+    *result = MEM_SUCCESS;
+
+    while (posted < count) {
+        mail_t batch[EVENT_BATCH];
+        void* blocks[EVENT_BATCH];
+        uint32_t n = count - posted < EVENT_BATCH ? count - posted : EVENT_BATCH;
+        uint32_t wanted = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            const userspace_event_t* event = &events[posted + i];
+            if (event->type >= USERSPACE_EVENT_TYPES ||
+                (event->payload && event->size > USERSPACE_EVENT_PAYLOAD_MAX)) {
+                *result = MEM_INVALID;
+                n = i;
+                break;
+            }
+            if (event->payload) wanted++;
+        }
+
+        uint32_t got = payload_get(blocks, wanted);
+        uint32_t used = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            const userspace_event_t* event = &events[posted + i];
+            mail_t* mail = &batch[i];
+            mail->generation = generation;
+            mail->event = *event;
+            mail->event.posted_ns = now;
+            if (!event->payload) {
+                mail->event.size = 0;
+                continue;
+            }
+            if (used == got) {
+                *result = MEM_FULL;
+                n = i;
+                break;
+            }
+            mail->event.payload = blocks[used++];
+            memcpy(mail->event.payload, event->payload, event->size);
+        }
+
+        uint32_t pushed = ring_push(&box->ring, batch, n, sizeof(mail_t));
+        if (pushed < n) *result = MEM_FULL;
+
+        // Payload blocks of events that did not go, and any left over
+        uint32_t unused = 0;
+        for (uint32_t i = pushed; i < n; i++) {
+            if (batch[i].event.payload) unused++;
+        }
+        payload_put(blocks + used - unused, got - used + unused);
+
+        posted += pushed;
+        if (*result != MEM_SUCCESS) break;
+    }
+
+    if (*result == MEM_FULL) atomic_fetch_add_explicit(&rejected, 1, memory_order_relaxed);
+    return posted;
+}
+
+int userspace_post_event(userspace_mailbox_t mailbox, uint32_t type, uint64_t data,
+                         const void* payload, size_t size) {
+    atomic_uint* calls = caller_enter();
+    uint32_t generation;
+    mailbox_t* box = lookup(mailbox, &generation);
+    if (!box) {
+        caller_leave(calls);
+        return MEM_INVALID;
+    }
+
+    userspace_event_t event = {
+        .type = type,
+        .size = (uint32_t)size,
+        .data = data,
+        .payload = (void*)payload,
+    };
+    int result;
+    post(box, generation, &event, 1, &result);
+    caller_leave(calls);
+    return result;
+}
+
+uint32_t userspace_post_events(userspace_mailbox_t mailbox, const userspace_event_t* events,
+                               uint32_t count) {
+    atomic_uint* calls = caller_enter();
+    uint32_t generation;
+    mailbox_t* box = lookup(mailbox, &generation);
+    uint32_t posted = 0;
+    if (box && events) {
+        int result;
+        posted = post(box, generation, events, count, &result);
+    }
+    caller_leave(calls);
+    return posted;
+}
+
+uint32_t userspace_receive_events(userspace_mailbox_t mailbox, userspace_event_t* events,
+                                  uint32_t max) {
+    atomic_uint* calls = caller_enter();
+    uint32_t generation;
+    mailbox_t* box = lookup(mailbox, &generation);
+    if (!box || !events) {
+        caller_leave(calls);
+        return 0;
+    }
+
+    uint32_t received = 0;
+    while (received < max) {
+        mail_t batch[EVENT_BATCH];
+        uint32_t want = max - received < EVENT_BATCH ? max - received : EVENT_BATCH;
+        uint32_t n = ring_pop(&box->ring, batch, want, sizeof(mail_t));
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].generation == generation) {
+                events[received++] = batch[i].event;
+            } else {
+                drop(&batch[i], 1);
+            }
+        }
+        if (n < want) break;
+    }
+    caller_leave(calls);
+    return received;
+}
+
+void userspace_release_events(const userspace_event_t* events, uint32_t count) {
+    if (!events) return;
+
+    atomic_uint* calls = caller_enter();
+    // Blocks from before a reset went with the partition
+    bool current = atomic_load(&payload_blocks) != 0;
+    void* blocks[EVENT_BATCH];
+    uint32_t n = 0;
+    for (uint32_t i = 0; current && i < count; i++) {
+        if (!events[i].payload || events[i].posted_ns <= reset_ns) continue;
+        blocks[n++] = events[i].payload;
+        if (n == EVENT_BATCH) {
+            payload_put(blocks, n);
+            n = 0;
+        }
+    }
+    payload_put(blocks, n);
+    caller_leave(calls);
+}
+
+void userspace_set_event_handler(uint32_t type, userspace_event_fn handler, void* context) {
+    if (type >= USERSPACE_EVENT_TYPES) return;
+    handlers[type] = handler;
+    handler_contexts[type] = context;
+}
+
+void userspace_handle_events(void) {
+    userspace_event_t events[EVENT_BATCH];
+    uint32_t handled = 0;
+
+    while (handled < EVENT_DISPATCH_MAX) {
+        uint32_t n = userspace_receive_events(USERSPACE_SYSTEM_MAILBOX, events, EVENT_BATCH);
+        for (uint32_t i = 0; i < n; i++) {
+            userspace_event_fn handler = handlers[events[i].type];
+            if (handler) handler(&events[i], handler_contexts[events[i].type]);
+        }
+        userspace_release_events(events, n);
+        handled += n;
+        if (n < EVENT_BATCH) break;
+    }
+
+    if (handled > 0) {
+        LOG_DEBUG("User space: Handled %u events", handled);
+    }
+}
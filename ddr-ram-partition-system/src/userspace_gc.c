@@ -0,0 +1,462 @@
+#include "userspace_internal.h"
+#include "config.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Garbage collector for memory apps get from userspace_alloc().
+//
+// Each such allocation is an object in the app's arena with a 16-byte
+// header, recorded in a per-app hash set. Collection is conservative mark
+// and sweep, one app at a time: any aligned word in the app's roots (its
+// memory region, its context pointer, a coroutine app's suspended stack
+// and roots added with userspace_gc_add_root()) that holds the address of
+// one of the app's objects keeps that object alive, and so do the objects
+// reachable from it the same way. Pointers must point at the start of an
+// object, and only an app's own roots keep its objects alive.
+//
+// The app is parked, off its run queue, while it is collected, so it
+// cannot move pointers around behind the marker; other apps keep running.
+// Apps store pointers with plain C writes, so there is no barrier that
+// would let the marker run alongside them. The work is done in steps of
+// bounded time: each call to userspace_garbage_collect() scans, marks and
+// sweeps until its budget is spent and resumes there next time. Objects
+// allocated for the app meanwhile are born marked. Step pauses bound the
+// collecting thread only; the app waits out every step of its collection
+// and the time in between, which the stats report as its stall.
+//
+// Unreachable objects go onto the app's free lists for its next
+// allocations of that size. Objects are not moved: compaction would need
+// every pointer to go through a handle, which plain C pointers in app
+// memory do not.
+//
+// Callers hold the app lock.
+
+#define GC_HEADER          16
+#define GC_SMALL_MAX       4096          // Larger objects share one free list
+#define GC_SMALL_CLASSES   (GC_SMALL_MAX / 16 + 1)
+#define GC_MIN_TABLE       64
+#define GC_DEFAULT_STEP_NS 100000ull
+#define GC_CHECK_WORDS     1024          // Scanning work between clock reads
+#define GC_CHECK_SLOTS     256
+#define TOMBSTONE          ((gc_object_t*)1)
+
+typedef struct gc_object {
+    uint32_t size;                  // Payload bytes, a multiple of 16
+    uint32_t epoch;                 // Marked in this collection if the heap's
+    struct gc_object* next;         // Free list link
+} gc_object_t;
+
+struct user_gc_heap {
+    gc_object_t** table;            // Open addressing, linear probing
+    size_t capacity;
+    size_t count;
+    size_t tombstones;
+    uint32_t epoch;
+    gc_object_t* free_small[GC_SMALL_CLASSES];
+    gc_object_t* free_large;
+    user_root_range_t* roots;
+    uint32_t root_count;
+    uint32_t root_capacity;
+    user_gc_heap_t* next;           // All heaps, so a reset can free them
+    user_gc_heap_t* prev;
+};
+
+typedef enum {
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP
+} gc_phase_t;
+
+// An incremental collection in progress
+static struct {
+    gc_phase_t phase;
+    user_app_t* app;
+    uint32_t app_id;
+    uint32_t slot;
+    user_gc_heap_t* heap;
+    uint32_t next_slot;             // Where the pass over the app table is
+    user_root_range_t* gray;        // Memory still to scan
+    size_t gray_count;
+    size_t gray_capacity;
+    size_t sweep_index;
+    bool overflow;                  // Gray memory did not fit; skip the sweep
+    uint64_t parked_ns;             // When the app came off its run queue
+    uint64_t step_ns;
+} gc = { .step_ns = GC_DEFAULT_STEP_NS };
+
+static userspace_gc_stats_t gc_stats;
+static user_gc_heap_t* heaps = NULL;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void* payload(gc_object_t* obj) {
+    return (char*)obj + GC_HEADER;
+}
+
+static inline size_t slot_of(const user_gc_heap_t* heap, const void* obj) {
+    uint64_t h = ((uintptr_t)obj >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (heap->capacity - 1);
+}
+
+static gc_object_t* table_find(const user_gc_heap_t* heap, uintptr_t word) {
+    if (!heap->table || word < GC_HEADER || (word & 15)) return NULL;
+
+    gc_object_t* obj = (gc_object_t*)(word - GC_HEADER);
+    for (size_t i = slot_of(heap, obj); heap->table[i]; i = (i + 1) & (heap->capacity - 1)) {
+        if (heap->table[i] == obj) return obj;
+    }
+    return NULL;
+}
+
+static void table_put(user_gc_heap_t* heap, gc_object_t* obj) {
+    size_t i = slot_of(heap, obj);
+    while (heap->table[i] && heap->table[i] != TOMBSTONE) {
+        i = (i + 1) & (heap->capacity - 1);
+    }
+    if (heap->table[i] == TOMBSTONE) heap->tombstones--;
+    heap->table[i] = obj;
+    heap->count++;
+}
+
+// Room for one more object, growing or clearing out tombstones as needed.
+// A sweep in progress starts over: slots move.
+static int table_reserve(user_gc_heap_t* heap) {
+    if (heap->table && (heap->count + heap->tombstones + 1) * 4 <= heap->capacity * 3) {
+        return MEM_SUCCESS;
+    }
+
+    size_t capacity = heap->capacity ? heap->capacity : GC_MIN_TABLE;
+    while ((heap->count + 1) * 2 > capacity) capacity *= 2;
+    gc_object_t** table = calloc(capacity, sizeof(gc_object_t*));
+    if (!table) return MEM_ERROR;
+
+    gc_object_t** old = heap->table;
+    size_t old_capacity = heap->capacity;
+    heap->table = table;
+    heap->capacity = capacity;
+    heap->count = 0;
+    heap->tombstones = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i] && old[i] != TOMBSTONE) table_put(heap, old[i]);
+    }
+    free(old);
+
+    if (gc.heap == heap) gc.sweep_index = 0;
+    return MEM_SUCCESS;
+}
+
+static user_gc_heap_t* heap_of(user_app_t* app) {
+    if (app->gc) return app->gc;
+
+    user_gc_heap_t* heap = calloc(1, sizeof(user_gc_heap_t));
+    if (!heap) return NULL;
+    heap->next = heaps;
+    if (heaps) heaps->prev = heap;
+    heaps = heap;
+    app->gc = heap;
+    return heap;
+}
+
+static void free_heap(user_gc_heap_t* heap) {
+    free(heap->table);
+    free(heap->roots);
+    free(heap);
+}
+
+static void push_free(user_gc_heap_t* heap, gc_object_t* obj) {
+    gc_object_t** list = obj->size <= GC_SMALL_MAX ? &heap->free_small[obj->size / 16] :
+                                                     &heap->free_large;
+    obj->next = *list;
+    *list = obj;
+}
+
+// Give a freed object back to its app: off the books, onto a free list
+static void free_object(user_app_t* app, gc_object_t* obj) {
+    push_free(app->gc, obj);
+    app->arena.used -= GC_HEADER + obj->size;
+    gc_stats.live_objects--;
+}
+
+static gc_object_t* reuse(user_gc_heap_t* heap, size_t size) {
+    gc_object_t** link = size <= GC_SMALL_MAX ? &heap->free_small[size / 16] : &heap->free_large;
+    for (; *link; link = &(*link)->next) {
+        // Large objects: the first that fits, if not wastefully large
+        if ((*link)->size >= size && (*link)->size - size <= size / 4) {
+            gc_object_t* obj = *link;
+            *link = obj->next;
+            return obj;
+        }
+    }
+    return NULL;
+}
+
+void* userspace_gc_alloc(user_app_t* app, size_t size) {
+    if (!app || size == 0 || size > UINT32_MAX - GC_HEADER) return NULL;
+
+    user_gc_heap_t* heap = heap_of(app);
+    if (!heap || table_reserve(heap) != MEM_SUCCESS) return NULL;
+
+    size_t rounded = (size + 15) & ~(size_t)15;
+    user_arena_t* arena = &app->arena;
+    gc_object_t* obj = reuse(heap, rounded);
+    if (obj) {
+        if (arena->quota && arena->used + GC_HEADER + obj->size > arena->quota) {
+            push_free(heap, obj);
+            return NULL;
+        }
+        arena->used += GC_HEADER + obj->size;
+        if (arena->used > arena->peak) arena->peak = arena->used;
+        memset(payload(obj), 0, obj->size);
+    } else {
+        obj = userspace_arena_alloc(arena, GC_HEADER + rounded);
+        if (!obj) return NULL;
+        obj->size = (uint32_t)rounded;
+    }
+
+    // Born marked, should a collection of the app be under way
+    obj->epoch = heap->epoch;
+    obj->next = NULL;
+    table_put(heap, obj);
+    gc_stats.live_objects++;
+    return payload(obj);
+}
+
+size_t userspace_gc_free(user_app_t* app, void* ptr) {
+    if (!app || !app->gc || !ptr) return 0;
+
+    user_gc_heap_t* heap = app->gc;
+    gc_object_t* obj = table_find(heap, (uintptr_t)ptr);
+    if (!obj) return 0;
+
+    for (size_t i = slot_of(heap, obj);; i = (i + 1) & (heap->capacity - 1)) {
+        if (heap->table[i] == obj) {
+            heap->table[i] = TOMBSTONE;
+            break;
+        }
+    }
+    heap->count--;
+    heap->tombstones++;
+    free_object(app, obj);
+    return GC_HEADER + obj->size;
+}
+
+int userspace_gc_root(user_app_t* app, const void* start, size_t size) {
+    if (!app || !start || size == 0) return MEM_INVALID;
+
+    user_gc_heap_t* heap = heap_of(app);
+    if (!heap) return MEM_ERROR;
+    if (heap->root_count == heap->root_capacity) {
+        uint32_t capacity = heap->root_capacity ? heap->root_capacity * 2 : 4;
+        user_root_range_t* roots = realloc(heap->roots, capacity * sizeof(user_root_range_t));
+        if (!roots) return MEM_ERROR;
+        heap->roots = roots;
+        heap->root_capacity = capacity;
+    }
+    heap->roots[heap->root_count++] = (user_root_range_t){ start, (const char*)start + size };
+    return MEM_SUCCESS;
+}
+
+void userspace_gc_release(user_app_t* app) {
+    user_gc_heap_t* heap = app->gc;
+    if (!heap) return;
+
+    // The arena going away takes the objects with it
+    gc_stats.live_objects -= heap->count;
+    if (gc.heap == heap) {
+        gc.phase = GC_IDLE;
+        gc.heap = NULL;
+        gc.app = NULL;
+    }
+    if (heap->prev) {
+        heap->prev->next = heap->next;
+    } else {
+        heaps = heap->next;
+    }
+    if (heap->next) heap->next->prev = heap->prev;
+    free_heap(heap);
+    app->gc = NULL;
+}
+
+// The apps themselves may be gone with their partition
+void userspace_gc_reset(void) {
+    while (heaps) {
+        user_gc_heap_t* next = heaps->next;
+        free_heap(heaps);
+        heaps = next;
+    }
+    gc.phase = GC_IDLE;
+    gc.app = NULL;
+    gc.heap = NULL;
+    gc.next_slot = 0;
+    gc.gray_count = 0;
+    memset(&gc_stats, 0, sizeof(gc_stats));
+}
+
+void userspace_gc_budget(uint64_t ns) {
+    gc.step_ns = ns ? ns : GC_DEFAULT_STEP_NS;
+}
+
+static void push_gray(const void* start, const void* end) {
+    if (end <= start) return;
+    if (gc.gray_count == gc.gray_capacity) {
+        size_t capacity = gc.gray_capacity ? gc.gray_capacity * 2 : 256;
+        user_root_range_t* gray = realloc(gc.gray, capacity * sizeof(user_root_range_t));
+        if (!gray) {
+            gc.overflow = true;
+            return;
+        }
+        gc.gray = gray;
+        gc.gray_capacity = capacity;
+    }
+    gc.gray[gc.gray_count++] = (user_root_range_t){ start, end };
+}
+
+static void begin(user_app_t* app, uint32_t slot) {
+    user_gc_heap_t* heap = app->gc;
+    heap->epoch++;
+    gc.phase = GC_MARK;
+    gc.app = app;
+    gc.app_id = app->app_id;
+    gc.slot = slot;
+    gc.heap = heap;
+    gc.gray_count = 0;
+    gc.sweep_index = 0;
+    gc.overflow = false;
+    gc.parked_ns = now_ns();
+
+    if (app->memory_region) {
+        push_gray(app->memory_region, (char*)app->memory_region + app->memory_size);
+    }
+    push_gray(&app->context, &app->context + 1);
+    user_root_range_t coro[2];
+    int ranges = userspace_coro_app_roots(app, coro, 2);
+    for (int i = 0; i < ranges; i++) {
+        push_gray(coro[i].start, coro[i].end);
+    }
+    for (uint32_t i = 0; i < heap->root_count; i++) {
+        push_gray(heap->roots[i].start, heap->roots[i].end);
+    }
+}
+
+// Scan gray memory until none is left (true) or the deadline passes
+static bool mark_some(uint64_t deadline) {
+    user_gc_heap_t* heap = gc.heap;
+    while (gc.gray_count > 0) {
+        user_root_range_t* range = &gc.gray[gc.gray_count - 1];
+        uintptr_t at = ((uintptr_t)range->start + 7) & ~(uintptr_t)7;
+        uintptr_t end = (uintptr_t)range->end;
+        uintptr_t stop = end - at > GC_CHECK_WORDS * 8 ? at + GC_CHECK_WORDS * 8 : end;
+        range->start = (const void*)stop;
+        if (stop >= end) gc.gray_count--;
+
+        for (; at + 8 <= stop; at += 8) {
+            gc_object_t* obj = table_find(heap, *(const uintptr_t*)at);
+            if (obj && obj->epoch != heap->epoch) {
+                obj->epoch = heap->epoch;
+                push_gray(payload(obj), (char*)payload(obj) + obj->size);
+            }
+        }
+        if (now_ns() >= deadline) return gc.gray_count == 0;
+    }
+    return true;
+}
+
+// Free unmarked objects until the table is done (true) or the deadline
+// passes
+static bool sweep_some(uint64_t deadline, size_t* freed) {
+    user_gc_heap_t* heap = gc.heap;
+    while (gc.sweep_index < heap->capacity) {
+        size_t stop = gc.sweep_index + GC_CHECK_SLOTS;
+        if (stop > heap->capacity) stop = heap->capacity;
+        for (; gc.sweep_index < stop; gc.sweep_index++) {
+            gc_object_t* obj = heap->table[gc.sweep_index];
+            if (!obj || obj == TOMBSTONE || obj->epoch == heap->epoch) continue;
+
+            heap->table[gc.sweep_index] = TOMBSTONE;
+            heap->count--;
+            heap->tombstones++;
+            *freed += GC_HEADER + obj->size;
+            gc_stats.objects_freed++;
+            gc_stats.bytes_freed += GC_HEADER + obj->size;
+            free_object(gc.app, obj);
+        }
+        if (now_ns() >= deadline) return gc.sweep_index >= heap->capacity;
+    }
+    return true;
+}
+
+static void record_time(uint64_t ns, uint64_t* max, uint64_t* histogram) {
+    if (ns > *max) *max = ns;
+
+    uint32_t bucket = 0;
+    for (uint64_t us = ns / 1000; us > 0 && bucket < USERSPACE_GC_PAUSE_BUCKETS - 1; us >>= 1) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+size_t userspace_gc_step(user_app_t** apps, uint32_t app_slots) {
+    uint64_t start = now_ns();
+    uint64_t deadline = start + gc.step_ns;
+    size_t freed = 0;
+
+    for (;;) {
+        if (gc.phase == GC_IDLE) {
+            // The next app with objects that can be taken off its queue;
+            // one in a turn on a worker waits for the next pass
+            user_app_t* next = NULL;
+            while (!next && gc.next_slot < app_slots) {
+                user_app_t* app = apps[gc.next_slot++];
+                if (app && app->gc && app->gc->count > 0 && userspace_sched_park(app)) {
+                    next = app;
+                }
+            }
+            if (!next) {
+                gc.next_slot = 0;
+                gc_stats.cycles++;
+                break;
+            }
+            begin(next, gc.next_slot - 1);
+        }
+
+        // Stopped since the last step, and its objects released with it
+        user_app_t* app = gc.app;
+        if (!app || gc.slot >= app_slots || apps[gc.slot] != app || app->app_id != gc.app_id) {
+            gc.phase = GC_IDLE;
+            continue;
+        }
+
+        if (gc.phase == GC_MARK) {
+            if (!mark_some(deadline)) break;
+            // Out of host memory for the gray list, some live objects may
+            // be unmarked: free nothing this time
+            gc.phase = GC_SWEEP;
+            if (gc.overflow) gc.sweep_index = gc.heap->capacity;
+        }
+        if (gc.phase == GC_SWEEP) {
+            if (!sweep_some(deadline, &freed)) break;
+            gc.phase = GC_IDLE;
+            gc.app = NULL;
+            gc.heap = NULL;
+            gc_stats.collections++;
+            record_time(now_ns() - gc.parked_ns, &gc_stats.max_stall_ns,
+                        gc_stats.stall_histogram);
+            userspace_sched_add(app);
+        }
+        if (now_ns() >= deadline) break;
+    }
+
+    gc_stats.steps++;
+    record_time(now_ns() - start, &gc_stats.max_pause_ns, gc_stats.pause_histogram);
+    return freed;
+}
+
+void userspace_gc_collect(userspace_stats_t* stats) {
+    stats->gc = gc_stats;
+}
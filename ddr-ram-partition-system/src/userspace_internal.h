@@ -0,0 +1,75 @@
+#ifndef USERSPACE_INTERNAL_H
+#define USERSPACE_INTERNAL_H
+
+// Shared between the user space modules; not part of the public API
+
+#include "userspace_app.h"
+
+// Scheduler (userspace_sched.c)
+void userspace_sched_reset(void);
+// Queue a started app, or take a stopped one off its queue; removal
+// clears is_running under the queue lock, so a worker that just ran the
+// app does not put it back. Removal returns false if the app is in a
+// turn, whose worker then releases it.
+void userspace_sched_add(user_app_t* app);
+bool userspace_sched_remove(user_app_t* app);
+// Take a queued app off its queue until userspace_sched_add(); false if it
+// is in a turn
+bool userspace_sched_park(user_app_t* app);
+uint32_t userspace_sched_weight(uint32_t priority);
+// Called on an app's weight change
+void userspace_sched_reweight(user_app_t* app, uint32_t weight);
+// Fill in the scheduling counters and per-queue statistics
+void userspace_sched_collect(userspace_stats_t* stats);
+
+// Arenas (userspace_arena.c); callers hold the app lock
+void userspace_arena_reset(memory_partition_t* partition);
+// Give an empty arena a first chunk of at least `size` bytes
+int userspace_arena_reserve(user_arena_t* arena, size_t size);
+void* userspace_arena_alloc(user_arena_t* arena, size_t size);
+// Take back the arena's latest allocation in its chunk; false for
+// anything else, which stays until the arena is released
+bool userspace_arena_unalloc(user_arena_t* arena, void* ptr, size_t size);
+void userspace_arena_release(user_arena_t* arena);
+void userspace_arena_collect(userspace_stats_t* stats);
+
+// Garbage collector (userspace_gc.c); callers hold the app lock
+typedef struct {
+    const void* start;
+    const void* end;
+} user_root_range_t;
+
+void userspace_gc_reset(void);
+void userspace_gc_budget(uint64_t ns);
+int userspace_gc_root(user_app_t* app, const void* start, size_t size);
+void* userspace_gc_alloc(user_app_t* app, size_t size);
+// Bytes freed; 0 if `ptr` is not one of the app's objects
+size_t userspace_gc_free(user_app_t* app, void* ptr);
+// Drop the app's collector state; its objects go with its arena
+void userspace_gc_release(user_app_t* app);
+// Returns the bytes freed
+size_t userspace_gc_step(user_app_t** apps, uint32_t app_slots);
+void userspace_gc_collect(userspace_stats_t* stats);
+
+// Events (userspace_events.c). Reset, open and close are called with the
+// app lock held.
+int userspace_events_reset(memory_partition_t* partition);
+userspace_mailbox_t userspace_events_open(user_app_t* app);
+void userspace_events_close(user_app_t* app);
+void userspace_events_collect(userspace_stats_t* stats);
+
+// Memory of a suspended coroutine app that may hold pointers: its stack
+// in use and its coroutine state (userspace_coro.c). Returns the number
+// of ranges filled in.
+int userspace_coro_app_roots(const user_app_t* app, user_root_range_t* ranges, int max);
+
+// Stop an app that returned APP_RUN_EXIT and release it (userspace_app.c)
+void userspace_app_exit(user_app_t* app);
+// Undo a userspace_app_alloc() that nothing was allocated after
+void userspace_app_unalloc(user_app_t* app, void* ptr, size_t size);
+// Release an app stopped during its turn, once the turn is over
+void userspace_app_release(user_app_t* app);
+// Run function of apps started without one
+app_run_result_t userspace_app_idle_run(user_app_t* app, void* context);
+
+#endif // USERSPACE_INTERNAL_H
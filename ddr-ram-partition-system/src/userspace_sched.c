@@ -0,0 +1,634 @@
+#define _GNU_SOURCE
+#include "userspace_internal.h"
+#include "config.h"
+#include "log.h"
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Fair scheduler for user apps.
+//
+// Every app accumulates virtual run time: the time it ran, scaled by
+// 1024 / weight, so heavier apps age more slowly. The app with the least
+// virtual run time runs next. Runnable apps are kept in a pairing heap on
+// vruntime: queueing is O(1), taking the minimum O(log n) amortized, and
+// apps can be removed from anywhere in the heap when stopped.
+//
+// Apps joining a queue start at the queue's minimum vruntime, so a new
+// app neither starves the others nor waits behind everything they ran.
+// Apps moving between queues keep their lead or lag on that minimum.
+//
+// Without SMP workers there is one queue, run by userspace_run_scheduler().
+// In SMP mode each worker owns a queue. An app's queue fields, its
+// affinity and is_running are protected by the lock of the queue in its
+// `cpu` field; an app being run is on no queue but keeps `cpu`, so only
+// that worker can put it back.
+
+#define SCHED_LATENCY_NS   6000000ull   // Every app runs once per period...
+#define SCHED_MIN_SLICE_NS 750000ull    // ...unless that makes slices shorter
+#define NICE_0_WEIGHT      1024
+#define STEAL_SEARCH       8            // Apps looked at for one the thief may run
+#define IDLE_WAIT_NS       1000000ull
+
+// Weights for USERSPACE_PRIORITY_MIN..MAX, 1.25x apart, 1024 at the default
+static const uint32_t priority_weights[USERSPACE_PRIORITY_MAX + 1] = {
+    335, 419, 524, 655, 819, 1024, 1280, 1600, 2000, 2500
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            // An app was queued
+    user_app_t* root;
+    uint64_t min_vruntime;          // Never decreases
+    uint64_t total_weight;
+    atomic_uint count;              // Read without the lock to pick victims
+    user_app_t* current;            // Last app run, for switch counting
+    uint32_t index;
+
+    uint64_t ticks;
+    uint64_t switches;
+    uint64_t slices;
+    uint64_t busy_ns;
+    uint64_t idle_ns;
+    uint64_t steals;
+    uint64_t migrations;
+} run_queue_t;
+
+static run_queue_t queues[USERSPACE_MAX_CPUS];
+static uint32_t nr_queues = 1;
+static atomic_uint next_queue = 0;      // Round-robin placement of new apps
+
+static userspace_smp_config_t smp_config;
+static pthread_t workers[USERSPACE_MAX_CPUS];
+static bool smp_running = false;
+static atomic_bool smp_stop_requested = false;
+static _Thread_local user_app_t* running_app = NULL;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline bool allowed_on(const user_app_t* app, uint32_t cpu) {
+    return app->affinity == 0 || (app->affinity & (1ull << cpu));
+}
+
+// Make the root with the larger vruntime the first child of the other
+static user_app_t* heap_meld(user_app_t* a, user_app_t* b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (b->vruntime < a->vruntime) {
+        user_app_t* t = a;
+        a = b;
+        b = t;
+    }
+    b->prev = a;
+    b->next = a->child;
+    if (a->child) a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+// Two-pass pairing: meld siblings in pairs left to right, then fold the
+// pairs right to left
+static user_app_t* heap_merge_pairs(user_app_t* first) {
+    user_app_t* pairs = NULL;
+    while (first) {
+        user_app_t* a = first;
+        user_app_t* b = a->next;
+        first = b ? b->next : NULL;
+        a->next = a->prev = NULL;
+        if (b) b->next = b->prev = NULL;
+
+        user_app_t* merged = heap_meld(a, b);
+        merged->next = pairs;
+        pairs = merged;
+    }
+
+    user_app_t* root = NULL;
+    while (pairs) {
+        user_app_t* next = pairs->next;
+        pairs->next = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
+    if (root) root->prev = NULL;
+    return root;
+}
+
+static void queue_push(run_queue_t* q, user_app_t* app) {
+    if (app->vruntime < q->min_vruntime) app->vruntime = q->min_vruntime;
+    app->child = app->next = app->prev = NULL;
+    q->root = heap_meld(q->root, app);
+    q->root->prev = NULL;
+    q->total_weight += app->weight;
+    app->queued = true;
+    if (atomic_fetch_add_explicit(&q->count, 1, memory_order_relaxed) == 0) {
+        pthread_cond_signal(&q->wake);
+    }
+}
+
+static user_app_t* queue_pop(run_queue_t* q) {
+    user_app_t* app = q->root;
+    if (!app) return NULL;
+
+    q->root = heap_merge_pairs(app->child);
+    app->child = NULL;
+    q->total_weight -= app->weight;
+    atomic_fetch_sub_explicit(&q->count, 1, memory_order_relaxed);
+    app->queued = false;
+    return app;
+}
+
+static void queue_erase(run_queue_t* q, user_app_t* app) {
+    if (app == q->root) {
+        queue_pop(q);
+        return;
+    }
+
+    // A first child's prev is its parent, anyone else's its left sibling
+    if (app->prev->child == app) {
+        app->prev->child = app->next;
+    } else {
+        app->prev->next = app->next;
+    }
+    if (app->next) app->next->prev = app->prev;
+    app->next = app->prev = NULL;
+
+    user_app_t* subtree = heap_merge_pairs(app->child);
+    app->child = NULL;
+    q->root = heap_meld(q->root, subtree);
+    q->root->prev = NULL;
+    q->total_weight -= app->weight;
+    atomic_fetch_sub_explicit(&q->count, 1, memory_order_relaxed);
+    app->queued = false;
+}
+
+static void update_min_vruntime(run_queue_t* q) {
+    if (q->root && q->root->vruntime > q->min_vruntime) {
+        q->min_vruntime = q->root->vruntime;
+    }
+}
+
+// Lock the queue `app` is on; it can move until the lock is held
+static run_queue_t* lock_app_queue(user_app_t* app) {
+    for (;;) {
+        run_queue_t* q = &queues[atomic_load(&app->cpu)];
+        pthread_mutex_lock(&q->lock);
+        if ((uint32_t)atomic_load(&app->cpu) == q->index) return q;
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+static void lock_pair(run_queue_t* a, run_queue_t* b) {
+    if (a->index > b->index) {
+        run_queue_t* t = a;
+        a = b;
+        b = t;
+    }
+    pthread_mutex_lock(&a->lock);
+    pthread_mutex_lock(&b->lock);
+}
+
+static void unlock_pair(run_queue_t* a, run_queue_t* b) {
+    pthread_mutex_unlock(&a->lock);
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Both locks held. The app keeps its distance from the queue minimum.
+static void move_app(run_queue_t* src, run_queue_t* dst, user_app_t* app) {
+    queue_erase(src, app);
+    uint64_t lag = app->vruntime > src->min_vruntime ? app->vruntime - src->min_vruntime : 0;
+    app->vruntime = dst->min_vruntime + lag;
+    atomic_store(&app->cpu, (int)dst->index);
+    queue_push(dst, app);
+}
+
+static void migrate(run_queue_t* src, run_queue_t* dst, user_app_t* app) {
+    move_app(src, dst, app);
+    app->migrations++;
+    dst->migrations++;
+}
+
+// An app on `src` that may run on `dst`: the next one to run if possible,
+// else one of its children
+static user_app_t* find_movable(run_queue_t* src, run_queue_t* dst) {
+    user_app_t* app = src->root;
+    if (!app || allowed_on(app, dst->index)) return app;
+
+    app = app->child;
+    for (int i = 0; app && i < STEAL_SEARCH; i++, app = app->next) {
+        if (allowed_on(app, dst->index)) return app;
+    }
+    return NULL;
+}
+
+uint32_t userspace_sched_weight(uint32_t priority) {
+    if (priority > USERSPACE_PRIORITY_MAX) priority = USERSPACE_PRIORITY_MAX;
+    return priority_weights[priority];
+}
+
+void userspace_sched_reset(void) {
+    static bool initialized = false;
+    if (smp_running) userspace_smp_stop();
+
+    for (uint32_t i = 0; i < USERSPACE_MAX_CPUS; i++) {
+        run_queue_t* q = &queues[i];
+        if (!initialized) {
+            pthread_mutex_init(&q->lock, NULL);
+            pthread_cond_init(&q->wake, NULL);
+        }
+        q->root = NULL;
+        q->min_vruntime = 0;
+        q->total_weight = 0;
+        atomic_store(&q->count, 0);
+        q->current = NULL;
+        q->index = i;
+        q->ticks = q->switches = q->slices = 0;
+        q->busy_ns = q->idle_ns = q->steals = q->migrations = 0;
+    }
+    initialized = true;
+    nr_queues = 1;
+}
+
+// The next allowed queue after the last one used
+static run_queue_t* place(const user_app_t* app) {
+    uint32_t start = atomic_fetch_add_explicit(&next_queue, 1, memory_order_relaxed);
+    for (uint32_t i = 0; i < nr_queues; i++) {
+        uint32_t cpu = (start + i) % nr_queues;
+        if (allowed_on(app, cpu)) return &queues[cpu];
+    }
+    // Affinity to queues not in use: the first one will do
+    return &queues[0];
+}
+
+void userspace_sched_add(user_app_t* app) {
+    if (!app) return;
+
+    run_queue_t* q = place(app);
+    atomic_store(&app->cpu, (int)q->index);
+    pthread_mutex_lock(&q->lock);
+    if (!app->queued && app->is_running) queue_push(q, app);
+    pthread_mutex_unlock(&q->lock);
+}
+
+bool userspace_sched_remove(user_app_t* app) {
+    if (!app) return false;
+
+    run_queue_t* q = lock_app_queue(app);
+    app->is_running = false;
+    if (app->queued) queue_erase(q, app);
+    if (q->current == app) q->current = NULL;
+    bool idle = !app->on_cpu;
+    pthread_mutex_unlock(&q->lock);
+    return idle;
+}
+
+bool userspace_sched_park(user_app_t* app) {
+    run_queue_t* q = lock_app_queue(app);
+    bool parked = app->queued && !app->on_cpu;
+    if (parked) queue_erase(q, app);
+    pthread_mutex_unlock(&q->lock);
+    return parked;
+}
+
+void userspace_sched_reweight(user_app_t* app, uint32_t weight) {
+    run_queue_t* q = lock_app_queue(app);
+    // vruntime is the heap key, so only the queue's total changes
+    if (app->queued) q->total_weight = q->total_weight - app->weight + weight;
+    app->weight = weight;
+    pthread_mutex_unlock(&q->lock);
+}
+
+void userspace_set_app_affinity(user_app_t* app, uint64_t cpus) {
+    if (!app) return;
+
+    run_queue_t* q = lock_app_queue(app);
+    app->affinity = cpus;
+    bool move = app->queued && !allowed_on(app, q->index);
+    pthread_mutex_unlock(&q->lock);
+    if (!move) return;
+
+    // Queued on a core it may no longer use; a running app moves when its
+    // slice ends
+    run_queue_t* dst = place(app);
+    if (dst == q) return;
+    lock_pair(q, dst);
+    if ((uint32_t)atomic_load(&app->cpu) == q->index && app->queued) migrate(q, dst, app);
+    unlock_pair(q, dst);
+}
+
+void userspace_set_app_entry(user_app_t* app, user_app_run_fn run, void* context) {
+    if (!app) return;
+
+    // Read by the worker running the app when it takes it off the queue
+    run_queue_t* q = lock_app_queue(app);
+    app->run = run ? run : userspace_app_idle_run;
+    app->context = context;
+    pthread_mutex_unlock(&q->lock);
+}
+
+// The app's share of the scheduling period, counting itself
+static uint64_t slice_ns(const run_queue_t* q, const user_app_t* app) {
+    uint64_t total = q->total_weight + app->weight;
+    uint64_t slice = SCHED_LATENCY_NS * app->weight / total;
+    return slice < SCHED_MIN_SLICE_NS ? SCHED_MIN_SLICE_NS : slice;
+}
+
+// Put an app back after its turn, on another queue if its affinity
+// changed meanwhile. False if it was stopped, leaving it to the caller to
+// release.
+static bool requeue(run_queue_t* q, user_app_t* app) {
+    if (!app->is_running) return false;
+    if (allowed_on(app, q->index)) {
+        app->on_cpu = false;
+        queue_push(q, app);
+        return true;
+    }
+
+    run_queue_t* dst = place(app);
+    atomic_store(&app->cpu, (int)dst->index);
+    pthread_mutex_unlock(&q->lock);
+
+    // Still in its turn until on the new queue, so a stop meanwhile does
+    // not release it under us
+    pthread_mutex_lock(&dst->lock);
+    bool running = app->is_running;
+    if (running) {
+        app->on_cpu = false;
+        app->migrations++;
+        dst->migrations++;
+        queue_push(dst, app);
+    }
+    pthread_mutex_unlock(&dst->lock);
+    pthread_mutex_lock(&q->lock);
+    return running;
+}
+
+// One turn of the next app on `q`. False if the queue was empty.
+static bool run_next(run_queue_t* q) {
+    pthread_mutex_lock(&q->lock);
+    q->ticks++;
+    user_app_t* app = queue_pop(q);
+    if (!app) {
+        pthread_mutex_unlock(&q->lock);
+        return false;
+    }
+    if (app != q->current) {
+        q->switches++;
+        q->current = app;
+    }
+    uint64_t slice = slice_ns(q, app);
+    user_app_run_fn run = app->run;
+    void* context = app->context;
+    app->on_cpu = true;
+    pthread_mutex_unlock(&q->lock);
+
+    uint64_t start = now_ns(), elapsed;
+    app_run_result_t result;
+    running_app = app;
+    do {
+        result = run(app, context);
+        elapsed = now_ns() - start;
+    } while (result == APP_RUN_CONTINUE && elapsed < slice);
+    running_app = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    app->runtime_ns += elapsed;
+    app->vruntime += elapsed * NICE_0_WEIGHT / app->weight;
+    app->slices++;
+    q->slices++;
+    q->busy_ns += elapsed;
+
+    // The app may have been stopped meanwhile, even by itself; then its
+    // arena was left for us to release
+    bool exited = result == APP_RUN_EXIT;
+    bool stopped = !exited && !requeue(q, app);
+    update_min_vruntime(q);
+    pthread_mutex_unlock(&q->lock);
+
+    if (exited) {
+        userspace_app_exit(app);
+    } else if (stopped) {
+        userspace_app_release(app);
+    }
+    return true;
+}
+
+user_app_t* userspace_current_app(void) {
+    return running_app;
+}
+
+void userspace_run_scheduler(void) {
+    if (smp_running) return;
+    run_next(&queues[0]);
+}
+
+// Pull one app from the longest other queue
+static bool steal(run_queue_t* q) {
+    run_queue_t* victim = NULL;
+    uint32_t longest = 0;
+    for (uint32_t i = 0; i < nr_queues; i++) {
+        uint32_t count = atomic_load_explicit(&queues[i].count, memory_order_relaxed);
+        if (i != q->index && count > longest) {
+            victim = &queues[i];
+            longest = count;
+        }
+    }
+    if (!victim) return false;
+
+    lock_pair(q, victim);
+    user_app_t* app = find_movable(victim, q);
+    if (app) {
+        migrate(victim, q, app);
+        q->steals++;
+    }
+    unlock_pair(q, victim);
+    return app != NULL;
+}
+
+// Move apps from the longest queues to the shortest until no two differ
+// by more than one, or nothing left can move
+static void balance(void) {
+    for (uint32_t pass = 0; pass < nr_queues; pass++) {
+        run_queue_t* busiest = &queues[0];
+        run_queue_t* idlest = &queues[0];
+        for (uint32_t i = 1; i < nr_queues; i++) {
+            uint32_t count = atomic_load_explicit(&queues[i].count, memory_order_relaxed);
+            if (count > atomic_load_explicit(&busiest->count, memory_order_relaxed)) {
+                busiest = &queues[i];
+            }
+            if (count < atomic_load_explicit(&idlest->count, memory_order_relaxed)) {
+                idlest = &queues[i];
+            }
+        }
+        if (busiest == idlest) return;
+
+        uint32_t moved = 0;
+        lock_pair(busiest, idlest);
+        while (atomic_load(&busiest->count) > atomic_load(&idlest->count) + 1) {
+            user_app_t* app = find_movable(busiest, idlest);
+            if (!app) break;
+            migrate(busiest, idlest, app);
+            moved++;
+        }
+        unlock_pair(busiest, idlest);
+        if (moved == 0) return;
+    }
+}
+
+static void* smp_worker(void* arg) {
+    run_queue_t* q = arg;
+    if (smp_config.pin) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(q->index % (cpus > 0 ? (uint32_t)cpus : 1), &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOG_WARN("Could not pin user space worker %u", q->index);
+        }
+    }
+
+    uint64_t interval = (uint64_t)smp_config.balance_interval_ms * 1000000ull;
+    uint64_t next_balance = now_ns() + interval;
+
+    while (!atomic_load(&smp_stop_requested)) {
+        if (!run_next(q) && !steal(q)) {
+            uint64_t start = now_ns();
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += IDLE_WAIT_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            pthread_mutex_lock(&q->lock);
+            if (atomic_load(&q->count) == 0 && !atomic_load(&smp_stop_requested)) {
+                pthread_cond_timedwait(&q->wake, &q->lock, &deadline);
+            }
+            q->idle_ns += now_ns() - start;
+            pthread_mutex_unlock(&q->lock);
+        }
+
+        if (q->index == 0 && now_ns() >= next_balance) {
+            balance();
+            next_balance = now_ns() + interval;
+        }
+    }
+    return NULL;
+}
+
+int userspace_smp_start(const userspace_smp_config_t* config) {
+    if (smp_running) return MEM_ERROR;
+
+    smp_config = config ? *config : (userspace_smp_config_t){0};
+    if (smp_config.workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        smp_config.workers = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    if (smp_config.workers > USERSPACE_MAX_CPUS) smp_config.workers = USERSPACE_MAX_CPUS;
+    if (smp_config.balance_interval_ms == 0) smp_config.balance_interval_ms = 10;
+
+    // Spread the apps queued so far over the new queues
+    run_queue_t* main_queue = &queues[0];
+    nr_queues = smp_config.workers;
+    for (uint32_t i = 1; i < nr_queues; i++) {
+        queues[i].min_vruntime = main_queue->min_vruntime;
+    }
+    user_app_t* pending = NULL;
+    while (main_queue->root) {
+        user_app_t* app = queue_pop(main_queue);
+        app->next = pending;
+        pending = app;
+    }
+    while (pending) {
+        user_app_t* app = pending;
+        pending = app->next;
+        run_queue_t* q = place(app);
+        atomic_store(&app->cpu, (int)q->index);
+        queue_push(q, app);
+    }
+
+    atomic_store(&smp_stop_requested, false);
+    for (uint32_t i = 0; i < nr_queues; i++) {
+        if (pthread_create(&workers[i], NULL, smp_worker, &queues[i]) != 0) {
+            LOG_ERROR("Failed to start user space worker %u", i);
+            atomic_store(&smp_stop_requested, true);
+            for (uint32_t j = 0; j < i; j++) {
+                pthread_mutex_lock(&queues[j].lock);
+                pthread_cond_broadcast(&queues[j].wake);
+                pthread_mutex_unlock(&queues[j].lock);
+                pthread_join(workers[j], NULL);
+            }
+            for (uint32_t j = 1; j < nr_queues; j++) {
+                while (queues[j].root) {
+                    move_app(&queues[j], &queues[0], queues[j].root);
+                }
+            }
+            nr_queues = 1;
+            return MEM_ERROR;
+        }
+    }
+    smp_running = true;
+
+    LOG_INFO("User space SMP started (%u workers%s)", nr_queues,
+             smp_config.pin ? ", pinned" : "");
+    return MEM_SUCCESS;
+}
+
+void userspace_smp_stop(void) {
+    if (!smp_running) return;
+
+    atomic_store(&smp_stop_requested, true);
+    for (uint32_t i = 0; i < nr_queues; i++) {
+        pthread_mutex_lock(&queues[i].lock);
+        pthread_cond_broadcast(&queues[i].wake);
+        pthread_mutex_unlock(&queues[i].lock);
+    }
+    for (uint32_t i = 0; i < nr_queues; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Everything back on the calling thread's queue
+    for (uint32_t i = 1; i < nr_queues; i++) {
+        while (queues[i].root) {
+            move_app(&queues[i], &queues[0], queues[i].root);
+        }
+    }
+    nr_queues = 1;
+    smp_running = false;
+
+    LOG_INFO("User space SMP stopped");
+}
+
+void userspace_sched_collect(userspace_stats_t* stats) {
+    stats->app_switches = 0;
+    stats->scheduler_ticks = 0;
+    stats->runnable_apps = 0;
+    stats->migrations = 0;
+    stats->cpus = nr_queues;
+
+    for (uint32_t i = 0; i < USERSPACE_MAX_CPUS; i++) {
+        run_queue_t* q = &queues[i];
+        userspace_cpu_stats_t* cpu = &stats->cpu[i];
+        pthread_mutex_lock(&q->lock);
+        cpu->slices = q->slices;
+        cpu->busy_ns = q->busy_ns;
+        cpu->idle_ns = q->idle_ns;
+        cpu->steals = q->steals;
+        cpu->migrations = q->migrations;
+        cpu->runnable_apps = atomic_load(&q->count);
+        stats->app_switches += q->switches;
+        stats->scheduler_ticks += q->ticks;
+        stats->migrations += q->migrations;
+        pthread_mutex_unlock(&q->lock);
+
+        uint64_t total = cpu->busy_ns + cpu->idle_ns;
+        cpu->utilization = total ? (double)cpu->busy_ns / (double)total : 0.0;
+        stats->runnable_apps += cpu->runnable_apps;
+    }
+}